@@ -366,7 +366,8 @@ module or10_top
    reg                 is_stop_reason_trap;
    reg                 stop_at_next_instruction_1;  // This is the "single step" setting in DMR1.
    reg                 stop_at_next_instruction_2;  // Delayed so that the CPU has time to execute one instruction.
-   reg [`OR10_PC_ADDR] dbg_write_mem_addr;  // Memory address for the next Debug Interface memory write operation.
+   reg [`OR10_PC_ADDR] dbg_write_mem_addr;  // Memory address for the next Debug Interface memory write operation, incremented after each write.
+   reg [WISHBONE_SEL_WIDTH-1:0] dbg_write_mem_sel;  // Wishbone 'sel' for the next Debug Interface memory write operation only, see OR1200_DU_WRITE_MEM_SEL.
 
    reg [`OR10_PC_ADDR] cpureg_pc;         // Current program counter. Note that this register does not have the last 2 bits.
 
@@ -2585,6 +2586,12 @@ module or10_top
                   should_raise_alignment_exception = 1;
              end
 
+           `OR1200_DU_WRITE_MEM_SEL:
+             begin
+                // Note that any other bits are ignored. We could raise an error if they are not 0.
+                dbg_write_mem_sel <= val[WISHBONE_SEL_WIDTH-1:0];
+             end
+
            `OR1200_DU_DRR:
              begin
                 // Note that any other bits are ignored. We could raise an error if they are not 0.
@@ -2919,6 +2926,8 @@ module or10_top
            // We don't actually need to read from this register, so we could save this logic.
            `OR1200_DU_WRITE_MEM_ADDR: val = pc_addr_to_32( dbg_write_mem_addr );
 
+           `OR1200_DU_WRITE_MEM_SEL: val = { {(DW-WISHBONE_SEL_WIDTH){1'b0}}, dbg_write_mem_sel };
+
            `OR1200_DU_DSR:
              begin
                 if ( ENABLE_DEBUG_UNIT )
@@ -3948,6 +3957,8 @@ module or10_top
          stop_at_next_instruction_1 <= 0;
          stop_at_next_instruction_2 <= 0;
 
+         dbg_write_mem_sel <= {WISHBONE_SEL_WIDTH{1'b1}};
+
          dbg_is_stalled_o <= 0;
 
          for ( watchpoint_index = 0; watchpoint_index < WATCHPOINT_COUNT; watchpoint_index = watchpoint_index + 1 )
@@ -4078,16 +4089,24 @@ module or10_top
                         dbg_spr_number_i[`OR10_SPR_REG_NUMBER] == `OR1200_DU_WRITE_MEM_DATA )
                 begin
                    if ( TRACE_DEBUG_INTERFACE )
-                    $display( "%sDebug Interface Wishbone write to memory address 0x%08h, data 0x%08h.",
+                    $display( "%sDebug Interface Wishbone write to memory address 0x%08h, data 0x%08h, sel 0x%01h.",
                               TRACE_ASM_INDENT,
                               pc_addr_to_32( dbg_write_mem_addr ),
-                              dbg_data_i );
+                              dbg_data_i,
+                              dbg_write_mem_sel );
 
                    start_wishbone_data_write_cycle( pc_addr_to_32( dbg_write_mem_addr ),
                                                     dbg_data_i,
-                                                    {WISHBONE_SEL_WIDTH{1'b1}},
+                                                    dbg_write_mem_sel,
                                                     1,
                                                     can_interrupt_ignored );
+
+                   // The byte mask only applies to a single write, the next one writes the whole word again.
+                   dbg_write_mem_sel <= {WISHBONE_SEL_WIDTH{1'b1}};
+
+                   // Advance to the next word, so that the Debug Interface client does not need
+                   // to write OR1200_DU_WRITE_MEM_ADDR again when writing a block of consecutive words.
+                   dbg_write_mem_addr <= dbg_write_mem_addr + 1'b1;
                 end
               else
                 begin
@@ -4663,6 +4682,7 @@ module or10_top
         wb_stb_o = 0;
         gpr_write_enable_1 = 0;  // May not be actually necessary.
         dbg_ack_o = 0;
+        dbg_write_mem_sel = {WISHBONE_SEL_WIDTH{1'b1}};
         div_din_tvalid = 0;    // Prevent that the external divider starts dividing immediately.
         muldiv_operand_a = 0;  // Initialised to zero to prevent assert in FakeExternalComponents/or10_external_multiplier.v when not multiplying.
         muldiv_operand_b = 0;
@@ -64,8 +64,13 @@
                                             // on the Debug Interface.
 `define OR1200_DU_WRITE_MEM_ADDR   11'd202  // Memory address for Debug Interface memory write access.
 `define OR1200_DU_WRITE_MEM_DATA   11'd203  // Memory data for Debug Interface memory write access. Writing to the SPR
-                                            // triggers the actual memory write.
+                                            // triggers the actual memory write, and then OR1200_DU_WRITE_MEM_ADDR
+                                            // advances to the next 32-bit word.
 `define OR1200_DU_WATCHPOINT_COUNT 11'd204
+`define OR1200_DU_WRITE_MEM_SEL    11'd205  // Wishbone 'sel' byte mask for the next OR1200_DU_WRITE_MEM_DATA write only,
+                                            // afterwards it reverts to all bytes. Bit 3 selects the byte at the lowest
+                                            // address (big endian), so that single bytes can be written without
+                                            // a read-modify-write cycle.
 
 
 // SPR Group: Programmable Interrupt Controller (PIC)
@@ -41,6 +41,10 @@ static const char * bsdl_dirs[MAX_BSDL_DIRS];
 static int bsdl_current_dir = 0;  // We try them in reverse order
 static int bsdl_dir_count = 0;
 
+// The directory being searched. It stays open between searches, so that the next search
+// carries on with the files after the one that matched last time.
+static DIR *bsdl_open_dir = NULL;
+
 // Globals to hold BSDL info
 static bsdlinfo *bsdl_head = NULL;
 static bsdlinfo *bsdl_tail = NULL;
@@ -112,6 +116,12 @@ void bsdl_terminate ( void )
 
   // ----- Dirnames -----
 
+  if ( bsdl_open_dir != NULL )
+  {
+    closedir_a( bsdl_open_dir );
+    bsdl_open_dir = NULL;
+  }
+
   for ( int i = 0; i < bsdl_dir_count; ++i )
   {
     free( const_cast< char * >( bsdl_dirs[i] ) );
@@ -234,8 +244,6 @@ bsdlinfo * get_bsdl_info ( const uint32_t idcode )
   }
 
   // Parse files until we get the IDCODE we want
-  DIR *bsdl_open_dir = NULL;
-
   for ( ; ; )
   {
     // Find and open a valid directory
@@ -322,7 +330,6 @@ bsdlinfo * get_bsdl_info ( const uint32_t idcode )
 	  if((ptr->idcode & ptr->idcode_mask) == (idcode & ptr->idcode_mask))
       {
 	    bsdl_last = ptr;
-        closedir_a(bsdl_open_dir);
 	    return ptr;
 	  }
 	}
@@ -25,9 +25,16 @@
 #include <assert.h>
 
 #include <stdexcept>
+#include <vector>
+#include <list>
 
 #include "cable_drivers/cable_simulation_over_tcp_socket.h"
 #include "cable_drivers/cable_simulation_with_predefined_file.h"
+#include "cable_drivers/cable_model.h"
+
+#ifdef __SUPPORT_VERILATOR_CABLE__
+  #include "cable_drivers/cable_verilator.h"
+#endif
 
 #ifdef __SUPPORT_PARALLEL_CABLES__
   #include "cable_drivers/cable_parallel.h"
@@ -66,6 +73,11 @@ void cable_setup ( void )
 
   jtag_cables[i++] = cable_rtl_get_driver();
   jtag_cables[i++] = cable_vpi_get_driver();
+  jtag_cables[i++] = cable_model_get_driver();
+
+#ifdef __SUPPORT_VERILATOR_CABLE__
+  jtag_cables[i++] = cable_verilator_get_driver();
+#endif
 
 #ifdef __SUPPORT_PARALLEL_CABLES__
   jtag_cables[i++] = cable_xpc3_get_driver();
@@ -175,16 +187,273 @@ void cable_print_help()
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////
+// Command queue
+//
+// In queued mode, write operations and TMS moves are not executed straight away, but accumulated
+// in a queue. Operations that need the data read back either flush the queue immediately, or,
+// for the cable_queue_xxx() variants, deliver the data when the queue is flushed later on.
+//
+// The queue does not store the individual calls, but merges them into as few stream transfers
+// as possible: a TMS bit can only go at the end of a stream, so each TMS bit closes the current
+// stream, but everything until that point travels in a single driver call. On USB cables,
+// that turns many tiny transfers into a few larger ones.
+
+struct queued_capture
+{
+  unsigned   first_bit;  // Position in the stream.
+  unsigned   len_bits;
+  uint32_t * instream;   // Either instream or bit_in is set.
+  uint8_t  * bit_in;
+};
+
+struct queued_stream
+{
+  std::vector< uint32_t > out_data;
+  unsigned len_bits;
+  bool     set_last_bit;     // Whether the stream is closed by a TMS bit.
+  bool     is_trst_pulse;    // A single TRST bit, which cannot be expressed as a stream.
+  bool     is_tms_sequence;  // Up to 32 TMS bits for the driver's native TMS routine.
+  std::vector< queued_capture > captures;
+
+  queued_stream ( void )
+    : len_bits( 0 )
+    , set_last_bit( false )
+    , is_trst_pulse( false )
+    , is_tms_sequence( false )
+  {
+  }
+};
+
+static bool s_is_queue_enabled = false;
+static bool s_is_executing_queue = false;
+static std::list< queued_stream > s_queue;
+static unsigned s_queued_bit_count = 0;
+
+// Flush automatically after so many bits, in order to limit memory usage.
+static const unsigned MAX_QUEUED_BIT_COUNT = 256 * 1024;
+
+
+static bool is_queue_active ( void )
+{
+  // The common driver routines implement streams with cable_write_bit() and so on,
+  // and those calls must go straight to the driver while the queue is being executed.
+  return s_is_queue_enabled && !s_is_executing_queue;
+}
+
+
+static queued_stream * get_open_stream ( void )
+{
+  if ( s_queue.empty() || s_queue.back().set_last_bit || s_queue.back().is_trst_pulse || s_queue.back().is_tms_sequence )
+    s_queue.push_back( queued_stream() );
+
+  return &s_queue.back();
+}
+
+
+static void append_bit ( queued_stream * const qs, const unsigned bit_value )
+{
+  if ( qs->len_bits % 32 == 0 )
+    qs->out_data.push_back( 0 );
+
+  qs->out_data.back() |= uint32_t( bit_value & 1 ) << ( qs->len_bits % 32 );
+  ++qs->len_bits;
+  ++s_queued_bit_count;
+}
+
+
+static int flush_if_queue_too_long ( void )
+{
+  if ( s_queued_bit_count >= MAX_QUEUED_BIT_COUNT )
+    return cable_flush();
+
+  return APP_ERR_NONE;
+}
+
+
+static int queue_bit ( const uint8_t packet, uint8_t * const bit_in )
+{
+  if ( packet & TRST )
+  {
+    assert( bit_in == NULL );
+
+    queued_stream qs;
+    qs.is_trst_pulse = true;
+    qs.out_data.push_back( packet );
+    s_queue.push_back( qs );
+    return APP_ERR_NONE;
+  }
+
+  queued_stream * const qs = get_open_stream();
+
+  if ( bit_in != NULL )
+  {
+    queued_capture c;
+    c.first_bit = qs->len_bits;
+    c.len_bits  = 1;
+    c.instream  = NULL;
+    c.bit_in    = bit_in;
+    qs->captures.push_back( c );
+  }
+
+  append_bit( qs, ( packet & TDO ) ? 1 : 0 );
+
+  if ( packet & TMS )
+    qs->set_last_bit = true;
+
+  return flush_if_queue_too_long();
+}
+
+
+static int queue_stream ( const uint32_t * const outstream,
+                          uint32_t * const instream,
+                          const int len_bits,
+                          const int set_last_bit )
+{
+  assert( len_bits > 0 );
+
+  queued_stream * const qs = get_open_stream();
+
+  if ( instream != NULL )
+  {
+    queued_capture c;
+    c.first_bit = qs->len_bits;
+    c.len_bits  = unsigned( len_bits );
+    c.instream  = instream;
+    c.bit_in    = NULL;
+    qs->captures.push_back( c );
+  }
+
+  for ( int i = 0; i < len_bits; ++i )
+    append_bit( qs, outstream[ i / 32 ] >> ( i % 32 ) );
+
+  if ( set_last_bit )
+    qs->set_last_bit = true;
+
+  return flush_if_queue_too_long();
+}
+
+
+// Drivers with a native TMS routine get whole state-machine walks in one call.
+// For all others, it is better to merge the TMS bits into the surrounding stream transfers.
+
+static bool has_native_tms_sequence ( void )
+{
+  return jtag_cable_in_use->tms_sequence_func != NULL &&
+         jtag_cable_in_use->tms_sequence_func != cable_common_write_tms_sequence;
+}
+
+
+static int queue_tms_sequence ( const uint32_t tms_bits, const int bit_count )
+{
+  if ( !has_native_tms_sequence() )
+  {
+    int err = APP_ERR_NONE;
+
+    for ( int i = 0; i < bit_count; i++ )
+      err |= queue_bit( ( ( tms_bits >> i ) & 1 ) ? TMS : 0, NULL );
+
+    return err;
+  }
+
+  if ( s_queue.empty() || !s_queue.back().is_tms_sequence || s_queue.back().len_bits + bit_count > 32 )
+  {
+    queued_stream qs;
+    qs.is_tms_sequence = true;
+    qs.out_data.push_back( 0 );
+    s_queue.push_back( qs );
+  }
+
+  queued_stream * const qs = &s_queue.back();
+
+  qs->out_data[0] |= tms_bits << qs->len_bits;
+  qs->len_bits += bit_count;
+  s_queued_bit_count += bit_count;
+
+  return flush_if_queue_too_long();
+}
+
+
+static int execute_queued_stream ( const queued_stream * const qs )
+{
+  if ( qs->is_trst_pulse )
+    return jtag_cable_in_use->bit_out_func( uint8_t( qs->out_data[0] ) );
+
+  if ( qs->is_tms_sequence )
+    return jtag_cable_in_use->tms_sequence_func( qs->out_data[0], int( qs->len_bits ) );
+
+  assert( qs->len_bits > 0 );
+
+  if ( qs->captures.empty() )
+    return jtag_cable_in_use->stream_out_func( &qs->out_data.front(), int( qs->len_bits ), qs->set_last_bit ? 1 : 0 );
+
+  // The common read routine may write one extra word past the end.
+  std::vector< uint32_t > in_data( qs->out_data.size() + 1, 0 );
+
+  const int err = jtag_cable_in_use->stream_inout_func( &qs->out_data.front(), &in_data.front(), int( qs->len_bits ), qs->set_last_bit ? 1 : 0 );
+
+  for ( std::vector< queued_capture >::const_iterator c = qs->captures.begin(); c != qs->captures.end(); ++c )
+  {
+    if ( c->bit_in != NULL )
+    {
+      *c->bit_in = uint8_t( ( in_data[ c->first_bit / 32 ] >> ( c->first_bit % 32 ) ) & 1 );
+      continue;
+    }
+
+    for ( unsigned i = 0; i < ( c->len_bits + 31 ) / 32; ++i )
+      c->instream[ i ] = 0;
+
+    for ( unsigned i = 0; i < c->len_bits; ++i )
+    {
+      const unsigned src = c->first_bit + i;
+      c->instream[ i / 32 ] |= ( ( in_data[ src / 32 ] >> ( src % 32 ) ) & 1 ) << ( i % 32 );
+    }
+  }
+
+  return err;
+}
+
+
+int cable_enable_queue ( const bool enable )
+{
+  int err = APP_ERR_NONE;
+
+  if ( !enable )
+    err = cable_flush();
+
+  s_is_queue_enabled = enable;
+
+  return err;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////
 // Cable API Functions
 
 int cable_write_stream ( const uint32_t * stream, int len_bits, int set_last_bit )
 {
+  if ( is_queue_active() )
+    return queue_stream( stream, NULL, len_bits, set_last_bit );
+
   return jtag_cable_in_use->stream_out_func( stream, len_bits, set_last_bit );
 }
 
 int cable_read_write_stream ( const uint32_t * outstream, uint32_t * instream, int len_bits, int set_last_bit )
 {
+  if ( is_queue_active() )
+  {
+    const int err = queue_stream( outstream, instream, len_bits, set_last_bit );
+    return err | cable_flush();
+  }
+
+  return jtag_cable_in_use->stream_inout_func( outstream, instream, len_bits, set_last_bit );
+}
+
+int cable_queue_read_write_stream ( const uint32_t * outstream, uint32_t * instream, int len_bits, int set_last_bit )
+{
+  if ( is_queue_active() )
+    return queue_stream( outstream, instream, len_bits, set_last_bit );
+
   return jtag_cable_in_use->stream_inout_func( outstream, instream, len_bits, set_last_bit );
 }
 
@@ -194,6 +463,9 @@ int cable_read_write_stream ( const uint32_t * outstream, uint32_t * instream, i
 int cable_write_bit ( uint8_t packet  // See the TDO, TMS and TRST constants.
                     )
 {
+  if ( is_queue_active() )
+    return queue_bit( packet, NULL );
+
   return jtag_cable_in_use->bit_out_func( packet );
 }
 
@@ -201,12 +473,66 @@ int cable_write_bit ( uint8_t packet  // See the TDO, TMS and TRST constants.
 int cable_read_write_bit ( uint8_t packet_out,  // See the TDO, TMS and TRST constants.
                            uint8_t * bit_in )
 {
+  if ( is_queue_active() )
+  {
+    const int err = queue_bit( packet_out, bit_in );
+    return err | cable_flush();
+  }
+
   return jtag_cable_in_use->bit_inout_func( packet_out, bit_in );
 }
 
-int cable_flush(void)
+int cable_queue_read_write_bit ( uint8_t packet_out, uint8_t * bit_in )
 {
-  if(jtag_cable_in_use->flush_func != NULL)
-    return jtag_cable_in_use->flush_func();
-  return APP_ERR_NONE;
+  if ( is_queue_active() )
+    return queue_bit( packet_out, bit_in );
+
+  return jtag_cable_in_use->bit_inout_func( packet_out, bit_in );
+}
+
+// Walks the TAP state machine. The TMS values are taken from LSB to MSB of tms_bits,
+// and TDI is held low. At most 32 bits can be sent at once.
+int cable_write_tms_sequence ( const uint32_t tms_bits, const int bit_count )
+{
+  assert( bit_count > 0 && bit_count <= 32 );
+  assert( bit_count == 32 || ( tms_bits >> bit_count ) == 0 );
+
+  if ( is_queue_active() )
+    return queue_tms_sequence( tms_bits, bit_count );
+
+  return jtag_cable_in_use->tms_sequence_func( tms_bits, bit_count );
+}
+
+// Executes all queued operations, and then flushes any data buffered in the driver.
+int cable_flush ( void )
+{
+  int err = APP_ERR_NONE;
+
+  if ( !s_queue.empty() )
+  {
+    assert( !s_is_executing_queue );
+    s_is_executing_queue = true;
+
+    try
+    {
+      for ( std::list< queued_stream >::const_iterator it = s_queue.begin(); it != s_queue.end(); ++it )
+        err |= execute_queued_stream( &*it );
+    }
+    catch ( ... )
+    {
+      s_is_executing_queue = false;
+      s_queue.clear();
+      s_queued_bit_count = 0;
+      throw;
+    }
+
+    s_is_executing_queue = false;
+    s_queue.clear();
+    s_queued_bit_count = 0;
+  }
+
+  if ( jtag_cable_in_use->flush_func != NULL )
+    err |= jtag_cable_in_use->flush_func();
+
+  return err;
 }
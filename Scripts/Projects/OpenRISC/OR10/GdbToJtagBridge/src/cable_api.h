@@ -22,6 +22,15 @@ int cable_write_bit ( uint8_t packet );
 int cable_read_write_bit ( uint8_t packet_out, uint8_t * bit_in );
 int cable_write_stream ( const uint32_t * stream, int len_bits, int set_last_bit );
 int cable_read_write_stream ( const uint32_t * outstream, uint32_t * instream, int len_bits, int set_last_bit );
+int cable_write_tms_sequence ( uint32_t tms_bits, int bit_count );
 int cable_flush ( void );
 
+// In queued mode, write operations are accumulated and only sent to the cable on the next flush.
+// The normal read routines flush the queue and return the data straight away.
+// The cable_queue_xxx() routines do not flush, so the data read is only available
+// after the next cable_flush() call. When not in queued mode, they behave like the normal routines.
+int cable_enable_queue ( bool enable );
+int cable_queue_read_write_bit ( uint8_t packet_out, uint8_t * bit_in );
+int cable_queue_read_write_stream ( const uint32_t * outstream, uint32_t * instream, int len_bits, int set_last_bit );
+
 #endif  // Include this header file only once.
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <assert.h>
+#include <string.h>
 
 
 #include "../errcodes.h"
@@ -15,6 +16,100 @@
 jtag_cable_t * jtag_cable_in_use = NULL; // The currently selected cable.
 
 
+// Drivers with an out_block_func get the pin states for a whole stream in a few calls,
+// instead of two out_func calls per bit. This is the maximum number of pin states per call.
+static const int MAX_PIN_STATES_PER_BLOCK = 2048;
+
+// For each value of 4 consecutive stream bits, the 8 pin states that clock them out (LSB first)
+// with TMS low and TRST inactive.
+static uint8_t s_pin_state_table[16][8];
+static bool s_is_pin_state_table_initialised = false;
+
+
+static uint8_t packet_to_pin_state ( const uint8_t packet )
+{
+  uint8_t data = TRST_BIT;  // TRST is active low, don't clear unless /set/ in 'packet'
+
+  if(packet & TDO) data |= TDI_BIT;
+  if(packet & TMS) data |= TMS_BIT;
+  if(packet & TRST) data &= ~TRST_BIT;
+
+  return data;
+}
+
+
+static void init_pin_state_table ( void )
+{
+  for ( int nibble = 0; nibble < 16; ++nibble )
+  {
+    for ( int i = 0; i < 4; ++i )
+    {
+      const uint8_t data = packet_to_pin_state( ( nibble >> i ) & 1 );
+
+      s_pin_state_table[ nibble ][ i * 2     ] = data;
+      s_pin_state_table[ nibble ][ i * 2 + 1 ] = data | TCLK_BIT;
+    }
+  }
+
+  s_is_pin_state_table_initialised = true;
+}
+
+
+// Accumulates pin states and hands them to the driver's out_block_func when the block is full.
+
+class pin_state_block
+{
+  uint8_t m_states[ MAX_PIN_STATES_PER_BLOCK ];
+  int m_count;
+  int m_err;
+
+public:
+  pin_state_block ( void )
+    : m_count( 0 )
+    , m_err( APP_ERR_NONE )
+  {
+    if ( !s_is_pin_state_table_initialised )
+      init_pin_state_table();
+  }
+
+  void add_bit ( const uint8_t packet )
+  {
+    make_room( 2 );
+
+    const uint8_t data = packet_to_pin_state( packet );
+
+    m_states[ m_count++ ] = data;
+    m_states[ m_count++ ] = data | TCLK_BIT;
+  }
+
+  // Adds 4 bits with TMS low, LSB first.
+  void add_nibble ( const unsigned nibble )
+  {
+    make_room( 8 );
+    memcpy( &m_states[ m_count ], s_pin_state_table[ nibble & 0x0F ], 8 );
+    m_count += 8;
+  }
+
+  int flush ( void )
+  {
+    if ( m_count > 0 )
+    {
+      m_err |= jtag_cable_in_use->out_block_func( m_states, m_count );
+      m_count = 0;
+    }
+
+    return m_err;
+  }
+
+private:
+  void make_room ( const int state_count )
+  {
+    if ( m_count + state_count > MAX_PIN_STATES_PER_BLOCK )
+      flush();
+  }
+};
+
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Common functions which may or may not be used by individual drivers
 
@@ -28,14 +123,16 @@ jtag_cable_t * jtag_cable_in_use = NULL; // The currently selected cable.
 int cable_common_write_bit ( const uint8_t packet  // See the TDO, TMS and TRST constants.
                            )
 {
-  uint8_t data = TRST_BIT;  // TRST is active low, don't clear unless /set/ in 'packet'
+  const uint8_t data = packet_to_pin_state( packet );
   int err = APP_ERR_NONE;
 
-  /* Write data, drop clock */
-  if(packet & TDO) data |= TDI_BIT;
-  if(packet & TMS) data |= TMS_BIT;
-  if(packet & TRST) data &= ~TRST_BIT;
+  if ( jtag_cable_in_use->out_block_func != NULL )
+  {
+    const uint8_t states[2] = { data, uint8_t( data | TCLK_BIT ) };
+    return jtag_cable_in_use->out_block_func( states, 2 );
+  }
 
+  /* Write data, drop clock */
   err |= jtag_cable_in_use->out_func(data);
 
   /* raise clock, to do write */
@@ -47,14 +144,10 @@ int cable_common_write_bit ( const uint8_t packet  // See the TDO, TMS and TRST
 int cable_common_read_write_bit ( const uint8_t packet_out,  // See the TDO, TMS and TRST constants.
                                   uint8_t * const bit_in )
 {
-  uint8_t data = TRST_BIT;  //  TRST is active low, don't clear unless /set/ in 'packet'
+  const uint8_t data = packet_to_pin_state( packet_out );
   int err = APP_ERR_NONE;
 
   /* Write data, drop clock */
-  if(packet_out & TDO) data |= TDI_BIT;
-  if(packet_out & TMS) data |= TMS_BIT;
-  if(packet_out & TRST) data &= ~TRST_BIT;
-
   err |= jtag_cable_in_use->out_func(data);  // drop the clock to make data available, set the out data
   err |= jtag_cable_in_use->inout_func((data | TCLK_BIT), bit_in);  // read in bit, clock high for out bit.
 
@@ -62,6 +155,36 @@ int cable_common_read_write_bit ( const uint8_t packet_out,  // See the TDO, TMS
 }
 
 
+// Expands the whole stream into pin states, 4 bits at a time with the help of a table,
+// and hands them to the driver in blocks.
+
+static int write_stream_as_pin_state_blocks ( const uint32_t * const stream,
+                                              const int len_bits,
+                                              const int set_last_bit )
+{
+  pin_state_block block;
+
+  // The last bit may need TMS, so it is always added separately.
+  const int body_len = len_bits - 1;
+  int i = 0;
+
+  for ( ; i + 4 <= body_len; i += 4 )
+    block.add_nibble( stream[ i / 32 ] >> ( i % 32 ) );
+
+  for ( ; i < len_bits; ++i )
+  {
+    uint8_t out = ( stream[ i / 32 ] >> ( i % 32 ) ) & 1;
+
+    if ( i == body_len && set_last_bit )
+      out |= TMS;
+
+    block.add_bit( out );
+  }
+
+  return block.flush();
+}
+
+
 // Writes bitstream via bit-bang. Can be used by any driver which does not have a high-speed transfer function.
 // Transfers LSB to MSB of stream[0], then LSB to MSB of stream[1], etc.
 
@@ -71,6 +194,9 @@ int cable_common_write_stream ( const uint32_t * const stream,
 {
   assert( len_bits > 0 );
 
+  if ( jtag_cable_in_use->out_block_func != NULL )
+    return write_stream_as_pin_state_blocks( stream, len_bits, set_last_bit );
+
   int index = 0;
   int bits_this_index = 0;
   uint8_t out;
@@ -91,7 +217,7 @@ int cable_common_write_stream ( const uint32_t * const stream,
     }
   }
 
-  out = (stream[index] >>(len_bits - 1)) & 0x1;
+  out = (stream[index] >> bits_this_index) & 0x1;
   if(set_last_bit) out |= TMS;
   err |= cable_write_bit(out);
   debug("%i)\n", out);
@@ -133,9 +259,9 @@ int cable_common_read_stream ( const uint32_t * const outstream,
   }
 
   if (set_last_bit)
-    outval = ((outstream[index] >> (len_bits - 1)) & 1) | TMS;
+    outval = ((outstream[index] >> bits_this_index) & 1) | TMS;
   else
-    outval = (outstream[index] >> (len_bits - 1)) & 1;
+    outval = (outstream[index] >> bits_this_index) & 1;
 
   err |= cable_read_write_bit(outval, &inval);
   debug("%i", inval);
@@ -145,3 +271,29 @@ int cable_common_read_stream ( const uint32_t * const outstream,
 
   return err;
 }
+
+
+// Walks the TAP state machine via bit-bang. Can be used by any driver which cannot shift TMS sequences in hardware.
+// The TMS values are taken from LSB to MSB of tms_bits, TDI is held low.
+int cable_common_write_tms_sequence ( const uint32_t tms_bits,
+                                      const int bit_count )
+{
+  assert( bit_count > 0 && bit_count <= 32 );
+
+  if ( jtag_cable_in_use->out_block_func != NULL )
+  {
+    pin_state_block block;
+
+    for ( int i = 0; i < bit_count; i++ )
+      block.add_bit( ( ( tms_bits >> i ) & 1 ) ? TMS : 0 );
+
+    return block.flush();
+  }
+
+  int err = APP_ERR_NONE;
+
+  for ( int i = 0; i < bit_count; i++ )
+    err |= cable_write_bit( ( ( tms_bits >> i ) & 1 ) ? TMS : 0 );
+
+  return err;
+}
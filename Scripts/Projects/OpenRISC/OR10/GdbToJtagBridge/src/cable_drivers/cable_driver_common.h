@@ -12,12 +12,14 @@ struct jtag_cable_t
   const char *name;
   int (*inout_func)(uint8_t, uint8_t *);
   int (*out_func)(uint8_t);
+  int (*out_block_func)(const uint8_t *, int);  // Optional, like calling out_func for each pin state in the array.
   int (*init_func)();
   int (*opt_func)(int, const char *);
   int (*bit_out_func)(uint8_t);
   int (*bit_inout_func)(uint8_t, uint8_t *);
   int (*stream_out_func)(const uint32_t *, int, int);
   int (*stream_inout_func)(const uint32_t *, uint32_t *, int, int);
+  int (*tms_sequence_func)(uint32_t, int);
   int (*flush_func)();
   void (*close_func)();
   const char *opts;
@@ -27,12 +29,14 @@ struct jtag_cable_t
   : name( NULL )
   , inout_func( NULL )
   , out_func( NULL )
+  , out_block_func( NULL )
   , init_func( NULL )
   , opt_func( NULL )
   , bit_out_func( NULL )
   , bit_inout_func( NULL )
   , stream_out_func( NULL )
   , stream_inout_func( NULL )
+  , tms_sequence_func( NULL )
   , flush_func( NULL )
   , close_func( NULL )
   , opts( NULL )
@@ -54,6 +58,7 @@ int cable_common_write_bit ( uint8_t packet );
 int cable_common_read_write_bit ( uint8_t packet_out, uint8_t * bit_in );
 int cable_common_write_stream ( const uint32_t * stream, int len_bits, int set_last_bit );
 int cable_common_read_stream ( const uint32_t *outstream, uint32_t *instream, int len_bits, int set_last_bit );
+int cable_common_write_tms_sequence ( uint32_t tms_bits, int bit_count );
 
 extern jtag_cable_t * jtag_cable_in_use;
 
@@ -25,17 +25,18 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <assert.h>
 #include <ftdi.h>
 
 #include <algorithm>
 
 #include "cable_ft2232.h"
+#include "mpsse_interpreter.h"
 #include "errcodes.h"
 int debug = 0;
 
 #define debug(...) //fprintf(stderr, __VA_ARGS__ )
 
-#define FTDX_MAXSEND 4096
 #define FTDX_MAXSEND_MPSSE (64 * 1024)
 #define FTDI_MAXRECV   ( 4 * 64)
 
@@ -128,6 +129,7 @@ static int seq_reset(struct ftdi_context *ftdic);
 static int usbconn_ftdi_flush( ftdi_param_t *params );
 static int usbconn_ftdi_read( usbconn_t *conn, uint8_t *buf, int len );
 static int usbconn_ftdi_write( usbconn_t *conn, uint8_t *buf, int len, int recv );
+static uint8_t *usbconn_ftdi_append( usbconn_t *conn, int len, int recv );
 static int usbconn_ftdi_mpsse_open( usbconn_t *conn );
 static int usbconn_ftdi_close(usbconn_t *conn);
 
@@ -151,6 +153,11 @@ usbconn_cable_t usbconn_ft2232_mpsse_CableID2= {
 
 static usbconn_t *ft2232_device;
 
+// With option -L, no hardware is used. The MPSSE commands are executed by a software interpreter instead,
+// with TDO looped back from TDI. This is useful for testing and benchmarking the command assembly.
+static bool use_mpsse_interpreter = false;
+static mpsse_interpreter ft2232_mpsse_interpreter;
+
 
 
 /// ----------------------------------------------------------------------------------------------
@@ -167,6 +174,10 @@ void print_buffer(unsigned char *buf, int size) {
 int my_ftdi_write_data(struct ftdi_context *ftdi, unsigned char *buf, int size) {
 	debug("[MYDBG] ftdi_write_data(ftdi, buf=BUFFER[%d], size=%d);\n", size, size);
 	if(debug > 1) print_buffer(buf, size);
+	if(use_mpsse_interpreter) {
+		mpsse_interpreter_write(&ft2232_mpsse_interpreter, buf, size);
+		return size;
+	}
 	return ftdi_write_data(ftdi, buf, size);
 }
 
@@ -178,77 +189,94 @@ char *my_ftdi_get_error_string (struct ftdi_context *ftdi) {
 int my_ftdi_read_data(struct ftdi_context *ftdi, unsigned char *buf, int size) {
 	int ret = 0;
 	debug("[MYDBG] ftdi_read_data(ftdi, buf=BUFFER[%d], size=%d);\n", size, size);
-	ret = ftdi_read_data(ftdi, buf, size);
+	if(use_mpsse_interpreter)
+		ret = mpsse_interpreter_read(&ft2232_mpsse_interpreter, buf, size);
+	else
+		ret = ftdi_read_data(ftdi, buf, size);
 	if(debug) print_buffer(buf, size);
 	return ret;
 }
 
 int my_ftdi_usb_open_desc(struct ftdi_context *ftdi, int vendor, int product, const char* description, const char* serial) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_usb_open_desc(ftdi, vendor=%d, product=%d, description=DESCRIPTION, serial=SERIAL);\n", vendor, product);
 	return ftdi_usb_open_desc(ftdi, vendor, product, description, serial);
 }
 
 void my_ftdi_deinit(struct ftdi_context *ftdi) {
+	if(use_mpsse_interpreter) return;
 	debug("[MYDBG] ftdi_deinit(ftdi);\n");
 	ftdi_deinit(ftdi);
 }
 
 int my_ftdi_usb_purge_buffers(struct ftdi_context *ftdi) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_usb_purge_buffers(ftdi);\n");
 	return ftdi_usb_purge_buffers(ftdi);
 }
 
 int my_ftdi_usb_purge_rx_buffer(struct ftdi_context *ftdi) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_usb_purge_rx_buffer(ftdi);\n");
 	return ftdi_usb_purge_rx_buffer(ftdi);
 }
 
 int my_ftdi_usb_purge_tx_buffer(struct ftdi_context *ftdi) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_usb_purge_tx_buffer(ftdi);\n");
 	return ftdi_usb_purge_tx_buffer(ftdi);
 }
 
 int my_ftdi_usb_reset(struct ftdi_context *ftdi) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_usb_reset(ftdi);\n");
 	return ftdi_usb_reset(ftdi);
 }
 
 int my_ftdi_set_latency_timer(struct ftdi_context *ftdi, unsigned char latency) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_set_latency_timer(ftdi, latency=0x%02x);\n", latency);
 	return ftdi_set_latency_timer(ftdi, latency);
 }
 
 int my_ftdi_set_baudrate(struct ftdi_context *ftdi, int baudrate) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_set_baudrate(ftdi, baudrate=%d);\n", baudrate);
 	return ftdi_set_baudrate(ftdi, baudrate);
 }
 
 int my_ftdi_read_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_read_data_set_chunksize(ftdi, chunksize=%u);\n", chunksize);
 	return ftdi_read_data_set_chunksize(ftdi, chunksize);
 }
 
 int my_ftdi_write_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_write_data_set_chunksize(ftdi, chunksize=%u);\n", chunksize);
 	return ftdi_write_data_set_chunksize(ftdi, chunksize);
 }
 
 int my_ftdi_set_event_char(struct ftdi_context *ftdi, unsigned char eventch, unsigned char enable) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_set_event_char(ftdi, eventch=0x%02x, enable=0x%02x);\n", eventch, enable);
 	return ftdi_set_event_char(ftdi, eventch, enable);
 }
 
 int my_ftdi_set_error_char(struct ftdi_context *ftdi, unsigned char errorch, unsigned char enable) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_set_error_char(ftdi, errorch=0x%02x, enable=0x%02x);\n", errorch, enable);
 	return ftdi_set_error_char(ftdi, errorch, enable);
 }
 
 int my_ftdi_set_bitmode(struct ftdi_context *ftdi, unsigned char bitmask, unsigned char mode) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_set_bitmode(ftdi, bitmask=0x%02x, mode=0x%02x);\n", bitmask, mode);
 	return ftdi_set_bitmode(ftdi, bitmask, mode);
 }
 
 int my_ftdi_usb_close(struct ftdi_context *ftdi) {
+	if(use_mpsse_interpreter) return 0;
 	debug("[MYDBG] ftdi_usb_close(ftdi);\n");
 	return ftdi_usb_close(ftdi);
 }
@@ -403,51 +431,55 @@ static int usbconn_ftdi_read( usbconn_t *conn, uint8_t *buf, int len ) {
 	return recvd < 0 ? -1 : cpy_len + len;
 }
 
-static int usbconn_ftdi_write( usbconn_t *conn, uint8_t *buf, int len, int recv ) {
+/* The send buffer is allocated once with the maximum size, and the MPSSE commands are assembled
+   directly in it. The buffer is only submitted when it is full, when the data read back is needed,
+   or on an explicit flush. This way, many commands go out in a single ftdi_write_data() call,
+   followed by a single read for all their answers.
+
+   Returns where to write the command, or NULL on error. */
+static uint8_t *usbconn_ftdi_append( usbconn_t *conn, int len, int recv ) {
 
 	ftdi_param_t *params = (ftdi_param_t *)conn->params;
-	int xferred = 0;
 
-	if (!params->ftdic)
-		return -1;
+	if (!params->ftdic || !params->send_buf)
+		return NULL;
 
-	/* this write function will try to buffer write data
-	   buffering will be ceased and a flush triggered in two cases. */
+	if ((uint32_t)len > params->send_buf_len) {
+		printf("MPSSE command too long.\n");
+		return NULL;
+	}
 
-	/* Case A: max number of scheduled receive bytes will be exceeded
-	   with this write
-	   Case B: max number of scheduled send bytes has been reached */
-	if ((params->to_recv + recv > FTDI_MAXRECV) || ((params->send_buffered > FTDX_MAXSEND) && (params->to_recv == 0)))
-		xferred = usbconn_ftdi_flush(params);
+	/* flush first if the command does not fit in the send buffer,
+	   or if too many receive bytes would be scheduled */
+	if ((params->send_buffered + len > params->send_buf_len) ||
+	    (params->to_recv > 0 && params->to_recv + recv > FTDI_MAXRECV))
+		if (usbconn_ftdi_flush(params) < 0)
+			return NULL;
 
-	if (xferred < 0)
-		return -1;
+	uint8_t *dest = &(params->send_buf[params->send_buffered]);
+	params->send_buffered += len;
+	params->to_recv += recv;
 
-	/* now buffer this write */
-	if (params->send_buffered + len > params->send_buf_len) {
-		params->send_buf_len = params->send_buffered + len;
-		if (params->send_buf)
-			params->send_buf = (uint8_t *)realloc( params->send_buf, params->send_buf_len);
-	}
+	return dest;
+}
 
-	if (params->send_buf) {
-		memcpy( &(params->send_buf[params->send_buffered]), buf, len );
-		params->send_buffered += len;
-		if (recv > 0)
-			params->to_recv += recv;
+static int usbconn_ftdi_write( usbconn_t *conn, uint8_t *buf, int len, int recv ) {
 
-		if (recv < 0) {
-			/* immediate write requested, so flush the buffered data */
-			xferred = usbconn_ftdi_flush( params );
-		}
+	uint8_t *dest = usbconn_ftdi_append( conn, len, (recv > 0) ? recv : 0 );
 
-		debug("[MYDBG] WRITE inmediate=%s ; xferred=%u ; len=%u\n", ((recv < 0) ? "TRUE" : "FALSE"), xferred, len);
-		return xferred < 0 ? -1 : len;
-	}
-	else {
-		printf("Send buffer does not exist.\n");
+	if (dest == NULL)
 		return -1;
+
+	memcpy( dest, buf, len );
+
+	if (recv < 0) {
+		/* immediate write requested, so flush the buffered data */
+		if (usbconn_ftdi_flush( (ftdi_param_t *)conn->params ) < 0)
+			return -1;
 	}
+
+	debug("[MYDBG] WRITE inmediate=%s ; len=%u\n", ((recv < 0) ? "TRUE" : "FALSE"), len);
+	return len;
 }
 
 static int usbconn_ftdi_mpsse_open( usbconn_t *conn ) {
@@ -560,7 +592,7 @@ usbconn_t * usbconn_ftdi_connect ( const char **, int, usbconn_cable_t * )
 	struct ftdi_context *ftdic = (ftdi_context *)malloc( sizeof( struct ftdi_context ) );
 
 	if (params) {
-		params->send_buf_len   = FTDX_MAXSEND;
+		params->send_buf_len   = FTDX_MAXSEND_MPSSE;
 		params->send_buffered  = 0;
 		params->send_buf       = (uint8_t *) malloc( params->send_buf_len );
 		params->recv_buf_len   = FTDI_MAXRECV;
@@ -621,50 +653,44 @@ usbconn_t * usbconn_ftdi_connect ( const char **, int, usbconn_cable_t * )
 
 int cable_ft2232_write_bytes(usbconn_t *conn, unsigned char *buf, int len, int postread) {
 
-	int cur_command_size;
-	int max_command_size;
+	// Each chunk must fit in the send buffer together with its 3-byte command header.
+	const int max_chunk_len = FTDX_MAXSEND_MPSSE - 3;
 	int cur_chunk_len;
 	int recv;
-	int xferred;
-	int i;
-	unsigned char *mybuf;
+	unsigned char opcode;
+	unsigned char *cmd;
 
 	if(len == 0)
 		return 0;
 	debug("write_bytes(length=%d, postread=%s)\n", len, ((postread > 0) ? "TRUE" : "FALSE"));
 	recv = 0;
-	max_command_size = std::min(len, 65536)+3;
-	mybuf = (unsigned char *) malloc( max_command_size );
 
 	/// Command OPCODE: write bytes
-	mybuf[0] = MPSSE_DO_WRITE | MPSSE_LSB | MPSSE_WRITE_NEG;
+	opcode = MPSSE_DO_WRITE | MPSSE_LSB | MPSSE_WRITE_NEG;
 	if(postread) // if postread is enabled it will buffer incoming bytes
-		mybuf[0] = mybuf[0] | MPSSE_DO_READ;
+		opcode = opcode | MPSSE_DO_READ;
 
-	// We divide the transmitting stream of bytes in chunks with a maximun length of 65536 bytes each.
+	// We divide the transmitting stream of bytes in chunks, and assemble each command directly in the send buffer.
 	while(len > 0) {
-		cur_chunk_len = std::min(len, 65536);
+		cur_chunk_len = std::min(len, max_chunk_len);
 		len = len - cur_chunk_len;
-		cur_command_size = cur_chunk_len + 3;
+
+		cmd = usbconn_ftdi_append( conn, cur_chunk_len + 3, (postread ? cur_chunk_len : 0) );
+		if(cmd == NULL)
+			return -1;
 
 		/// Low and High bytes of the length field
-		mybuf[1] = (unsigned char) ( cur_chunk_len - 1);
-		mybuf[2] = (unsigned char) ((cur_chunk_len - 1) >> 8);
+		cmd[0] = opcode;
+		cmd[1] = (unsigned char) ( cur_chunk_len - 1);
+		cmd[2] = (unsigned char) ((cur_chunk_len - 1) >> 8);
 
-		debug("\tOPCODE:  0x%x\n", mybuf[0]);
-		debug("\tLENGTL:  0x%02x\n", mybuf[1]);
-		debug("\tLENGTH:  0x%02x\n", mybuf[2]);
+		debug("\tOPCODE:  0x%x\n", cmd[0]);
+		debug("\tLENGTL:  0x%02x\n", cmd[1]);
+		debug("\tLENGTH:  0x%02x\n", cmd[2]);
 
 		/// The rest of the command is filled with the bytes that will be transferred
-		memcpy(&(mybuf[3]), buf, cur_chunk_len );
+		memcpy(&(cmd[3]), buf, cur_chunk_len );
 		buf = buf + cur_chunk_len;
-		for(i = 0; i< cur_chunk_len; i++)
-			if(debug>1) debug("\tBYTE%3d: 0x%02x\n", i, mybuf[3+i]);
-
-		/// Finally we can ransmit the command
-		xferred = usbconn_ftdi_write( conn, mybuf, cur_command_size, (postread ? cur_chunk_len : 0) );
-		if(xferred != cur_command_size)
-			return -1;
 
 		// If OK, the update the number of incoming bytes that are being buffered for a posterior read
 		if(postread)
@@ -678,33 +704,29 @@ int cable_ft2232_write_bytes(usbconn_t *conn, unsigned char *buf, int len, int p
 
 int cable_ft2232_write_bits(usbconn_t *conn, unsigned char *buf, int len, int postread, int with_tms)
 {
-	int max_command_size;
 	int max_chunk_len;
 	int cur_chunk_len;
 	int recv;
-	int xferred;
 	int i;
-	unsigned char *mybuf;
+	unsigned char opcode;
+	unsigned char *cmd;
 
 	if(len == 0)
 		return 0;
 
-	max_command_size = 3;
-	mybuf = (unsigned char *) malloc( max_command_size );
-
 	if(!with_tms) {
 		/// Command OPCODE: write bits (can write up to 8 bits in a single command)
 		max_chunk_len = 8;
-		mybuf[0] = MPSSE_DO_WRITE | MPSSE_LSB | MPSSE_WRITE_NEG | MPSSE_BITMODE;
+		opcode = MPSSE_DO_WRITE | MPSSE_LSB | MPSSE_WRITE_NEG | MPSSE_BITMODE;
 	}
 	else {
 		/// Command OPCODE: 0x4B write bit with tms (can write up to 1 bits in a single command)
 		max_chunk_len = 1;
-		mybuf[0] = MPSSE_WRITE_TMS|MPSSE_LSB|MPSSE_BITMODE|MPSSE_WRITE_NEG;
+		opcode = MPSSE_WRITE_TMS|MPSSE_LSB|MPSSE_BITMODE|MPSSE_WRITE_NEG;
 	}
 
 	if(postread) // (OPCODE += 0x20) if postread is enabled it will buffer incoming bits
-		mybuf[0] = mybuf[0] | MPSSE_DO_READ;
+		opcode = opcode | MPSSE_DO_READ;
 
 	// We divide the transmitting stream of bytes in chunks with a maximun length of max_chunk_len bits each.
 	i=0;
@@ -713,30 +735,30 @@ int cable_ft2232_write_bits(usbconn_t *conn, unsigned char *buf, int len, int po
 		cur_chunk_len = std::min(len, max_chunk_len);
 		len = len - cur_chunk_len;
 
+		cmd = usbconn_ftdi_append( conn, 3, (postread ? 1 : 0) );
+		if(cmd == NULL)
+			return -1;
+
 		/// Bits length field
-		mybuf[1] = (unsigned char) ( cur_chunk_len - 1);
+		cmd[0] = opcode;
+		cmd[1] = (unsigned char) ( cur_chunk_len - 1);
 
-		debug("\tOPCODE:  0x%x\n", mybuf[0]);
-		debug("\tLENGTH:  0x%02x\n", mybuf[1]);
+		debug("\tOPCODE:  0x%x\n", cmd[0]);
+		debug("\tLENGTH:  0x%02x\n", cmd[1]);
 
 		if(!with_tms) {
 			/// The last byte of the command is filled with the bits that will be transferred
 			debug("\tDATA[%d]  0x%02x\n", (i/8), buf[i/8]);
-			mybuf[2] = buf[i/8];
+			cmd[2] = buf[i/8];
 			i=i+8;
 		}
 		else {
-			//TODO: select the bit to transmit
-			mybuf[2] = 0x01 | ((buf[(i/8)] >> (i%8)) << 7);
+			// TMS high, bit 7 is the TDI value.
+			cmd[2] = 0x01 | ((buf[(i/8)] >> (i%8)) << 7);
 			i++;
 		}
 
-		debug("\tBYTE%3d: 0x%02x\n", i, mybuf[2]);
-
-		/// Finally we can transmmit the command
-		xferred = usbconn_ftdi_write( conn, mybuf, max_command_size, (postread ? 1 : 0) );
-		if(xferred != max_command_size)
-			return -1;
+		debug("\tBYTE%3d: 0x%02x\n", i, cmd[2]);
 
 		// If OK, the update the number of incoming bytes that are being buffered for a posterior read
 		if(postread)
@@ -749,59 +771,42 @@ int cable_ft2232_write_bits(usbconn_t *conn, unsigned char *buf, int len, int po
 
 int cable_ft2232_read_packed_bits(usbconn_t *conn, uint8_t *buf, int packet_len, int bits_per_packet, int offset)
 {
-	unsigned char *mybuf;
-	unsigned char dst_mask;
-	unsigned char src_mask;
-	int row_offset;
-	int dst_row;
-	int dst_col;
-	int src_row;
-	int src_col;
+	unsigned char packet;
+	int dst_bit;
 	int i;
-	int r;
+	int j;
 
 	if(packet_len == 0 || bits_per_packet == 0)
 		return 0;
 
-	mybuf = (unsigned char *) malloc( packet_len );
-	if((r=usbconn_ftdi_read( conn, mybuf, packet_len )) < 0) {
-		debug("Read failed\n");
-		return -1;
+	if(bits_per_packet == 8) {
+		// Whole bytes can be read straight into the destination.
+		assert( offset % 8 == 0 );
+		return (usbconn_ftdi_read( conn, &(buf[offset / 8]), packet_len ) < 1) ? -1 : 0;
 	}
 
-	if(bits_per_packet < 8) {
-		for(i=0; i < packet_len; i++){ // rotate bits to the left side
-//			debug("[MYDBG] unaligned bits[%d]=%02x\n", i, mybuf[i]);
-			mybuf[i] = (mybuf[i] >> (8-bits_per_packet));
-//			debug("[MYDBG]   aligned bits[%d]=%02x\n", i, mybuf[i]);
+	if(bits_per_packet > 8)
+		return -1;
+
+	for(i=0; i < packet_len; i++) {
+		if(usbconn_ftdi_read( conn, &packet, 1 ) < 1) {
+			debug("Read failed\n");
+			return -1;
 		}
-		for(i=offset; i < (packet_len*bits_per_packet+offset); i++) {
-			dst_row = i / 8;
-			dst_col = i % 8;
-			src_row = (i-offset) / bits_per_packet;
-			src_col = (i-offset) % bits_per_packet;
-			dst_mask = ~(1 << dst_col);
-			src_mask = (1 << src_col);
-//			debug("[MYDBG] i=%4d dst[%3d][%3d] dst_mask=%02x dst_val=%02x dst_masked=%02x\n", i, dst_row, dst_col, dst_mask, buf[dst_row], (buf[dst_row] & dst_mask));
-//			debug("[MYDBG] i=%4d src[%3d][%3d] src_mask=%02x src_val=%02x src_masked=%02x\n", i, src_row, src_col, src_mask, mybuf[src_row], (mybuf[src_row] & src_mask));
-			if(dst_col >= src_col)
-				buf[dst_row] = (buf[dst_row] & dst_mask) | ((mybuf[src_row] & src_mask) << (dst_col - src_col));
+
+		// The bits are shifted in from the MSB side, so rotate them to the right.
+		packet = (packet >> (8-bits_per_packet));
+
+		for(j=0; j < bits_per_packet; j++) {
+			dst_bit = offset + i * bits_per_packet + j;
+			if((packet >> j) & 1)
+				buf[dst_bit / 8] |= (1 << (dst_bit % 8));
 			else
-				buf[dst_row] = (buf[dst_row] & dst_mask) | ((mybuf[src_row] & src_mask) >> (dst_col - src_col));
+				buf[dst_bit / 8] &= ~(1 << (dst_bit % 8));
 		}
-
-	}
-	else if(bits_per_packet == 8){
-		row_offset = offset / 8;
-//		debug("[MYDBG] Row offset=%d\n", row_offset);
-		memcpy( &(buf[row_offset]), mybuf, packet_len);
-	}
-	else {
-		return -1;
 	}
 
-//	debug("read_bits()-> %x\n", *buf);
-	return ((r < 1) ? -1 : 0);
+	return 0;
 }
 
 int cable_ft2232_write_stream(usbconn_t *conn, unsigned char *buf, int len, int postread, int with_tms) {
@@ -862,7 +867,10 @@ int cable_ft2232_read_stream(usbconn_t *conn, unsigned char *buf, int len, int w
 int cable_ftdi_init() {
 	int err = APP_ERR_NONE;
 	int res = 0;
-	unsigned char *buf = (unsigned char *)malloc(10);
+	unsigned char buf[10];
+
+	if(use_mpsse_interpreter)
+		mpsse_interpreter_init(&ft2232_mpsse_interpreter, NULL, NULL);
 
 	ft2232_device = usbconn_ftdi_connect( NULL, 0, NULL );
 
@@ -893,12 +901,23 @@ int cable_ftdi_init() {
 	return err;
 }
 
-int cable_ftdi_close()
+int cable_ftdi_flush();
+
+void cable_ftdi_close()
 {
+	cable_ftdi_flush();
+
+	if(use_mpsse_interpreter) {
+		const mpsse_interpreter * const mi = &ft2232_mpsse_interpreter;
+		printf("MPSSE interpreter statistics: %llu USB writes, %llu bytes, %llu commands, %llu TCK cycles.\n",
+		       (unsigned long long)mi->write_call_count,
+		       (unsigned long long)mi->written_byte_count,
+		       (unsigned long long)mi->command_count,
+		       (unsigned long long)mi->tck_count);
+	}
+
 	usbconn_ftdi_close(ft2232_device);
 	usbconn_ftdi_free(ft2232_device);
-
-	return APP_ERR_NONE;
 }
 
 int cable_ftdi_flush() {
@@ -908,19 +927,31 @@ int cable_ftdi_flush() {
 	return APP_ERR_NONE;
 }
 
+// The MPSSE engine keeps the TMS line at the value of the last TMS command, and the data shifting commands
+// do not change it. Therefore, single bits are always clocked with a 1-bit TMS command (0x4B),
+// which sets TMS explicitly. Otherwise, a bit with TMS low after a TMS sequence ending in 1 would go out with TMS high.
+static int cable_ft2232_write_single_bit(usbconn_t *conn, uint8_t packet, int postread) {
+	unsigned char *cmd;
+
+	cmd = usbconn_ftdi_append( conn, 3, (postread ? 1 : 0) );
+	if(cmd == NULL)
+		return -1;
+
+	cmd[0] = MPSSE_WRITE_TMS|MPSSE_LSB|MPSSE_BITMODE|MPSSE_WRITE_NEG;
+	if(postread)
+		cmd[0] = cmd[0] | MPSSE_DO_READ;
+	cmd[1] = 0;  // 1 bit.
+	cmd[2] = ((packet & TMS) ? 0x01 : 0x00) | ((packet & TDO) ? 0x80 : 0x00);
+
+	return 0;
+}
+
 int cable_ftdi_write_bit(uint8_t packet) {
 	int err = APP_ERR_NONE;
-	unsigned char buf;
-	int tms;
-
-	buf = ((packet & TDO) ? 0x01 : 0x00);
-	tms = ((packet & TMS) ? 1 : 0);
 
-	if(cable_ft2232_write_stream(ft2232_device, &buf, 1, 0, tms) < 0)
+	if(cable_ft2232_write_single_bit(ft2232_device, packet, 0) < 0)
 		err |= APP_ERR_COMM;
 
-	cable_ftdi_flush();
-
 	return err;
 
 }
@@ -928,16 +959,11 @@ int cable_ftdi_write_bit(uint8_t packet) {
 int cable_ftdi_read_write_bit(uint8_t packet_out, uint8_t *bit_in) {
 
 	int err = APP_ERR_NONE;
-	unsigned char buf;
-	int tms;
-
-	buf = ((packet_out & TDO) ? 0x01 : 0x00);
-	tms = ((packet_out & TMS) ? 1 : 0);
 
-	if(cable_ft2232_write_stream(ft2232_device, &buf, 1, 1, tms) < 0)
+	if(cable_ft2232_write_single_bit(ft2232_device, packet_out, 1) < 0)
 		err = APP_ERR_COMM;
 
-	if(cable_ft2232_read_stream(ft2232_device, ((unsigned char *)bit_in), 1, tms) < 0)
+	if(cable_ft2232_read_packed_bits(ft2232_device, bit_in, 1, 1, 0) < 0)
 		err = APP_ERR_COMM;
 
 	return err;
@@ -950,8 +976,6 @@ int cable_ftdi_write_stream ( const uint32_t * stream, int len_bits, int set_las
 	if(cable_ft2232_write_stream(ft2232_device, ((unsigned char *)stream), len_bits, 0, set_last_bit) < 0)
 		err |= APP_ERR_COMM;
 
-	cable_ftdi_flush();
-
 	return err;
 }
 
@@ -969,12 +993,47 @@ int cable_ftdi_read_stream ( const uint32_t * outstream,
 	return err;
 }
 
+// Walks the TAP state machine with MPSSE command 0x4B, which clocks out up to 7 TMS bits
+// from a single data byte. Bit 7 of that byte holds TDI, which stays low.
+// Like all other write operations, the commands are only sent on the next flush or read.
+int cable_ftdi_write_tms_sequence ( const uint32_t tms_bits, const int bit_count )
+{
+	const int MAX_TMS_BITS_PER_COMMAND = 7;
+
+	assert( bit_count > 0 && bit_count <= 32 );
+
+	for ( int i = 0; i < bit_count; i += MAX_TMS_BITS_PER_COMMAND )
+	{
+		const int chunk_len = std::min( bit_count - i, MAX_TMS_BITS_PER_COMMAND );
+
+		unsigned char * const cmd = usbconn_ftdi_append( ft2232_device, 3, 0 );
+
+		if ( cmd == NULL )
+			return APP_ERR_COMM;
+
+		cmd[0] = MPSSE_WRITE_TMS|MPSSE_LSB|MPSSE_BITMODE|MPSSE_WRITE_NEG;
+		cmd[1] = (unsigned char) ( chunk_len - 1 );
+		cmd[2] = (unsigned char) ( ( tms_bits >> i ) & ( ( 1 << chunk_len ) - 1 ) );
+	}
+
+	return APP_ERR_NONE;
+}
+
+mpsse_interpreter * cable_ftdi_get_mpsse_interpreter ( void )
+{
+	return use_mpsse_interpreter ? &ft2232_mpsse_interpreter : NULL;
+}
+
 int cable_ftdi_opt ( const int c, const char * const str )
 {
   uint32_t newvid;
   uint32_t newpid;
 
   switch(c) {
+  case 'L':
+    use_mpsse_interpreter = true;
+    break;
+
   case 'p':
     if(!sscanf(str, "%x", &newpid)) {
       fprintf(stderr, "p parameter must have a hex number as parameter\n");
@@ -1016,9 +1075,12 @@ jtag_cable_t *cable_ftdi_get_driver(void)
 		ft2232_cable_driver.bit_inout_func = cable_ftdi_read_write_bit;
 		ft2232_cable_driver.stream_out_func = cable_ftdi_write_stream;
 		ft2232_cable_driver.stream_inout_func = cable_ftdi_read_stream;
+		ft2232_cable_driver.tms_sequence_func = cable_ftdi_write_tms_sequence;
 		ft2232_cable_driver.flush_func = cable_ftdi_flush;
-		ft2232_cable_driver.opts = "p:v:";
-		ft2232_cable_driver.help = "\t-p [PID] Alteranate PID for USB device (hex value)\n\t-v [VID] Alternate VID for USB device (hex value)\n";
+		ft2232_cable_driver.close_func = cable_ftdi_close;
+		ft2232_cable_driver.opts = "p:v:L";
+		ft2232_cable_driver.help = "\t-p [PID] Alteranate PID for USB device (hex value)\n\t-v [VID] Alternate VID for USB device (hex value)\n"
+		                           "\t-L       No hardware, run the MPSSE commands in a software interpreter with TDO looped back from TDI\n";
 
 		was_ft2232_cable_driver_initialised = true;
 	}
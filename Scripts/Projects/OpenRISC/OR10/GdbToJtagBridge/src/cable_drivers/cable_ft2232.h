@@ -6,6 +6,12 @@
 
 jtag_cable_t * cable_ftdi_get_driver ( void );
 
+struct mpsse_interpreter;
+
+// With option -L, returns the software MPSSE interpreter the commands are sent to, otherwise NULL.
+// Tests can hook into it after the cable has been initialised.
+mpsse_interpreter * cable_ftdi_get_mpsse_interpreter ( void );
+
 #endif
 
 
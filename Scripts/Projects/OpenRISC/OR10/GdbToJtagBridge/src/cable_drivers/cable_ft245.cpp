@@ -28,6 +28,8 @@
 #include <string.h>
 #include <stdint.h>
 
+#include <algorithm>
+
 #include "ftdi.h"  // libftdi header
 
 #include "cable_ft245.h"
@@ -38,6 +40,7 @@
 static int cable_ft245_init();
 static int cable_ft245_out(uint8_t value);
 static int cable_ft245_inout(uint8_t value, uint8_t *in_bit);
+static int cable_ft245_out_block(const uint8_t *values, int count);
 static int cable_ft245_write_stream(const uint32_t *stream, int len_bits, int set_last_bit);
 static int cable_ft245_opt ( const int c, const char * const str );
 
@@ -408,6 +411,35 @@ int cable_ft245_out(uint8_t value)
 	return 0;
 }
 
+// In bit-bang mode, each byte written is one pin state, so a whole block of pin states
+// can be sent with a single USB transaction per 63 bytes, instead of one transaction per pin state.
+int cable_ft245_out_block(const uint8_t *values, int count)
+{
+  uint32_t count_written;
+  int err = APP_ERR_NONE;
+
+  while(count > 0)
+    {
+      const int bytes_this_xfer = std::min(count, USBBLASTER_MAX_WRITE);
+
+      // USB-Blaster has no TRST pin
+      for(int i = 0; i < bytes_this_xfer; i++)
+        data_out_scratchpad[i] = FTDI_OTHERS |
+                                 ((values[i] & TCLK_BIT) ? (1<<FTDI_TCK) : 0) |
+                                 ((values[i] & TMS_BIT)  ? (1<<FTDI_TMS) : 0) |
+                                 ((values[i] & TDI_BIT)  ? (1<<FTDI_TDI) : 0);
+
+      if(usb_blaster_buf_write(data_out_scratchpad, bytes_this_xfer, &count_written) < 0 ||
+         count_written != uint32_t(bytes_this_xfer))
+        err |= APP_ERR_USB;
+
+      values += bytes_this_xfer;
+      count  -= bytes_this_xfer;
+    }
+
+  return err;
+}
+
 int cable_ft245_inout(uint8_t value, uint8_t *in_bit)
 {
 	int    tck = 0;
@@ -476,6 +508,7 @@ jtag_cable_t *cable_ft245_get_driver(void)
     ft245_cable_driver.name = "ft245";
     ft245_cable_driver.inout_func = cable_ft245_inout;
     ft245_cable_driver.out_func = cable_ft245_out;
+    ft245_cable_driver.out_block_func = cable_ft245_out_block;
     ft245_cable_driver.init_func =cable_ft245_init;
     ft245_cable_driver.opt_func = cable_ft245_opt;
     ft245_cable_driver.bit_out_func = cable_common_write_bit;
@@ -487,6 +520,7 @@ jtag_cable_t *cable_ft245_get_driver(void)
     ft245_cable_driver.stream_out_func = cable_common_write_stream;
     ft245_cable_driver.stream_inout_func = cable_common_read_stream;
 #endif
+    ft245_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
     ft245_cable_driver.flush_func = NULL;
     ft245_cable_driver.opts = "p:v:";
     ft245_cable_driver.help = "\t-p [PID] Alternate PID for USB device (hex value)\n\t-v [VID] Alternate VID for USB device (hex value)\n";
@@ -0,0 +1,1108 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Software model cable: instead of driving real JTAG pins, this driver feeds them into a C++ model
+// of the OR10 JTAG TAP (JTAG/tap_top.v) and its DEBUG register (JTAG/tap_or10.v).
+// The debug unit talks to an emulated CPU with a sparse SPR file and a sparse memory.
+//
+// The model is clocked by the TCK edges the bridge generates, and it follows the Verilog code
+// register by register, so that the bridge sees the same TDO bit sequences as with the real hardware.
+// The CPU side is simplified: it runs in the TCK clock domain, and answers each
+// debug interface request after a configurable number of TCK cycles.
+//
+// This way, the upper layers (chain_commands, dbg_api, rsp_or10) can be benchmarked and tested
+// deterministically without a simulator or a board.
+//
+// Unstalling the CPU makes it "run" for a configurable number of TCK cycles, after which it stops
+// as if it had hit a breakpoint (trap exception).
+//
+// Other devices can be placed in the JTAG chain before and after the OR10 TAP, in order to test
+// the prefix and postfix bit handling. They only implement the IDCODE and BYPASS instructions.
+
+#include "cable_model.h"  // The include file for this module should come first.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include <map>
+#include <vector>
+
+#include "errcodes.h"
+#include "spr-defs.h"
+#include "jtag_tap_state.h"
+
+
+static bool was_model_cable_driver_initialised = false;
+static jtag_cable_t model_cable_driver;
+
+
+// ----------- JTAG TAP, see tap_top.v and tap_defines.v -----------
+
+static const unsigned IR_LENGTH = 4;
+static const uint8_t JTAG_INSTRUCTION_IDCODE = 0x2;
+static const uint8_t JTAG_INSTRUCTION_DEBUG  = 0x8;
+static const uint32_t OPENRISC_CPU_JTAG_IDCODE_VALUE = 0x149B51C3;
+
+
+// ----------- Other devices in the JTAG chain -----------
+
+// These devices share TCK and TMS with the OR10 TAP, so their TAP state is always the same.
+
+static const unsigned OTHER_DEVICE_IR_LENGTH      = 8;
+static const uint32_t OTHER_DEVICE_IR_IDCODE      = 0x01;  // Any other instruction selects the BYPASS register.
+static const uint32_t OTHER_DEVICE_IDCODE_BASE    = 0x0BA00055;
+static const uint32_t OTHER_DEVICE_IDCODE_STEP    = 0x00001000;
+
+struct other_device
+{
+  uint32_t idcode;
+  uint32_t ir;
+  uint32_t current_instruction;
+  uint32_t dr;   // The IDCODE register, or the BYPASS register in bit 0.
+  bool     tdo;  // Changes on the falling edge of TCK.
+};
+
+// The devices are listed in the order the data flows through them.
+static unsigned device_count_before_tap = 0;
+static unsigned device_count_after_tap  = 0;
+static std::vector< other_device > devices_before_tap;  // Between the cable data output and the OR10 TAP.
+static std::vector< other_device > devices_after_tap;   // Between the OR10 TAP and the cable data input.
+
+
+// ----------- DEBUG register, see tap_or10.v -----------
+
+enum cpu_state_enum
+{
+  CPU_STATE_IDLE,
+  CPU_STATE_WAITING_FOR_CPU_IDLE,
+  CPU_STATE_DATA_WRITTEN,
+  CPU_STATE_WAITING_FOR_ACK
+};
+
+static const unsigned DEBUG_CMD_NOP             = 0;
+static const unsigned DEBUG_CMD_IS_CPU_STALLED  = 1;
+static const unsigned DEBUG_CMD_WRITE_CPU_SPR   = 2;
+static const unsigned DEBUG_CMD_READ_CPU_SPR    = 3;
+static const unsigned DEBUG_CMD_BURST_READ_MEM  = 6;
+static const unsigned DEBUG_CMD_BURST_WRITE_MEM = 7;
+
+static const unsigned SHIFT_REG_LEN   = 3 + 16 + 32;
+static const unsigned OUTPUT_REG_LEN  = 32 + 1 + 1;
+static const unsigned BURST_FRAME_LEN = 32;
+
+static const uint64_t OPERATION_COMPLETE_FLAG = 1;  // Bit 0 of the output register.
+static const uint64_t OPERATION_FAILED_FLAG   = 2;  // Bit 1 of the output register.
+static const uint64_t BURST_OVERFLOW_FLAG     = 4;  // Bit 2 of the burst write status.
+
+static unsigned get_cmd_opcode ( const uint64_t cmd ) { return unsigned( cmd >> 48 ) & 7;  }
+static uint16_t get_cmd_spr    ( const uint64_t cmd ) { return uint16_t( cmd >> 32 );       }
+static uint32_t get_cmd_value  ( const uint64_t cmd ) { return uint32_t( cmd );             }
+
+static bool is_burst_cmd ( const unsigned opcode )
+{
+  return opcode == DEBUG_CMD_BURST_READ_MEM || opcode == DEBUG_CMD_BURST_WRITE_MEM;
+}
+
+
+// All registers clocked on the TCK rising edge. The Verilog code uses non-blocking assignments,
+// so each rising edge computes a new copy of this structure from the old one.
+
+struct model_registers
+{
+  // tap_top.v
+  tap_state_enum tap_state;
+  uint8_t  jtag_ir;
+  uint8_t  current_instruction;
+  bool     bypass_reg;
+  uint32_t idcode_reg;
+
+  // tap_or10.v
+  cpu_state_enum cpu_state;
+  uint64_t input_shift_reg;
+  uint64_t current_cmd;
+  uint64_t output_shift_reg;
+  unsigned output_bits_left;
+  unsigned burst_cpu_ops_left;
+  unsigned burst_frames_left;
+  uint32_t burst_addr;
+  bool     burst_write_addr_sent;
+  bool     burst_failed;
+  bool     burst_overflow;
+  bool     burst_status_sent;
+  bool     burst_held_valid;
+  uint64_t burst_held_frame;
+  bool     burst_pending_valid;
+  uint32_t burst_pending_data;
+  unsigned input_bits_left;
+  uint32_t input_word;
+
+  bool     cpu_stb;
+  bool     cpu_we;
+  uint16_t cpu_spr_number;
+  uint32_t cpu_data_out;
+
+  // The 2 flip-flops of each clock_domain_crossing_synchroniser, bit 0 is the synchronised output.
+  unsigned ack_synchroniser;
+  unsigned is_stalled_synchroniser;
+
+  // The emulated CPU's side of the debug interface.
+  bool     cpu_ack;
+  bool     cpu_err;
+  uint32_t cpu_data_in;
+  int      cpu_ack_countdown;  // -1 if no request is being processed.
+};
+
+
+static model_registers regs;
+static bool previous_tck = false;
+static bool jtag_tdo = false;  // Changes on the falling edge of TCK.
+
+// Emulated CPU.
+static unsigned ack_latency = 4;      // In TCK cycles.
+static unsigned run_cycles  = 1000;   // How long the CPU runs after being unstalled, in TCK cycles, 0 means forever.
+static uint32_t memory_size = 8 * 1024 * 1024;
+static bool     is_cpu_stalled = false;
+static unsigned cpu_run_countdown = 0;
+static uint32_t write_mem_addr = 0;
+static unsigned write_mem_sel  = 0xF;
+
+// Whether the TAP implements the burst memory commands, and whether the CPU implements
+// the OR1200_DU_WRITE_MEM_SEL SPR. Older bitstreams do not. The CPUs without that SPR
+// do not increment the write address after each OR1200_DU_WRITE_MEM_DATA write either.
+static bool has_burst_cmds = true;
+static bool has_write_mem_sel = true;
+
+static std::map< uint16_t, uint32_t > spr_file;
+
+static const uint32_t MEMORY_PAGE_SIZE = 4096;
+static std::map< uint32_t, std::vector< uint8_t > > memory_pages;
+
+// Statistics.
+static uint64_t tck_cycle_count = 0;
+static uint64_t cpu_operation_count = 0;
+static uint64_t protocol_error_count = 0;
+
+
+static uint8_t * get_memory_byte ( const uint32_t addr )
+{
+  std::vector< uint8_t > & page = memory_pages[ addr / MEMORY_PAGE_SIZE ];
+
+  if ( page.empty() )
+    page.resize( MEMORY_PAGE_SIZE, 0 );
+
+  return &page[ addr % MEMORY_PAGE_SIZE ];
+}
+
+
+static bool is_valid_memory_word ( const uint32_t addr )
+{
+  return addr % 4 == 0 && addr < memory_size && memory_size - addr >= 4;
+}
+
+
+// The OpenRISC is big endian.
+
+static uint32_t read_memory_word ( const uint32_t addr )
+{
+  uint32_t val = 0;
+
+  for ( uint32_t i = 0; i < 4; ++i )
+    val = ( val << 8 ) | *get_memory_byte( addr + i );
+
+  return val;
+}
+
+
+static void write_memory_word ( const uint32_t addr, const uint32_t val, const unsigned sel )
+{
+  for ( uint32_t i = 0; i < 4; ++i )
+  {
+    if ( sel & ( 8 >> i ) )
+      *get_memory_byte( addr + i ) = uint8_t( val >> ( 24 - 8 * i ) );
+  }
+}
+
+
+static void reset_cpu ( void )
+{
+  spr_file.clear();
+  spr_file[ SPR_SR ] = SPR_SR_FO | SPR_SR_SM;
+
+  is_cpu_stalled    = false;
+  cpu_run_countdown = run_cycles;
+  write_mem_addr    = 0;
+  write_mem_sel     = 0xF;
+}
+
+
+// Emulates the CPU's handling of a debug interface request, see or10_top.v .
+
+static void execute_cpu_operation ( const bool we,
+                                    const uint16_t spr_number,
+                                    const uint32_t data,
+                                    uint32_t * const result,
+                                    bool * const err )
+{
+  ++cpu_operation_count;
+
+  *result = 0;
+  *err    = false;
+
+  if ( !we )
+  {
+    switch ( spr_number )
+    {
+    case SPR_DU_EDIS:
+      *result = is_cpu_stalled ? 1 : 0;
+      break;
+
+    case OR1200_DU_WRITE_MEM_ADDR:
+      *result = write_mem_addr;
+      break;
+
+    case OR1200_DU_WRITE_MEM_SEL:
+      if ( has_write_mem_sel )
+        *result = write_mem_sel;
+      else
+        *err = true;
+      break;
+
+    case OR1200_DU_WATCHPOINT_COUNT:
+      *result = 0;
+      break;
+
+    default:
+      {
+        const std::map< uint16_t, uint32_t >::const_iterator it = spr_file.find( spr_number );
+        *result = ( it == spr_file.end() ) ? 0 : it->second;
+        break;
+      }
+    }
+
+    return;
+  }
+
+  switch ( spr_number )
+  {
+  case SPR_DU_EDIS:
+    is_cpu_stalled = ( data & 1 ) != 0;
+
+    if ( !is_cpu_stalled )
+      cpu_run_countdown = run_cycles;
+    break;
+
+  case SPR_DU_READ_MEM_ADDR:
+    if ( is_valid_memory_word( data ) )
+      *result = read_memory_word( data );
+    else
+      *err = true;
+    break;
+
+  case OR1200_DU_WRITE_MEM_ADDR:
+    if ( data % 4 == 0 )
+      write_mem_addr = data;
+    else
+      *err = true;
+    break;
+
+  case OR1200_DU_WRITE_MEM_DATA:
+    if ( is_valid_memory_word( write_mem_addr ) )
+      write_memory_word( write_mem_addr, data, write_mem_sel );
+    else
+      *err = true;
+
+    // The byte mask only applies to a single write, and the address advances to the next word.
+    write_mem_sel = 0xF;
+
+    if ( has_write_mem_sel )
+      write_mem_addr += 4;
+    break;
+
+  case OR1200_DU_WRITE_MEM_SEL:
+    if ( has_write_mem_sel )
+      write_mem_sel = data & 0xF;
+    else
+      *err = true;
+    break;
+
+  default:
+    spr_file[ spr_number ] = data;
+    break;
+  }
+}
+
+
+static void reset_tap ( model_registers * const n )
+{
+  n->tap_state = TAP_STATE_TEST_LOGIC_RESET;
+  n->current_instruction = JTAG_INSTRUCTION_IDCODE;
+}
+
+
+static void stop_cpu_transaction ( model_registers * const n )
+{
+  n->cpu_stb = false;
+}
+
+
+static void reset_burst_state ( model_registers * const n )
+{
+  n->output_bits_left      = 0;
+  n->burst_cpu_ops_left    = 0;
+  n->burst_frames_left     = 0;
+  n->burst_write_addr_sent = false;
+  n->burst_failed          = false;
+  n->burst_overflow        = false;
+  n->burst_status_sent     = false;
+  n->burst_held_valid      = false;
+  n->burst_pending_valid   = false;
+  n->input_bits_left       = 0;
+}
+
+
+static void protocol_error ( const char * const msg )
+{
+  // The Verilog code stops the simulation here with ASSERT_FALSE.
+  ++protocol_error_count;
+  fprintf( stderr, "Model cable: %s\n", msg );
+}
+
+
+// The rising TCK edge for tap_or10.v, 'c' holds the current register values and 'n' the next ones.
+
+static void step_debug_unit ( const model_registers & c, model_registers * const n, const bool tdi )
+{
+  const bool is_shift_dr  = c.tap_state == TAP_STATE_SHIFT_DR;
+  const bool is_update_dr = c.tap_state == TAP_STATE_UPDATE_DR;
+  const bool synchronised_cpu_ack        = ( c.ack_synchroniser & 1 ) != 0;
+  const bool synchronised_cpu_is_stalled = ( c.is_stalled_synchroniser & 1 ) != 0;
+
+  uint64_t next_cmd = c.current_cmd;
+  cpu_state_enum next_cpu_state = c.cpu_state;
+
+  bool input_word_complete = false;
+  uint32_t input_word_value = 0;
+
+
+  // ------ step_state_machine_update ------
+
+  if ( is_update_dr )
+  {
+    if ( next_cpu_state != CPU_STATE_IDLE )
+      protocol_error( "Update-DR while a debug operation was still in progress." );
+
+    stop_cpu_transaction( n );
+
+    next_cmd = c.input_shift_reg;
+
+    reset_burst_state( n );
+
+    unsigned opcode = get_cmd_opcode( c.input_shift_reg );
+
+    // An older TAP does not know the burst commands and never delivers a result for them.
+    if ( !has_burst_cmds && is_burst_cmd( opcode ) )
+    {
+      next_cmd = 0;
+      opcode   = DEBUG_CMD_NOP;
+    }
+
+    switch ( opcode )
+    {
+    case DEBUG_CMD_NOP:
+      n->output_shift_reg = 0;
+      next_cpu_state = CPU_STATE_IDLE;
+      break;
+
+    case DEBUG_CMD_IS_CPU_STALLED:
+      n->output_shift_reg = synchronised_cpu_is_stalled ? 1 : 0;
+      next_cpu_state = CPU_STATE_IDLE;
+      break;
+
+    case DEBUG_CMD_READ_CPU_SPR:
+    case DEBUG_CMD_WRITE_CPU_SPR:
+      n->output_shift_reg = 0;  // Operation in progress.
+      next_cpu_state = CPU_STATE_WAITING_FOR_CPU_IDLE;
+      break;
+
+    case DEBUG_CMD_BURST_READ_MEM:
+    case DEBUG_CMD_BURST_WRITE_MEM:
+      n->output_shift_reg   = 0;
+      n->burst_addr         = get_cmd_value( c.input_shift_reg );
+      n->burst_cpu_ops_left = opcode == DEBUG_CMD_BURST_READ_MEM  ? get_cmd_spr( c.input_shift_reg ) : 0;
+      n->burst_frames_left  = opcode == DEBUG_CMD_BURST_WRITE_MEM ? get_cmd_spr( c.input_shift_reg ) : 0;
+      next_cpu_state = CPU_STATE_IDLE;
+      break;
+
+    default:
+      protocol_error( "Invalid debug command." );
+      n->output_shift_reg = 0;
+      next_cpu_state = CPU_STATE_IDLE;
+      break;
+    }
+  }
+
+
+  // ------ step_state_machine_shift ------
+
+  if ( is_shift_dr )
+  {
+    input_word_value = ( uint32_t( tdi ) << 31 ) | ( c.input_word >> 1 );
+
+    n->input_shift_reg = ( uint64_t( tdi ) << ( SHIFT_REG_LEN - 1 ) ) | ( c.input_shift_reg >> 1 );
+
+    if ( get_cmd_opcode( next_cmd ) == DEBUG_CMD_BURST_WRITE_MEM )
+    {
+      if ( c.input_bits_left == 0 )
+      {
+        if ( tdi && c.burst_frames_left != 0 )
+          n->input_bits_left = BURST_FRAME_LEN;
+      }
+      else
+      {
+        n->input_word      = input_word_value;
+        n->input_bits_left = c.input_bits_left - 1;
+
+        if ( c.input_bits_left == 1 )
+          input_word_complete = true;
+      }
+    }
+
+    n->output_shift_reg = c.output_shift_reg >> 1;
+
+    if ( c.output_bits_left != 0 )
+      n->output_bits_left = c.output_bits_left - 1;
+  }
+
+
+  // ------ step_state_machine_tick ------
+
+  const unsigned opcode = get_cmd_opcode( next_cmd );
+  const bool is_burst = is_burst_cmd( opcode );
+
+  bool is_output_free = c.output_bits_left == 0 || ( c.output_bits_left == 1 && is_shift_dr );
+  bool next_pending_valid = c.burst_pending_valid;
+  bool next_failed = c.burst_failed;
+
+  if ( c.burst_held_valid && is_output_free && !is_update_dr )
+  {
+    n->output_shift_reg = c.burst_held_frame;
+    n->output_bits_left = OUTPUT_REG_LEN;
+    n->burst_held_valid = false;
+    is_output_free = false;
+  }
+
+  switch ( next_cpu_state )
+  {
+  case CPU_STATE_IDLE:
+    if ( is_burst && !is_update_dr && !next_failed )
+    {
+      if ( opcode == DEBUG_CMD_BURST_READ_MEM )
+      {
+        if ( c.burst_cpu_ops_left != 0 && !c.burst_held_valid )
+        {
+          n->burst_cpu_ops_left = c.burst_cpu_ops_left - 1;
+          next_cpu_state = CPU_STATE_WAITING_FOR_CPU_IDLE;
+        }
+      }
+      else if ( !c.burst_write_addr_sent || c.burst_pending_valid )
+      {
+        next_cpu_state = CPU_STATE_WAITING_FOR_CPU_IDLE;
+      }
+    }
+    break;
+
+  case CPU_STATE_WAITING_FOR_CPU_IDLE:
+    if ( !is_burst )
+      n->output_shift_reg = 0;
+
+    if ( !synchronised_cpu_ack )
+    {
+      switch ( opcode )
+      {
+      case DEBUG_CMD_READ_CPU_SPR:
+        n->cpu_spr_number = get_cmd_spr( next_cmd );
+        n->cpu_we = false;
+        break;
+
+      case DEBUG_CMD_WRITE_CPU_SPR:
+        n->cpu_spr_number = get_cmd_spr( next_cmd );
+        n->cpu_data_out   = get_cmd_value( next_cmd );
+        n->cpu_we = true;
+        break;
+
+      case DEBUG_CMD_BURST_READ_MEM:
+        n->cpu_spr_number = SPR_DU_READ_MEM_ADDR;
+        n->cpu_data_out   = c.burst_addr;
+        n->cpu_we = true;
+        break;
+
+      case DEBUG_CMD_BURST_WRITE_MEM:
+        if ( !c.burst_write_addr_sent )
+        {
+          n->cpu_spr_number = OR1200_DU_WRITE_MEM_ADDR;
+          n->cpu_data_out   = c.burst_addr;
+        }
+        else
+        {
+          n->cpu_spr_number = OR1200_DU_WRITE_MEM_DATA;
+          n->cpu_data_out   = c.burst_pending_data;
+          next_pending_valid = false;
+        }
+
+        n->cpu_we = true;
+        break;
+
+      default:
+        protocol_error( "Invalid debug command while waiting for the CPU." );
+        break;
+      }
+
+      next_cpu_state = CPU_STATE_DATA_WRITTEN;
+    }
+    break;
+
+  case CPU_STATE_DATA_WRITTEN:
+    if ( !is_burst )
+      n->output_shift_reg = 0;
+
+    n->cpu_stb = true;
+    next_cpu_state = CPU_STATE_WAITING_FOR_ACK;
+    break;
+
+  case CPU_STATE_WAITING_FOR_ACK:
+    if ( !is_burst )
+      n->output_shift_reg = 0;
+
+    if ( synchronised_cpu_ack )
+    {
+      if ( is_burst )
+      {
+        if ( c.cpu_err )
+          next_failed = true;
+
+        if ( opcode == DEBUG_CMD_BURST_READ_MEM )
+        {
+          const uint64_t result_frame = c.cpu_err ? ( OPERATION_FAILED_FLAG | OPERATION_COMPLETE_FLAG )
+                                                  : ( ( uint64_t( c.cpu_data_in ) << 2 ) | OPERATION_COMPLETE_FLAG );
+          if ( is_output_free )
+          {
+            n->output_shift_reg = result_frame;
+            n->output_bits_left = OUTPUT_REG_LEN;
+            is_output_free = false;
+          }
+          else
+          {
+            n->burst_held_frame = result_frame;
+            n->burst_held_valid = true;
+          }
+
+          n->burst_addr = c.burst_addr + 4;
+        }
+        else
+        {
+          n->burst_write_addr_sent = true;
+        }
+      }
+      else if ( c.cpu_err )
+      {
+        n->output_shift_reg = OPERATION_FAILED_FLAG | OPERATION_COMPLETE_FLAG;
+      }
+      else
+      {
+        n->output_shift_reg = ( uint64_t( c.cpu_data_in ) << 2 ) | OPERATION_COMPLETE_FLAG;
+      }
+
+      next_cpu_state = CPU_STATE_IDLE;
+      stop_cpu_transaction( n );
+    }
+    break;
+  }
+
+  if ( opcode == DEBUG_CMD_BURST_WRITE_MEM && !is_update_dr )
+  {
+    if ( input_word_complete )
+    {
+      n->burst_frames_left = c.burst_frames_left - 1;
+
+      if ( next_pending_valid )
+      {
+        next_failed = true;
+        n->burst_overflow = true;
+      }
+      else if ( !next_failed )
+      {
+        next_pending_valid = true;
+        n->burst_pending_data = input_word_value;
+      }
+    }
+
+    if ( next_failed )
+      next_pending_valid = false;
+
+    if ( c.burst_frames_left == 0 &&
+         !input_word_complete &&
+         !next_pending_valid &&
+         next_cpu_state == CPU_STATE_IDLE &&
+         ( c.burst_write_addr_sent || next_failed ) &&
+         !c.burst_status_sent &&
+         is_output_free )
+    {
+      n->output_shift_reg  = ( c.burst_overflow ? BURST_OVERFLOW_FLAG   : 0 ) |
+                             ( next_failed      ? OPERATION_FAILED_FLAG : 0 ) |
+                             OPERATION_COMPLETE_FLAG;
+      n->output_bits_left  = 3;
+      n->burst_status_sent = true;
+    }
+  }
+
+  if ( !is_update_dr )
+  {
+    n->burst_pending_valid = next_pending_valid;
+    n->burst_failed        = next_failed;
+  }
+
+  n->current_cmd = next_cmd;
+  n->cpu_state   = next_cpu_state;
+}
+
+
+// The emulated CPU, it sees the debug interface signals from before the clock edge.
+
+static void step_cpu ( const model_registers & c, model_registers * const n )
+{
+  if ( !is_cpu_stalled && run_cycles != 0 )
+  {
+    if ( --cpu_run_countdown == 0 )
+    {
+      // Stop as if the CPU had hit a breakpoint.
+      is_cpu_stalled = true;
+      spr_file[ SPR_DRR ] |= SPR_DRR_TE;
+    }
+  }
+
+  if ( c.cpu_ack )
+  {
+    // The CPU waits for the strobe to go away before accepting the next request.
+    if ( !c.cpu_stb )
+      n->cpu_ack = false;
+
+    return;
+  }
+
+  if ( !c.cpu_stb )
+    return;
+
+  if ( c.cpu_ack_countdown < 0 )
+  {
+    n->cpu_ack_countdown = int( ack_latency );
+    return;
+  }
+
+  if ( c.cpu_ack_countdown > 0 )
+  {
+    n->cpu_ack_countdown = c.cpu_ack_countdown - 1;
+    return;
+  }
+
+  execute_cpu_operation( c.cpu_we, c.cpu_spr_number, c.cpu_data_out, &n->cpu_data_in, &n->cpu_err );
+  n->cpu_ack = true;
+  n->cpu_ack_countdown = -1;
+}
+
+
+// The rising TCK edge for tap_top.v .
+
+static void step_tap ( const model_registers & c, model_registers * const n, const bool tms, const bool tdi )
+{
+  switch ( c.tap_state )
+  {
+  case TAP_STATE_TEST_LOGIC_RESET:
+    reset_tap( n );
+    break;
+
+  case TAP_STATE_CAPTURE_IR:
+    n->jtag_ir = 0x5;  // Bits [1:0] must be "01" according to the JTAG specification.
+    break;
+
+  case TAP_STATE_UPDATE_IR:
+    n->current_instruction = c.jtag_ir;
+    break;
+
+  case TAP_STATE_SHIFT_IR:
+    n->jtag_ir = uint8_t( ( tdi ? 1 << ( IR_LENGTH - 1 ) : 0 ) | ( c.jtag_ir >> 1 ) );
+    break;
+
+  case TAP_STATE_CAPTURE_DR:
+    if ( c.current_instruction == JTAG_INSTRUCTION_IDCODE )
+      n->idcode_reg = OPENRISC_CPU_JTAG_IDCODE_VALUE;
+    else if ( c.current_instruction != JTAG_INSTRUCTION_DEBUG )
+      n->bypass_reg = false;
+    break;
+
+  case TAP_STATE_SHIFT_DR:
+    if ( c.current_instruction == JTAG_INSTRUCTION_IDCODE )
+      n->idcode_reg = ( tdi ? 0x80000000 : 0 ) | ( c.idcode_reg >> 1 );
+    else if ( c.current_instruction != JTAG_INSTRUCTION_DEBUG )
+      n->bypass_reg = tdi;
+    break;
+
+  default:
+    break;
+  }
+
+  n->tap_state = get_next_tap_state( c.tap_state, tms );
+}
+
+
+static void reset_other_device ( other_device * const d )
+{
+  d->current_instruction = OTHER_DEVICE_IR_IDCODE;
+}
+
+
+static void step_other_device ( const tap_state_enum state, other_device * const d, const bool tdi )
+{
+  const bool is_idcode = ( d->current_instruction == OTHER_DEVICE_IR_IDCODE );
+
+  switch ( state )
+  {
+  case TAP_STATE_TEST_LOGIC_RESET:
+    reset_other_device( d );
+    break;
+
+  case TAP_STATE_CAPTURE_IR:
+    d->ir = 0x01;  // Bits [1:0] must be "01" according to the JTAG specification.
+    break;
+
+  case TAP_STATE_SHIFT_IR:
+    d->ir = ( tdi ? 1 << ( OTHER_DEVICE_IR_LENGTH - 1 ) : 0 ) | ( d->ir >> 1 );
+    break;
+
+  case TAP_STATE_UPDATE_IR:
+    d->current_instruction = d->ir;
+    break;
+
+  case TAP_STATE_CAPTURE_DR:
+    d->dr = is_idcode ? d->idcode : 0;
+    break;
+
+  case TAP_STATE_SHIFT_DR:
+    d->dr = is_idcode ? ( ( tdi ? 0x80000000 : 0 ) | ( d->dr >> 1 ) )
+                      : ( tdi ? 1 : 0 );
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+// Each device in the chain samples the TDO value its predecessor drove on the last falling edge.
+
+static bool step_other_devices ( const tap_state_enum state,
+                                 std::vector< other_device > * const devices,
+                                 const bool tdi )
+{
+  bool chain_tdi = tdi;
+
+  for ( size_t i = 0; i < devices->size(); ++i )
+  {
+    other_device * const d = &(*devices)[ i ];
+    const bool d_tdo = d->tdo;
+
+    step_other_device( state, d, chain_tdi );
+
+    chain_tdi = d_tdo;
+  }
+
+  return chain_tdi;
+}
+
+
+static void update_other_devices_tdo ( std::vector< other_device > * const devices )
+{
+  for ( size_t i = 0; i < devices->size(); ++i )
+  {
+    other_device * const d = &(*devices)[ i ];
+    d->tdo = ( ( regs.tap_state == TAP_STATE_SHIFT_IR ? d->ir : d->dr ) & 1 ) != 0;
+  }
+}
+
+
+static void init_other_devices ( std::vector< other_device > * const devices,
+                                 const unsigned count,
+                                 const unsigned first_idcode_index )
+{
+  devices->assign( count, other_device() );
+
+  for ( unsigned i = 0; i < count; ++i )
+  {
+    other_device * const d = &(*devices)[ i ];
+    d->idcode = OTHER_DEVICE_IDCODE_BASE + ( first_idcode_index + i ) * OTHER_DEVICE_IDCODE_STEP;
+    reset_other_device( d );
+  }
+}
+
+
+static void tck_posedge ( const bool tms, const bool tdi_from_cable )
+{
+  ++tck_cycle_count;
+
+  // The devices after the OR10 TAP sample its TDO value before this clock edge changes it.
+  step_other_devices( regs.tap_state, &devices_after_tap, jtag_tdo );
+
+  const bool tdi = step_other_devices( regs.tap_state, &devices_before_tap, tdi_from_cable );
+
+  const model_registers & c = regs;
+  model_registers n = regs;
+
+  if ( c.tap_state == TAP_STATE_TEST_LOGIC_RESET || c.current_instruction != JTAG_INSTRUCTION_DEBUG )
+  {
+    n.cpu_state       = CPU_STATE_IDLE;
+    n.input_shift_reg = 0;
+    n.current_cmd     = 0;
+    stop_cpu_transaction( &n );
+    reset_burst_state( &n );
+  }
+  else
+  {
+    step_debug_unit( c, &n, tdi );
+  }
+
+  step_cpu( c, &n );
+
+  n.ack_synchroniser        = ( c.ack_synchroniser >> 1 ) | ( c.cpu_ack ? 2 : 0 );
+  n.is_stalled_synchroniser = ( c.is_stalled_synchroniser >> 1 ) | ( is_cpu_stalled ? 2 : 0 );
+
+  step_tap( c, &n, tms, tdi );
+
+  regs = n;
+}
+
+
+static void tck_negedge ( void )
+{
+  if ( regs.tap_state == TAP_STATE_SHIFT_IR )
+    jtag_tdo = ( regs.jtag_ir & 1 ) != 0;
+  else if ( regs.current_instruction == JTAG_INSTRUCTION_IDCODE )
+    jtag_tdo = ( regs.idcode_reg & 1 ) != 0;
+  else if ( regs.current_instruction == JTAG_INSTRUCTION_DEBUG )
+    jtag_tdo = ( regs.output_shift_reg & 1 ) != 0;
+  else
+    jtag_tdo = regs.bypass_reg;
+
+  update_other_devices_tdo( &devices_before_tap );
+  update_other_devices_tdo( &devices_after_tap );
+}
+
+
+// The TDO value the cable sees at the end of the chain.
+
+static bool get_chain_tdo ( void )
+{
+  return devices_after_tap.empty() ? jtag_tdo : devices_after_tap.back().tdo;
+}
+
+
+static int cable_model_init ( void )
+{
+  memset( &regs, 0, sizeof( regs ) );
+  reset_tap( &regs );
+  regs.cpu_state = CPU_STATE_IDLE;
+  regs.cpu_ack_countdown = -1;
+
+  previous_tck = false;
+  jtag_tdo = false;
+
+  // Each device gets a different IDCODE.
+  init_other_devices( &devices_after_tap , device_count_after_tap, 0 );
+  init_other_devices( &devices_before_tap, device_count_before_tap, device_count_after_tap );
+
+  memory_pages.clear();
+  reset_cpu();
+
+  tck_cycle_count = 0;
+  cpu_operation_count = 0;
+  protocol_error_count = 0;
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_model_out ( const uint8_t value )
+{
+  const bool tck = ( value & TCLK_BIT ) != 0;
+
+  if ( ( value & TRST_BIT ) == 0 )
+  {
+    // The asynchronous reset only affects tap_top.v directly.
+    reset_tap( &regs );
+
+    for ( size_t i = 0; i < devices_before_tap.size(); ++i )
+      reset_other_device( &devices_before_tap[ i ] );
+
+    for ( size_t i = 0; i < devices_after_tap.size(); ++i )
+      reset_other_device( &devices_after_tap[ i ] );
+  }
+  else if ( tck && !previous_tck )
+  {
+    tck_posedge( ( value & TMS_BIT ) != 0, ( value & TDI_BIT ) != 0 );
+  }
+  else if ( !tck && previous_tck )
+  {
+    tck_negedge();
+  }
+
+  previous_tck = tck;
+
+  return APP_ERR_NONE;
+}
+
+
+// Like the 'vpi' cable, TDO is sampled before the new pin state is applied.
+
+static int cable_model_inout ( const uint8_t value, uint8_t * const inval )
+{
+  *inval = get_chain_tdo() ? 1 : 0;
+
+  return cable_model_out( value );
+}
+
+
+static int cable_model_out_block ( const uint8_t * const values, const int count )
+{
+  for ( int i = 0; i < count; ++i )
+    cable_model_out( values[ i ] );
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_model_opt ( const int c, const char * const str )
+{
+  // Options without an argument get a NULL string.
+  const long val = str == NULL ? 0 : atol( str );
+
+  switch ( c )
+  {
+  case 'l':
+    if ( val < 0 )
+    {
+      fprintf( stderr, "Bad ack latency for the model cable: %s\n", str );
+      return APP_ERR_BAD_PARAM;
+    }
+
+    ack_latency = unsigned( val );
+    break;
+
+  case 'r':
+    if ( val < 0 )
+    {
+      fprintf( stderr, "Bad run cycle count for the model cable: %s\n", str );
+      return APP_ERR_BAD_PARAM;
+    }
+
+    run_cycles = unsigned( val );
+    break;
+
+  case 'm':
+    if ( val <= 0 )
+    {
+      fprintf( stderr, "Bad memory size for the model cable: %s\n", str );
+      return APP_ERR_BAD_PARAM;
+    }
+
+    memory_size = uint32_t( val );
+    break;
+
+  case 'b':
+  case 'a':
+    if ( val < 0 || val > 64 )
+    {
+      fprintf( stderr, "Bad device count for the model cable: %s\n", str );
+      return APP_ERR_BAD_PARAM;
+    }
+
+    if ( c == 'b' )
+      device_count_before_tap = unsigned( val );
+    else
+      device_count_after_tap = unsigned( val );
+    break;
+
+  case 'n':
+    has_burst_cmds = false;
+    break;
+
+  case 's':
+    has_write_mem_sel = false;
+    break;
+
+  default:
+    fprintf( stderr, "Unknown parameter '%c'\n", c );
+    return APP_ERR_BAD_PARAM;
+  }
+
+  return APP_ERR_NONE;
+}
+
+
+static void cable_model_close ( void )
+{
+  printf( "Model cable: %" PRIu64 " TCK cycles, %" PRIu64 " CPU debug operations, %" PRIu64 " protocol errors.\n",
+          tck_cycle_count, cpu_operation_count, protocol_error_count );
+}
+
+
+jtag_cable_t * cable_model_get_driver ( void )
+{
+  if ( was_model_cable_driver_initialised )
+  {
+    // I think this routine gets called only once at the moment.
+    assert( false );
+  }
+  else
+  {
+    model_cable_driver.name = "model";
+    model_cable_driver.inout_func = cable_model_inout;
+    model_cable_driver.out_func = cable_model_out;
+    model_cable_driver.out_block_func = cable_model_out_block;
+    model_cable_driver.init_func = cable_model_init;
+    model_cable_driver.opt_func = cable_model_opt;
+    model_cable_driver.bit_out_func = cable_common_write_bit;
+    model_cable_driver.bit_inout_func = cable_common_read_write_bit;
+    model_cable_driver.stream_out_func = cable_common_write_stream;
+    model_cable_driver.stream_inout_func = cable_common_read_stream;
+    model_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
+    model_cable_driver.close_func = cable_model_close;
+    model_cable_driver.opts = "l:r:m:b:a:ns";
+    model_cable_driver.help = "\t-l [cycles] TCK cycles the emulated CPU takes to answer a debug request (default 4)\n"
+                              "\t-r [cycles] TCK cycles the CPU runs after being unstalled before it stops again, 0 means forever (default 1000)\n"
+                              "\t-m [bytes]  Emulated memory size (default 8 MiB)\n"
+                              "\t-b [count]  Other devices in the JTAG chain between the cable data output and the OR10 TAP (default 0)\n"
+                              "\t-a [count]  Other devices in the JTAG chain between the OR10 TAP and the cable data input (default 0)\n"
+                              "\t            These devices have an 8-bit IR and only implement IDCODE (0x01) and BYPASS.\n"
+                              "\t-n          Emulate an older OR10 TAP without the burst memory commands\n"
+                              "\t-s          Emulate an older CPU without the OR1200_DU_WRITE_MEM_SEL SPR\n"
+                              "\t            and without the write address auto-increment\n";
+
+    was_model_cable_driver_initialised = true;
+  }
+
+  return &model_cable_driver;
+}
@@ -0,0 +1,8 @@
+#ifndef CABLE_MODEL_H_INCLUDED
+#define CABLE_MODEL_H_INCLUDED
+
+#include "cable_driver_common.h"
+
+jtag_cable_t * cable_model_get_driver ( void );
+
+#endif
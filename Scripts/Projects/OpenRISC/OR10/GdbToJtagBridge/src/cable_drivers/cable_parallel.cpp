@@ -366,6 +366,7 @@ jtag_cable_t *cable_xpc3_get_driver(void)
     xpc3_cable_driver.bit_inout_func = cable_common_read_write_bit;
     xpc3_cable_driver.stream_out_func = cable_common_write_stream;
     xpc3_cable_driver.stream_inout_func = cable_common_read_stream;
+    xpc3_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
     xpc3_cable_driver.flush_func = NULL;
 #ifdef __CYGWIN_HOST__
     xpc3_cable_driver.opts = "p:";
@@ -445,6 +446,7 @@ jtag_cable_t *cable_bb2_get_driver(void)
     bb2_cable_driver.bit_inout_func = cable_common_read_write_bit;
     bb2_cable_driver.stream_out_func = cable_common_write_stream;
     bb2_cable_driver.stream_inout_func = cable_common_read_stream;
+    bb2_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
     bb2_cable_driver.flush_func = NULL;
 #ifdef __CYGWIN_HOST__
     bb2_cable_driver.opts = "p:";
@@ -518,6 +520,7 @@ jtag_cable_t *cable_xess_get_driver(void)
     xess_cable_driver.bit_inout_func = cable_common_read_write_bit;
     xess_cable_driver.stream_out_func = cable_common_write_stream;
     xess_cable_driver.stream_inout_func = cable_common_read_stream;
+    xess_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
     xess_cable_driver.flush_func = NULL;
 #ifdef __CYGWIN_HOST__
     xess_cable_driver.opts = "p:";
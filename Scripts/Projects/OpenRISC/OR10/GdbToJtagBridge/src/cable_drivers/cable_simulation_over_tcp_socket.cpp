@@ -34,6 +34,8 @@
 #include <assert.h>
 
 #include <stdexcept>
+#include <algorithm>
+#include <vector>
 
 #include "errcodes.h"
 #include "string_utils.h"
@@ -50,6 +52,22 @@ static in_port_t tcp_port = 4567;
 static std::string remote_hostname = "localhost";
 
 
+// Stream protocol, see OR10/TestBench/jtag_stream_dpi.cpp for a description.
+// These values must match the ones in the simulation-side server.
+static const uint8_t CMD_STREAM = 0x82;
+static const uint8_t STREAM_FLAG_READ_TDO = 0x01;
+static const uint8_t STREAM_BANNER[] = { 0xA5, 'J', 'S', 0x01 };
+static const int MAX_STREAM_FRAME_BITS = 4096;
+
+// Write-only frames are not answered, so they can wait here until the next read or flush.
+static const size_t MAX_PENDING_STREAM_BYTES = 64 * 1024;
+
+static bool use_stream_protocol = false;
+static std::vector< uint8_t > stream_send_buffer;
+
+static void negotiate_protocol ( void );
+
+
 static int cable_vpi_init ( void )
 {
   assert( connection_socket < 0 );
@@ -91,6 +109,8 @@ static int cable_vpi_init ( void )
 
   printf( "OK\n" );
 
+  negotiate_protocol();
+
   return APP_ERR_NONE;
 }
 
@@ -110,6 +130,34 @@ static void send_one_byte ( const uint8_t data )
 }
 
 
+static void receive_bytes ( uint8_t * const buffer, const size_t byte_count )
+{
+  assert( connection_socket != -1 );
+
+  size_t received = 0;
+
+  while ( received < byte_count )
+  {
+    const ssize_t res = read( connection_socket, buffer + received, byte_count - received );
+
+    if ( res == -1 )
+    {
+      const int errno_code = errno;
+
+      if ( errno_code == EINTR || errno_code == EAGAIN )
+        continue;
+
+      throw std::runtime_error( format_errno_msg( errno_code, "Error reading from the JTAG socket: " ) );
+    }
+
+    if ( res == 0 )
+      throw std::runtime_error( "Error reading from the JTAG socket: The remote server closed the connection." );
+
+    received += size_t( res );
+  }
+}
+
+
 static uint8_t receive_one_byte ( void )
 {
   assert( connection_socket != -1 );
@@ -131,6 +179,110 @@ static uint8_t receive_one_byte ( void )
 }
 
 
+// Servers that support the stream protocol send a banner as soon as they accept the connection.
+// Older servers never send anything on their own, so ask for the TDO value, which every server answers.
+// If the first byte received is not the start of the banner, then it was that answer.
+
+static void negotiate_protocol ( void )
+{
+  send_one_byte( 0x80 );
+
+  const uint8_t first = receive_one_byte();
+
+  if ( first != STREAM_BANNER[0] )
+  {
+    if ( first > 1 )
+      fprintf( stderr, "Unexpected value: %i\n", first );
+
+    printf( "The remote JTAG server does not support the stream protocol, falling back to the per-bit protocol.\n" );
+    use_stream_protocol = false;
+    return;
+  }
+
+  for ( size_t i = 1; i < sizeof( STREAM_BANNER ); ++i )
+  {
+    if ( receive_one_byte() != STREAM_BANNER[i] )
+      throw std::runtime_error( "The remote JTAG server sent an invalid protocol banner." );
+  }
+
+  receive_one_byte();  // The answer to the TDO request.
+
+  use_stream_protocol = true;
+}
+
+
+static void send_pending_stream_frames ( void )
+{
+  if ( stream_send_buffer.empty() )
+    return;
+
+  try
+  {
+    write_loop( connection_socket, &stream_send_buffer[0], stream_send_buffer.size() );
+  }
+  catch ( const std::exception & e )
+  {
+    stream_send_buffer.clear();
+    throw std::runtime_error( format_msg( "Error writing to the JTAG socket: %s", e.what() ) );
+  }
+
+  stream_send_buffer.clear();
+}
+
+
+static uint8_t get_stream_byte ( const uint32_t * const stream, const int first_bit )
+{
+  assert( first_bit % 8 == 0 );
+  return uint8_t( stream[ first_bit / 32 ] >> ( first_bit % 32 ) );
+}
+
+
+// Frame layout: command, flags, 16-bit bit count (little endian),
+// then the TDI bits and the TMS bits, each packed LSB first and padded to a whole byte.
+// The first bit must be at a byte boundary in the streams.
+
+static void append_stream_frame ( const uint32_t * const tdi_stream,  // NULL means TDI is held low.
+                                  const uint32_t * const tms_stream,  // NULL means TMS is held low.
+                                  const int first_bit,
+                                  const int bit_count,
+                                  const bool set_last_tms,
+                                  const bool read_tdo )
+{
+  assert( bit_count > 0 && bit_count <= MAX_STREAM_FRAME_BITS );
+
+  const int byte_count = ( bit_count + 7 ) / 8;
+  const uint8_t last_bit_mask = uint8_t( 1 << ( ( bit_count - 1 ) % 8 ) );
+  const uint8_t last_byte_mask = uint8_t( ( last_bit_mask << 1 ) - 1 );
+
+  stream_send_buffer.push_back( CMD_STREAM );
+  stream_send_buffer.push_back( read_tdo ? STREAM_FLAG_READ_TDO : 0 );
+  stream_send_buffer.push_back( uint8_t( bit_count ) );
+  stream_send_buffer.push_back( uint8_t( bit_count >> 8 ) );
+
+  const size_t tdi_pos = stream_send_buffer.size();
+  const size_t tms_pos = tdi_pos + byte_count;
+  stream_send_buffer.resize( tms_pos + byte_count, 0 );
+
+  for ( int i = 0; i < byte_count; ++i )
+  {
+    if ( tdi_stream != NULL )
+      stream_send_buffer[ tdi_pos + i ] = get_stream_byte( tdi_stream, first_bit + i * 8 );
+
+    if ( tms_stream != NULL )
+      stream_send_buffer[ tms_pos + i ] = get_stream_byte( tms_stream, first_bit + i * 8 );
+  }
+
+  stream_send_buffer[ tdi_pos + byte_count - 1 ] &= last_byte_mask;
+  stream_send_buffer[ tms_pos + byte_count - 1 ] &= last_byte_mask;
+
+  if ( set_last_tms )
+    stream_send_buffer[ tms_pos + byte_count - 1 ] |= last_bit_mask;
+
+  if ( !read_tdo && stream_send_buffer.size() >= MAX_PENDING_STREAM_BYTES )
+    send_pending_stream_frames();
+}
+
+
 static void cable_vpi_wait ( void )
 {
   // Get the sim to reply when the timeout has been reached.
@@ -146,6 +298,8 @@ static void cable_vpi_wait ( void )
 
 static int cable_vpi_out ( const uint8_t value )
 {
+  send_pending_stream_frames();
+
   send_one_byte( value );
 
   uint8_t ack;
@@ -161,8 +315,63 @@ static int cable_vpi_out ( const uint8_t value )
 }
 
 
+// Sends many pin states without waiting for each acknowledge in turn. The remote server processes
+// the socket data in order, so all requests can go out in a single write, and then all acknowledges
+// are collected. The chunk size limits how much data is in flight, so that neither side blocks
+// because the socket buffer in the other direction is full.
+
+static int cable_vpi_out_block ( const uint8_t * const values, const int count )
+{
+  const int MAX_VALUES_PER_CHUNK = 256;
+  uint8_t requests[ MAX_VALUES_PER_CHUNK * 2 ];
+
+  send_pending_stream_frames();
+
+  for ( int first = 0; first < count; first += MAX_VALUES_PER_CHUNK )
+  {
+    const int chunk_len = std::min( count - first, MAX_VALUES_PER_CHUNK );
+
+    for ( int i = 0; i < chunk_len; ++i )
+    {
+      requests[ i * 2     ] = values[ first + i ];
+      requests[ i * 2 + 1 ] = 0x81;  // Get the sim to reply when the timeout has been reached, see cable_vpi_wait().
+    }
+
+    try
+    {
+      write_loop( connection_socket, requests, chunk_len * 2 );
+    }
+    catch ( const std::exception & e )
+    {
+      throw std::runtime_error( format_msg( "Error writing to the JTAG socket: %s", e.what() ) );
+    }
+
+    for ( int i = 0; i < chunk_len; ++i )
+    {
+      const uint8_t value = values[ first + i ];
+
+      uint8_t ack;
+      do
+      {
+        ack = receive_one_byte();
+
+      } while(ack != (value | 0x10));
+
+      const uint8_t data_in = receive_one_byte();
+
+      if(data_in != 0xFF)
+        fprintf(stderr, "Warning: got wrong byte waiting for timeout: 0x%X\n", data_in);
+    }
+  }
+
+  return APP_ERR_NONE;
+}
+
+
 static int cable_vpi_inout ( const uint8_t value, uint8_t * const inval )
 {
+  send_pending_stream_frames();
+
   // Ask the remote VPI/DPI server to send us the out-bit.
   send_one_byte( 0x80 );
 
@@ -183,6 +392,121 @@ static int cable_vpi_inout ( const uint8_t value, uint8_t * const inval )
 }
 
 
+// With the stream protocol, the routines below send whole bit sequences in one frame,
+// instead of 2 pin states per bit, each with its own round trip. TRST cannot be driven
+// with the stream protocol, so such bits still go through the per-bit protocol.
+
+static int cable_vpi_write_bit ( const uint8_t packet )
+{
+  if ( !use_stream_protocol || ( packet & TRST ) )
+    return cable_common_write_bit( packet );
+
+  const uint32_t tdi = ( packet & TDO ) ? 1 : 0;
+  const uint32_t tms = ( packet & TMS ) ? 1 : 0;
+
+  append_stream_frame( &tdi, &tms, 0, 1, false, false );
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_vpi_read_write_bit ( const uint8_t packet_out, uint8_t * const bit_in )
+{
+  if ( !use_stream_protocol || ( packet_out & TRST ) )
+    return cable_common_read_write_bit( packet_out, bit_in );
+
+  const uint32_t tdi = ( packet_out & TDO ) ? 1 : 0;
+  const uint32_t tms = ( packet_out & TMS ) ? 1 : 0;
+
+  append_stream_frame( &tdi, &tms, 0, 1, false, true );
+  send_pending_stream_frames();
+
+  uint8_t reply;
+  receive_bytes( &reply, 1 );
+  *bit_in = reply & 1;
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_vpi_write_stream ( const uint32_t * const stream,
+                                    const int len_bits,
+                                    const int set_last_bit )
+{
+  if ( !use_stream_protocol )
+    return cable_common_write_stream( stream, len_bits, set_last_bit );
+
+  for ( int first = 0; first < len_bits; first += MAX_STREAM_FRAME_BITS )
+  {
+    const int count = std::min( len_bits - first, MAX_STREAM_FRAME_BITS );
+
+    append_stream_frame( stream, NULL, first, count, set_last_bit && first + count == len_bits, false );
+  }
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_vpi_read_stream ( const uint32_t * const outstream,
+                                   uint32_t * const instream,
+                                   const int len_bits,
+                                   const int set_last_bit )
+{
+  if ( !use_stream_protocol )
+    return cable_common_read_stream( outstream, instream, len_bits, set_last_bit );
+
+  // All frames go out together, and then all answers are collected.
+
+  for ( int first = 0; first < len_bits; first += MAX_STREAM_FRAME_BITS )
+  {
+    const int count = std::min( len_bits - first, MAX_STREAM_FRAME_BITS );
+
+    append_stream_frame( outstream, NULL, first, count, set_last_bit && first + count == len_bits, true );
+  }
+
+  send_pending_stream_frames();
+
+  memset( instream, 0, ( ( len_bits + 31 ) / 32 ) * sizeof( uint32_t ) );
+
+  uint8_t reply[ MAX_STREAM_FRAME_BITS / 8 ];
+
+  for ( int first = 0; first < len_bits; first += MAX_STREAM_FRAME_BITS )
+  {
+    const int count = std::min( len_bits - first, MAX_STREAM_FRAME_BITS );
+    const int byte_count = ( count + 7 ) / 8;
+
+    receive_bytes( reply, byte_count );
+
+    // Works for either endian.
+    for ( int i = 0; i < byte_count; ++i )
+    {
+      const int bit_pos = first + i * 8;
+      instream[ bit_pos / 32 ] |= uint32_t( reply[i] ) << ( bit_pos % 32 );
+    }
+  }
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_vpi_write_tms_sequence ( const uint32_t tms_bits, const int bit_count )
+{
+  if ( !use_stream_protocol )
+    return cable_common_write_tms_sequence( tms_bits, bit_count );
+
+  append_stream_frame( NULL, &tms_bits, 0, bit_count, false, false );
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_vpi_flush ( void )
+{
+  send_pending_stream_frames();
+  return APP_ERR_NONE;
+}
+
+
 static int cable_vpi_opt ( const int c, const char * const str )
 {
   switch(c)
@@ -214,6 +538,8 @@ static int cable_vpi_opt ( const int c, const char * const str )
 
 static void cable_vpi_close ( void )
 {
+  stream_send_buffer.clear();
+
   if ( connection_socket != -1 )
     close_a( connection_socket );
 }
@@ -231,13 +557,15 @@ jtag_cable_t * cable_vpi_get_driver ( void )
     vpi_cable_driver.name = "vpi";
     vpi_cable_driver.inout_func = cable_vpi_inout;
     vpi_cable_driver.out_func = cable_vpi_out;
+    vpi_cable_driver.out_block_func = cable_vpi_out_block;
     vpi_cable_driver.init_func = cable_vpi_init;
     vpi_cable_driver.opt_func = cable_vpi_opt;
-    vpi_cable_driver.bit_out_func = cable_common_write_bit;
-    vpi_cable_driver.bit_inout_func = cable_common_read_write_bit;
-    vpi_cable_driver.stream_out_func = cable_common_write_stream;
-    vpi_cable_driver.stream_inout_func = cable_common_read_stream;
-    vpi_cable_driver.flush_func = NULL;
+    vpi_cable_driver.bit_out_func = cable_vpi_write_bit;
+    vpi_cable_driver.bit_inout_func = cable_vpi_read_write_bit;
+    vpi_cable_driver.stream_out_func = cable_vpi_write_stream;
+    vpi_cable_driver.stream_inout_func = cable_vpi_read_stream;
+    vpi_cable_driver.tms_sequence_func = cable_vpi_write_tms_sequence;
+    vpi_cable_driver.flush_func = cable_vpi_flush;
     vpi_cable_driver.close_func = cable_vpi_close;
     vpi_cable_driver.opts = "s:p:";
     vpi_cable_driver.help = "\t-s [server] Server name/address the remote JTAG VPI/DPI module is listening on\n"
@@ -31,8 +31,18 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <assert.h>
 
+#include <stdexcept>
+#include <string>
+
+#include "jtag_shm_ring.h"
 #include "errcodes.h"
+#include "string_utils.h"
+#include "linux_utils.h"
 
 #define debug(...) //fprintf(stderr, __VA_ARGS__ )
 
@@ -43,11 +53,207 @@ static const char *gdb_in  = "gdb_in.dat";
 static const char *gdb_out = "gdb_out.dat";
 
 
+// Shared-memory mode, see jtag_shm_ring.h . Instead of exchanging every bit through the gdb_in.dat
+// and gdb_out.dat files, pin states are queued in a ring buffer, and only TDO reads wait for the simulator.
+
+static std::string shm_filename;  // If empty, the file-based protocol is used.
+static jtag_shm_layout * shm = NULL;
+
+static uint32_t shm_cmd_head = 0;         // Not yet visible to the simulator until published.
+static uint32_t shm_cmd_tail_cache = 0;   // The last cmd_tail value seen.
+static uint32_t shm_rsp_tail = 0;
+static uint32_t shm_pending_reads = 0;    // TDO reads queued but not collected yet.
+
+static const unsigned SHM_WAIT_TIMEOUT_MS = 1000;
+static const unsigned SHM_MAX_WAIT_TIMEOUT_COUNT = 60;  // Give up if the simulator makes no progress for about a minute.
+
+
+static void shm_open ( void )
+{
+  const int fd = open( shm_filename.c_str(), O_RDWR | O_CREAT, 0666 );
+
+  if ( fd == -1 )
+    throw std::runtime_error( format_errno_msg( errno, "Cannot open the JTAG shared memory file \"%s\": ", shm_filename.c_str() ) );
+
+  if ( 0 != ftruncate( fd, sizeof( jtag_shm_layout ) ) )
+  {
+    const int saved_errno = errno;
+    close_a( fd );
+    throw std::runtime_error( format_errno_msg( saved_errno, "Cannot set the size of the JTAG shared memory file: " ) );
+  }
+
+  void * const addr = mmap( NULL, sizeof( jtag_shm_layout ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  const int mmap_errno = errno;
+
+  // The mapping remains valid after closing the file descriptor.
+  close_a( fd );
+
+  if ( addr == MAP_FAILED )
+    throw std::runtime_error( format_errno_msg( mmap_errno, "Cannot map the JTAG shared memory file: " ) );
+
+  shm = static_cast< jtag_shm_layout * >( addr );
+
+  // The simulator may still have the file mapped from a previous session, so invalidate it first.
+  jtag_shm_store( &shm->magic, 0 );
+
+  shm->version = JTAG_SHM_VERSION;
+  jtag_shm_store( &shm->cmd_head.value, 0 );
+  jtag_shm_store( &shm->cmd_head.is_waiting, 0 );
+  jtag_shm_store( &shm->cmd_tail.value, 0 );
+  jtag_shm_store( &shm->cmd_tail.is_waiting, 0 );
+  jtag_shm_store( &shm->rsp_head.value, 0 );
+  jtag_shm_store( &shm->rsp_head.is_waiting, 0 );
+  jtag_shm_store( &shm->session, jtag_shm_load( &shm->session ) + 1 );
+
+  jtag_shm_store( &shm->magic, JTAG_SHM_MAGIC );
+
+  shm_cmd_head = 0;
+  shm_cmd_tail_cache = 0;
+  shm_rsp_tail = 0;
+  shm_pending_reads = 0;
+}
+
+
+// Waits until the index no longer has the given value. Throws if the simulator makes no progress
+// for too long, for example because it has been stopped or has crashed.
+
+static uint32_t shm_wait_for_change ( jtag_shm_index * const index,
+                                      const uint32_t old_value,
+                                      const char * const what )
+{
+  for ( unsigned i = 0; i < SHM_MAX_WAIT_TIMEOUT_COUNT; ++i )
+  {
+    const uint32_t value = jtag_shm_wait_for_change( index, old_value, SHM_WAIT_TIMEOUT_MS );
+
+    if ( value != old_value )
+      return value;
+  }
+
+  throw std::runtime_error( format_msg( "Timeout waiting for the simulator to %s.", what ) );
+}
+
+
+static void shm_publish_commands ( void )
+{
+  jtag_shm_store( &shm->cmd_head.value, shm_cmd_head );
+}
+
+
+static void shm_put_command ( const uint8_t cmd )
+{
+  while ( shm_cmd_head - shm_cmd_tail_cache == JTAG_SHM_CMD_RING_SIZE )
+  {
+    shm_cmd_tail_cache = jtag_shm_load( &shm->cmd_tail.value );
+
+    if ( shm_cmd_head - shm_cmd_tail_cache != JTAG_SHM_CMD_RING_SIZE )
+      break;
+
+    // The ring is full, let the simulator see everything and wait until it makes some room.
+    shm_publish_commands();
+    shm_cmd_tail_cache = shm_wait_for_change( &shm->cmd_tail, shm_cmd_tail_cache, "make room in the command ring" );
+  }
+
+  shm->cmd_ring[ shm_cmd_head % JTAG_SHM_CMD_RING_SIZE ] = cmd;
+  ++shm_cmd_head;
+
+  if ( cmd & JTAG_SHM_CMD_READ_TDO )
+    ++shm_pending_reads;
+}
+
+
+// Waits for the oldest pending TDO value. The commands must have been published beforehand.
+
+static uint8_t shm_get_response ( void )
+{
+  assert( shm_pending_reads > 0 );
+
+  uint32_t rsp_head = jtag_shm_load( &shm->rsp_head.value );
+
+  while ( rsp_head == shm_rsp_tail )
+    rsp_head = shm_wait_for_change( &shm->rsp_head, rsp_head, "deliver a TDO value" );
+
+  const uint8_t val = shm->rsp_ring[ shm_rsp_tail % JTAG_SHM_RSP_RING_SIZE ];
+  ++shm_rsp_tail;
+  --shm_pending_reads;
+
+  return val;
+}
+
+
+static int shm_read_stream ( const uint32_t * const outstream,
+                             uint32_t * const instream,
+                             const int len_bits,
+                             const int set_last_bit )
+{
+  assert( shm_pending_reads == 0 );
+
+  const int word_count = ( len_bits + 31 ) / 32;
+
+  for ( int i = 0; i < word_count; ++i )
+    instream[ i ] = 0;
+
+  int collected = 0;
+
+  for ( int i = 0; i < len_bits; ++i )
+  {
+    uint8_t pins = JTAG_SHM_PIN_TRST;  // TRST inactive.
+
+    if ( ( outstream[ i / 32 ] >> ( i % 32 ) ) & 1 )
+      pins |= JTAG_SHM_PIN_TDI;
+
+    if ( i == len_bits - 1 && set_last_bit )
+      pins |= JTAG_SHM_PIN_TMS;
+
+    // Like cable_common_read_write_bit(): drop the clock with the new data, and sample TDO before raising it.
+    shm_put_command( pins );
+    shm_put_command( pins | JTAG_SHM_PIN_TCK | JTAG_SHM_CMD_READ_TDO );
+
+    if ( shm_pending_reads == JTAG_SHM_RSP_RING_SIZE || i == len_bits - 1 )
+    {
+      shm_publish_commands();
+
+      while ( shm_pending_reads > 0 )
+      {
+        if ( shm_get_response() )
+          instream[ collected / 32 ] |= uint32_t( 1 ) << ( collected % 32 );
+
+        ++collected;
+      }
+    }
+  }
+
+  assert( collected == len_bits );
+
+  return APP_ERR_NONE;
+}
+
+
+// Waits until the simulator has executed all queued commands.
+
+static void shm_wait_until_idle ( void )
+{
+  shm_publish_commands();
+
+  uint32_t tail = jtag_shm_load( &shm->cmd_tail.value );
+
+  while ( tail != shm_cmd_head )
+    tail = shm_wait_for_change( &shm->cmd_tail, tail, "execute the queued commands" );
+
+  shm_cmd_tail_cache = tail;
+}
+
+
 
 /*-------------------------------------------[ rtl_sim specific functions ]---*/
 
 static int cable_rtl_sim_init()
 {
+  if ( !shm_filename.empty() )
+  {
+    shm_open();
+    return APP_ERR_NONE;
+  }
+
   FILE *fin = fopen (gdb_in, "wt+");
   if(!fin) {
     fprintf(stderr, "Can not open %s\n", gdb_in);
@@ -63,6 +269,14 @@ static int cable_rtl_sim_out(uint8_t value)
   int num_read;
   int r;
   debug("O (%x)\n", value);
+
+  if ( shm != NULL )
+  {
+    shm_put_command( value & JTAG_SHM_PIN_MASK );
+    shm_publish_commands();
+    return APP_ERR_NONE;
+  }
+
   fout = fopen(gdb_in, "wt+");
   fprintf(fout, "F\n");
   fflush(fout);
@@ -89,6 +303,14 @@ static int cable_rtl_sim_inout(uint8_t value, uint8_t *inval)
   uint8_t data;
   debug("IO (");
 
+  if ( shm != NULL )
+  {
+    shm_put_command( ( value & JTAG_SHM_PIN_MASK ) | JTAG_SHM_CMD_READ_TDO );
+    shm_publish_commands();
+    *inval = shm_get_response();
+    return APP_ERR_NONE;
+  }
+
   while(1) {
     fin = fopen(gdb_in, "rt");
     if(!fin) {
@@ -117,6 +339,71 @@ static int cable_rtl_sim_inout(uint8_t value, uint8_t *inval)
 }
 
 
+static int cable_rtl_sim_out_block ( const uint8_t * const values, const int count )
+{
+  if ( shm == NULL )
+  {
+    int err = APP_ERR_NONE;
+
+    for ( int i = 0; i < count; ++i )
+      err |= cable_rtl_sim_out( values[ i ] );
+
+    return err;
+  }
+
+  for ( int i = 0; i < count; ++i )
+    shm_put_command( values[ i ] & JTAG_SHM_PIN_MASK );
+
+  shm_publish_commands();
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_rtl_sim_read_stream ( const uint32_t * const outstream,
+                                       uint32_t * const instream,
+                                       const int len_bits,
+                                       const int set_last_bit )
+{
+  if ( shm != NULL )
+    return shm_read_stream( outstream, instream, len_bits, set_last_bit );
+
+  return cable_common_read_stream( outstream, instream, len_bits, set_last_bit );
+}
+
+
+static int cable_rtl_sim_flush ( void )
+{
+  // The simulator picks up the published commands on its own, there is no need to wait for them here.
+  if ( shm != NULL )
+    shm_publish_commands();
+
+  return APP_ERR_NONE;
+}
+
+
+static void cable_rtl_sim_close ( void )
+{
+  if ( shm != NULL )
+  {
+    // The simulator may have already gone away, so do not wait forever for the last commands.
+    try
+    {
+      shm_wait_until_idle();
+    }
+    catch ( const std::exception & e )
+    {
+      fprintf( stderr, "Giving up on the last JTAG commands for the simulator: %s\n", e.what() );
+    }
+
+    if ( 0 != munmap( shm, sizeof( jtag_shm_layout ) ) )
+      fprintf( stderr, "Error unmapping the JTAG shared memory file: %s\n", strerror( errno ) );
+
+    shm = NULL;
+  }
+}
+
+
 static int cable_rtl_sim_opt ( const int c, const char * const str )
 {
   switch(c)
@@ -147,6 +434,10 @@ static int cable_rtl_sim_opt ( const int c, const char * const str )
       break;
     }
 
+  case 'm':
+    shm_filename = str;
+    break;
+
   default:
     fprintf(stderr, "Unknown parameter '%c'\n", c);
     return APP_ERR_BAD_PARAM;
@@ -162,15 +453,19 @@ jtag_cable_t * cable_rtl_get_driver ( void )
     rtl_cable_driver.name ="rtl_sim";
     rtl_cable_driver.inout_func = cable_rtl_sim_inout;
     rtl_cable_driver.out_func = cable_rtl_sim_out;
+    rtl_cable_driver.out_block_func = cable_rtl_sim_out_block;
     rtl_cable_driver.init_func = cable_rtl_sim_init;
     rtl_cable_driver.opt_func = cable_rtl_sim_opt;
     rtl_cable_driver.bit_out_func = cable_common_write_bit;
     rtl_cable_driver.bit_inout_func = cable_common_read_write_bit;
     rtl_cable_driver.stream_out_func = cable_common_write_stream;
-    rtl_cable_driver.stream_inout_func = cable_common_read_stream;
-    rtl_cable_driver.flush_func = NULL;
-    rtl_cable_driver.opts = "d:";
-    rtl_cable_driver.help = "\t-d [directory] Directory in which gdb_in.dat/gdb_out.dat may be found\n";
+    rtl_cable_driver.stream_inout_func = cable_rtl_sim_read_stream;
+    rtl_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
+    rtl_cable_driver.flush_func = cable_rtl_sim_flush;
+    rtl_cable_driver.close_func = cable_rtl_sim_close;
+    rtl_cable_driver.opts = "d:m:";
+    rtl_cable_driver.help = "\t-d [directory] Directory in which gdb_in.dat/gdb_out.dat may be found\n"
+                            "\t-m [file]      Use a shared memory file instead, see jtag_shm_server.cpp in the OR10 test bench\n";
 
     was_rtl_cable_driver_initialised = true;
   }
@@ -24,10 +24,15 @@
 #include <string.h>  // for memcpy()
 #include <stdint.h>
 
+#include <stdexcept>
+#include <vector>
+
 #include "linux_utils.h"
 #include "cable_usbblaster.h"
 #include "utilities.h"
 #include "errcodes.h"
+#include "usb_async_transport.h"
+#include "usbblaster_scan_encoder.h"
 
 #define debug(...) //fprintf(stderr, __VA_ARGS__ )
 
@@ -36,6 +41,8 @@ static int cable_usbblaster_init();
 static int cable_usbblaster_out(uint8_t value);
 static int cable_usbblaster_inout(uint8_t value, uint8_t *in_bit);
 static int cable_usbblaster_opt ( const int c, const char * const str );
+static int cable_usbblaster_flush(void);
+static void cable_usbblaster_close(void);
 
 
 static bool was_usbblaster_cable_driver_initialised = false;
@@ -54,27 +61,33 @@ static uint32_t ALTERA_PID = 0x6001;
 #define USB_TIMEOUT 10000
 
 
-// Bit meanings in the command byte sent to the USB-Blaster
-#define USBBLASTER_CMD_TCK 0x01
-#define USBBLASTER_CMD_TMS 0x02
-#define USBBLASTER_CMD_nCE 0x04  /* should be left low */
-#define USBBLASTER_CMD_nCS 0x08  /* must be set for byte-shift mode reads to work */
-#define USBBLASTER_CMD_TDI 0x10
-#define USBBLASTER_CMD_OE  0x20  /* appears necessary to set it to make everything work */
-#define USBBLASTER_CMD_READ 0x40
-#define USBBLASTER_CMD_BYTESHIFT 0x80
-
-
 static struct usb_device *usbblaster_device;
 static usb_dev_handle *h_device;
 
-// libusb seems to give an error if we ask for a transfer larger than 64 bytes
-// USBBlaster also has a max. single transaction of 63 bytes.
-// So, size the max read and write to create 64-byte USB packets (reads have 2 useless bytes prepended)
-#define USBBLASTER_MAX_WRITE 63
-static char data_out_scratchpad[USBBLASTER_MAX_WRITE+1];
-#define USBBLASTER_MAX_READ  62
-static char data_in_scratchpad[USBBLASTER_MAX_READ+2];
+// If not NULL, all bulk transfers go through the asynchronous transport instead of h_device.
+// Single-bit commands are then buffered until the next read or flush,
+// and long streams keep several USB transfers in flight.
+static usb_async_transport *async_transport = NULL;
+
+#ifdef __SUPPORT_LIBUSB1__
+static bool use_async_transport = false;
+#endif
+
+// libusb seems to give an error if we ask for a transfer larger than 64 bytes,
+// so the command stream is written in chunks of that size, which is the USB packet size anyway.
+// Reads return 64-byte USB packets with 2 useless bytes prepended.
+#define USBBLASTER_MAX_WRITE 64
+#define USBBLASTER_MAX_READ  64
+#define USBBLASTER_READ_HEADER_LEN 2
+static char data_in_scratchpad[USBBLASTER_MAX_READ];
+
+// The device cannot take any more commands while its IN FIFO is full, so a long scan is sent
+// in segments, and the answer for each segment is collected before sending the next one.
+// The FT245 chip in the USB-Blaster has a 384-byte transmit buffer.
+#define USBBLASTER_MAX_PENDING_ANSWER 256
+
+static usbblaster_encoded_scan encoded_scan;
+static std::vector<uint8_t> scan_answer;
 
 // Flag used to avoid unnecessary transfers
 // Since clock is lowered if high (and never the other way around),
@@ -155,9 +168,105 @@ static int usbblaster_enumerate_bus(void)
 }
 
 
+#ifdef __SUPPORT_LIBUSB1__
+
+static int cable_usbblaster_init_async(void)
+{
+  usb_async_transport_config config;
+  config.out_transfer_size  = 4096;
+  config.out_transfer_count = 4;
+  // The USB-Blaster is a full-speed device, so IN packets are 64 bytes long,
+  // and each one starts with 2 status bytes.
+  config.in_transfer_size   = 512;
+  config.in_transfer_count  = 4;
+  config.in_header_len      = 2;
+  config.in_packet_size     = 64;
+  config.timeout_ms         = USB_TIMEOUT;
+
+  usb_async_backend *backend = NULL;
+
+  try
+  {
+    backend = usb_async_create_libusb1_backend(ALTERA_VID, ALTERA_PID, 0, EP2, EP1);
+
+    fprintf(stderr, "Found Altera USB-Blaster\n");
+
+    // Some clones need this before they will start processing IN/OUT requests.
+    if(usb_async_libusb1_control_msg(backend, (USB_ENDPOINT_OUT | USB_TYPE_VENDOR), USB_REQ_GET_STATUS,
+                                     0, 0, NULL, 0, 1000) < 0)
+      fprintf(stderr, "Failed to start remote interface\n");
+
+    uint8_t ver[2];
+    if(usb_async_libusb1_control_msg(backend, 0xC0, 0x90, 0, 3, ver, 2, USB_TIMEOUT) < 0)
+      throw std::runtime_error("Failed to read firmware version.");
+
+    printf("firmware version = 0x%04X (%u)\n", (ver[0] << 8) | ver[1], (ver[0] << 8) | ver[1]);
+
+    // The 2 useless bytes the USB-Blaster sends after the initialisation are just a status header,
+    // which the transport strips anyway.
+    async_transport = new usb_async_transport(backend, config);
+  }
+  catch ( const std::exception & e )
+  {
+    delete backend;
+    fprintf(stderr, "%s\n", e.what());
+    return APP_ERR_USB;
+  }
+
+  return APP_ERR_NONE;
+}
+
+#endif
+
+
+// Sends a single bit-bang command byte over the asynchronous transport,
+// and reads the TDO value back if in_bit is not NULL.
+static int usbblaster_async_bitbang(uint8_t value, uint8_t *in_bit)
+{
+  uint8_t out = (USBBLASTER_CMD_OE | USBBLASTER_CMD_nCS);
+
+  if(in_bit != NULL)
+    out |= USBBLASTER_CMD_READ;
+
+  // USB-Blaster has no TRST pin
+  if(value & TCLK_BIT)
+    out |= USBBLASTER_CMD_TCK;
+  if(value & TDI_BIT)
+    out |= USBBLASTER_CMD_TDI;
+  if(value & TMS_BIT)
+    out |= USBBLASTER_CMD_TMS;
+
+  try
+  {
+    async_transport->write(&out, 1);
+
+    if(in_bit != NULL)
+    {
+      uint8_t ret;
+      async_transport->read(&ret, 1);
+      *in_bit = (ret & 0x01);  /* TDO is bit 0.  USB-Blaster may also set bit 1. */
+    }
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf(stderr, "\n%s\n", e.what());
+    return APP_ERR_USB;
+  }
+
+  clock_is_high = (value & TCLK_BIT) ? 1 : 0;
+
+  return APP_ERR_NONE;
+}
+
+
 int cable_usbblaster_init(){
   int err = APP_ERR_NONE;
 
+#ifdef __SUPPORT_LIBUSB1__
+  if(use_async_transport)
+    return cable_usbblaster_init_async();
+#endif
+
   // Process to reset the usb blaster
   if(err |= usbblaster_enumerate_bus()) {
     return err;
@@ -225,6 +334,9 @@ int cable_usbblaster_out(uint8_t value)
   char out;
   int err = APP_ERR_NONE;
 
+  if(async_transport != NULL)
+    return usbblaster_async_bitbang(value, NULL);
+
   // open the device, if necessary
   if(h_device == NULL) {
     rv = cable_usbblaster_open_cable();
@@ -268,6 +380,9 @@ int cable_usbblaster_inout(uint8_t value, uint8_t *in_bit)
   char ret[3] = {0,0,0};               // Two useless bytes (0x31,0x60) always precede the useful byte
   char out;
 
+  if(async_transport != NULL)
+    return usbblaster_async_bitbang(value, in_bit);
+
   out = (USBBLASTER_CMD_OE | USBBLASTER_CMD_nCS);  // Set output enable (?) and nCS (necessary for byte-shift reads)
   out |=  USBBLASTER_CMD_READ;
 
@@ -325,219 +440,160 @@ int cable_usbblaster_inout(uint8_t value, uint8_t *in_bit)
 }
 
 
-// The usbblaster transfers the bits in the stream in the following order:
-// bit 0 of the first byte received ... bit 7 of the first byte received
-// bit 0 of second byte received ... etc.
-int cable_usbblaster_write_stream ( const uint32_t * const stream,
-                                    int len_bits,
-                                    int set_last_bit )
+static int usbblaster_write_commands(const uint8_t *commands, unsigned len)
 {
-  int             rv;                  // to catch return values of functions
-  unsigned int bytes_to_transfer, leftover_bit_length;
-  uint32_t leftover_bits;
-  int bytes_remaining;
-  const char *xfer_ptr;
-  int err = APP_ERR_NONE;
-
-  debug("cable_usbblaster_write_stream(0x%X, %d, %i)\n", stream, len, set_last_bit);
-
-  // This routine must transfer at least 8 bits.  Additionally, TMS (the last bit)
-  // cannot be set by 'byte shift mode'.  So we need at least 8 bits to transfer,
-  // plus one bit to send along with TMS.
-  bytes_to_transfer = len_bits / 8;
-  leftover_bit_length = len_bits - (bytes_to_transfer * 8);
+  if(async_transport != NULL) {
+    try
+    {
+      async_transport->write(commands, len);
+    }
+    catch ( const std::exception & e )
+    {
+      fprintf(stderr, "\n%s\n", e.what());
+      return APP_ERR_USB;
+    }
 
-  if((!leftover_bit_length) && set_last_bit) {
-    bytes_to_transfer -= 1;
-    leftover_bit_length += 8;
+    return APP_ERR_NONE;
   }
 
-  debug("bytes_to_transfer: %d. leftover_bit_length: %d\n", bytes_to_transfer, leftover_bit_length);
+  for(unsigned pos = 0; pos < len; )
+    {
+      const int bytes_this_xfer = (len - pos > USBBLASTER_MAX_WRITE) ? USBBLASTER_MAX_WRITE : len - pos;
 
-  // Not enough bits for high-speed transfer. bit-bang.
-  if(bytes_to_transfer == 0) {
-    return cable_common_write_stream(stream, len_bits, set_last_bit);
-  }
+      const int rv = usb_bulk_write(h_device, EP2, (char *) &commands[pos], bytes_this_xfer, USB_TIMEOUT);
+      if (rv != bytes_this_xfer){
+	fprintf(stderr, "\nFailed to write to the EP2 FIFO (rv = %d):\n%s", rv, usb_strerror());
+	cable_usbblaster_close_cable();
+	return APP_ERR_USB;
+      }
 
-  // Bitbang functions leave clock high.  USBBlaster assumes clock low at the start of a burst.
-  if(clock_is_high)
-    {
-      err |= cable_usbblaster_out(0);  // Lower the clock.
+      pos += bytes_this_xfer;
     }
 
-  // Set leftover bits
-  leftover_bits = (stream[bytes_to_transfer>>2] >> ((bytes_to_transfer & 0x3) * 8)) & 0xFF;
+  return APP_ERR_NONE;
+}
 
-  debug("leftover_bits: 0x%X, LSB_first_xfer = %d\n", leftover_bits, LSB_first_xfer);
 
-  // open the device, if necessary
-  if(h_device == NULL) {
-    rv = cable_usbblaster_open_cable();
-    if(rv != APP_ERR_NONE) return rv;
-  }
-
-  bytes_remaining = bytes_to_transfer;
-  xfer_ptr = (const char *) stream;
-  while(bytes_remaining > 0)
+// Collects the given number of answer bytes. Sometimes, a read returns just the useless 0x31,0x60 chars,
+// so keep reading until all data has arrived, but give up if it takes too long.
+static int usbblaster_read_answer(uint8_t *answer, unsigned len)
+{
+  if(async_transport != NULL) {
+    try
+    {
+      async_transport->read(answer, len);
+    }
+    catch ( const std::exception & e )
     {
-      int bytes_this_xfer = (bytes_remaining > USBBLASTER_MAX_WRITE) ? USBBLASTER_MAX_WRITE:bytes_remaining;
+      fprintf(stderr, "\n%s\n", e.what());
+      return APP_ERR_USB;
+    }
 
-      data_out_scratchpad[0] = USBBLASTER_CMD_BYTESHIFT | (bytes_this_xfer & 0x3F);
-      memcpy(&data_out_scratchpad[1], xfer_ptr, bytes_this_xfer);
+    return APP_ERR_NONE;
+  }
 
-      /* printf("Data packet: ");
-	 for(i = 0; i <= bytes_to_transfer; i++)
-	 printf("0x%X ", out[i]);
-	 printf("\n"); */
+  unsigned bytes_received = 0;
+  int err = APP_ERR_NONE;
+  timeout_timer timer;
+  create_timer( &timer );
 
-      rv = usb_bulk_write(h_device, EP2, data_out_scratchpad, bytes_this_xfer+1, USB_TIMEOUT);
-      if (rv != (bytes_this_xfer+1)){
-	fprintf(stderr, "\nFailed to write to the FIFO (rv = %d):\n%s", rv, usb_strerror());
-	err |= APP_ERR_USB;
+  while(bytes_received < len)
+    {
+      const unsigned bytes_wanted = len - bytes_received;
+      const unsigned max_data_len = USBBLASTER_MAX_READ - USBBLASTER_READ_HEADER_LEN;
+
+      const int rv = usb_bulk_read(h_device, EP1, data_in_scratchpad,
+                                   (bytes_wanted > max_data_len ? max_data_len : bytes_wanted) + USBBLASTER_READ_HEADER_LEN,
+                                   USB_TIMEOUT);
+      if (rv < 0){
+	fprintf(stderr, "\nFailed to read stream from the EP1 FIFO (%i):\n%s", rv, usb_strerror());
+	cable_usbblaster_close_cable();
+	err = APP_ERR_USB;
 	break;
       }
 
-      bytes_remaining -= bytes_this_xfer;
-      xfer_ptr += bytes_this_xfer;
+      if (rv > USBBLASTER_READ_HEADER_LEN) {
+	const unsigned data_len = rv - USBBLASTER_READ_HEADER_LEN;
+	memcpy(&answer[bytes_received], &data_in_scratchpad[USBBLASTER_READ_HEADER_LEN],
+	       data_len > bytes_wanted ? bytes_wanted : data_len);
+	bytes_received += data_len > bytes_wanted ? bytes_wanted : data_len;
+      }
+      else if (timedout(&timer)) {
+	fprintf(stderr, "\nTimeout reading from the EP1 FIFO, %u of %u bytes received.\n", bytes_received, len);
+	err = APP_ERR_USB;
+	break;
+      }
     }
 
-  clock_is_high = 0;
-
-  // if we have a number of bits not divisible by 8, or we need to set TMS...
-  if(leftover_bit_length != 0) {
-    //printf("Doing leftovers: (0x%X, %d, %d)\n", leftover_bits, leftover_bit_length, set_last_bit);
-    return cable_common_write_stream(&leftover_bits, leftover_bit_length, set_last_bit);
-  }
-
+  destroy_timer( &timer );
   return err;
 }
 
 
-int cable_usbblaster_read_stream ( const uint32_t * const outstream,
-                                   uint32_t * const instream,
-                                   const int len_bits,
-                                   const int set_last_bit )
+// Sends a complete scan as a single command stream, see usbblaster_scan_encoder.h .
+// If instream is not NULL, all TDO bits are collected afterwards.
+static int usbblaster_scan(const uint32_t *outstream, uint32_t *instream, int len_bits, int set_last_bit)
 {
-  int             rv;                  // to catch return values of functions
-  unsigned int bytes_received = 0, total_bytes_received = 0;
-  unsigned int bytes_to_transfer, leftover_bit_length;
-  uint32_t leftover_bits, leftovers_received = 0;
-  unsigned char i;
-  int bytes_remaining;
-  const char *xfer_ptr;
-  int retval = APP_ERR_NONE;
-
-  debug("cable_usbblaster_read_stream(0x%X, %d, %i)\n", outstream[0], len_bits, set_last_bit);
-
-  // This routine must transfer at least 8 bits.  Additionally, TMS (the last bit)
-  // cannot be set by 'byte shift mode'.  So we need at least 8 bits to transfer,
-  // plus one bit to send along with TMS.
-  bytes_to_transfer = len_bits / 8;
-  leftover_bit_length = len_bits - (bytes_to_transfer * 8);
-
-  if((!leftover_bit_length) && set_last_bit) {
-    bytes_to_transfer -= 1;
-    leftover_bit_length += 8;
-  }
+  int err = APP_ERR_NONE;
 
-  debug("RD bytes_to_transfer: %d. leftover_bit_length: %d\n", bytes_to_transfer, leftover_bit_length);
+  debug("usbblaster_scan(0x%X, %d, %i)\n", outstream[0], len_bits, set_last_bit);
 
-  // Not enough bits for high-speed transfer. bit-bang.
-  if(bytes_to_transfer == 0) {
-    return cable_common_read_stream(outstream, instream, len_bits, set_last_bit);
+  // open the device, if necessary
+  if(async_transport == NULL && h_device == NULL) {
+    err = cable_usbblaster_open_cable();
+    if(err != APP_ERR_NONE) return err;
   }
 
-  // Bitbang functions leave clock high.  USBBlaster assumes clock low at the start of a burst.
-  if(clock_is_high)
-    {
-      // Lower the clock.
-      retval |= cable_usbblaster_out(0);
-    }
+  usbblaster_encode_scan(outstream, len_bits, set_last_bit != 0, instream != NULL, clock_is_high != 0, &encoded_scan);
 
-  // Zero the input, since we add new data by logical-OR
-  for(i = 0; i < (len_bits/32); i++)  instream[i] = 0;
-  if(len_bits % 32)                   instream[i] = 0;
+  scan_answer.resize(encoded_scan.byte_shift_count + encoded_scan.bit_bang_count);
 
-  // Set leftover bits
-  leftover_bits = (outstream[bytes_to_transfer>>2] >> ((bytes_to_transfer & 0x3) * 8)) & 0xFF;
-  debug("leftover_bits: 0x%X\n", leftover_bits);
+  const std::vector<uint8_t> &commands = encoded_scan.commands;
+  unsigned answer_pos = 0;
 
-  // open the device, if necessary
-  if(h_device == NULL) {
-    rv = cable_usbblaster_open_cable();
-    if(rv != APP_ERR_NONE) return rv;
-  }
-
-  // Transfer the data.  USBBlaster has a max transfer size of 64 bytes.
-  bytes_remaining = bytes_to_transfer;
-  xfer_ptr = (const char *) outstream;
-  total_bytes_received = 0;
-  while(bytes_remaining > 0)
+  for(unsigned pos = 0; pos < commands.size(); )
     {
-      int bytes_this_xfer = (bytes_remaining > USBBLASTER_MAX_READ) ? USBBLASTER_MAX_READ:bytes_remaining;
-      data_out_scratchpad[0] = USBBLASTER_CMD_BYTESHIFT | USBBLASTER_CMD_READ | (bytes_this_xfer & 0x3F);
-      memcpy(&data_out_scratchpad[1], xfer_ptr, bytes_this_xfer);
+      unsigned answer_len;
+      const unsigned end = usbblaster_find_segment_end(&commands, pos, USBBLASTER_MAX_PENDING_ANSWER, &answer_len);
 
-      /* debug("Data packet: ");
-	 for(i = 0; i <= bytes_to_transfer; i++) debug("0x%X ", data_out_scratchpad[i]);
-	 debug("\n"); */
+      err = usbblaster_write_commands(&commands[pos], end - pos);
 
-      rv = usb_bulk_write(h_device, EP2, data_out_scratchpad, bytes_this_xfer+1, USB_TIMEOUT);
-      if (rv != (bytes_this_xfer+1)){
-	fprintf(stderr, "\nFailed to write to the EP2 FIFO (rv = %d):\n%s", rv, usb_strerror());
-	cable_usbblaster_close_cable();
-	return APP_ERR_USB;
-      }
+      if(err == APP_ERR_NONE && answer_len != 0)
+        err = usbblaster_read_answer(&scan_answer[answer_pos], answer_len);
 
-      // receive the response
-      // Sometimes, we do a read but just get the useless 0x31,0x60 chars...
-      // retry until we get at least 3 bytes (with real data), for a reasonable number of retries.
-      int retries = 0;
-      bytes_received = 0;
-      do {
-	debug("stream read, bytes_this_xfer = %i, bytes_received = %i\n", bytes_this_xfer, bytes_received);
-	rv = usb_bulk_read(h_device, EP1, data_in_scratchpad, (bytes_this_xfer-bytes_received)+2, USB_TIMEOUT);
-	if (rv < 0){
-	  fprintf(stderr, "\nFailed to read stream from the EP1 FIFO (%i):\n%s", rv, usb_strerror());
-	  cable_usbblaster_close_cable();
-	  return APP_ERR_USB;
-	}
-
-	/* debug("Read %i bytes: ", rv);
-	   for(i = 0; i < rv; i++)
-	   debug("0x%X ", data_in_scratchpad[i]);
-	   debug("\n"); */
-
-	if(rv > 2) retries = 0;
-	else retries++;
-
-	/* Put the received bytes into the return stream.  Works for either endian. */
-	for(i = 0; i < (rv-2); i++) {
-	  // Do size/type promotion before shift.  Must cast to unsigned, else the value may be
-	  // sign-extended through the upper 16 bits of the uint32_t.
-	  uint32_t tmp = (unsigned char) data_in_scratchpad[2+i];
-	  instream[(total_bytes_received+i)>>2] |= (tmp << ((i & 0x3)*8));
-	}
-
-	bytes_received += (rv-2);
-	total_bytes_received += (rv-2);
-      }
-      while((bytes_received < unsigned(bytes_this_xfer)) && (retries < 15));
+      if(err != APP_ERR_NONE)
+        return err;
 
-      bytes_remaining -= bytes_this_xfer;
-      xfer_ptr += bytes_this_xfer;
+      pos = end;
+      answer_pos += answer_len;
     }
 
-  clock_is_high = 0;
+  clock_is_high = encoded_scan.is_clock_high_at_the_end ? 1 : 0;
 
-  // if we have a number of bits not divisible by 8
-  if(leftover_bit_length != 0) {
-    debug("Doing leftovers: (0x%X, %d, %d)\n", leftover_bits, leftover_bit_length, set_last_bit);
-    retval |= cable_common_read_stream(&leftover_bits, &leftovers_received, leftover_bit_length, set_last_bit);
-    instream[bytes_to_transfer>>2] |= (leftovers_received & 0xFF) << (8*(bytes_to_transfer & 0x3));
-  }
+  if(instream != NULL)
+    usbblaster_decode_scan(&encoded_scan, &scan_answer[0], instream);
+
+  return APP_ERR_NONE;
+}
+
+
+// The usbblaster transfers the bits in the stream in the following order:
+// bit 0 of the first byte received ... bit 7 of the first byte received
+// bit 0 of second byte received ... etc.
+int cable_usbblaster_write_stream ( const uint32_t * const stream,
+                                    const int len_bits,
+                                    const int set_last_bit )
+{
+  return usbblaster_scan(stream, NULL, len_bits, set_last_bit);
+}
 
-  return retval;
+
+int cable_usbblaster_read_stream ( const uint32_t * const outstream,
+                                   uint32_t * const instream,
+                                   const int len_bits,
+                                   const int set_last_bit )
+{
+  return usbblaster_scan(outstream, instream, len_bits, set_last_bit);
 }
 
 jtag_cable_t *cable_usbblaster_get_driver(void)
@@ -553,9 +609,17 @@ jtag_cable_t *cable_usbblaster_get_driver(void)
     usbblaster_cable_driver.bit_inout_func = cable_common_read_write_bit;
     usbblaster_cable_driver.stream_out_func =  cable_usbblaster_write_stream;
     usbblaster_cable_driver.stream_inout_func = cable_usbblaster_read_stream;
-    usbblaster_cable_driver.flush_func = NULL;
+    usbblaster_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
+    usbblaster_cable_driver.flush_func = cable_usbblaster_flush;
+    usbblaster_cable_driver.close_func = cable_usbblaster_close;
+#ifdef __SUPPORT_LIBUSB1__
+    usbblaster_cable_driver.opts = "p:v:A";
+    usbblaster_cable_driver.help = "\t-p [PID] Alternate PID for USB device (hex value)\n\t-v [VID] Alternate VID for USB device (hex value)\n"
+                                   "\t-A       Use asynchronous libusb-1.0 transfers, which keep several of them in flight\n";
+#else
     usbblaster_cable_driver.opts = "p:v:";
     usbblaster_cable_driver.help = "\t-p [PID] Alternate PID for USB device (hex value)\n\t-v [VID] Alternate VID for USB device (hex value)\n";
+#endif
 
     was_usbblaster_cable_driver_initialised = true;
   }
@@ -589,6 +653,12 @@ int cable_usbblaster_opt ( const int c, const char * const str )
     }
     break;
 
+#ifdef __SUPPORT_LIBUSB1__
+  case 'A':
+    use_async_transport = true;
+    break;
+#endif
+
   default:
     fprintf(stderr, "Unknown parameter '%c'\n", c);
     return APP_ERR_BAD_PARAM;
@@ -653,6 +723,36 @@ void cable_usbblaster_close_cable(void)
   return;
 }
 
+
+int cable_usbblaster_flush(void)
+{
+  if(async_transport == NULL)
+    return APP_ERR_NONE;
+
+  try
+  {
+    async_transport->flush();
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf(stderr, "\n%s\n", e.what());
+    return APP_ERR_USB;
+  }
+
+  return APP_ERR_NONE;
+}
+
+
+void cable_usbblaster_close(void)
+{
+  if(async_transport != NULL)
+  {
+    cable_usbblaster_flush();
+    delete async_transport;
+    async_transport = NULL;
+  }
+}
+
 /*
 int cable_usbblaster_reopen_cable(void)
 {
@@ -0,0 +1,213 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// In-process simulation cable: the OR10 test bench, compiled to C++ by Verilator,
+// is linked into the bridge, and the JTAG pins are driven with direct function calls.
+//
+// There is no socket round trip per JTAG clock cycle like with the 'vpi' cable,
+// but the simulated system only runs while the bridge drives the JTAG pins.
+// Between GDB requests, the debug unit polling (for example, waiting for the CPU to stall)
+// keeps the simulation going.
+//
+// The model must be built with EXTERNAL_JTAG_PINS defined, see script
+// Tools/SimulatorBuildScripts/BuildSim-OR10-Verilator-Library.sh and configure option --with-verilator-model.
+
+#include "cable_verilator.h"  // The include file for this module should come first.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Vtest_bench.h"
+#include "verilated.h"
+
+#include "errcodes.h"
+#include "string_utils.h"
+
+
+static bool was_verilator_cable_driver_initialised = false;
+static jtag_cable_t verilator_cable_driver;
+
+static Vtest_bench * top = NULL;
+static uint64_t current_simulation_time = 0;
+
+// Number of system clock cycles TCK stays low and high. The JTAG TAP runs directly on TCK,
+// but the debug unit synchronises its signals to the system clock, so TCK must be slower.
+static int clock_cycles_per_half_tck = 2;
+
+// Verilated::commandArgs() keeps pointers to the arguments, so they must live until the end.
+static std::vector< std::string > plusargs;
+static std::vector< const char * > plusarg_pointers;
+
+
+// Verilator calls this routine for $time and the like.
+double sc_time_stamp ()
+{
+  return double( current_simulation_time );
+}
+
+
+static void advance_clock ( const int cycle_count )
+{
+  for ( int i = 0; i < cycle_count; ++i )
+  {
+    for ( int edge = 0; edge < 2; ++edge )
+    {
+      top->clock = !top->clock;
+      top->eval();
+      ++current_simulation_time;
+    }
+
+    if ( Verilated::gotFinish() )
+      throw std::runtime_error( "The simulation has finished." );
+  }
+}
+
+
+static int cable_verilator_init ( void )
+{
+  assert( top == NULL );
+
+  plusarg_pointers.clear();
+  plusarg_pointers.push_back( "or10_gdb_to_jtag_bridge" );
+
+  for ( size_t i = 0; i < plusargs.size(); ++i )
+    plusarg_pointers.push_back( plusargs[ i ].c_str() );
+
+  Verilated::commandArgs( int( plusarg_pointers.size() ), &plusarg_pointers[0] );
+
+  top = new Vtest_bench;
+
+  top->reset = 0;
+  top->clock = 0;
+
+  top->jtag_tms_i  = 0;
+  top->jtag_tck_i  = 0;
+  top->jtag_trst_i = 1;  // TRST is active low.
+  top->jtag_tdi_i  = 0;
+
+  top->eval();
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_verilator_out ( const uint8_t value )
+{
+  assert( top != NULL );
+
+  top->jtag_tck_i  = ( value & TCLK_BIT ) ? 1 : 0;
+  top->jtag_trst_i = ( value & TRST_BIT ) ? 1 : 0;
+  top->jtag_tdi_i  = ( value & TDI_BIT  ) ? 1 : 0;
+  top->jtag_tms_i  = ( value & TMS_BIT  ) ? 1 : 0;
+
+  advance_clock( clock_cycles_per_half_tck );
+
+  return APP_ERR_NONE;
+}
+
+
+// Like the 'vpi' cable, TDO is sampled before the new pin state is applied.
+
+static int cable_verilator_inout ( const uint8_t value, uint8_t * const inval )
+{
+  assert( top != NULL );
+
+  const uint8_t data_in = top->jtag_tdo_o ? 1 : 0;
+
+  cable_verilator_out( value );
+
+  *inval = data_in;
+
+  return APP_ERR_NONE;
+}
+
+
+static int cable_verilator_opt ( const int c, const char * const str )
+{
+  switch ( c )
+  {
+  case 'c':
+    {
+      const int val = atoi( str );
+
+      if ( val <= 0 )
+      {
+        fprintf( stderr, "Bad clock cycle count for the Verilator cable: %s\n", str );
+        return APP_ERR_BAD_PARAM;
+      }
+
+      clock_cycles_per_half_tck = val;
+      break;
+    }
+
+  case 'a':
+    plusargs.push_back( str );
+    break;
+
+  default:
+    fprintf( stderr, "Unknown parameter '%c'\n", c );
+    return APP_ERR_BAD_PARAM;
+  }
+
+  return APP_ERR_NONE;
+}
+
+
+static void cable_verilator_close ( void )
+{
+  if ( top != NULL )
+  {
+    top->final();
+    delete top;
+    top = NULL;
+  }
+}
+
+
+jtag_cable_t * cable_verilator_get_driver ( void )
+{
+  if ( was_verilator_cable_driver_initialised )
+  {
+    // I think this routine gets called only once at the moment.
+    assert( false );
+  }
+  else
+  {
+    verilator_cable_driver.name = "verilator";
+    verilator_cable_driver.inout_func = cable_verilator_inout;
+    verilator_cable_driver.out_func = cable_verilator_out;
+    verilator_cable_driver.init_func = cable_verilator_init;
+    verilator_cable_driver.opt_func = cable_verilator_opt;
+    verilator_cable_driver.bit_out_func = cable_common_write_bit;
+    verilator_cable_driver.bit_inout_func = cable_common_read_write_bit;
+    verilator_cable_driver.stream_out_func = cable_common_write_stream;
+    verilator_cable_driver.stream_inout_func = cable_common_read_stream;
+    verilator_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
+    verilator_cable_driver.close_func = cable_verilator_close;
+    verilator_cable_driver.opts = "c:a:";
+    verilator_cable_driver.help = "\t-c [count]    System clock cycles per half TCK period (default 2)\n"
+                                  "\t-a [plusarg]  Simulator argument like +file_name=firmware.hex, can be repeated\n";
+
+    was_verilator_cable_driver_initialised = true;
+  }
+
+  return &verilator_cable_driver;
+}
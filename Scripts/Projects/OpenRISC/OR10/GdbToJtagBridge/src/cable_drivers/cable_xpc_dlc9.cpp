@@ -608,6 +608,38 @@ int cable_xpcusb_cpld_write_bit(uint8_t value)
 	return cable_xpcusb_write_stream(&out, 1, value & TMS);
 }
 
+// Sends a whole TMS sequence in a single ext transfer, TDI is held low.
+int cable_xpcusb_write_tms_sequence ( const uint32_t tms_bits, const int bit_count )
+{
+	xpc_ext_transfer_state_t xts;
+
+	assert( bit_count > 0 && bit_count <= 32 );
+
+	if(h_device == NULL)
+	{
+		throw_if_error( cable_xpcusb_open_cable() );
+	}
+
+	if ( !cpld_ctrl )
+	{
+		throw_if_error( cable_xpcusb_cpld_init() );
+	}
+
+	xts.in_bits = 0;
+	xts.out_bits = 0;
+
+	for ( int i = 0; i < bit_count; i++ )
+		xpcusb_add_bit_for_ext_transfer(&xts, 1, (tms_bits >> i) & 1, 0, 0);
+
+	// CPLD doesn't like multiples of 4; add one dummy bit.
+	if((xts.in_bits & 3) == 0)
+		xpcusb_add_bit_for_ext_transfer(&xts, 0, 0, 0, 0);
+
+	throw_if_error( xpcusb_do_ext_transfer(&xts, NULL) );
+
+	return APP_ERR_NONE;
+}
+
 
 static int cable_xpcusb_open_cable(void)
 {
@@ -694,6 +726,7 @@ jtag_cable_t *cable_xpcusb_get_driver(void)
         dlc9_cable_driver.bit_inout_func = cable_xpcusb_read_write_bit;
         dlc9_cable_driver.stream_out_func = cable_common_write_stream;
         dlc9_cable_driver.stream_inout_func = cable_common_read_stream;
+        dlc9_cable_driver.tms_sequence_func = cable_common_write_tms_sequence;
         dlc9_cable_driver.flush_func = NULL;
         dlc9_cable_driver.opts = "";
       #else
@@ -712,6 +745,7 @@ jtag_cable_t *cable_xpcusb_get_driver(void)
 
         dlc9_cable_driver.stream_out_func = cable_xpcusb_write_stream;
         dlc9_cable_driver.stream_inout_func = cable_xpcusb_readwrite_stream;
+        dlc9_cable_driver.tms_sequence_func = cable_xpcusb_write_tms_sequence;
         dlc9_cable_driver.flush_func = NULL;
         dlc9_cable_driver.opts = "";
       #endif
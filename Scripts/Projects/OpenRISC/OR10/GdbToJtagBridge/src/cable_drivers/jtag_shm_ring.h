@@ -0,0 +1,147 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JTAG_SHM_RING_H_INCLUDED
+#define JTAG_SHM_RING_H_INCLUDED
+
+// Shared-memory link between the 'rtl_sim' cable (option -m) and the simulation,
+// see OR10/TestBench/jtag_shm_server.cpp for the simulator side.
+//
+// Both processes map the same file. The bridge writes pin-state commands into one ring buffer,
+// and the simulator writes the sampled TDO values into another one. Each ring has a single producer
+// and a single consumer, so the indices need no locks. The indices are free-running 32-bit counters,
+// and the ring sizes are powers of 2.
+//
+// The simulator never blocks, as the simulated system must keep running, so it polls the command ring
+// on every clock tick. The bridge sleeps on a futex while it waits for TDO values or for free space
+// in the command ring, and the simulator wakes it up when it moves the index the bridge is waiting on.
+//
+// The bridge never queues more TDO reads than fit in the response ring, so the simulator
+// does not need to check for free space there.
+//
+// This file is also compiled into the simulator, so it must not depend on anything else in the bridge.
+
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+
+// Command bytes: the lower 4 bits are the new pin states, like the ones passed to out_func().
+static const uint8_t JTAG_SHM_PIN_TCK  = 0x01;
+static const uint8_t JTAG_SHM_PIN_TRST = 0x02;  // TRST is active low.
+static const uint8_t JTAG_SHM_PIN_TDI  = 0x04;
+static const uint8_t JTAG_SHM_PIN_TMS  = 0x08;
+static const uint8_t JTAG_SHM_PIN_MASK = 0x0F;
+
+// Sample TDO before applying the new pin states, and write it (0 or 1) to the response ring.
+static const uint8_t JTAG_SHM_CMD_READ_TDO = 0x10;
+
+static const uint32_t JTAG_SHM_MAGIC   = 0x4D48534A;  // "JSHM" in little endian.
+static const uint32_t JTAG_SHM_VERSION = 1;
+
+static const uint32_t JTAG_SHM_CMD_RING_SIZE = 64 * 1024;
+static const uint32_t JTAG_SHM_RSP_RING_SIZE = 16 * 1024;
+
+// Spinning for a short while before sleeping on the futex helps, because the simulator often answers
+// within a few simulated clock cycles, and a futex sleep and wake-up costs several microseconds.
+static const int JTAG_SHM_SPIN_COUNT = 4000;
+
+
+struct jtag_shm_index
+{
+  uint32_t value;
+  uint32_t is_waiting;     // Set by the side that is sleeping on 'value'.
+  uint8_t  padding[ 56 ];  // Keep each index in its own cache line.
+};
+
+struct jtag_shm_layout
+{
+  uint32_t magic;    // Written last by the bridge, after initialising everything else.
+  uint32_t version;
+  uint32_t session;  // Incremented by the bridge on every connection, so that the simulator can resynchronise.
+  uint8_t  padding[ 52 ];
+
+  jtag_shm_index cmd_head;  // Written by the bridge.
+  jtag_shm_index cmd_tail;  // Written by the simulator.
+  jtag_shm_index rsp_head;  // Written by the simulator.
+
+  uint8_t cmd_ring[ JTAG_SHM_CMD_RING_SIZE ];
+  uint8_t rsp_ring[ JTAG_SHM_RSP_RING_SIZE ];
+};
+
+
+// All accesses to the shared indices are sequentially consistent, which the wake-up logic below relies on:
+// the waiter sets is_waiting before checking the value for the last time, and the publisher
+// checks is_waiting after updating the value, so at least one of them sees the other's write.
+
+inline uint32_t jtag_shm_load ( const uint32_t * const p )
+{
+  return __atomic_load_n( p, __ATOMIC_SEQ_CST );
+}
+
+inline void jtag_shm_store ( uint32_t * const p, const uint32_t value )
+{
+  __atomic_store_n( p, value, __ATOMIC_SEQ_CST );
+}
+
+
+// Updates an index and wakes up the other side if it is sleeping on it.
+
+inline void jtag_shm_publish ( jtag_shm_index * const index, const uint32_t new_value )
+{
+  jtag_shm_store( &index->value, new_value );
+
+  if ( jtag_shm_load( &index->is_waiting ) != 0 )
+    syscall( SYS_futex, &index->value, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+}
+
+
+// Waits until the index no longer has the given value, or until the timeout expires.
+// Returns the current index value, which may still be the old one.
+
+inline uint32_t jtag_shm_wait_for_change ( jtag_shm_index * const index,
+                                           const uint32_t old_value,
+                                           const unsigned timeout_ms )
+{
+  for ( int i = 0; i < JTAG_SHM_SPIN_COUNT; ++i )
+  {
+    const uint32_t value = jtag_shm_load( &index->value );
+
+    if ( value != old_value )
+      return value;
+  }
+
+  jtag_shm_store( &index->is_waiting, 1 );
+
+  if ( jtag_shm_load( &index->value ) == old_value )
+  {
+    timespec timeout;
+    timeout.tv_sec  = timeout_ms / 1000;
+    timeout.tv_nsec = long( timeout_ms % 1000 ) * 1000000;
+
+    // Errors like EAGAIN (the value has already changed) or EINTR are fine, the caller checks the value again.
+    syscall( SYS_futex, &index->value, FUTEX_WAIT, old_value, &timeout, NULL, 0 );
+  }
+
+  jtag_shm_store( &index->is_waiting, 0 );
+
+  return jtag_shm_load( &index->value );
+}
+
+#endif  // Include this header file only once.
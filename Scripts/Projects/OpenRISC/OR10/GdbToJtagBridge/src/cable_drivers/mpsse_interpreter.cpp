@@ -0,0 +1,345 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mpsse_interpreter.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+
+// These are the same values as in libftdi's ftdi.h, which is not included here,
+// so that this module does not depend on libftdi.
+
+static const uint8_t OPCODE_BITMODE   = 0x02;
+static const uint8_t OPCODE_LSB       = 0x08;
+static const uint8_t OPCODE_DO_WRITE  = 0x10;
+static const uint8_t OPCODE_DO_READ   = 0x20;
+static const uint8_t OPCODE_WRITE_TMS = 0x40;
+
+static const uint8_t OPCODE_SET_BITS_LOW   = 0x80;
+static const uint8_t OPCODE_GET_BITS_LOW   = 0x81;
+static const uint8_t OPCODE_SET_BITS_HIGH  = 0x82;
+static const uint8_t OPCODE_GET_BITS_HIGH  = 0x83;
+static const uint8_t OPCODE_LOOPBACK_START = 0x84;
+static const uint8_t OPCODE_LOOPBACK_END   = 0x85;
+static const uint8_t OPCODE_TCK_DIVISOR    = 0x86;
+static const uint8_t OPCODE_SEND_IMMEDIATE = 0x87;
+static const uint8_t OPCODE_CLOCK_BITS     = 0x8E;
+static const uint8_t OPCODE_CLOCK_BYTES    = 0x8F;
+
+// The MPSSE engine answers an unknown opcode with this byte followed by the opcode.
+static const uint8_t BAD_COMMAND_ANSWER = 0xFA;
+
+// Pin assignments on ADBUS for the JTAG signals.
+static const uint8_t ADBUS_TDI_BIT = 0x02;
+static const uint8_t ADBUS_TMS_BIT = 0x08;
+
+
+void mpsse_interpreter_init ( mpsse_interpreter * const mi,
+                              const mpsse_tck_func tck_func,
+                              void * const tck_context )
+{
+  mi->tck_func    = tck_func;
+  mi->tck_context = tck_context;
+
+  mi->is_loopback_enabled = false;
+  mi->tms = 1;
+  mi->tdi = 0;
+
+  mi->write_log = NULL;
+
+  mi->pending_cmd.clear();
+  mi->read_data.clear();
+  mi->read_pos = 0;
+
+  mi->write_call_count   = 0;
+  mi->written_byte_count = 0;
+  mi->command_count      = 0;
+  mi->tck_count          = 0;
+}
+
+
+static int clock_tck ( mpsse_interpreter * const mi, const int tms, const int tdi )
+{
+  ++mi->tck_count;
+
+  mi->tms = uint8_t( tms ? 1 : 0 );
+  mi->tdi = uint8_t( tdi ? 1 : 0 );
+
+  if ( mi->is_loopback_enabled || mi->tck_func == NULL )
+    return mi->tdi;
+
+  return mi->tck_func( mi->tck_context, mi->tms, mi->tdi ) ? 1 : 0;
+}
+
+
+// Returns the total length of the command at the beginning of the given data,
+// or 0 if more bytes are needed in order to tell.
+
+static size_t get_command_length ( const uint8_t * const cmd, const size_t available )
+{
+  assert( available > 0 );
+
+  const uint8_t opcode = cmd[0];
+
+  if ( opcode & 0x80 )
+  {
+    switch ( opcode )
+    {
+    case OPCODE_SET_BITS_LOW:
+    case OPCODE_SET_BITS_HIGH:
+    case OPCODE_TCK_DIVISOR:
+    case OPCODE_CLOCK_BYTES:
+      return 3;
+
+    case OPCODE_CLOCK_BITS:
+      return 2;
+
+    default:
+      return 1;
+    }
+  }
+
+  if ( opcode & OPCODE_WRITE_TMS )
+    return 3;
+
+  if ( opcode & OPCODE_BITMODE )
+    return ( opcode & OPCODE_DO_WRITE ) ? 3 : 2;
+
+  if ( !( opcode & OPCODE_DO_WRITE ) )
+    return 3;
+
+  if ( available < 3 )
+    return 0;
+
+  return 3 + ( size_t( cmd[1] ) | ( size_t( cmd[2] ) << 8 ) ) + 1;
+}
+
+
+// Shifts the given number of bits, which are taken from and stored into 'data' and 'captured'
+// in the bit order given by the LSB flag.
+
+static void shift_byte ( mpsse_interpreter * const mi,
+                         const uint8_t opcode,
+                         const uint8_t data,
+                         const int bit_count,
+                         uint8_t * const captured )
+{
+  const bool is_lsb = ( opcode & OPCODE_LSB ) != 0;
+
+  uint8_t in = 0;
+
+  for ( int i = 0; i < bit_count; ++i )
+  {
+    const int tdi = is_lsb ? ( data >> i ) & 1
+                           : ( data >> ( 7 - i ) ) & 1;
+
+    const int tdo = clock_tck( mi, mi->tms, tdi );
+
+    // In bit mode, the chip shifts the captured bits into the answer byte,
+    // so the first bit ends up at the position given by the bit count.
+    if ( is_lsb )
+      in = uint8_t( ( in >> 1 ) | ( tdo << 7 ) );
+    else
+      in = uint8_t( ( in << 1 ) | tdo );
+  }
+
+  *captured = in;
+}
+
+
+static void execute_command ( mpsse_interpreter * const mi, const uint8_t * const cmd )
+{
+  ++mi->command_count;
+
+  const uint8_t opcode = cmd[0];
+
+  if ( opcode & 0x80 )
+  {
+    switch ( opcode )
+    {
+    case OPCODE_SET_BITS_LOW:
+      mi->tdi = ( cmd[1] & ADBUS_TDI_BIT ) ? 1 : 0;
+      mi->tms = ( cmd[1] & ADBUS_TMS_BIT ) ? 1 : 0;
+      break;
+
+    case OPCODE_GET_BITS_LOW:
+      mi->read_data.push_back( uint8_t( ( mi->tdi ? ADBUS_TDI_BIT : 0 ) |
+                                        ( mi->tms ? ADBUS_TMS_BIT : 0 ) ) );
+      break;
+
+    case OPCODE_GET_BITS_HIGH:
+      mi->read_data.push_back( 0 );
+      break;
+
+    case OPCODE_LOOPBACK_START:
+      mi->is_loopback_enabled = true;
+      break;
+
+    case OPCODE_LOOPBACK_END:
+      mi->is_loopback_enabled = false;
+      break;
+
+    case OPCODE_SET_BITS_HIGH:
+    case OPCODE_TCK_DIVISOR:
+    case OPCODE_SEND_IMMEDIATE:
+      break;
+
+    case OPCODE_CLOCK_BITS:
+      for ( int i = 0; i <= cmd[1]; ++i )
+        clock_tck( mi, mi->tms, mi->tdi );
+      break;
+
+    case OPCODE_CLOCK_BYTES:
+      {
+        const unsigned byte_count = ( unsigned( cmd[1] ) | ( unsigned( cmd[2] ) << 8 ) ) + 1;
+
+        for ( unsigned i = 0; i < byte_count * 8; ++i )
+          clock_tck( mi, mi->tms, mi->tdi );
+      }
+      break;
+
+    default:
+      mi->read_data.push_back( BAD_COMMAND_ANSWER );
+      mi->read_data.push_back( opcode );
+      break;
+    }
+
+    return;
+  }
+
+  const bool is_read = ( opcode & OPCODE_DO_READ ) != 0;
+
+  if ( opcode & OPCODE_WRITE_TMS )
+  {
+    // Up to 7 TMS bits, LSB first. Bit 7 is the TDI value held during the whole sequence.
+    const int bit_count = ( cmd[1] & 7 ) + 1;
+    const int tdi = ( cmd[2] >> 7 ) & 1;
+
+    uint8_t in = 0;
+
+    for ( int i = 0; i < bit_count; ++i )
+    {
+      const int tdo = clock_tck( mi, ( cmd[2] >> i ) & 1, tdi );
+      in = uint8_t( ( in >> 1 ) | ( tdo << 7 ) );
+    }
+
+    if ( is_read )
+      mi->read_data.push_back( in );
+
+    return;
+  }
+
+  const bool is_write = ( opcode & OPCODE_DO_WRITE ) != 0;
+
+  if ( opcode & OPCODE_BITMODE )
+  {
+    const int bit_count = ( cmd[1] & 7 ) + 1;
+    const uint8_t data = is_write ? cmd[2] : ( mi->tdi ? 0xFF : 0x00 );
+
+    uint8_t captured;
+    shift_byte( mi, opcode, data, bit_count, &captured );
+
+    if ( is_read )
+      mi->read_data.push_back( captured );
+
+    return;
+  }
+
+  const unsigned byte_count = ( unsigned( cmd[1] ) | ( unsigned( cmd[2] ) << 8 ) ) + 1;
+
+  for ( unsigned i = 0; i < byte_count; ++i )
+  {
+    const uint8_t data = is_write ? cmd[3 + i] : ( mi->tdi ? 0xFF : 0x00 );
+
+    uint8_t captured;
+    shift_byte( mi, opcode, data, 8, &captured );
+
+    if ( is_read )
+      mi->read_data.push_back( captured );
+  }
+}
+
+
+void mpsse_interpreter_write ( mpsse_interpreter * const mi, const uint8_t * const data, const int len )
+{
+  assert( len >= 0 );
+
+  ++mi->write_call_count;
+  mi->written_byte_count += len;
+
+  if ( mi->write_log != NULL )
+    mi->write_log->insert( mi->write_log->end(), data, data + len );
+
+  // The normal case is that the data contains complete commands only,
+  // so avoid copying it to the pending command buffer.
+
+  const uint8_t * p;
+  size_t available;
+
+  if ( mi->pending_cmd.empty() )
+  {
+    p = data;
+    available = size_t( len );
+  }
+  else
+  {
+    mi->pending_cmd.insert( mi->pending_cmd.end(), data, data + len );
+    p = &mi->pending_cmd.front();
+    available = mi->pending_cmd.size();
+  }
+
+  while ( available > 0 )
+  {
+    const size_t cmd_len = get_command_length( p, available );
+
+    if ( cmd_len == 0 || cmd_len > available )
+      break;
+
+    execute_command( mi, p );
+
+    p += cmd_len;
+    available -= cmd_len;
+  }
+
+  // Keep any incomplete command for the next write call.
+  std::vector< uint8_t > rest( p, p + available );
+  mi->pending_cmd.swap( rest );
+}
+
+
+int mpsse_interpreter_read ( mpsse_interpreter * const mi, uint8_t * const buf, const int len )
+{
+  assert( len >= 0 );
+
+  const size_t available = mi->read_data.size() - mi->read_pos;
+  const size_t to_copy   = std::min( available, size_t( len ) );
+
+  if ( to_copy > 0 )
+    memcpy( buf, &mi->read_data[ mi->read_pos ], to_copy );
+
+  mi->read_pos += to_copy;
+
+  if ( mi->read_pos == mi->read_data.size() )
+  {
+    mi->read_data.clear();
+    mi->read_pos = 0;
+  }
+
+  return int( to_copy );
+}
@@ -0,0 +1,65 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MPSSE_INTERPRETER_H_INCLUDED
+#define MPSSE_INTERPRETER_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+// Software model of the MPSSE engine in the FTDI FT2232 chips.
+//
+// It executes the same command stream that the ft2232 cable driver would send over USB,
+// so that the driver's command assembly can be tested and benchmarked without any hardware.
+// Commands may be split across several write calls, like they can be over USB.
+
+// Generates one TCK clock cycle on the simulated target and returns its TDO value.
+typedef int (*mpsse_tck_func) ( void * context, int tms, int tdi );
+
+struct mpsse_interpreter
+{
+  mpsse_tck_func tck_func;  // If NULL, TDO is looped back from TDI, as if there were a wire between them.
+  void *         tck_context;
+
+  bool    is_loopback_enabled;  // See the LOOPBACK_START command.
+  uint8_t tms;
+  uint8_t tdi;
+
+  std::vector< uint8_t > * write_log;  // If not NULL, receives a copy of all bytes written. Useful for tests.
+
+  std::vector< uint8_t > pending_cmd;  // An incomplete command from the last write call.
+  std::vector< uint8_t > read_data;    // Answer bytes not collected yet.
+  size_t read_pos;
+
+  // Statistics, useful for benchmarking.
+  uint64_t write_call_count;
+  uint64_t written_byte_count;
+  uint64_t command_count;
+  uint64_t tck_count;
+};
+
+void mpsse_interpreter_init ( mpsse_interpreter * mi,
+                              mpsse_tck_func tck_func,
+                              void * tck_context );
+
+void mpsse_interpreter_write ( mpsse_interpreter * mi, const uint8_t * data, int len );
+
+// Returns the number of bytes read, which can be less than requested.
+int mpsse_interpreter_read ( mpsse_interpreter * mi, uint8_t * buf, int len );
+
+#endif  // Include this header file only once.
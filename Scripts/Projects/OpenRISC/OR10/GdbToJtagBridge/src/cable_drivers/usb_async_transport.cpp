@@ -0,0 +1,472 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "usb_async_transport.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <stdexcept>
+#include <algorithm>
+
+#include "string_utils.h"
+
+
+static uint64_t get_monotonic_time_ms ( void )
+{
+  timespec ts;
+
+  if ( 0 != clock_gettime( CLOCK_MONOTONIC, &ts ) )
+    throw std::runtime_error( format_errno_msg( errno, "Cannot read the monotonic clock: " ) );
+
+  return uint64_t( ts.tv_sec ) * 1000 + uint64_t( ts.tv_nsec ) / 1000000;
+}
+
+
+usb_async_transport::usb_async_transport ( usb_async_backend * const backend,
+                                           const usb_async_transport_config & config )
+  : m_backend( backend )
+  , m_config( config )
+  , m_filling( NULL )
+  , m_next_out_sequence( 0 )
+  , m_next_in_sequence( 0 )
+  , m_next_in_sequence_to_deliver( 0 )
+  , m_in_flight_count( 0 )
+  , m_out_transfer_count( 0 )
+  , m_in_transfer_count( 0 )
+  , m_max_in_flight( 0 )
+{
+  assert( config.out_transfer_size > 0 && config.out_transfer_count >= 2 );
+  assert( config.in_transfer_count > 0 );
+  assert( config.in_packet_size > config.in_header_len );
+  assert( config.in_transfer_size >= config.in_packet_size );
+
+  for ( unsigned i = 0; i < config.out_transfer_count; ++i )
+  {
+    usb_async_transfer * const t = new usb_async_transfer();
+    t->is_in = false;
+    t->buffer.resize( config.out_transfer_size );
+    m_out_transfers.push_back( t );
+  }
+
+  for ( unsigned i = 0; i < config.in_transfer_count; ++i )
+  {
+    usb_async_transfer * const t = new usb_async_transfer();
+    t->is_in = true;
+    t->buffer.resize( config.in_transfer_size );
+    m_in_transfers.push_back( t );
+  }
+}
+
+
+usb_async_transport::~usb_async_transport ( void )
+{
+  // There may be IN transfers still waiting for data that will never come.
+  // Any OUT data should have been flushed by the caller.
+
+  for ( size_t i = 0; i < m_in_transfers.size(); ++i )
+  {
+    if ( m_in_transfers[i]->is_in_flight )
+      m_backend->cancel_transfer( this, m_in_transfers[i] );
+  }
+
+  for ( size_t i = 0; i < m_out_transfers.size(); ++i )
+  {
+    if ( m_out_transfers[i]->is_in_flight )
+      m_backend->cancel_transfer( this, m_out_transfers[i] );
+  }
+
+  for ( size_t i = 0; i < m_out_transfers.size(); ++i )
+  {
+    m_backend->release_transfer( m_out_transfers[i] );
+    delete m_out_transfers[i];
+  }
+
+  for ( size_t i = 0; i < m_in_transfers.size(); ++i )
+  {
+    m_backend->release_transfer( m_in_transfers[i] );
+    delete m_in_transfers[i];
+  }
+
+  delete m_backend;
+}
+
+
+usb_async_transfer * usb_async_transport::get_free_out_transfer ( void )
+{
+  for ( ; ; )
+  {
+    for ( size_t i = 0; i < m_out_transfers.size(); ++i )
+    {
+      usb_async_transfer * const t = m_out_transfers[i];
+
+      if ( t != m_filling &&
+           !t->is_in_flight &&
+           std::find( m_out_ready.begin(), m_out_ready.end(), t ) == m_out_ready.end() )
+      {
+        t->length = 0;
+        return t;
+      }
+    }
+
+    // All buffers are on the bus or waiting to go, so wait until one comes back.
+    wait_for_events();
+  }
+}
+
+
+void usb_async_transport::submit ( usb_async_transfer * const transfer )
+{
+  transfer->actual_length = 0;
+  transfer->is_complete   = false;
+  transfer->failed        = false;
+  transfer->is_in_flight  = true;
+
+  if ( transfer->is_in )
+  {
+    transfer->length = m_config.in_transfer_size;
+    transfer->sequence_number = m_next_in_sequence++;
+    ++m_in_transfer_count;
+  }
+  else
+  {
+    transfer->sequence_number = m_next_out_sequence++;
+    ++m_out_transfer_count;
+  }
+
+  ++m_in_flight_count;
+  m_max_in_flight = std::max( m_max_in_flight, m_in_flight_count );
+
+  try
+  {
+    m_backend->submit_transfer( this, transfer );
+  }
+  catch ( ... )
+  {
+    transfer->is_in_flight = false;
+    --m_in_flight_count;
+    throw;
+  }
+}
+
+
+void usb_async_transport::submit_ready_out_transfers ( void )
+{
+  // OUT transfers must go to the bus in order, so they wait here until there is a free slot.
+  // Every OUT buffer counts as a slot, but one of them is reserved for filling,
+  // which is what makes it double-buffered.
+
+  unsigned out_in_flight = 0;
+
+  for ( size_t i = 0; i < m_out_transfers.size(); ++i )
+  {
+    if ( m_out_transfers[i]->is_in_flight )
+      ++out_in_flight;
+  }
+
+  while ( !m_out_ready.empty() && out_in_flight < m_config.out_transfer_count - 1 )
+  {
+    usb_async_transfer * const t = m_out_ready.front();
+    m_out_ready.pop_front();
+    submit( t );
+    ++out_in_flight;
+  }
+}
+
+
+void usb_async_transport::submit_filling_transfer ( void )
+{
+  if ( m_filling != NULL && m_filling->length > 0 )
+  {
+    m_out_ready.push_back( m_filling );
+    m_filling = NULL;
+  }
+
+  submit_ready_out_transfers();
+}
+
+
+void usb_async_transport::write ( const uint8_t * data, unsigned len )
+{
+  while ( len > 0 )
+  {
+    if ( m_filling == NULL )
+      m_filling = get_free_out_transfer();
+
+    const unsigned chunk_len = std::min( len, m_config.out_transfer_size - m_filling->length );
+
+    memcpy( &m_filling->buffer[ m_filling->length ], data, chunk_len );
+    m_filling->length += chunk_len;
+    data += chunk_len;
+    len  -= chunk_len;
+
+    if ( m_filling->length == m_config.out_transfer_size )
+      submit_filling_transfer();
+  }
+}
+
+
+void usb_async_transport::flush ( void )
+{
+  submit_filling_transfer();
+
+  for ( ; ; )
+  {
+    check_for_failed_transfers();
+
+    bool any_pending = !m_out_ready.empty();
+
+    for ( size_t i = 0; i < m_out_transfers.size() && !any_pending; ++i )
+    {
+      if ( m_out_transfers[i]->is_in_flight )
+        any_pending = true;
+    }
+
+    if ( !any_pending )
+      break;
+
+    wait_for_events();
+  }
+}
+
+
+void usb_async_transport::submit_in_transfers ( void )
+{
+  for ( size_t i = 0; i < m_in_transfers.size(); ++i )
+  {
+    usb_async_transfer * const t = m_in_transfers[i];
+
+    if ( !t->is_in_flight && !t->is_complete )
+      submit( t );
+  }
+}
+
+
+// Moves the data of the completed IN transfers to m_in_data, in submission order,
+// and makes the transfer objects available again.
+
+void usb_async_transport::deliver_in_data ( void )
+{
+  for ( ; ; )
+  {
+    usb_async_transfer * next = NULL;
+
+    for ( size_t i = 0; i < m_in_transfers.size(); ++i )
+    {
+      usb_async_transfer * const t = m_in_transfers[i];
+
+      if ( t->is_complete && t->sequence_number == m_next_in_sequence_to_deliver )
+      {
+        next = t;
+        break;
+      }
+    }
+
+    if ( next == NULL )
+      return;
+
+    if ( next->failed )
+      throw std::runtime_error( "USB bulk read transfer failed." );
+
+    // Strip the status header at the beginning of every packet.
+    for ( unsigned pos = 0; pos < next->actual_length; pos += m_config.in_packet_size )
+    {
+      const unsigned packet_end = std::min( pos + m_config.in_packet_size, next->actual_length );
+      const unsigned data_start = pos + m_config.in_header_len;
+
+      if ( data_start < packet_end )
+        m_in_data.insert( m_in_data.end(), &next->buffer[ data_start ], &next->buffer[0] + packet_end );
+    }
+
+    next->is_complete = false;
+    ++m_next_in_sequence_to_deliver;
+  }
+}
+
+
+void usb_async_transport::read ( uint8_t * const buf, const unsigned len )
+{
+  submit_filling_transfer();
+
+  uint64_t last_progress_time = get_monotonic_time_ms();
+
+  while ( m_in_data.size() < len )
+  {
+    check_for_failed_transfers();
+    submit_in_transfers();
+
+    const size_t prev_size = m_in_data.size();
+
+    wait_for_events();
+    deliver_in_data();
+
+    const uint64_t now = get_monotonic_time_ms();
+
+    if ( m_in_data.size() != prev_size )
+    {
+      last_progress_time = now;
+    }
+    else if ( now - last_progress_time >= m_config.timeout_ms )
+    {
+      throw std::runtime_error( format_msg( "Timeout reading from the USB device, %u of %u bytes received.",
+                                            unsigned( m_in_data.size() ), len ) );
+    }
+  }
+
+  std::copy( m_in_data.begin(), m_in_data.begin() + len, buf );
+  m_in_data.erase( m_in_data.begin(), m_in_data.begin() + len );
+}
+
+
+void usb_async_transport::transfer_completed ( usb_async_transfer * const transfer,
+                                               const bool failed,
+                                               const unsigned actual_length )
+{
+  assert( transfer->is_in_flight );
+  assert( actual_length <= transfer->length );
+
+  transfer->is_in_flight  = false;
+  transfer->failed        = failed;
+  transfer->actual_length = actual_length;
+
+  --m_in_flight_count;
+
+  // Completed OUT transfers need no further processing, unless they failed.
+  // Completed IN transfers wait until their turn in deliver_in_data().
+  transfer->is_complete = transfer->is_in || failed;
+}
+
+
+void usb_async_transport::check_for_failed_transfers ( void )
+{
+  for ( size_t i = 0; i < m_out_transfers.size(); ++i )
+  {
+    usb_async_transfer * const t = m_out_transfers[i];
+
+    if ( t->is_complete && t->failed )
+    {
+      t->is_complete = false;
+      throw std::runtime_error( "USB bulk write transfer failed." );
+    }
+  }
+}
+
+
+void usb_async_transport::wait_for_events ( void )
+{
+  const unsigned POLL_INTERVAL_MS = 100;
+
+  m_backend->wait_for_events( this, POLL_INTERVAL_MS );
+
+  // A completed OUT transfer frees a slot on the bus.
+  submit_ready_out_transfers();
+}
+
+
+// ------------------------------------------------------------------------------------------
+// Loopback backend
+
+static const uint8_t LOOPBACK_STATUS_BYTE = 0x31;
+
+class usb_loopback_backend : public usb_async_backend
+{
+  const unsigned m_packet_size;
+  const unsigned m_header_len;
+  std::vector< usb_async_transfer * > m_submitted;  // In submission order.
+  std::deque< uint8_t > m_fifo;
+
+public:
+  usb_loopback_backend ( const unsigned packet_size, const unsigned header_len )
+    : m_packet_size( packet_size )
+    , m_header_len( header_len )
+  {
+  }
+
+  virtual void submit_transfer ( usb_async_transport *, usb_async_transfer * const transfer )
+  {
+    m_submitted.push_back( transfer );
+  }
+
+  virtual void wait_for_events ( usb_async_transport * const transport, unsigned )
+  {
+    if ( m_submitted.empty() )
+      return;
+
+    // The data moves on the bus in submission order...
+    std::vector< unsigned > actual_lengths;
+
+    for ( size_t i = 0; i < m_submitted.size(); ++i )
+    {
+      usb_async_transfer * const t = m_submitted[i];
+
+      if ( !t->is_in )
+      {
+        m_fifo.insert( m_fifo.end(), &t->buffer[0], &t->buffer[0] + t->length );
+        actual_lengths.push_back( t->length );
+        continue;
+      }
+
+      // Like the FTDI chips, every packet starts with a status header, even if there is no data.
+      unsigned pos = 0;
+
+      do
+      {
+        for ( unsigned j = 0; j < m_header_len; ++j )
+          t->buffer[ pos++ ] = LOOPBACK_STATUS_BYTE;
+
+        while ( !m_fifo.empty() && pos % m_packet_size != 0 && pos < t->length )
+        {
+          t->buffer[ pos++ ] = m_fifo.front();
+          m_fifo.pop_front();
+        }
+      }
+      while ( !m_fifo.empty() && pos + m_header_len < t->length );
+
+      actual_lengths.push_back( pos );
+    }
+
+    // ...but the completions are reported in reverse order.
+    std::vector< usb_async_transfer * > submitted;
+    submitted.swap( m_submitted );
+
+    for ( size_t i = submitted.size(); i > 0; --i )
+      transport->transfer_completed( submitted[ i - 1 ], false, actual_lengths[ i - 1 ] );
+  }
+
+  virtual void cancel_transfer ( usb_async_transport * const transport, usb_async_transfer * const transfer )
+  {
+    std::vector< usb_async_transfer * >::iterator it = std::find( m_submitted.begin(), m_submitted.end(), transfer );
+
+    if ( it != m_submitted.end() )
+    {
+      m_submitted.erase( it );
+      transport->transfer_completed( transfer, true, 0 );
+    }
+  }
+
+  virtual void release_transfer ( usb_async_transfer * )
+  {
+  }
+};
+
+
+usb_async_backend * usb_async_create_loopback_backend ( const unsigned packet_size, const unsigned header_len )
+{
+  assert( packet_size > header_len );
+  return new usb_loopback_backend( packet_size, header_len );
+}
@@ -0,0 +1,190 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USB_ASYNC_TRANSPORT_H_INCLUDED
+#define USB_ASYNC_TRANSPORT_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+#include <deque>
+
+// Asynchronous bulk transfer layer for the USB cable drivers.
+//
+// With synchronous calls, every chunk of data waits for a full USB round trip before the next one
+// can be sent. This layer keeps several OUT and IN transfers in flight at the same time,
+// so that the USB pipe stays busy during long streams. While some OUT buffers are on the bus,
+// the driver keeps filling the next one.
+//
+// The OUT data is a plain byte stream: writes are accumulated and split into transfers
+// of the configured size. The IN data is also returned as a byte stream, after stripping
+// the status header that some chips (like the FTDI ones) prepend to every IN packet.
+// IN transfers may complete in any order, but their data is always delivered in submission order.
+//
+// The actual USB access is done by a backend. Besides the libusb-1.0 backend,
+// there is a loopback backend that echoes the OUT data back, so that the chunking
+// and reordering logic can be exercised without a device.
+
+struct usb_async_transfer
+{
+  bool is_in;
+  std::vector< uint8_t > buffer;  // Allocated once with the maximum transfer size.
+  unsigned length;                // OUT: bytes to send. IN: maximum bytes to receive.
+  unsigned actual_length;         // Set on completion.
+  uint64_t sequence_number;       // Submission order within the same direction.
+  bool     is_in_flight;
+  bool     is_complete;
+  bool     failed;
+  void *   backend_data;          // For example, the libusb_transfer object.
+
+  usb_async_transfer ( void )
+    : is_in( false )
+    , length( 0 )
+    , actual_length( 0 )
+    , sequence_number( 0 )
+    , is_in_flight( false )
+    , is_complete( false )
+    , failed( false )
+    , backend_data( NULL )
+  {
+  }
+};
+
+
+class usb_async_transport;
+
+class usb_async_backend
+{
+public:
+  virtual ~usb_async_backend ( void ) {}
+
+  // Starts a bulk transfer on the OUT or IN endpoint, as given by transfer->is_in.
+  // The backend must call usb_async_transport::transfer_completed() later on,
+  // but only from within wait_for_events() or cancel_transfer().
+  virtual void submit_transfer ( usb_async_transport * transport, usb_async_transfer * transfer ) = 0;
+
+  // Blocks until at least one transfer has completed, or until the given time has elapsed.
+  virtual void wait_for_events ( usb_async_transport * transport, unsigned timeout_ms ) = 0;
+
+  // Aborts an in-flight transfer and waits for its completion to be reported.
+  virtual void cancel_transfer ( usb_async_transport * transport, usb_async_transfer * transfer ) = 0;
+
+  // Releases any backend resources attached to the transfer object.
+  virtual void release_transfer ( usb_async_transfer * transfer ) = 0;
+};
+
+
+struct usb_async_transport_config
+{
+  unsigned out_transfer_size;
+  unsigned out_transfer_count;  // Maximum number of OUT transfers in flight, at least 2 for double buffering.
+  unsigned in_transfer_size;    // Including the status header.
+  unsigned in_transfer_count;   // Maximum number of IN transfers in flight.
+  unsigned in_header_len;       // Bytes at the beginning of every IN packet that are not data.
+  unsigned in_packet_size;      // The header repeats at every packet boundary inside an IN transfer.
+  unsigned timeout_ms;          // How long a read may wait without receiving any data.
+};
+
+
+class usb_async_transport
+{
+public:
+  usb_async_transport ( usb_async_backend * backend,  // This object takes ownership.
+                        const usb_async_transport_config & config );
+  ~usb_async_transport ( void );
+
+  // Queues data for the OUT endpoint. Full transfer buffers are submitted straight away,
+  // but the last partial one is only submitted on the next read or flush.
+  void write ( const uint8_t * data, unsigned len );
+
+  // Submits any pending OUT data and waits until all of it has been sent.
+  void flush ( void );
+
+  // Submits any pending OUT data and reads exactly the given number of data bytes.
+  // Throws an exception if no data arrives within the configured timeout.
+  void read ( uint8_t * buf, unsigned len );
+
+  // Called by the backend when a transfer has finished.
+  void transfer_completed ( usb_async_transfer * transfer, bool failed, unsigned actual_length );
+
+  usb_async_backend * get_backend ( void ) const { return m_backend; }
+
+  // Statistics, useful for benchmarking.
+  uint64_t get_out_transfer_count ( void ) const { return m_out_transfer_count; }
+  uint64_t get_in_transfer_count  ( void ) const { return m_in_transfer_count;  }
+  unsigned get_max_in_flight      ( void ) const { return m_max_in_flight;      }
+
+private:
+  usb_async_backend * const m_backend;
+  const usb_async_transport_config m_config;
+
+  std::vector< usb_async_transfer * > m_out_transfers;
+  std::vector< usb_async_transfer * > m_in_transfers;
+
+  usb_async_transfer * m_filling;                  // The OUT buffer being filled, if any.
+  std::deque< usb_async_transfer * > m_out_ready;  // Full OUT buffers waiting for a free slot on the bus.
+
+  uint64_t m_next_out_sequence;
+  uint64_t m_next_in_sequence;
+  uint64_t m_next_in_sequence_to_deliver;
+
+  std::deque< uint8_t > m_in_data;  // Received data bytes not yet collected by read().
+
+  unsigned m_in_flight_count;
+  uint64_t m_out_transfer_count;
+  uint64_t m_in_transfer_count;
+  unsigned m_max_in_flight;
+
+  usb_async_transfer * get_free_out_transfer ( void );
+  void submit_ready_out_transfers ( void );
+  void submit_filling_transfer ( void );
+  void submit ( usb_async_transfer * transfer );
+  void submit_in_transfers ( void );
+  void deliver_in_data ( void );
+  void check_for_failed_transfers ( void );
+  void wait_for_events ( void );
+};
+
+
+// A backend without hardware: the data of every OUT transfer is appended to a FIFO,
+// and IN transfers return it again, with a fake status header of the given length at the beginning
+// of every packet. The completions are reported in reverse submission order, in order to exercise
+// the reordering logic in the transport.
+usb_async_backend * usb_async_create_loopback_backend ( unsigned packet_size, unsigned header_len );
+
+#ifdef __SUPPORT_LIBUSB1__
+// Opens the first device with the given IDs and claims the given interface.
+// Throws an exception on error.
+usb_async_backend * usb_async_create_libusb1_backend ( uint16_t vendor_id,
+                                                       uint16_t product_id,
+                                                       int interface_number,
+                                                       uint8_t out_endpoint,
+                                                       uint8_t in_endpoint );
+
+// Synchronous control transfer on a libusb-1.0 backend. Returns the number of bytes transferred,
+// or a negative value on error, like usb_control_msg() in libusb-0.1.
+int usb_async_libusb1_control_msg ( usb_async_backend * backend,
+                                    uint8_t request_type,
+                                    uint8_t request,
+                                    uint16_t value,
+                                    uint16_t index,
+                                    uint8_t * data,
+                                    uint16_t length,
+                                    unsigned timeout_ms );
+#endif
+
+#endif  // Include this header file only once.
@@ -0,0 +1,227 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// libusb-1.0 backend for the asynchronous USB transport.
+// libusb-0.1 has no asynchronous API, that is why this backend needs the newer library.
+
+#include "usb_async_transport.h"  // The include file for this module should come first.
+
+#include <assert.h>
+
+#include <stdexcept>
+
+#include <libusb-1.0/libusb.h>
+
+#include "string_utils.h"
+
+
+static std::string get_libusb_error_msg ( const int code, const char * const prefix )
+{
+  return format_msg( "%s%s (%d)", prefix, libusb_error_name( code ), code );
+}
+
+
+class usb_libusb1_backend : public usb_async_backend
+{
+  libusb_context *       m_context;
+  libusb_device_handle * m_handle;
+  const int              m_interface_number;
+  const uint8_t          m_out_endpoint;
+  const uint8_t          m_in_endpoint;
+
+  // Each callback needs to know which transport object to notify.
+  struct callback_data
+  {
+    usb_async_transport * transport;
+    usb_async_transfer *  transfer;
+  };
+
+  static void LIBUSB_CALL transfer_callback ( libusb_transfer * const lt )
+  {
+    callback_data * const cd = static_cast< callback_data * >( lt->user_data );
+
+    cd->transport->transfer_completed( cd->transfer,
+                                       lt->status != LIBUSB_TRANSFER_COMPLETED,
+                                       unsigned( lt->actual_length ) );
+  }
+
+  void close ( void )
+  {
+    if ( m_handle != NULL )
+    {
+      libusb_release_interface( m_handle, m_interface_number );
+      libusb_close( m_handle );
+      m_handle = NULL;
+    }
+
+    if ( m_context != NULL )
+    {
+      libusb_exit( m_context );
+      m_context = NULL;
+    }
+  }
+
+public:
+  usb_libusb1_backend ( const uint16_t vendor_id,
+                        const uint16_t product_id,
+                        const int interface_number,
+                        const uint8_t out_endpoint,
+                        const uint8_t in_endpoint )
+    : m_context( NULL )
+    , m_handle( NULL )
+    , m_interface_number( interface_number )
+    , m_out_endpoint( out_endpoint )
+    , m_in_endpoint( in_endpoint )
+  {
+    const int init_res = libusb_init( &m_context );
+
+    if ( init_res != 0 )
+      throw std::runtime_error( get_libusb_error_msg( init_res, "Error initialising libusb-1.0: " ) );
+
+    try
+    {
+      m_handle = libusb_open_device_with_vid_pid( m_context, vendor_id, product_id );
+
+      if ( m_handle == NULL )
+        throw std::runtime_error( format_msg( "Cannot open the USB device with VID 0x%04X and PID 0x%04X.",
+                                              vendor_id, product_id ) );
+
+      const int claim_res = libusb_claim_interface( m_handle, interface_number );
+
+      if ( claim_res != 0 )
+      {
+        libusb_close( m_handle );
+        m_handle = NULL;
+        throw std::runtime_error( get_libusb_error_msg( claim_res, "Cannot claim the USB interface: " ) );
+      }
+    }
+    catch ( ... )
+    {
+      close();
+      throw;
+    }
+  }
+
+  virtual ~usb_libusb1_backend ( void )
+  {
+    close();
+  }
+
+  libusb_device_handle * get_handle ( void ) const { return m_handle; }
+
+  virtual void submit_transfer ( usb_async_transport * const transport, usb_async_transfer * const transfer )
+  {
+    libusb_transfer * lt = static_cast< libusb_transfer * >( transfer->backend_data );
+
+    if ( lt == NULL )
+    {
+      lt = libusb_alloc_transfer( 0 );
+
+      if ( lt == NULL )
+        throw std::runtime_error( "Cannot allocate a libusb transfer." );
+
+      lt->user_data = new callback_data();
+      transfer->backend_data = lt;
+    }
+
+    callback_data * const cd = static_cast< callback_data * >( lt->user_data );
+    cd->transport = transport;
+    cd->transfer  = transfer;
+
+    // The timeout is handled by the transport, so the transfers themselves never time out.
+    libusb_fill_bulk_transfer( lt,
+                               m_handle,
+                               transfer->is_in ? m_in_endpoint : m_out_endpoint,
+                               &transfer->buffer[0],
+                               int( transfer->length ),
+                               transfer_callback,
+                               cd,
+                               0 );
+
+    const int res = libusb_submit_transfer( lt );
+
+    if ( res != 0 )
+      throw std::runtime_error( get_libusb_error_msg( res, "Error submitting a USB bulk transfer: " ) );
+  }
+
+  virtual void wait_for_events ( usb_async_transport *, const unsigned timeout_ms )
+  {
+    timeval tv;
+    tv.tv_sec  = timeout_ms / 1000;
+    tv.tv_usec = ( timeout_ms % 1000 ) * 1000;
+
+    const int res = libusb_handle_events_timeout_completed( m_context, &tv, NULL );
+
+    if ( res != 0 && res != LIBUSB_ERROR_INTERRUPTED )
+      throw std::runtime_error( get_libusb_error_msg( res, "Error waiting for USB events: " ) );
+  }
+
+  virtual void cancel_transfer ( usb_async_transport *, usb_async_transfer * const transfer )
+  {
+    libusb_transfer * const lt = static_cast< libusb_transfer * >( transfer->backend_data );
+    assert( lt != NULL );
+
+    if ( 0 != libusb_cancel_transfer( lt ) )
+      return;  // The transfer has probably completed in the meantime, the callback will be called anyway.
+
+    // The callback reports the cancellation, keep processing events until it arrives.
+    while ( transfer->is_in_flight )
+    {
+      const int res = libusb_handle_events_completed( m_context, NULL );
+
+      if ( res != 0 && res != LIBUSB_ERROR_INTERRUPTED )
+        break;
+    }
+  }
+
+  virtual void release_transfer ( usb_async_transfer * const transfer )
+  {
+    libusb_transfer * const lt = static_cast< libusb_transfer * >( transfer->backend_data );
+
+    if ( lt == NULL )
+      return;
+
+    delete static_cast< callback_data * >( lt->user_data );
+    libusb_free_transfer( lt );
+    transfer->backend_data = NULL;
+  }
+};
+
+
+usb_async_backend * usb_async_create_libusb1_backend ( const uint16_t vendor_id,
+                                                       const uint16_t product_id,
+                                                       const int interface_number,
+                                                       const uint8_t out_endpoint,
+                                                       const uint8_t in_endpoint )
+{
+  return new usb_libusb1_backend( vendor_id, product_id, interface_number, out_endpoint, in_endpoint );
+}
+
+
+int usb_async_libusb1_control_msg ( usb_async_backend * const backend,
+                                    const uint8_t request_type,
+                                    const uint8_t request,
+                                    const uint16_t value,
+                                    const uint16_t index,
+                                    uint8_t * const data,
+                                    const uint16_t length,
+                                    const unsigned timeout_ms )
+{
+  usb_libusb1_backend * const b = dynamic_cast< usb_libusb1_backend * >( backend );
+  assert( b != NULL );
+
+  return libusb_control_transfer( b->get_handle(), request_type, request, value, index, data, length, timeout_ms );
+}
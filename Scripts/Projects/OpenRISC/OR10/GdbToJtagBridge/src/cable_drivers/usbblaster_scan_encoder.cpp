@@ -0,0 +1,164 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "usbblaster_scan_encoder.h"  // The include file for this module should come first.
+
+#include <assert.h>
+
+
+static uint8_t get_stream_byte ( const uint32_t * const stream, const unsigned byte_index )
+{
+  return uint8_t( stream[ byte_index / 4 ] >> ( ( byte_index % 4 ) * 8 ) );
+}
+
+
+static bool get_stream_bit ( const uint32_t * const stream, const unsigned bit_index )
+{
+  return ( ( stream[ bit_index / 32 ] >> ( bit_index % 32 ) ) & 1 ) != 0;
+}
+
+
+void usbblaster_encode_scan ( const uint32_t * const out_stream,
+                              const int len_bits,
+                              const bool set_last_bit,
+                              const bool read_tdo,
+                              const bool is_clock_high,
+                              usbblaster_encoded_scan * const scan )
+{
+  assert( len_bits > 0 );
+
+  // The last bit must be clocked in bit-bang mode if TMS needs to be set.
+  unsigned byte_shift_count = unsigned( len_bits ) / 8;
+
+  if ( set_last_bit && byte_shift_count * 8 == unsigned( len_bits ) )
+    --byte_shift_count;
+
+  scan->commands.clear();
+  scan->byte_shift_count = byte_shift_count;
+  scan->bit_bang_count   = unsigned( len_bits ) - byte_shift_count * 8;
+
+  const uint8_t base_cmd = USBBLASTER_CMD_OE | USBBLASTER_CMD_nCS;  // USB-Blaster has no TRST pin.
+  const uint8_t read_flag = read_tdo ? USBBLASTER_CMD_READ : 0;
+
+  bool clock_high = is_clock_high;
+
+  if ( byte_shift_count != 0 )
+  {
+    if ( clock_high )
+    {
+      scan->commands.push_back( base_cmd );
+      clock_high = false;
+    }
+
+    for ( unsigned pos = 0; pos < byte_shift_count; )
+    {
+      const unsigned block_len = ( byte_shift_count - pos > USBBLASTER_MAX_BYTESHIFT_LEN )
+                                     ? USBBLASTER_MAX_BYTESHIFT_LEN
+                                     : byte_shift_count - pos;
+
+      scan->commands.push_back( uint8_t( USBBLASTER_CMD_BYTESHIFT | read_flag | block_len ) );
+
+      for ( unsigned i = 0; i < block_len; ++i )
+        scan->commands.push_back( get_stream_byte( out_stream, pos + i ) );
+
+      pos += block_len;
+    }
+  }
+
+  // Each bit-bang bit is sent like cable_common_read_write_bit() does: first set the data and drop the clock,
+  // and then raise the clock, reading TDO at the same time.
+  for ( unsigned i = byte_shift_count * 8; i < unsigned( len_bits ); ++i )
+  {
+    uint8_t cmd = base_cmd;
+
+    if ( get_stream_bit( out_stream, i ) )
+      cmd |= USBBLASTER_CMD_TDI;
+
+    if ( set_last_bit && i == unsigned( len_bits ) - 1 )
+      cmd |= USBBLASTER_CMD_TMS;
+
+    scan->commands.push_back( cmd );
+    scan->commands.push_back( uint8_t( cmd | USBBLASTER_CMD_TCK | read_flag ) );
+    clock_high = true;
+  }
+
+  scan->is_clock_high_at_the_end = clock_high;
+}
+
+
+void usbblaster_decode_scan ( const usbblaster_encoded_scan * const scan,
+                              const uint8_t * const answer,
+                              uint32_t * const in_stream )
+{
+  const unsigned len_bits = scan->byte_shift_count * 8 + scan->bit_bang_count;
+
+  for ( unsigned i = 0; i < ( len_bits + 31 ) / 32; ++i )
+    in_stream[ i ] = 0;
+
+  // Byte-shift mode delivers the bits LSB first, like the stream layout. Works for either endian.
+  for ( unsigned i = 0; i < scan->byte_shift_count; ++i )
+    in_stream[ i / 4 ] |= uint32_t( answer[ i ] ) << ( ( i % 4 ) * 8 );
+
+  for ( unsigned i = 0; i < scan->bit_bang_count; ++i )
+  {
+    const unsigned bit_index = scan->byte_shift_count * 8 + i;
+
+    // TDO is bit 0. USB-Blaster may also set bit 1.
+    if ( answer[ scan->byte_shift_count + i ] & 0x01 )
+      in_stream[ bit_index / 32 ] |= uint32_t( 1 ) << ( bit_index % 32 );
+  }
+}
+
+
+unsigned usbblaster_find_segment_end ( const std::vector< uint8_t > * const commands,
+                                       const unsigned start,
+                                       const unsigned max_answer_len,
+                                       unsigned * const answer_len )
+{
+  unsigned pos = start;
+  unsigned len = 0;
+
+  while ( pos < commands->size() )
+  {
+    const uint8_t cmd = (*commands)[ pos ];
+
+    unsigned cmd_len;
+    unsigned cmd_answer_len;
+
+    if ( cmd & USBBLASTER_CMD_BYTESHIFT )
+    {
+      const unsigned byte_count = cmd & 0x3F;
+      cmd_len = 1 + byte_count;
+      cmd_answer_len = ( cmd & USBBLASTER_CMD_READ ) ? byte_count : 0;
+    }
+    else
+    {
+      cmd_len = 1;
+      cmd_answer_len = ( cmd & USBBLASTER_CMD_READ ) ? 1 : 0;
+    }
+
+    assert( pos + cmd_len <= commands->size() );
+
+    if ( pos != start && len + cmd_answer_len > max_answer_len )
+      break;
+
+    pos += cmd_len;
+    len += cmd_answer_len;
+  }
+
+  *answer_len = len;
+  return pos;
+}
@@ -0,0 +1,85 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USBBLASTER_SCAN_ENCODER_H_INCLUDED
+#define USBBLASTER_SCAN_ENCODER_H_INCLUDED
+
+#include <stdint.h>
+
+#include <vector>
+
+// Builds the USB-Blaster command bytes for a complete JTAG scan.
+//
+// The USB-Blaster can shift whole bytes at once in byte-shift mode, but it cannot set TMS there,
+// so the remaining bits and the last bit with TMS must be clocked in bit-bang mode.
+// Instead of sending each part in a separate USB transaction, the whole scan is encoded
+// in a single command stream: a bit-bang byte to lower TCK if necessary, the byte-shift blocks,
+// and then 2 bit-bang bytes per leftover bit. If TDO is wanted, all commands carry the read flag,
+// so that the answers for the whole scan can be collected afterwards in one go.
+//
+// These routines do not talk to the hardware, so that they can be checked against
+// recorded command traces.
+
+// Bit meanings in the command byte sent to the USB-Blaster.
+#define USBBLASTER_CMD_TCK 0x01
+#define USBBLASTER_CMD_TMS 0x02
+#define USBBLASTER_CMD_nCE 0x04  /* should be left low */
+#define USBBLASTER_CMD_nCS 0x08  /* must be set for byte-shift mode reads to work */
+#define USBBLASTER_CMD_TDI 0x10
+#define USBBLASTER_CMD_OE  0x20  /* appears necessary to set it to make everything work */
+#define USBBLASTER_CMD_READ 0x40
+#define USBBLASTER_CMD_BYTESHIFT 0x80
+
+// The byte count in a byte-shift command has 6 bits.
+#define USBBLASTER_MAX_BYTESHIFT_LEN 63
+
+
+struct usbblaster_encoded_scan
+{
+  std::vector< uint8_t > commands;
+
+  // The answer consists of one TDO byte for each byte shifted in byte-shift mode,
+  // followed by one byte per bit-bang bit, with TDO in bit 0.
+  unsigned byte_shift_count;
+  unsigned bit_bang_count;
+
+  bool is_clock_high_at_the_end;
+};
+
+
+void usbblaster_encode_scan ( const uint32_t * out_stream,
+                              int len_bits,
+                              bool set_last_bit,
+                              bool read_tdo,
+                              bool is_clock_high,  // Byte-shift mode assumes that TCK starts low.
+                              usbblaster_encoded_scan * scan );
+
+// Fills in_stream with the TDO bits from the answer, which must be
+// byte_shift_count + bit_bang_count bytes long.
+void usbblaster_decode_scan ( const usbblaster_encoded_scan * scan,
+                              const uint8_t * answer,
+                              uint32_t * in_stream );
+
+// Returns the position of the first command at or after 'start' that would make
+// the number of answer bytes exceed max_answer_len, or the end of the command stream.
+// The number of answer bytes up to that point is returned in answer_len.
+// Each segment contains at least one command.
+unsigned usbblaster_find_segment_end ( const std::vector< uint8_t > * commands,
+                                       unsigned start,
+                                       unsigned max_answer_len,
+                                       unsigned * answer_len );
+
+#endif  // Include this header file only once.
@@ -25,7 +25,6 @@
 #include "chain_commands.h"  // The include file for this module should come first.
 
 #include <stdio.h>
-#include <string.h>  // For memset().
 #include <assert.h>
 #include <stdarg.h>
 
@@ -37,6 +36,8 @@
 #include "string_utils.h"
 #include "linux_utils.h"
 #include "or10_debug_module.h"
+#include "jtag_trace_ring.h"
+#include "jtag_tap_state.h"
 
 
 #define debug(...) //fprintf(stderr, __VA_ARGS__ )
@@ -72,6 +73,8 @@ static bool is_xilinx_bscan_internal_jtag = false;
 static unsigned int vjtag_cmd_vir = ALTERA_CYCLONE_CMD_VIR;  // virtual IR-shift command for altera devices, may be configured on command line
 static unsigned int vjtag_cmd_vdr = ALTERA_CYCLONE_CMD_VDR; // virtual DR-shift, ditto
 
+static bool s_is_dr_session_enabled = false;
+
 static bool s_enable_bit_data_trace = false;
 static const char BIT_DATA_TRACE_PREFIX[] = "JTAG bit data: ";
 static std::string s_trace_buffer;
@@ -79,6 +82,14 @@ static std::string s_trace_buffer;
 
 static void trace_jtag ( const char * const format_str, ... )
 {
+  if ( jtag_trace_ring_is_enabled() )
+  {
+    va_list arg_list;
+    va_start( arg_list, format_str );
+    jtag_trace_ring_record_context( false, format_str, arg_list );
+    va_end( arg_list );
+  }
+
   if ( !s_enable_bit_data_trace )
     return;
 
@@ -163,9 +174,16 @@ void config_set_trace ( const bool enable_bit_data_trace )
   s_enable_bit_data_trace = enable_bit_data_trace;
 }
 
+void config_set_dr_session ( const bool enable )
+{
+  s_is_dr_session_enabled = enable;
+}
+
 
 static void trace_outgoing_bit ( const uint8_t packet )
 {
+  jtag_trace_ring_record_outgoing_bit( packet );
+
   if ( !s_enable_bit_data_trace )
     return;
 
@@ -187,12 +205,34 @@ static void trace_outgoing_bit ( const uint8_t packet )
 }
 
 
+static void trace_outgoing_tms_sequence ( const uint32_t tms_bits,
+                                          const int bit_count,
+                                          const int tap_state )  // Before the sequence, for the binary trace only.
+{
+  jtag_trace_ring_record_tms_sequence( tms_bits, bit_count, tap_state );
+
+  if ( !s_enable_bit_data_trace )
+    return;
+
+  s_trace_buffer.clear();
+
+  for ( int i = 0; i < bit_count; i++ )
+    s_trace_buffer += ( ( tms_bits >> i ) & 1 ) ? '1' : '0';
+
+  printf( "%sSent TMS sequence: %s\n",
+          BIT_DATA_TRACE_PREFIX,
+          s_trace_buffer.c_str() );
+}
+
+
 static void trace_outgoing_stream ( const uint32_t * const stream,
                                     const int len_bits,
                                     const bool set_TMS_during_the_last_bit_transfer )
 {
   assert( len_bits > 0 );
 
+  jtag_trace_ring_record_outgoing_stream( stream, len_bits, set_TMS_during_the_last_bit_transfer );
+
   if ( !s_enable_bit_data_trace )
     return;
 
@@ -230,6 +270,8 @@ static void trace_incoming_stream ( const uint32_t * const stream,
 {
   assert( len_bits > 0 );
 
+  jtag_trace_ring_record_incoming_stream( stream, len_bits );
+
   if ( !s_enable_bit_data_trace )
     return;
 
@@ -259,22 +301,211 @@ static void trace_incoming_stream ( const uint32_t * const stream,
 }
 
 
+////////////////////////////////////////////////////////////////////
+// TAP state tracking
+//
+// All TMS changes go through this module, so it always knows the current TAP state.
+// The TAP can then be moved to any other state with the shortest TMS sequence,
+// and moving to the state the TAP is already in costs nothing.
+
+
+static tap_state_enum s_tap_state = TAP_STATE_UNKNOWN;
+
+// The number of consecutive TMS=1 bits sent while the TAP state was unknown.
+static int s_tms_high_count_in_unknown_state = 0;
+
+// Whether the TAP has been parked in Pause-DR at the end of a debug operation, see tap_end_dr_session().
+static bool s_is_dr_session_open = false;
+
+// The last instruction written to the IR, so that writing it again can be skipped.
+static bool s_is_ir_known = false;
+static unsigned s_current_ir = 0;
+
+
+static void track_tms_bit ( const bool tms )
+{
+  if ( s_tap_state != TAP_STATE_UNKNOWN )
+  {
+    s_tap_state = get_next_tap_state( s_tap_state, tms );
+    return;
+  }
+
+  // 5 consecutive TMS=1 bits lead to Test-Logic-Reset from any state.
+  if ( !tms )
+  {
+    s_tms_high_count_in_unknown_state = 0;
+    return;
+  }
+
+  ++s_tms_high_count_in_unknown_state;
+
+  if ( s_tms_high_count_in_unknown_state >= 5 )
+    s_tap_state = TAP_STATE_TEST_LOGIC_RESET;
+}
+
+
+static void track_packet ( const uint8_t packet )
+{
+  if ( packet & TRST )
+  {
+    // Whether the TAP lands in Test-Logic-Reset depends on whether the TRST signal is actually connected.
+    s_tap_state = TAP_STATE_UNKNOWN;
+    s_tms_high_count_in_unknown_state = 0;
+    s_is_ir_known = false;
+    return;
+  }
+
+  track_tms_bit( ( packet & TMS ) != 0 );
+}
+
+
+static void track_stream ( const int length_bits,
+                           const bool set_TMS_during_the_last_bit_transfer )
+{
+  assert( length_bits > 0 );
+
+  // With TMS low, every state reaches a state that loops on itself in at most 2 steps.
+  for ( int i = 0; i < length_bits - 1 && i < 2; ++i )
+    track_tms_bit( false );
+
+  track_tms_bit( set_TMS_during_the_last_bit_transfer );
+}
+
+
+// Appends the shortest path from 'state' to 'target' to the given TMS sequence, and updates 'state'.
+
+static void append_tms_path ( tap_state_enum * const state,
+                              const tap_state_enum target,
+                              uint32_t * const tms_bits,
+                              int * const bit_count )
+{
+  if ( *state == TAP_STATE_UNKNOWN )
+    throw std::runtime_error( "The JTAG TAP state is unknown, the TAP must be reset first." );
+
+  uint32_t path_bits;
+  int path_len;
+  get_shortest_tms_path( *state, target, &path_bits, &path_len );
+
+  *tms_bits  |= path_bits << *bit_count;
+  *bit_count += path_len;
+
+  assert( *bit_count <= 32 );
+
+  *state = target;
+}
+
+
 ////////////////////////////////////////////////////////////////////
 // Operations to read / write data over JTAG
 
+// Bits from the devices between the target and the cable data input that have not been
+// shifted out yet, see jtag_discard_postfix_bits(). They are merged into the next read
+// from the target, so that they do not cost a separate cable transfer.
+static int s_pending_postfix_bit_count = 0;
+
+// Scratch buffers for the scans that need padding.
+static std::vector< uint32_t > s_padded_out;
+static std::vector< uint32_t > s_padded_in;
+
+#define BITS_PER_BYTE  8
+#define JSZIIH_BUFFER_SIZE_IN_WORDS 64
+static const int MAX_BITS_PER_CHUNK = JSZIIH_BUFFER_SIZE_IN_WORDS * sizeof(uint32_t) * BITS_PER_BYTE;
+
+// The NOP command is made up of zeros, and so is the padding for other devices in the chain.
+static const uint32_t s_zero_buffer[ JSZIIH_BUFFER_SIZE_IN_WORDS ] = { 0 };
+
+
+static void copy_bits ( const uint32_t * const src,
+                        const int src_pos,
+                        uint32_t * const dest,
+                        const int dest_pos,
+                        const int bit_count )
+{
+  for ( int i = 0; i < bit_count; ++i )
+  {
+    const int s = src_pos  + i;
+    const int d = dest_pos + i;
+
+    const uint32_t mask = uint32_t( 1 ) << ( d % 32 );
+
+    if ( ( src[ s / 32 ] >> ( s % 32 ) ) & 1 )
+      dest[ d / 32 ] |= mask;
+    else
+      dest[ d / 32 ] &= ~mask;
+  }
+}
+
+
+// Used before operations that cannot merge the pending postfix bits into their own scan.
+
+static void shift_pending_postfix_bits ( void )
+{
+  if ( s_pending_postfix_bit_count == 0 )
+    return;
+
+  const int bit_count = s_pending_postfix_bit_count;
+  s_pending_postfix_bit_count = 0;
+
+  assert( bit_count <= MAX_BITS_PER_CHUNK );
+
+  trace_outgoing_stream( s_zero_buffer, bit_count, false );
+
+  throw_if_error( cable_write_stream( s_zero_buffer, bit_count, 0 ) );
+  track_stream( bit_count, false );
+}
+
+
 static void jtag_write_bit ( uint8_t packet  // See the TDO, TMS and TRST constants.
                            )
 {
+  shift_pending_postfix_bits();
+
   trace_outgoing_bit( packet );
   throw_if_error( cable_write_bit( packet ) );
+  track_packet( packet );
+}
+
+// Walks the TAP state machine. The TMS values are sent from LSB to MSB, TDI is held low.
+
+static void jtag_write_tms_sequence ( const uint32_t tms_bits,
+                                      const int bit_count )
+{
+  shift_pending_postfix_bits();
+
+  trace_outgoing_tms_sequence( tms_bits, bit_count, s_tap_state );
+  throw_if_error( cable_write_tms_sequence( tms_bits, bit_count ) );
+
+  for ( int i = 0; i < bit_count; ++i )
+    track_tms_bit( ( ( tms_bits >> i ) & 1 ) != 0 );
+}
+
+
+static void tap_move_to_state ( const tap_state_enum target )
+{
+  tap_state_enum state = s_tap_state;
+  uint32_t tms_bits = 0;
+  int bit_count = 0;
+
+  append_tms_path( &state, target, &tms_bits, &bit_count );
+
+  if ( bit_count != 0 )
+    jtag_write_tms_sequence( tms_bits, bit_count );
+
+  assert( s_tap_state == target );
 }
 
+
 void jtag_read_write_bit ( const uint8_t packet,  // See the TDO, TMS and TRST constants.
                            uint8_t * const in_bit )
 {
+  shift_pending_postfix_bits();
+
   trace_outgoing_bit( packet );
 
   throw_if_error( cable_read_write_bit( packet, in_bit ) );
+  track_packet( packet );
+
+  jtag_trace_ring_record_incoming_bit( *in_bit );
 
   if ( s_enable_bit_data_trace )
     printf( "%sReceived bit TDI=%c\n",
@@ -282,101 +513,109 @@ void jtag_read_write_bit ( const uint8_t packet,  // See the TDO, TMS and TRST c
             *in_bit ? '1' : '0' );
 }
 
+// Like jtag_read_write_bit(), but in queued mode the bit read is only available after the next jtag_flush() call.
+// Therefore, the incoming bit is not traced.
 
-// When set_TMS_during_the_last_bit_transfer is true, this function ensures the written data is in the desired JTAG chain position
-// (past prefix bits) before sending TMS. The extra bits sent after the given out_data are padded with zeros.
-
-void jtag_write_stream ( const uint32_t * const out_data,
-                         const int length_bits,
-                         const bool set_TMS_during_the_last_bit_transfer )
+void jtag_queue_read_write_bit ( const uint8_t packet,  // See the TDO, TMS and TRST constants.
+                                 uint8_t * const in_bit )
 {
-  if ( !set_TMS_during_the_last_bit_transfer )
-  {
-    trace_outgoing_stream( out_data, length_bits, false );
-
-    const int err = cable_write_stream( out_data, length_bits, 0 );
-    throw_if_error( err );
-  }
-  else if ( global_DR_prefix_bits == 0 )
-  {
-    trace_outgoing_stream( out_data, length_bits, true );
+  // In queued mode, the pending bits and the bit read travel together in the same stream transfer.
+  shift_pending_postfix_bits();
 
-    const int err = cable_write_stream( out_data, length_bits, 1 );
-    throw_if_error( err );
-  }
-  else
-  {
-    trace_outgoing_stream( out_data, length_bits, false );
+  trace_outgoing_bit( packet );
 
-    const int err1 = cable_write_stream( out_data, length_bits, 0 );
-    throw_if_error( err1 );
+  throw_if_error( cable_queue_read_write_bit( packet, in_bit ) );
+  track_packet( packet );
+}
 
-    jtag_shift_by_prefix_bits_with_ending_tms( 0 );
-  }
+void jtag_flush ( void )
+{
+  throw_if_error( cable_flush() );
 }
 
 
-// When set_TMS_during_the_last_bit_transfer is true, this function ensures the written data is in the desired JTAG chain position
-// (past prefix bits) before sending TMS. The extra bits sent after the given out_data are padded with zeros.
+// Shifts a DR stream in a single cable call. Any pending postfix bits are shifted before the payload,
+// and, if TMS is to be set at the end, the zeros needed to push the payload past the prefix bits
+// are appended, so that the data lands in the target's register. If in_data is not NULL,
+// it receives the bits that the target delivered while the payload was being shifted.
 
-void jtag_read_write_stream ( const uint32_t * const out_data,
-                              uint32_t * const in_data,
-                              const int length_bits,
-                              const bool set_TMS_during_the_last_bit_transfer )
+static void shift_padded_stream ( const uint32_t * const out_data,
+                                  uint32_t * const in_data,
+                                  const int length_bits,
+                                  const bool set_TMS_during_the_last_bit_transfer )
 {
-  assert( global_DR_postfix_bits >= 0 );
+  const int lead_bit_count  = s_pending_postfix_bit_count;
+  const int trail_bit_count = set_TMS_during_the_last_bit_transfer ? global_DR_prefix_bits : 0;
+  const int total_bit_count = lead_bit_count + length_bits + trail_bit_count;
 
-  // If there are both prefix and postfix bits, we may shift more bits than strictly necessary.
-  // If we shifted out the data while burning through the postfix bits, these shifts could be subtracted
-  // from the number of prefix shifts.  However, that way leads to madness.
-  if ( !set_TMS_during_the_last_bit_transfer )
-  {
-    trace_outgoing_stream( out_data, length_bits, false );
+  s_pending_postfix_bit_count = 0;
 
-    const int err = cable_read_write_stream( out_data, in_data, length_bits, 0 );
-    throw_if_error( err );
+  const uint32_t * out = out_data;
+  uint32_t * in = in_data;
 
-    trace_incoming_stream( in_data, length_bits );
-  }
-  else if ( global_DR_prefix_bits == 0 )
+  if ( lead_bit_count != 0 || trail_bit_count != 0 )
   {
-    trace_outgoing_stream( out_data, length_bits, true );
-    const int err = cable_read_write_stream( out_data, in_data, length_bits, 1 );
-    throw_if_error( err );
+    const size_t word_count = size_t( total_bit_count + 31 ) / 32;
 
-    trace_incoming_stream( in_data, length_bits );
+    s_padded_out.assign( word_count, 0 );
+    copy_bits( out_data, 0, &s_padded_out.front(), lead_bit_count, length_bits );
+    out = &s_padded_out.front();
+
+    if ( in_data != NULL )
+    {
+      s_padded_in.resize( word_count );
+      in = &s_padded_in.front();
+    }
   }
-  else
-  {
-    trace_outgoing_stream( out_data, length_bits, false );
 
-    const int err1 = cable_read_write_stream( out_data, in_data, length_bits, 0 );
-    throw_if_error( err1 );
+  trace_outgoing_stream( out, total_bit_count, set_TMS_during_the_last_bit_transfer );
 
-    trace_incoming_stream( in_data, length_bits );
+  const int set_last_bit = set_TMS_during_the_last_bit_transfer ? 1 : 0;
 
-    jtag_shift_by_prefix_bits_with_ending_tms( 0 );
+  const int err = ( in == NULL ) ? cable_write_stream( out, total_bit_count, set_last_bit )
+                                 : cable_read_write_stream( out, in, total_bit_count, set_last_bit );
+  throw_if_error( err );
+  track_stream( total_bit_count, set_TMS_during_the_last_bit_transfer );
+
+  if ( in_data != NULL )
+  {
+    trace_incoming_stream( in, total_bit_count );
+
+    if ( in != in_data )
+      copy_bits( in, lead_bit_count, in_data, 0, length_bits );
   }
 }
 
 
-#define BITS_PER_BYTE  8
-#define JSZIIH_BUFFER_SIZE_IN_WORDS 64
-static const int MAX_BITS_PER_CHUNK = JSZIIH_BUFFER_SIZE_IN_WORDS * sizeof(uint32_t) * BITS_PER_BYTE;
+// When set_TMS_during_the_last_bit_transfer is true, this function ensures the written data is in the desired JTAG chain position
+// (past prefix bits) before sending TMS. The extra bits sent after the given out_data are padded with zeros.
 
-static void shift_chunk ( const int bit_count,
-                          const bool set_TMS_during_the_last_bit_transfer )
+void jtag_write_stream ( const uint32_t * const out_data,
+                         const int length_bits,
+                         const bool set_TMS_during_the_last_bit_transfer )
 {
-  uint32_t buffer[ JSZIIH_BUFFER_SIZE_IN_WORDS ];
-  memset( buffer, 0, sizeof(buffer) );
+  shift_padded_stream( out_data, NULL, length_bits, set_TMS_during_the_last_bit_transfer );
+}
 
-  assert( bit_count > 0 && bit_count <= MAX_BITS_PER_CHUNK );
 
-  jtag_write_stream( buffer, bit_count, set_TMS_during_the_last_bit_transfer );
+// When set_TMS_during_the_last_bit_transfer is true, this function ensures the written data is in the desired JTAG chain position
+// (past prefix bits) before sending TMS. The extra bits sent after the given out_data are padded with zeros.
+// If jtag_discard_postfix_bits() was called beforehand, the bits returned start with the target's data.
+
+void jtag_read_write_stream ( const uint32_t * const out_data,
+                              uint32_t * const in_data,
+                              const int length_bits,
+                              const bool set_TMS_during_the_last_bit_transfer )
+{
+  // If there are both prefix and postfix bits, we may shift more bits than strictly necessary.
+  // If we shifted out the data while burning through the postfix bits, these shifts could be subtracted
+  // from the number of prefix shifts.  However, that way leads to madness.
+  shift_padded_stream( out_data, in_data, length_bits, set_TMS_during_the_last_bit_transfer );
 }
 
 
-// Shifts as many zeros in as specified. The bits read back are discarded.
+// Shifts as many zeros in as specified, plus the prefix bits if TMS is set at the end.
+// The bits read back are discarded.
 
 static void jtag_shift_zeros_in ( const int bit_count,
                                   const bool set_TMS_during_the_last_bit_transfer )
@@ -385,25 +624,22 @@ static void jtag_shift_zeros_in ( const int bit_count,
 
   while ( bit_left_count > MAX_BITS_PER_CHUNK )
   {
-    assert( false );  // TODO: I haven't tested this code yet.
-    shift_chunk( MAX_BITS_PER_CHUNK, false );
+    jtag_write_stream( s_zero_buffer, MAX_BITS_PER_CHUNK, false );
     bit_left_count -= MAX_BITS_PER_CHUNK;
   }
 
-  shift_chunk( bit_left_count, set_TMS_during_the_last_bit_transfer );
+  jtag_write_stream( s_zero_buffer, bit_left_count, set_TMS_during_the_last_bit_transfer );
 }
 
 
-// Shifts so many zeros in as there are postfix bits. The bits read back are discarded.
+// The bits from the devices between the target and the cable data input arrive before the target's data.
+// They are not shifted straight away, but together with the next read.
 
 void jtag_discard_postfix_bits ( void )
 {
-  // TODO: This only happens when there are other devices in the JTAG chain,
-  //       and that hasn't been tested since the last time this source code was heavily modified.
-  assert( global_DR_postfix_bits == 0 );
+  assert( global_DR_postfix_bits >= 0 );
 
-  if ( global_DR_postfix_bits > 0 )
-    jtag_shift_zeros_in( global_DR_postfix_bits, false );
+  s_pending_postfix_bit_count += global_DR_postfix_bits;
 }
 
 
@@ -413,14 +649,9 @@ void jtag_discard_postfix_bits ( void )
 
 void jtag_shift_by_prefix_bits_with_ending_tms ( const int extra_bit_count )
 {
-  // TODO: This only happens when there are other devices in the JTAG chain,
-  //       and that hasn't been tested since the last time this source code was heavily modified.
-  assert( global_DR_prefix_bits == 0 );
+  assert( global_DR_prefix_bits + extra_bit_count > 0 );
 
-  const int total_bit_count = global_DR_prefix_bits + extra_bit_count;
-  assert( total_bit_count > 0 );
-
-  jtag_shift_zeros_in( total_bit_count, true );
+  jtag_shift_zeros_in( extra_bit_count, true );
 }
 
 
@@ -433,11 +664,15 @@ void tap_reset ( void )
 {
   try
   {
+    // The TMS sequence below goes through Update-DR.
+    tap_end_dr_session();
+
     trace_jtag( "Resetting the TAP...\n" );
 
     // I don't know why we write a TDO bit value of 0 here,
     // it should not be necessary to reset the TAP.
     jtag_write_bit(0);
+    jtag_flush();
 
     // TODO: There is no need to wait, at least for the vpi cable.
     //       Under what circumstances or for what cables do we need to wait?
@@ -446,8 +681,7 @@ void tap_reset ( void )
     // In case the JTAG connection does not have a TRST, reset it manually
     // by issuing at least 5 TMS impulses.
     // I don't know why we send 8 here, 5 should be enough according to the JTAG specification.
-    for ( int i = 0; i < 8; i++ )
-      jtag_write_bit(TMS);
+    jtag_write_tms_sequence( 0xFF, 8 );
 
     // In case the JTAG connection does have a TRST signal, use it to reset the TAP.
     // This step should actually not be needed after the reset step above.
@@ -455,6 +689,7 @@ void tap_reset ( void )
     // from the Test-Logic-Reset state to the Run-Test/Idle state.
 
     jtag_write_bit(TRST);
+    jtag_flush();
 
     wait_ms( 100 );
 
@@ -463,6 +698,12 @@ void tap_reset ( void )
     // If TRST is not connnected and we were already in the Run-Test/Idle state,
     // this has no effect (it does not change the state).
     jtag_write_bit(0);
+    jtag_flush();
+
+    // Either way, the TAP is now in the Run-Test/Idle state. Depending on the device,
+    // the IR holds now the IDCODE or the BYPASS instruction.
+    s_tap_state = TAP_STATE_RUN_TEST_IDLE;
+    s_is_ir_known = false;
 
     trace_jtag( "Finished resetting the TAP.\n" );
   }
@@ -474,7 +715,7 @@ void tap_reset ( void )
 }
 
 
-void finish_and_leave_a_dbg_nop_cmd_in_place ( void )
+static void leave_a_dbg_nop_cmd_in_place ( void )
 {
   trace_jtag( "Writing a debug nop command. This is part of the debug operation finish sequence.\n" );
 
@@ -489,8 +730,55 @@ void finish_and_leave_a_dbg_nop_cmd_in_place ( void )
 
   tap_move_from_exit_1_to_idle();
 
+  // This is the end of every debug operation, so send any queued JTAG commands now.
+  // Otherwise, the last write operation would remain in the queue until the next one comes.
+  jtag_flush();
+
   trace_jtag( "Finished writing a debug nop command.\n" );
 }
+
+
+void finish_and_leave_a_dbg_nop_cmd_in_place ( void )
+{
+  if ( !s_is_dr_session_enabled )
+  {
+    leave_a_dbg_nop_cmd_in_place();
+    return;
+  }
+
+  trace_jtag( "Parking the TAP in Pause-DR until the next debug operation.\n" );
+
+  // Leave Shift-DR without going through Update-DR. The next debug operation
+  // will shift its command in straight away.
+  tap_move_to_state( TAP_STATE_PAUSE_DR );
+  s_is_dr_session_open = true;
+
+  // This is the end of every debug operation, see leave_a_dbg_nop_cmd_in_place().
+  jtag_flush();
+}
+
+
+void tap_end_dr_session ( void )
+{
+  if ( !s_is_dr_session_open )
+    return;
+
+  trace_jtag( "Ending the debug session...\n" );
+
+  // The DR still holds the last debug command, which would be executed again
+  // if the TAP went through Update-DR now.
+  // The TAP is normally parked in Pause-DR, but after an error it may have been left anywhere
+  // in the middle of a debug operation. The shortest path to Shift-DR never goes through Update-DR.
+  tap_move_to_state( TAP_STATE_SHIFT_DR );
+
+  s_is_dr_session_open = false;
+
+  leave_a_dbg_nop_cmd_in_place();
+
+  trace_jtag( "Finished ending the debug session.\n" );
+}
+
+
 // Write the DEBUG instruction opcode to the IR register, one way or the other.
 
 void set_ir_to_cpu_debug_module ( void )
@@ -503,17 +791,14 @@ void set_ir_to_cpu_debug_module ( void )
     {
       // Set for virtual IR shift.
       tap_set_ir(vjtag_cmd_vir);  // This is the altera virtual IR scan command
-      jtag_write_bit(TMS);  // SELECT_DR SCAN
-      jtag_write_bit(  0);  // CAPTURE_DR
-      jtag_write_bit(  0);  // SHIFT_DR
+      tap_move_from_idle_to_shift_dr();
 
       // Select debug scan chain in virtual IR.
       const uint32_t data = (0x1<<ALT_VJTAG_IR_SIZE)|ALT_VJTAG_CMD_DEBUG;
       jtag_write_stream( &data, (ALT_VJTAG_IR_SIZE+1),
                          true  // Set TMS during the last bit transfer -> EXIT1_DR
                        );
-      jtag_write_bit(TMS);  // UPDATE_DR
-      jtag_write_bit(  0);  // IDLE
+      tap_move_from_exit_1_to_idle();
 
       // This is a command to set an altera device to the "virtual DR shift" command.
       tap_set_ir( vjtag_cmd_vdr );
@@ -541,43 +826,34 @@ static std::vector< uint32_t > ir_chain;
 
 void tap_set_ir ( const unsigned instruction_opcode )
 {
-  trace_jtag( "Setting the JTAG IR to 0x%X...\n", instruction_opcode );
+  // The way to the IR scan path goes through Update-DR.
+  tap_end_dr_session();
+
+  if ( s_is_ir_known && s_current_ir == instruction_opcode )
+  {
+    trace_jtag( "The JTAG IR already holds 0x%X.\n", instruction_opcode );
+    tap_move_to_state( TAP_STATE_RUN_TEST_IDLE );
+    return;
+  }
 
-  int chain_size;
-  int chain_size_words;
-  int i;
-  int startoffset, startshift;
+  trace_jtag( "Setting the JTAG IR to 0x%X...\n", instruction_opcode );
 
-  // Adjust desired IR with prefix, postfix bits to set other devices in the chain to BYPASS
-  chain_size = global_IR_size + global_IR_prefix_bits + global_IR_postfix_bits;
+  // Adjust desired IR with prefix, postfix bits to set other devices in the chain to BYPASS.
+  // The postfix bits come first, as they are the first ones to be shifted in,
+  // and end up in the devices nearest to the cable data input.
+  const int chain_size = global_IR_size + global_IR_prefix_bits + global_IR_postfix_bits;
   assert( chain_size >= 1 );
-  chain_size_words = (chain_size/32)+1;
-  assert( chain_size_words >= 1 );
-
-  ir_chain.resize( chain_size_words );
+  assert( global_IR_size > 0 && global_IR_size <= 32 );
 
-  for(i = 0; i < chain_size_words; i++)
-    ir_chain[i] = 0xFFFFFFFF;  // Set all other devices to BYPASS
+  ir_chain.assign( ( chain_size + 31 ) / 32, 0xFFFFFFFF );  // Set all other devices to BYPASS
 
   // Copy the IR value into the output stream
-  startoffset = global_IR_postfix_bits/32;
-  startshift = (global_IR_postfix_bits - (startoffset*32));
-  ir_chain[startoffset] &= (instruction_opcode << startshift);
-  ir_chain[startoffset] |= ~(0xFFFFFFFF << startshift);  // Put the 1's back in the LSB positions
-  ir_chain[startoffset] |= (0xFFFFFFFF << (startshift + global_IR_size));  // Put 1's back in MSB positions, if any
-  if((startshift + global_IR_size) > 32)
-  { // Deal with spill into the next word
-    ir_chain[startoffset+1] &= instruction_opcode >> (32-startshift);
-    ir_chain[startoffset+1] |= (0xFFFFFFFF << (global_IR_size - (32-startshift)));  // Put the 1's back in the MSB positions
-  }
+  const uint32_t opcode = instruction_opcode;
+  copy_bits( &opcode, 0, &ir_chain.front(), global_IR_postfix_bits, global_IR_size );
 
-  // Do the actual JTAG transaction. Note that we assume that the TAP is in the Run-Test/Idle state.
+  // Do the actual JTAG transaction.
   debug("Set IR to 0x%X\n", instruction_opcode);
-  jtag_write_bit(TMS); // SELECT_DR SCAN
-  jtag_write_bit(TMS); // SELECT_IR SCAN
-
-  jtag_write_bit(  0); // CAPTURE_IR
-  jtag_write_bit(  0); // SHIFT_IR
+  tap_move_to_state( TAP_STATE_SHIFT_IR );
 
   // Write data, EXIT1_IR.
   debug( "Setting IR, size %i, IR_size = %i, pre_size = %i, post_size = %i, data 0x%X\n",
@@ -587,10 +863,14 @@ void tap_set_ir ( const unsigned instruction_opcode )
 
   const int err = cable_write_stream( &ir_chain.front(), chain_size, 1 );  // Use cable_ call directly (not jtag_), so we don't add DR prefix bits
   throw_if_error( err );
+  track_stream( chain_size, true );
   debug("Done setting IR\n");
 
-  jtag_write_bit(TMS); // UPDATE_IR
-  jtag_write_bit(  0); // IDLE
+  // UPDATE_IR -> IDLE
+  tap_move_to_state( TAP_STATE_RUN_TEST_IDLE );
+
+  s_is_ir_known = true;
+  s_current_ir = instruction_opcode;
 
   trace_jtag( "Finished setting the JTAG IR.\n" );
 }
@@ -600,9 +880,8 @@ void tap_move_from_idle_to_shift_dr ( void )
 {
   trace_jtag( "Moving TAP from Idle to Shift-DR...\n" );
 
-  jtag_write_bit(TMS);  // SELECT_DR SCAN
-  jtag_write_bit(  0);  // CAPTURE_DR
-  jtag_write_bit(  0);  // SHIFT_DR
+  // SELECT_DR SCAN -> CAPTURE_DR -> SHIFT_DR
+  tap_move_to_state( TAP_STATE_SHIFT_DR );
 
   trace_jtag( "Finished moving TAP from Idle to Shift-DR.\n" );
 }
@@ -612,13 +891,86 @@ void tap_move_from_exit_1_to_idle ( void )
 {
   trace_jtag( "Moving TAP from Exit-1 to Idle...\n" );
 
-  jtag_write_bit(TMS); // UPDATE_DR
-  jtag_write_bit(  0); // IDLE
+  // UPDATE_DR -> IDLE
+  tap_move_to_state( TAP_STATE_RUN_TEST_IDLE );
 
   trace_jtag( "Finished moving TAP from Exit-1 to Idle.\n" );
 }
 
 
+void tap_move_from_exit_1_to_shift_dr ( void )
+{
+  trace_jtag( "Moving TAP from Exit-1 to Shift-DR through Update-DR...\n" );
+
+  assert( s_tap_state == TAP_STATE_EXIT1_DR );
+
+  // UPDATE_DR -> SELECT_DR SCAN -> CAPTURE_DR -> SHIFT_DR
+  tap_state_enum state = s_tap_state;
+  uint32_t tms_bits = 0;
+  int bit_count = 0;
+
+  append_tms_path( &state, TAP_STATE_UPDATE_DR, &tms_bits, &bit_count );
+  append_tms_path( &state, TAP_STATE_SHIFT_DR , &tms_bits, &bit_count );
+
+  jtag_write_tms_sequence( tms_bits, bit_count );
+
+  trace_jtag( "Finished moving TAP from Exit-1 to Shift-DR.\n" );
+}
+
+
+void jtag_init_dr_scan_template ( jtag_dr_scan_template * const tmpl, const int cmd_len_bits )
+{
+  assert( cmd_len_bits > 0 );
+
+  tmpl->cmd_len_bits = cmd_len_bits;
+  tmpl->bits.assign( ( cmd_len_bits + 31 ) / 32, 0 );
+}
+
+
+void jtag_set_dr_scan_template_field ( jtag_dr_scan_template * const tmpl,
+                                       const int first_bit,
+                                       const int bit_count,
+                                       const uint32_t value )
+{
+  assert( first_bit >= 0 && bit_count > 0 && bit_count <= 32 );
+  assert( first_bit + bit_count <= tmpl->cmd_len_bits );
+
+  for ( int i = 0; i < bit_count; ++i )
+  {
+    const int bit_pos = first_bit + i;
+    const uint32_t mask = uint32_t( 1 ) << ( bit_pos % 32 );
+
+    if ( ( value >> i ) & 1 )
+      tmpl->bits[ bit_pos / 32 ] |= mask;
+    else
+      tmpl->bits[ bit_pos / 32 ] &= ~mask;
+  }
+}
+
+
+void jtag_execute_dr_scan_template ( jtag_dr_scan_template * const tmpl )
+{
+  // The command is padded with zeros, so that it moves past the prefix bits
+  // before TMS is set, see jtag_write_stream().
+  const int len_bits = tmpl->cmd_len_bits + global_DR_prefix_bits;
+  const size_t word_count = size_t( len_bits + 31 ) / 32;
+
+  if ( tmpl->bits.size() < word_count )
+    tmpl->bits.resize( word_count, 0 );
+
+  tap_move_to_state( TAP_STATE_SHIFT_DR );
+  shift_pending_postfix_bits();
+
+  trace_outgoing_stream( &tmpl->bits.front(), len_bits, true );
+
+  const int err = cable_write_stream( &tmpl->bits.front(), len_bits, 1 );
+  throw_if_error( err );
+  track_stream( len_bits, true );
+
+  tap_move_from_exit_1_to_shift_dr();
+}
+
+
 // This function attempts to scan the JTAG chain and determine how many devices are present
 // and what their IDCODEs are (if supported).
 // There is no easy way to automatically determine the length of the IR registers -
@@ -643,9 +995,7 @@ void jtag_enumerate_chain ( std::vector< uint32_t > * const discovered_id_codes
     uint32_t invalid_code = 0x7f;  // 7 bits with value '1'. Shift this out, we know we're done when we get it back.
     const unsigned int done_code = 0x3f;  // invalid_code is altered, we keep this for comparison (minus the start bit)
 
-    jtag_write_bit(TMS); // SELECT_DR SCAN
-    jtag_write_bit(  0); // CAPTURE_DR
-    jtag_write_bit(  0); // SHIFT_DR
+    tap_move_from_idle_to_shift_dr();
 
     // Putting a limit on the number of devices supported has the useful side effect
     // of ensuring we still exit in error cases (we never get the 0x7f manuf. id)
@@ -704,10 +1054,8 @@ void jtag_enumerate_chain ( std::vector< uint32_t > * const discovered_id_codes
     if ( discovered_id_codes->size() >= MAX_DEVICE_COUNT )
       throw std::runtime_error( format_msg( "The JTAG chain seems to have more devices than the maximum allowed of %d, or, more likely, the JTAG interface is not correctly connected.", MAX_DEVICE_COUNT ) );
 
-    // Put in IDLE mode.
-    jtag_write_bit(TMS); // EXIT1_DR
-    jtag_write_bit(TMS); // UPDATE_DR
-    jtag_write_bit(0);   // IDLE
+    // Put in IDLE mode: SHIFT_DR -> EXIT1_DR -> UPDATE_DR -> IDLE
+    tap_move_to_state( TAP_STATE_RUN_TEST_IDLE );
 
     trace_jtag( "Finished enumerating the TAP chain.\n" );
   }
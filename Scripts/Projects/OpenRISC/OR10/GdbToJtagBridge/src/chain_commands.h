@@ -20,6 +20,12 @@ void config_set_vjtag_cmd_vdr(unsigned int cmd);
 void config_set_xilinx_bscan_internal_jtag ( bool enable );
 void config_set_trace ( bool enable_bit_data_trace );
 
+// In a debug session, the TAP does not return to Run-Test/Idle after each debug operation,
+// but waits in Pause-DR for the next one, which can then shift its command in straight away.
+// tap_end_dr_session() closes the session and leaves the TAP in Run-Test/Idle,
+// it should be called when the bridge becomes idle. Disabled by default.
+void config_set_dr_session ( bool enable );
+
 
 // ----------- High-level TAP operations -----------
 
@@ -32,13 +38,34 @@ void jtag_get_idcode ( uint32_t cmd, uint32_t * idcode );
 void set_ir_to_cpu_debug_module ( void );
 
 // After a TAP operation we normally return to the IDLE state.
-// We could optimise a little further and always remain in the DR chain,
-// because we only set the IR register on start-up.
+// The current TAP state is tracked, so these routines send the shortest TMS sequence
+// from wherever the TAP is, and nothing at all if it is already in the target state.
+// tap_set_ir() does nothing if the IR already holds the given instruction.
 void tap_set_ir ( unsigned instruction_opcode );
 void tap_move_from_idle_to_shift_dr ( void );
 void tap_move_from_exit_1_to_idle ( void );
 
+// Goes through Update-DR, so that the data just shifted in takes effect,
+// and then straight back to Shift-DR without stopping at Run-Test/Idle.
+void tap_move_from_exit_1_to_shift_dr ( void );
+
+// A debug command scan whose fixed bits are prepared only once. Before each execution,
+// only the variable fields (like the SPR number or the value to write) need to be patched in.
+struct jtag_dr_scan_template
+{
+  std::vector< uint32_t > bits;  // Any bits past the command are zero.
+  int cmd_len_bits;
+};
+
+void jtag_init_dr_scan_template ( jtag_dr_scan_template * tmpl, int cmd_len_bits );
+void jtag_set_dr_scan_template_field ( jtag_dr_scan_template * tmpl, int first_bit, int bit_count, uint32_t value );
+
+// Moves the TAP to Shift-DR, shifts the command in, and goes back to Shift-DR through Update-DR,
+// so that the command starts executing.
+void jtag_execute_dr_scan_template ( jtag_dr_scan_template * tmpl );
+
 void finish_and_leave_a_dbg_nop_cmd_in_place ( void );
+void tap_end_dr_session ( void );
 
 // ----------- Low-level TAP operations -----------
 
@@ -47,6 +74,8 @@ void finish_and_leave_a_dbg_nop_cmd_in_place ( void );
 // this simplifies the system somewhat.
 // void jtag_write_bit      ( uint8_t packet );
 void jtag_read_write_bit ( uint8_t packet, uint8_t * in_bit );
+void jtag_queue_read_write_bit ( uint8_t packet, uint8_t * in_bit );
+void jtag_flush ( void );
 
 // Functions to Send/receive bitstreams via JTAG.
 // These functions are aware of other devices in the chain, and may adjust for them.
@@ -58,6 +87,7 @@ void jtag_read_write_stream ( const uint32_t * out_data,
                               int length_bits,
                               bool set_TMS_during_the_last_bit_transfer );
 
+// The postfix bits are not shifted straight away, but merged into the next stream read.
 void jtag_discard_postfix_bits ( void );
 void jtag_shift_by_prefix_bits_with_ending_tms ( int extra_bit_count );
 
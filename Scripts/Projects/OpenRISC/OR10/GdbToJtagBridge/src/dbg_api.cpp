@@ -25,6 +25,7 @@
 #include <stdarg.h>
 
 #include <stdexcept>
+#include <algorithm>
 
 #include "chain_commands.h"
 #include "errcodes.h"
@@ -32,12 +33,15 @@
 #include "string_utils.h"
 #include "spr-defs.h"
 #include "or10_debug_module.h"
+#include "jtag_trace_ring.h"
 
 
 #define BITS_PER_BYTE  8
 
 
 static bool s_enable_jtag_trace;
+static bool s_enable_burst_mem_access = true;
+static bool s_enable_write_mem_sel = true;
 
 
 void dgb_enable_jtag_trace ( const bool enable_jtag_trace )
@@ -45,8 +49,26 @@ void dgb_enable_jtag_trace ( const bool enable_jtag_trace )
   s_enable_jtag_trace = enable_jtag_trace;
 }
 
+void dbg_enable_burst_mem_access ( const bool enable_burst_mem_access )
+{
+  s_enable_burst_mem_access = enable_burst_mem_access;
+}
+
+void dbg_enable_write_mem_sel ( const bool enable_write_mem_sel )
+{
+  s_enable_write_mem_sel = enable_write_mem_sel;
+}
+
 static void trace_jtag ( const char * const format_str, ... )
 {
+  if ( jtag_trace_ring_is_enabled() )
+  {
+    va_list arg_list;
+    va_start( arg_list, format_str );
+    jtag_trace_ring_record_context( true, format_str, arg_list );
+    va_end( arg_list );
+  }
+
   if ( !s_enable_jtag_trace )
     return;
 
@@ -70,89 +92,209 @@ static std::string decode_spr_number ( const uint16_t cpu_spr_reg_number )
 }
 
 
-// TODO: The old code has always called cable_flush() after a transaction, is that really necessary?
-//       If so, which cables do need it?
-// extern int cable_flush ( void );
+// Instead of polling the completion bit with one cable call per TCK, which means one USB round trip
+// per bit on USB cables, wait_for_completion() shifts a window of bits at once and looks for the ack bit
+// in the captured stream. The window size follows the number of TCKs the last operations took,
+// so that most operations complete within a single transfer.
+
+static const unsigned MAX_ACK_WINDOW_BIT_COUNT     = 1024;
+static const unsigned DEFAULT_ACK_WINDOW_BIT_COUNT = 256;
+static const unsigned ACK_WINDOW_SLACK_BIT_COUNT   = 8;
+
+static unsigned s_max_ack_window_bit_count = DEFAULT_ACK_WINDOW_BIT_COUNT;
+static unsigned s_ack_latency_bit_count    = 0;  // Estimated number of '0' bits before the ack bit.
+
+
+void dbg_set_max_ack_window ( const unsigned max_bit_count )
+{
+  if ( max_bit_count == 0 || max_bit_count > MAX_ACK_WINDOW_BIT_COUNT )
+  {
+    throw std::runtime_error( format_msg( "Invalid ack window size of %u bits, the valid range is 1 to %u.",
+                                          max_bit_count,
+                                          MAX_ACK_WINDOW_BIT_COUNT ) );
+  }
+
+  s_max_ack_window_bit_count = max_bit_count;
+  s_ack_latency_bit_count    = std::min( s_ack_latency_bit_count, max_bit_count );
+}
+
+
+static unsigned get_bit ( const uint32_t * const bit_buffer, const unsigned bit_pos )
+{
+  return ( bit_buffer[ bit_pos / 32 ] >> ( bit_pos % 32 ) ) & 1;
+}
+
 
-// Returns the error bit read back.
+// Waits for the '1' bit that signals operation completion and returns in 'payload' the given number
+// of bits that follow it, LSB first.
+//
+// If max_zero_bit_count is not zero, gives up and returns false after that many bits without a '1' bit.
+// Otherwise, waits forever.
+//
+// Any bits shifted past the payload are discarded. That is harmless, as the TAP does not care
+// how many bits are shifted after the operation has completed, it only latches the last ones
+// shifted in as the next command when going through Update-DR.
 
-static bool wait_for_cpu_ack ( void )
+static bool wait_for_completion ( const unsigned payload_bit_count,
+                                  const unsigned max_zero_bit_count,
+                                  uint64_t * const payload )
 {
+  assert( payload_bit_count > 0 && payload_bit_count <= 1 + 32 );
+
   jtag_discard_postfix_bits();
 
   trace_jtag( "Waiting for a '1' bit to signal operation completion...\n" );
 
-  // Wait for a '1' bit that indicates the operation is complete.
-  // POSSIBLE OPTIMISATION: We could read several bits at once here.
+  const unsigned max_bit_count = MAX_ACK_WINDOW_BIT_COUNT + 1 + 1 + 32;
+
+  const uint32_t zeros[ ( max_bit_count + 31 ) / 32 ] = { 0 };
+  uint32_t window[ ( max_bit_count + 31 ) / 32 ];
+  uint32_t tail[ ( max_bit_count + 31 ) / 32 ];
+
+  unsigned window_size    = std::min( s_ack_latency_bit_count + ACK_WINDOW_SLACK_BIT_COUNT, s_max_ack_window_bit_count );
+  unsigned zero_bit_count = 0;
 
   for ( ; ; )
   {
-    uint8_t bit_read;
-    jtag_read_write_bit( 0, &bit_read );
+    const unsigned bit_count = window_size + 1 + payload_bit_count;
 
-    if ( bit_read != 0 )
-      break;
-  }
+    jtag_read_write_stream( zeros, window, bit_count, false );
 
-  // Read the error bit.
+    unsigned ack_pos = 0;
 
-  uint8_t error_bit_read;
-  jtag_read_write_bit( 0, &error_bit_read );
+    while ( ack_pos < bit_count && get_bit( window, ack_pos ) == 0 )
+      ++ack_pos;
 
-  trace_jtag( "Operation complete, the error bit read was %c.\n", error_bit_read ? '1' : '0' );
+    zero_bit_count += ack_pos;
 
-  return error_bit_read ? true : false;
+    if ( ack_pos == bit_count )
+    {
+      if ( max_zero_bit_count != 0 && zero_bit_count >= max_zero_bit_count )
+      {
+        trace_jtag( "Giving up waiting for operation completion after %u bits.\n", zero_bit_count );
+        return false;
+      }
+
+      // The operation is taking longer than expected.
+      window_size = std::min( window_size * 2, s_max_ack_window_bit_count );
+      continue;
+    }
+
+    // Fetch whatever part of the payload did not fit in the window.
+
+    const unsigned payload_pos           = ack_pos + 1;
+    const unsigned payload_bits_captured = std::min( bit_count - payload_pos, payload_bit_count );
+
+    if ( payload_bits_captured < payload_bit_count )
+      jtag_read_write_stream( zeros, tail, payload_bit_count - payload_bits_captured, false );
+
+    *payload = 0;
+
+    for ( unsigned i = 0; i < payload_bit_count; ++i )
+    {
+      const unsigned bit = ( i < payload_bits_captured ) ? get_bit( window, payload_pos + i )
+                                                         : get_bit( tail, i - payload_bits_captured );
+      *payload |= uint64_t( bit ) << i;
+    }
+
+    // Adapt quickly to longer operations, but forget about a slow one only gradually.
+    s_ack_latency_bit_count = std::min( std::max( zero_bit_count, s_ack_latency_bit_count - s_ack_latency_bit_count / 8 ),
+                                        s_max_ack_window_bit_count );
+
+    trace_jtag( "Operation complete after %u bits.\n", zero_bit_count );
+
+    return true;
+  }
 }
 
 
-static void read_spr ( uint32_t * const cpu_spr_reg_value )
+// Waits for the '1' bit that signals operation completion and returns the error bit that follows.
+// If result is not NULL, it also returns the 32-bit operation result, which comes after the error bit.
+
+static bool wait_for_cpu_ack ( uint32_t * const result )
 {
-  // Read the 32 bits with the operation result.
-  assert( sizeof( *cpu_spr_reg_value ) * BITS_PER_BYTE == 32 );
-  const uint32_t zeros = 0;
-  assert( sizeof( *cpu_spr_reg_value ) == sizeof( zeros ) );
+  uint64_t payload;
+
+  wait_for_completion( 1 + ( result == NULL ? 0 : 32 ), 0, &payload );  // Error bit + result.
+
+  const bool error_bit = ( payload & 1 ) != 0;
+
+  if ( result != NULL )
+    *result = error_bit ? 0 : uint32_t( payload >> 1 );
+
+  trace_jtag( "The error bit read was %c.\n", error_bit ? '1' : '0' );
 
-  jtag_read_write_stream( &zeros,
-                          cpu_spr_reg_value,
-                          sizeof( zeros ) * BITS_PER_BYTE,
-                          false );
+  return error_bit;
 }
 
 
-bool dbg_cpu0_read_spr ( const uint16_t cpu_spr_reg_number, uint32_t * const cpu_spr_reg_value )
+// Debug command layouts, LSB first:
+//   DEBUG_CMD_READ_CPU_SPR  : <SPR number (16 bits)> + <opcode (3 bits)>
+//   DEBUG_CMD_WRITE_CPU_SPR : <new SPR value (32 bits)> + <SPR number (16 bits)> + <opcode (3 bits)>
+//   DEBUG_CMD_IS_CPU_STALLED: <opcode (3 bits)>
+//   Burst commands          : <start memory address (32 bits)> + <word count (16 bits)> + <opcode (3 bits)>
+
+static const int READ_SPR_CMD_BIT_LEN  = 16 + DEBUG_CMD_LEN;
+static const int WRITE_SPR_CMD_BIT_LEN = 32 + 16 + DEBUG_CMD_LEN;
+static const int BURST_CMD_BIT_LEN     = 32 + 16 + DEBUG_CMD_LEN;
+
+// The opcode and the zero padding for the other devices in the chain are set only once,
+// the SPR numbers, values and addresses are patched in before each scan.
+static jtag_dr_scan_template s_read_spr_scan;
+static jtag_dr_scan_template s_write_spr_scan;
+static jtag_dr_scan_template s_is_stalled_scan;
+static jtag_dr_scan_template s_burst_scan;
+static bool s_are_scan_templates_initialised = false;
+
+static void init_scan_templates ( void )
 {
-  try
-  {
-    trace_jtag( "Reading %s...\n", decode_spr_number(cpu_spr_reg_number).c_str() );
-    tap_move_from_idle_to_shift_dr();
+  if ( s_are_scan_templates_initialised )
+    return;
 
-    const uint32_t read_spr_cmd = ( DEBUG_CMD_READ_CPU_SPR << sizeof(cpu_spr_reg_number) * BITS_PER_BYTE ) | cpu_spr_reg_number;
+  jtag_init_dr_scan_template( &s_read_spr_scan, READ_SPR_CMD_BIT_LEN );
+  jtag_set_dr_scan_template_field( &s_read_spr_scan, 16, DEBUG_CMD_LEN, DEBUG_CMD_READ_CPU_SPR );
 
-    const int read_spr_cmd_bit_len = DEBUG_CMD_LEN + sizeof(cpu_spr_reg_number) * BITS_PER_BYTE;
+  jtag_init_dr_scan_template( &s_write_spr_scan, WRITE_SPR_CMD_BIT_LEN );
+  jtag_set_dr_scan_template_field( &s_write_spr_scan, 32 + 16, DEBUG_CMD_LEN, DEBUG_CMD_WRITE_CPU_SPR );
 
-    assert( read_spr_cmd_bit_len <= int( sizeof( read_spr_cmd ) * BITS_PER_BYTE ) );
+  jtag_init_dr_scan_template( &s_is_stalled_scan, DEBUG_CMD_LEN );
+  jtag_set_dr_scan_template_field( &s_is_stalled_scan, 0, DEBUG_CMD_LEN, DEBUG_CMD_IS_CPU_STALLED );
 
-    jtag_write_stream( &read_spr_cmd,
-                       read_spr_cmd_bit_len,
-                       true  // Set TMS during the last bit transfer, goes to state EXIT1_DR.
-                   );
+  // The burst opcode varies, so it is patched in for each burst.
+  jtag_init_dr_scan_template( &s_burst_scan, BURST_CMD_BIT_LEN );
 
-    // Moves the state machine from EXIT1-DR -> Update-DR -> IDLE.
-    // Going through Update-DR triggers the actual CPU SPR read.
-    tap_move_from_exit_1_to_idle();
+  s_are_scan_templates_initialised = true;
+}
 
-    tap_move_from_idle_to_shift_dr();
 
-    const bool error_bit = wait_for_cpu_ack();
+// Leaves the TAP in the Shift-DR state with the operation running.
+
+static void start_read_spr ( const uint16_t cpu_spr_reg_number )
+{
+  init_scan_templates();
+  jtag_set_dr_scan_template_field( &s_read_spr_scan, 0, 16, cpu_spr_reg_number );
+  jtag_execute_dr_scan_template( &s_read_spr_scan );
+}
+
+static void start_write_spr ( const uint16_t cpu_spr_reg_number, const uint32_t cpu_spr_reg_value )
+{
+  init_scan_templates();
+  jtag_set_dr_scan_template_field( &s_write_spr_scan, 0, 32, cpu_spr_reg_value );
+  jtag_set_dr_scan_template_field( &s_write_spr_scan, 32, 16, cpu_spr_reg_number );
+  jtag_execute_dr_scan_template( &s_write_spr_scan );
+}
 
-    if ( error_bit )
-    {
-      *cpu_spr_reg_value = 0;
-    }
-    else
-    {
-      read_spr( cpu_spr_reg_value );
-    }
+
+bool dbg_cpu0_read_spr ( const uint16_t cpu_spr_reg_number, uint32_t * const cpu_spr_reg_value )
+{
+  try
+  {
+    trace_jtag( "Reading %s...\n", decode_spr_number(cpu_spr_reg_number).c_str() );
+
+    // Going through Update-DR triggers the actual CPU SPR read.
+    start_read_spr( cpu_spr_reg_number );
+
+    const bool error_bit = wait_for_cpu_ack( cpu_spr_reg_value );
 
     finish_and_leave_a_dbg_nop_cmd_in_place();
 
@@ -181,30 +323,10 @@ void dbg_cpu0_read_spr_e ( const uint16_t cpu_spr_reg_number, uint32_t * const c
 
 static bool write_spr ( const uint16_t cpu_spr_reg_number, const uint32_t cpu_spr_reg_value )
 {
-  tap_move_from_idle_to_shift_dr();
-
-  uint32_t write_spr_cmd[2];
-  write_spr_cmd[0] = cpu_spr_reg_value;
-  write_spr_cmd[1] = ( DEBUG_CMD_WRITE_CPU_SPR << sizeof(cpu_spr_reg_number) * BITS_PER_BYTE ) | cpu_spr_reg_number;
-
-  const int write_spr_cmd_bit_len = sizeof(cpu_spr_reg_value) * BITS_PER_BYTE +
-                                    DEBUG_CMD_LEN +
-                                     sizeof(cpu_spr_reg_number) * BITS_PER_BYTE;
-
-  assert( write_spr_cmd_bit_len <= int( sizeof( write_spr_cmd ) * BITS_PER_BYTE ) );
-
-  jtag_write_stream( write_spr_cmd,
-                     write_spr_cmd_bit_len,
-                     true  // Set TMS during the last bit transfer, goes to state EXIT1_DR.
-                   );
-
-  // Moves the state machine from EXIT1-DR -> Update-DR -> IDLE.
   // Going through Update-DR triggers the actual CPU SPR write.
-  tap_move_from_exit_1_to_idle();
-
-  tap_move_from_idle_to_shift_dr();
+  start_write_spr( cpu_spr_reg_number, cpu_spr_reg_value );
 
-  return wait_for_cpu_ack();
+  return wait_for_cpu_ack( NULL );
 }
 
 
@@ -243,77 +365,232 @@ void dbg_cpu0_write_spr_e ( const uint16_t cpu_spr_reg_number, const uint32_t cp
 }
 
 
-// Writes a CPU SPR and reads the new value in a single transaction.
+// An SPR operation inside a sequence, see spr_op_sequence().
+// Note that is_read is the last member, so that it defaults to false (a write operation)
+// when initialising an instance with an aggregate initializer.
+
+struct spr_op
+{
+  uint16_t spr_number;
+  uint32_t value_to_write;  // Ignored for read operations.
+  bool     is_read;
+};
+
+
+static void start_spr_op ( const spr_op * const op )
+{
+  if ( op->is_read )
+    start_read_spr( op->spr_number );
+  else
+    start_write_spr( op->spr_number, op->value_to_write );
+}
+
+
+// Executes a sequence of SPR read and write operations back to back.
+//
+// Instead of going through the whole "write command, wait, read result, leave a NOP in place"
+// sequence for each operation, the command for the next operation is shifted in straight after
+// the result of the current one has been read. The Update-DR state that follows
+// then triggers the next operation straight away. The NOP command is only left in place
+// after the last operation, or when an error has been reported.
+//
+// If values_read is not NULL, it receives the value read back for each operation. Besides normal SPR reads,
+// that is how memory is read: writing an address to SPR_DU_READ_MEM_ADDR delivers the memory contents as the result.
+//
+// Returns the number of operations that completed successfully. If error_bits is NULL and the CPU reports
+// an error, the sequence stops there and the remaining operations are not executed. Otherwise, all operations
+// are executed, and error_bits receives the error bit for each one.
+
+static unsigned spr_op_sequence ( const spr_op * const ops,
+                                  const unsigned op_count,
+                                  uint32_t * const values_read,
+                                  bool * const error_bits )
+{
+  assert( op_count > 0 );
+
+  unsigned op_index = 0;
+  unsigned success_count = 0;
+
+  for ( ; ; )
+  {
+    // The TAP is already in Shift-DR after the first operation, so the command
+    // for the next one is shifted in without any TMS moves beforehand.
+    start_spr_op( &ops[ op_index ] );
+
+    const bool error_bit = wait_for_cpu_ack( values_read == NULL ? NULL : &values_read[ op_index ] );
+
+    if ( error_bits != NULL )
+      error_bits[ op_index ] = error_bit;
+    else if ( error_bit )
+      break;
+
+    if ( !error_bit )
+      ++success_count;
+
+    ++op_index;
+
+    if ( op_index == op_count )
+      break;
+  }
+
+  finish_and_leave_a_dbg_nop_cmd_in_place();
+
+  return success_count;
+}
+
+
+static std::string describe_spr_list ( const uint16_t * const cpu_spr_reg_numbers, const unsigned spr_count )
+{
+  return format_msg( "%u SPRs starting with %s", spr_count, decode_spr_number( cpu_spr_reg_numbers[ 0 ] ).c_str() );
+}
 
-static bool dbg_cpu0_write_and_read_spr ( const uint16_t cpu_spr_reg_number,
-                                          const uint32_t cpu_spr_reg_value_to_write,
-                                          uint32_t * const cpu_spr_reg_value_read )
+
+// If error_bits is NULL, stops at the first error. Returns the number of successful operations.
+
+static unsigned read_sprs ( const uint16_t * const cpu_spr_reg_numbers,
+                            const unsigned spr_count,
+                            uint32_t * const cpu_spr_reg_values,
+                            bool * const error_bits )
 {
+  assert( spr_count > 0 );
+
+  std::vector< spr_op > ops( spr_count );
+
+  for ( unsigned i = 0; i < spr_count; ++i )
+  {
+    ops[ i ].spr_number = cpu_spr_reg_numbers[ i ];
+    ops[ i ].is_read    = true;
+  }
+
   try
   {
-    const bool error_bit = write_spr( cpu_spr_reg_number, cpu_spr_reg_value_to_write );
+    trace_jtag( "Reading %s...\n", describe_spr_list( cpu_spr_reg_numbers, spr_count ).c_str() );
 
-    if ( error_bit )
-    {
-      *cpu_spr_reg_value_read = 0;
-    }
-    else
-    {
-      read_spr( cpu_spr_reg_value_read );
-    }
+    const unsigned read_count = spr_op_sequence( &ops.front(), spr_count, cpu_spr_reg_values, error_bits );
 
-    finish_and_leave_a_dbg_nop_cmd_in_place();
+    trace_jtag( "Finished reading %s, %u successful.\n", describe_spr_list( cpu_spr_reg_numbers, spr_count ).c_str(), read_count );
 
-    return error_bit;
+    return read_count;
   }
   catch ( const std::exception & e )
   {
-    throw std::runtime_error( format_msg( "Error during a combined write+read operation on %s, value written: 0x%08X: %s",
-                                          decode_spr_number(cpu_spr_reg_number).c_str(),
-                                          (unsigned)cpu_spr_reg_value_to_write,
+    throw std::runtime_error( format_msg( "Error reading %s: %s",
+                                          describe_spr_list( cpu_spr_reg_numbers, spr_count ).c_str(),
                                           e.what() ) );
   }
 }
 
 
-bool dbg_cpu0_is_stalled ( void )
+// If error_bits is NULL, stops at the first error. Returns the number of successful operations.
+
+static unsigned write_sprs ( const uint16_t * const cpu_spr_reg_numbers,
+                             const uint32_t * const cpu_spr_reg_values,
+                             const unsigned spr_count,
+                             bool * const error_bits )
 {
+  assert( spr_count > 0 );
+
+  std::vector< spr_op > ops( spr_count );
+
+  for ( unsigned i = 0; i < spr_count; ++i )
+  {
+    ops[ i ].spr_number     = cpu_spr_reg_numbers[ i ];
+    ops[ i ].value_to_write = cpu_spr_reg_values[ i ];
+  }
+
   try
   {
-    trace_jtag( "Querying CPU stall status...\n" );
+    trace_jtag( "Writing %s...\n", describe_spr_list( cpu_spr_reg_numbers, spr_count ).c_str() );
 
-    tap_move_from_idle_to_shift_dr();
+    const unsigned write_count = spr_op_sequence( &ops.front(), spr_count, NULL, error_bits );
 
-    trace_jtag( "Writing a DEBUG_CMD_IS_CPU_STALLED command.\n" );
+    trace_jtag( "Finished writing %s, %u successful.\n", describe_spr_list( cpu_spr_reg_numbers, spr_count ).c_str(), write_count );
+
+    return write_count;
+  }
+  catch ( const std::exception & e )
+  {
+    throw std::runtime_error( format_msg( "Error writing %s: %s",
+                                          describe_spr_list( cpu_spr_reg_numbers, spr_count ).c_str(),
+                                          e.what() ) );
+  }
+}
 
-    const uint32_t is_stalled_cmd = DEBUG_CMD_IS_CPU_STALLED;
 
-    const int is_stalled_cmd_bit_len = DEBUG_CMD_LEN;
+bool dbg_cpu0_read_sprs ( const uint16_t * const cpu_spr_reg_numbers,
+                          const unsigned spr_count,
+                          uint32_t * const cpu_spr_reg_values,
+                          bool * const error_bits )
+{
+  assert( error_bits != NULL );
+  return read_sprs( cpu_spr_reg_numbers, spr_count, cpu_spr_reg_values, error_bits ) != spr_count;
+}
 
-    assert( is_stalled_cmd_bit_len <= int( sizeof( is_stalled_cmd ) * BITS_PER_BYTE ) );
 
-    jtag_write_stream( &is_stalled_cmd,
-                       is_stalled_cmd_bit_len,
-                       true  // Set TMS during the last bit transfer, goes to state EXIT1_DR.
-                     );
+void dbg_cpu0_read_sprs_e ( const uint16_t * const cpu_spr_reg_numbers,
+                            const unsigned spr_count,
+                            uint32_t * const cpu_spr_reg_values )
+{
+  const unsigned read_count = read_sprs( cpu_spr_reg_numbers, spr_count, cpu_spr_reg_values, NULL );
 
-    // Moves the state machine from EXIT1-DR -> Update-DR -> IDLE.
-    // Going through Update-DR triggers the actual CPU "is stalled" query.
-    tap_move_from_exit_1_to_idle();
+  if ( read_count != spr_count )
+  {
+    throw std::runtime_error( format_msg( "Error reading from %s: The CPU JTAG interface returned an error indication.",
+                                          decode_spr_number( cpu_spr_reg_numbers[ read_count ] ).c_str() ) );
+  }
+}
 
-    tap_move_from_idle_to_shift_dr();
+
+bool dbg_cpu0_write_sprs ( const uint16_t * const cpu_spr_reg_numbers,
+                           const uint32_t * const cpu_spr_reg_values,
+                           const unsigned spr_count,
+                           bool * const error_bits )
+{
+  assert( error_bits != NULL );
+  return write_sprs( cpu_spr_reg_numbers, cpu_spr_reg_values, spr_count, error_bits ) != spr_count;
+}
+
+
+void dbg_cpu0_write_sprs_e ( const uint16_t * const cpu_spr_reg_numbers,
+                             const uint32_t * const cpu_spr_reg_values,
+                             const unsigned spr_count )
+{
+  const unsigned write_count = write_sprs( cpu_spr_reg_numbers, cpu_spr_reg_values, spr_count, NULL );
+
+  if ( write_count != spr_count )
+  {
+    throw std::runtime_error( format_msg( "Error writing to %s, new value: 0x%08X: The CPU JTAG interface returned an error indication.",
+                                          decode_spr_number( cpu_spr_reg_numbers[ write_count ] ).c_str(),
+                                          (unsigned)cpu_spr_reg_values[ write_count ] ) );
+  }
+}
+
+
+bool dbg_cpu0_is_stalled ( void )
+{
+  try
+  {
+    trace_jtag( "Querying CPU stall status...\n" );
+
+    trace_jtag( "Writing a DEBUG_CMD_IS_CPU_STALLED command.\n" );
+
+    // Going through Update-DR triggers the actual CPU "is stalled" query.
+    init_scan_templates();
+    jtag_execute_dr_scan_template( &s_is_stalled_scan );
 
     jtag_discard_postfix_bits();
 
     trace_jtag( "Reading the 'is stalled' bit...\n" );
 
-    uint8_t bit_read;
-    jtag_read_write_bit( 0, &bit_read );
-
-    const bool ret = ( bit_read != 0 );
+    // The bit read is delivered when finish_and_leave_a_dbg_nop_cmd_in_place() flushes the command queue,
+    // so that the whole query can travel in a single cable transfer.
+    uint8_t bit_read = 0;
+    jtag_queue_read_write_bit( 0, &bit_read );
 
     finish_and_leave_a_dbg_nop_cmd_in_place();
 
+    const bool ret = ( bit_read != 0 );
+
     trace_jtag( "Finished querying CPU stall status, result is: %s.\n", ret ? "stalled" : "not stalled" );
 
     return ret;
@@ -326,249 +603,620 @@ bool dbg_cpu0_is_stalled ( void )
 }
 
 
-static void break_up_into_bytes ( const uint32_t val,
-                                  uint8_t * const b1,
-                                  uint8_t * const b2,
-                                  uint8_t * const b3,
-                                  uint8_t * const b4 )
+static const unsigned BURST_MAX_WORD_COUNT = 0xFFFF;
+
+// Burst read result frame: <'1' start bit> + <error bit> + <32 data bits>.
+static const unsigned BURST_READ_FRAME_BIT_LEN = 1 + 1 + 32;
+// Burst write data frame: <'1' start bit> + <32 data bits>.
+static const unsigned BURST_WRITE_FRAME_BIT_LEN = 1 + 32;
+
+// The first burst read result frame takes a few clock cycles to arrive, so read a few
+// more bits than strictly necessary, in order to avoid another round trip to the cable.
+static const unsigned BURST_READ_SLACK_BIT_COUNT = 16;
+
+// Limits the size of the buffers passed to the cable in a single call.
+static const unsigned BURST_MAX_CHUNK_BIT_COUNT = 32 * 1024;
+
+// The CPU answers a memory access within a few clock cycles. If no start bit arrives for this long,
+// something is wrong, for example, the OR10 TAP may not implement the burst commands,
+// in which case it would never answer.
+static const unsigned BURST_MAX_ZERO_BIT_COUNT = 64 * 1024;
+
+// Burst write status: <'1' bit> + <error bit> + <overflow bit>.
+static const uint64_t BURST_WRITE_ERROR_FLAG    = 1;
+static const uint64_t BURST_WRITE_OVERFLOW_FLAG = 2;
+
+// The TAP can only hold one data word while the CPU is writing the previous one, so the write data frames
+// are separated by '0' bits according to the CPU latency measured in wait_for_completion().
+// If the data still overflows, the minimum gap below is raised and the burst is retried.
+static const unsigned BURST_WRITE_MAX_GAP_BIT_COUNT = MAX_ACK_WINDOW_BIT_COUNT;
+static unsigned s_burst_write_min_gap_bit_count = 0;
+
+enum burst_write_result_enum
 {
-  *b1 =  val >> 24;
-  *b2 = (val >> 16) & 0xFF;
-  *b3 = (val >>  8) & 0xFF;
-  *b4 = val & 0xFF;
+  BURST_WRITE_SUCCEEDED,
+  BURST_WRITE_FAILED,
+  BURST_WRITE_OVERFLOWED
+};
+
+
+static void put_bits ( std::vector< uint32_t > * const bit_buffer,
+                       const unsigned first_bit_pos,
+                       const uint32_t value,
+                       const unsigned bit_count )
+{
+  for ( unsigned i = 0; i < bit_count; ++i )
+  {
+    const unsigned bit_pos = first_bit_pos + i;
+
+    if ( ( value >> i ) & 1 )
+      (*bit_buffer)[ bit_pos / 32 ] |= uint32_t( 1 ) << ( bit_pos % 32 );
+  }
 }
 
 
-static uint32_t assemble_bytes ( const uint8_t b1,
-                                 const uint8_t b2,
-                                 const uint8_t b3,
-                                 const uint8_t b4 )
+// Leaves the TAP in the Shift-DR state with the given burst command running.
+
+static void start_burst_cmd ( const uint32_t opcode, const uint32_t start_addr, const unsigned word_count )
 {
-    return ( b1 << 24 ) |
-           ( b2 << 16 ) |
-           ( b3 << 8  ) |
-           ( b4 );
+  // A burst write of 0 words is only used to probe whether the TAP supports the burst commands.
+  assert( ( word_count > 0 || opcode == DEBUG_CMD_BURST_WRITE_MEM ) && word_count <= BURST_MAX_WORD_COUNT );
+  assert( start_addr % 4 == 0 );
+
+  init_scan_templates();
+  jtag_set_dr_scan_template_field( &s_burst_scan, 0, 32, start_addr );
+  jtag_set_dr_scan_template_field( &s_burst_scan, 32, 16, word_count );
+  jtag_set_dr_scan_template_field( &s_burst_scan, 32 + 16, DEBUG_CMD_LEN, opcode );
+
+  // Going through Update-DR starts the burst.
+  jtag_execute_dr_scan_template( &s_burst_scan );
 }
 
 
-// NOTE: If the CPU reports an error reading from memory, this routine stops, so the data returned
-//       may contain fewer bytes than requested. That matches the specification of GDB RSP command 'm addr,length'.
+// Returns the number of words successfully read.
 
-void dbg_cpu0_read_mem ( const uint32_t start_addr,
-                         const uint32_t byte_count,
-                         std::vector< uint8_t > * const data_read )
+static unsigned burst_read_mem_words ( const uint32_t start_addr,
+                                       const unsigned word_count,
+                                       uint32_t * const words_read )
 {
-  if ( byte_count == 0 )
-  {
-    assert( false );
-    return;
-  }
+  trace_jtag( "Starting a burst read of %u words at address 0x%08X...\n", word_count, start_addr );
 
-  trace_jtag( "Reading from memory, address 0x%08X, byte count %u...\n", start_addr, byte_count );
+  start_burst_cmd( DEBUG_CMD_BURST_READ_MEM, start_addr, word_count );
 
-  // The code below assumes that the OR10 CPU is big endian.
-  //
-  // This code can be optimised by having a central loop that reads 4-byte aligned data in chunks.
-  //
-  // If the debug interface supported setting the Wishbone 'sel' signal, we could read single bytes
-  // and 16-bit words where necessary.
+  jtag_discard_postfix_bits();
 
-  uint32_t addr     = start_addr & 0xFFFFFFFC;
-  unsigned byte_pos = start_addr % 4;
+  // The result frames may arrive with some '0' bits in between, and a frame may straddle
+  // two chunks, so the frame parsing state is kept across chunks.
 
-  uint8_t b1;
-  uint8_t b2;
-  uint8_t b3;
-  uint8_t b4;
+  unsigned word_index     = 0;
+  int      frame_bit_pos  = -1;  // -1 means waiting for the start bit, 0 is the error bit, the data bits come afterwards.
+  uint32_t data           = 0;
+  bool     error_bit      = false;
+  unsigned zero_bit_count = 0;   // Bits shifted since the last start bit.
 
-  uint32_t mem_val_1;
-  const bool error_bit_1 = dbg_cpu0_write_and_read_spr( SPR_DU_READ_MEM_ADDR, addr, &mem_val_1 );
-  if ( error_bit_1 )
-  {
-    // printf("Error bit set at mem addr: 0x%08X\n", addr );
+  std::vector< uint32_t > zeros;
+  std::vector< uint32_t > bits_in;
 
-    // Nothing else to do here, the caller will get fewer bytes than requested,
-    // and that is the only error indication this routine is returning.
-  }
-  else
+  while ( word_index < word_count && !error_bit )
   {
-    // printf("Mem addr: 0x%08X, value read: 0x%08X\n", addr, mem_val_1 );
-    break_up_into_bytes( mem_val_1, &b1, &b2, &b3, &b4 );
+    if ( zero_bit_count >= BURST_MAX_ZERO_BIT_COUNT )
+    {
+      throw std::runtime_error( format_msg( "No burst read result frame arrived after %u bits. "
+                                            "The OR10 TAP may not implement the burst memory commands.",
+                                            zero_bit_count ) );
+    }
+
+    const unsigned bit_count = std::min( ( word_count - word_index ) * BURST_READ_FRAME_BIT_LEN + BURST_READ_SLACK_BIT_COUNT,
+                                         BURST_MAX_CHUNK_BIT_COUNT );
+    const unsigned buffer_len = ( bit_count + 31 ) / 32;
+
+    zeros.assign( buffer_len, 0 );
+    bits_in.resize( buffer_len );
 
+    jtag_read_write_stream( &zeros.front(), &bits_in.front(), bit_count, false );
 
-    for ( unsigned i = 0; i < byte_count; ++i )
+    for ( unsigned i = 0; i < bit_count && word_index < word_count && !error_bit; ++i )
     {
-      bool is_end_of_32_bit_word = false;
+      const uint32_t bit = ( bits_in[ i / 32 ] >> ( i % 32 ) ) & 1;
 
-      switch ( byte_pos )
+      if ( frame_bit_pos < 0 )
       {
-      case 0: data_read->push_back( b1 ); break;
-      case 1: data_read->push_back( b2 ); break;
-      case 2: data_read->push_back( b3 ); break;
-      case 3: data_read->push_back( b4 );
-        is_end_of_32_bit_word = true;
-        break;
-      default:
-        assert( false );
+        if ( bit )
+        {
+          frame_bit_pos  = 0;
+          zero_bit_count = 0;
+        }
+        else
+        {
+          ++zero_bit_count;
+        }
       }
-
-      if ( is_end_of_32_bit_word )
+      else if ( frame_bit_pos == 0 )
       {
-        byte_pos = 0;
-        addr += 4;
+        if ( bit )
+          error_bit = true;
 
-        uint32_t mem_val_2;
-        const bool error_bit_2 = dbg_cpu0_write_and_read_spr( SPR_DU_READ_MEM_ADDR, addr, &mem_val_2 );
-        if ( error_bit_2 )
-        {
-          // printf("Error bit set at mem addr: 0x%08X\n", addr );
-          break;
-        }
-        // printf("Mem addr: 0x%08X, value read: 0x%08X\n", addr, mem_val_2 );
-        break_up_into_bytes( mem_val_2, &b1, &b2, &b3, &b4 );
+        data = 0;
+        frame_bit_pos = 1;
       }
       else
       {
-        byte_pos++;
+        data |= bit << ( frame_bit_pos - 1 );
+
+        if ( frame_bit_pos == 32 )
+        {
+          words_read[ word_index ] = data;
+          ++word_index;
+          frame_bit_pos = -1;
+        }
+        else
+        {
+          ++frame_bit_pos;
+        }
       }
     }
   }
 
-  trace_jtag( "Finished reading from memory, address 0x%08X, byte count %u.\n", start_addr, byte_count );
+  // We have been shifting zeros in, but the bits at the end of the DEBUG register may not be all zeros yet.
+  finish_and_leave_a_dbg_nop_cmd_in_place();
+
+  trace_jtag( "Finished the burst read, %u words read.\n", word_index );
+
+  return word_index;
 }
 
 
-static bool dbg_cpu0_write_mem_2 ( const uint32_t start_addr,
-                                   const uint32_t byte_count,
-                                   const std::vector< uint8_t > * const data_to_write )
+static unsigned get_burst_write_gap_bit_count ( void )
 {
-  if ( byte_count == 0 )
+  // The CPU write of the previous word must have finished by the time the next frame is complete.
+  const unsigned cpu_latency_bit_count = s_ack_latency_bit_count + ACK_WINDOW_SLACK_BIT_COUNT;
+  const unsigned latency_gap_bit_count = cpu_latency_bit_count > BURST_WRITE_FRAME_BIT_LEN
+                                           ? cpu_latency_bit_count - BURST_WRITE_FRAME_BIT_LEN
+                                           : 0;
+
+  return std::max( latency_gap_bit_count, s_burst_write_min_gap_bit_count );
+}
+
+
+// Waits for the burst write status and leaves a NOP command in place.
+
+static burst_write_result_enum finish_burst_write ( void )
+{
+  uint64_t status;
+
+  if ( !wait_for_completion( 2, BURST_MAX_ZERO_BIT_COUNT, &status ) )
   {
-    assert( false );
-    return false;
+    throw std::runtime_error( "No burst write status arrived. "
+                              "The OR10 TAP may not implement the burst memory commands." );
   }
 
-  assert( byte_count <= data_to_write->size() );
+  finish_and_leave_a_dbg_nop_cmd_in_place();
 
-  // The code below assumes that the OR10 CPU is big endian.
-  //
-  // This code can be optimised by having a central loop that writes 4-byte aligned data in chunks.
-  //
-  // If the debug interface supported setting the Wishbone 'sel' signal, we could write single bytes
-  // and 16-bit words where necessary.
+  if ( status & BURST_WRITE_OVERFLOW_FLAG )
+    return BURST_WRITE_OVERFLOWED;
+
+  return ( status & BURST_WRITE_ERROR_FLAG ) ? BURST_WRITE_FAILED : BURST_WRITE_SUCCEEDED;
+}
+
+
+static burst_write_result_enum burst_write_mem_words ( const uint32_t start_addr,
+                                                       const unsigned word_count,
+                                                       const uint32_t * const words_to_write )
+{
+  const unsigned gap_bit_count = get_burst_write_gap_bit_count();
+  const unsigned frame_bit_len = BURST_WRITE_FRAME_BIT_LEN + gap_bit_count;
+
+  trace_jtag( "Starting a burst write of %u words at address 0x%08X, with %u idle bits between frames...\n",
+              word_count, start_addr, gap_bit_count );
 
-  uint32_t addr     = start_addr & 0xFFFFFFFC;
-  unsigned byte_pos = start_addr % 4;
+  start_burst_cmd( DEBUG_CMD_BURST_WRITE_MEM, start_addr, word_count );
 
-  uint8_t b1;
-  uint8_t b2;
-  uint8_t b3;
-  uint8_t b4;
+  std::vector< uint32_t > frames;
 
-  // If the start memory address is not aligned or we are not writing at least 4 bytes,
-  // some of the bytes at the corresponding starting aligned 32-bit memory position will not be overwritten.
-  // Therefore, we have to read the aligned 32-bit word beforehand,
-  // modify just part of it, and then write the resulting 32-bit word later.
-  if ( byte_pos != 0 || byte_count < 4 )
+  for ( unsigned word_index = 0; word_index < word_count; )
   {
-    /*
-    if ( byte_pos != 0 )
-    {
-      printf( "Unaligned at start by %d bytes.\n", byte_pos );
-    }
-    else if ( byte_count < 4 )
+    const unsigned frame_count = std::min( word_count - word_index, std::max( BURST_MAX_CHUNK_BIT_COUNT / frame_bit_len, 1u ) );
+
+    // There must be no idle bits after the last frame, or the status could go out while they are being shifted.
+    const bool     is_last_chunk = ( word_index + frame_count == word_count );
+    const unsigned bit_count     = frame_count * frame_bit_len - ( is_last_chunk ? gap_bit_count : 0 );
+
+    frames.assign( ( bit_count + 31 ) / 32, 0 );
+
+    for ( unsigned i = 0; i < frame_count; ++i )
     {
-      printf( "Unaligned length at start of %d bytes.\n", byte_count );
+      const unsigned frame_bit_pos = i * frame_bit_len;
+      put_bits( &frames, frame_bit_pos, 1, 1 );
+      put_bits( &frames, frame_bit_pos + 1, words_to_write[ word_index + i ], 32 );
     }
-    */
 
-    uint32_t mem_val_1;
+    jtag_write_stream( &frames.front(), bit_count, false );
 
-    const bool error_bit_1 = dbg_cpu0_write_and_read_spr( SPR_DU_READ_MEM_ADDR, addr, &mem_val_1 );
-    if ( error_bit_1 )
+    word_index += frame_count;
+  }
+
+  const burst_write_result_enum result = finish_burst_write();
+
+  trace_jtag( "Finished the burst write, %s.\n",
+              result == BURST_WRITE_SUCCEEDED ? "successful" :
+              result == BURST_WRITE_FAILED    ? "the CPU reported an error" : "the data overflowed" );
+  return result;
+}
+
+
+bool dbg_probe_burst_mem_access ( void )
+{
+  try
+  {
+    trace_jtag( "Checking whether the OR10 TAP supports the burst memory commands...\n" );
+
+    // A burst write of 0 words only writes the start address to the CPU's Debug Unit, which is harmless.
+    start_burst_cmd( DEBUG_CMD_BURST_WRITE_MEM, 0, 0 );
+
+    uint64_t status;
+    const bool is_supported = wait_for_completion( 2, BURST_MAX_ZERO_BIT_COUNT, &status ) && status == 0;
+
+    finish_and_leave_a_dbg_nop_cmd_in_place();
+
+    trace_jtag( "The OR10 TAP %s the burst memory commands.\n", is_supported ? "supports" : "does not support" );
+
+    return is_supported;
+  }
+  catch ( const std::exception & e )
+  {
+    throw std::runtime_error( format_msg( "Error checking whether the OR10 TAP supports the burst memory commands: %s",
+                                          e.what() ) );
+  }
+}
+
+
+static unsigned spr_sequence_read_mem_words ( const uint32_t start_addr,
+                                              const unsigned word_count,
+                                              uint32_t * const words_read )
+{
+  std::vector< spr_op > ops( word_count );
+
+  for ( unsigned i = 0; i < word_count; ++i )
+  {
+    ops[ i ].spr_number     = SPR_DU_READ_MEM_ADDR;
+    ops[ i ].value_to_write = start_addr + i * 4;
+  }
+
+  return spr_op_sequence( &ops.front(), word_count, words_read, NULL );
+}
+
+
+// Newer CPUs increment their Debug Unit write address after each write to OR1200_DU_WRITE_MEM_DATA,
+// so the start address is only sent once for the whole block. That change came together with
+// OR1200_DU_WRITE_MEM_SEL, so if the CPU does not support that SPR, the address is sent before every word.
+
+static bool spr_sequence_write_mem_words ( const uint32_t start_addr,
+                                           const unsigned word_count,
+                                           const uint32_t * const words_to_write )
+{
+  std::vector< spr_op > ops;
+  ops.reserve( word_count * 2 );
+
+  for ( unsigned i = 0; i < word_count; ++i )
+  {
+    if ( i == 0 || !s_enable_write_mem_sel )
     {
-      // printf("Error bit set at mem addr: 0x%08X\n", addr );
-      return true;
+      const spr_op addr_op = { OR1200_DU_WRITE_MEM_ADDR, start_addr + i * 4 };
+      ops.push_back( addr_op );
     }
-    // printf("Mem addr: 0x%08X, value read: 0x%08X\n", addr, mem_val_1 );
-    break_up_into_bytes( mem_val_1, &b1, &b2, &b3, &b4 );
+
+    const spr_op data_op = { OR1200_DU_WRITE_MEM_DATA, words_to_write[ i ] };
+    ops.push_back( data_op );
   }
 
+  return spr_op_sequence( &ops.front(), unsigned( ops.size() ), NULL, NULL ) != ops.size();
+}
+
+
+// Reads a block of consecutive, aligned 32-bit words from memory.
+//
+// Returns the number of words successfully read. If the CPU reports an error,
+// the words from that address onwards are not read.
 
-  for ( unsigned i = 0; ; )
+static unsigned read_mem_words ( const uint32_t start_addr,
+                                 const unsigned word_count,
+                                 uint32_t * const words_read )
+{
+  assert( word_count > 0 );
+  assert( start_addr % 4 == 0 );
+
+  try
   {
-    assert( i < data_to_write->size() );
+    if ( !s_enable_burst_mem_access )
+      return spr_sequence_read_mem_words( start_addr, word_count, words_read );
 
-    const uint8_t current_byte = (*data_to_write)[ i ];
-    bool is_end_of_32_bit_word = false;
+    unsigned total_read_count = 0;
 
-    switch ( byte_pos )
+    while ( total_read_count < word_count )
     {
-    case 0: b1 = current_byte; break;
-    case 1: b2 = current_byte; break;
-    case 2: b3 = current_byte; break;
-    case 3: b4 = current_byte;
-                 is_end_of_32_bit_word = true;
-                 break;
-    default:
-      assert( false );
+      const unsigned burst_word_count = std::min( word_count - total_read_count, BURST_MAX_WORD_COUNT );
+
+      const unsigned read_count = burst_read_mem_words( start_addr + total_read_count * 4,
+                                                        burst_word_count,
+                                                        words_read + total_read_count );
+      total_read_count += read_count;
+
+      if ( read_count != burst_word_count )
+        break;
     }
 
-    ++i;
-    const bool should_exit_loop = ( i == byte_count );
+    return total_read_count;
+  }
+  catch ( const std::exception & e )
+  {
+    throw std::runtime_error( format_msg( "Error reading %u words from memory at address 0x%08X: %s",
+                                          word_count,
+                                          (unsigned)start_addr,
+                                          e.what() ) );
+  }
+}
+
 
-    if ( is_end_of_32_bit_word || should_exit_loop )
+// Writes a block of consecutive, aligned 32-bit words to memory.
+//
+// Returns true if there was an error writing to memory.
+
+static bool write_mem_words ( const uint32_t start_addr,
+                              const unsigned word_count,
+                              const uint32_t * const words_to_write )
+{
+  assert( word_count > 0 );
+  assert( start_addr % 4 == 0 );
+
+  try
+  {
+    unsigned written_count = 0;
+
+    // The OR10 TAP sends the start address only once for a burst write, and relies on the CPU incrementing it.
+    // The older CPUs without OR1200_DU_WRITE_MEM_SEL do not, see spr_sequence_write_mem_words().
+    if ( s_enable_burst_mem_access && s_enable_write_mem_sel )
     {
-      assert( addr % 4 == 0 );
+      while ( written_count < word_count )
+      {
+        const unsigned burst_word_count = std::min( word_count - written_count, BURST_MAX_WORD_COUNT );
 
-      if ( dbg_cpu0_write_spr( OR1200_DU_WRITE_MEM_ADDR, addr ) )
-        return true;
+        const burst_write_result_enum result = burst_write_mem_words( start_addr + written_count * 4,
+                                                                      burst_word_count,
+                                                                      words_to_write + written_count );
+        if ( result == BURST_WRITE_FAILED )
+          return true;
 
-      const uint32_t new_val = assemble_bytes( b1, b2, b3, b4 );
+        if ( result == BURST_WRITE_SUCCEEDED )
+        {
+          written_count += burst_word_count;
+          continue;
+        }
 
-      if ( dbg_cpu0_write_spr( OR1200_DU_WRITE_MEM_DATA, new_val ) )
-        return true;
-    }
+        // The data frames were sent too fast for the CPU. Leave more idle bits between them from now on,
+        // and write the same block again.
+        const unsigned gap_bit_count = get_burst_write_gap_bit_count();
 
-    if ( should_exit_loop )
-      break;
+        if ( gap_bit_count >= BURST_WRITE_MAX_GAP_BIT_COUNT )
+        {
+          trace_jtag( "The burst write overflowed with %u idle bits between frames, falling back to individual SPR writes.\n",
+                      gap_bit_count );
+          break;
+        }
 
+        s_burst_write_min_gap_bit_count = std::min( std::max( gap_bit_count * 2, ACK_WINDOW_SLACK_BIT_COUNT ),
+                                                    BURST_WRITE_MAX_GAP_BIT_COUNT );
 
-    if ( is_end_of_32_bit_word )
-    {
-      byte_pos = 0;
-      addr += 4;
+        trace_jtag( "The burst write overflowed, retrying with %u idle bits between frames.\n", s_burst_write_min_gap_bit_count );
+      }
+
+      if ( written_count == word_count )
+        return false;
     }
-    else
+
+    return spr_sequence_write_mem_words( start_addr + written_count * 4,
+                                         word_count - written_count,
+                                         words_to_write + written_count );
+  }
+  catch ( const std::exception & e )
+  {
+    throw std::runtime_error( format_msg( "Error writing %u words to memory at address 0x%08X: %s",
+                                          word_count,
+                                          (unsigned)start_addr,
+                                          e.what() ) );
+  }
+}
+
+
+// NOTE: If the CPU reports an error reading from memory, this routine stops, so the data returned
+//       may contain fewer bytes than requested. That matches the specification of GDB RSP command 'm addr,length'.
+
+void dbg_cpu0_read_mem ( const uint32_t start_addr,
+                         const uint32_t byte_count,
+                         std::vector< uint8_t > * const data_read )
+{
+  if ( byte_count == 0 )
+  {
+    assert( false );
+    return;
+  }
+
+  trace_jtag( "Reading from memory, address 0x%08X, byte count %u...\n", start_addr, byte_count );
+
+  // The code below assumes that the OR10 CPU is big endian.
+  //
+  // Memory is always read in whole 32-bit words. Reading the extra bytes around an unaligned
+  // block is harmless for normal memory, and the Debug Unit only lets you set the Wishbone 'sel'
+  // signal for writes anyway.
+
+  const uint32_t first_word_addr = start_addr & 0xFFFFFFFC;
+  const unsigned first_byte_pos  = start_addr % 4;
+  const unsigned word_count      = ( first_byte_pos + byte_count + 3 ) / 4;
+
+  std::vector< uint32_t > words( word_count );
+
+  const unsigned word_read_count = read_mem_words( first_word_addr, word_count, &words.front() );
+
+  // Nothing else to do if fewer words were read, the caller will get fewer bytes than requested,
+  // and that is the only error indication this routine is returning.
+
+  const unsigned available_byte_count = word_read_count * 4 - first_byte_pos;
+  const unsigned byte_count_to_copy   = ( word_read_count == 0 ) ? 0 : std::min( available_byte_count, unsigned( byte_count ) );
+
+  for ( unsigned i = 0; i < byte_count_to_copy; ++i )
+  {
+    const unsigned byte_pos = first_byte_pos + i;
+    const uint32_t word     = words[ byte_pos / 4 ];
+
+    data_read->push_back( uint8_t( word >> ( ( 3 - byte_pos % 4 ) * BITS_PER_BYTE ) ) );
+  }
+
+  trace_jtag( "Finished reading from memory, address 0x%08X, byte count %u.\n", start_addr, byte_count );
+}
+
+
+bool dbg_probe_write_mem_sel ( void )
+{
+  // Older CPUs report an error when writing to an unknown Debug Unit SPR. On newer CPUs, a full 'sel' mask
+  // is the default value anyway.
+  const bool is_supported = !dbg_cpu0_write_spr( OR1200_DU_WRITE_MEM_SEL, 0xF );
+
+  trace_jtag( "The CPU %s the OR1200_DU_WRITE_MEM_SEL SPR.\n", is_supported ? "supports" : "does not support" );
+
+  return is_supported;
+}
+
+
+// Writes some of the bytes in an aligned 32-bit word. The Wishbone 'sel' mask is set beforehand,
+// so that the other bytes in memory are left untouched, and there is no need to read the word first.
+// If the CPU does not support OR1200_DU_WRITE_MEM_SEL, the word is read, modified and written back instead.
+//
+// Returns true if there was an error writing to memory.
+
+static bool write_partial_mem_word ( const uint32_t word_addr,
+                                     const unsigned first_byte_pos,
+                                     const unsigned byte_count,
+                                     const uint32_t word )
+{
+  assert( word_addr % 4 == 0 );
+  assert( byte_count > 0 && first_byte_pos + byte_count <= 4 );
+
+  // The OR10 CPU is big endian, so the byte at the lowest address is selected by the highest 'sel' bit.
+  uint32_t sel = 0;
+
+  for ( unsigned byte_pos = first_byte_pos; byte_pos < first_byte_pos + byte_count; ++byte_pos )
+    sel |= 1 << ( 3 - byte_pos );
+
+  const spr_op ops[] = { { OR1200_DU_WRITE_MEM_SEL , sel       },
+                         { OR1200_DU_WRITE_MEM_ADDR, word_addr },
+                         { OR1200_DU_WRITE_MEM_DATA, word      } };
+
+  const unsigned op_count = sizeof( ops ) / sizeof( ops[0] );
+
+  try
+  {
+    if ( s_enable_write_mem_sel )
+      return spr_op_sequence( ops, op_count, NULL, NULL ) != op_count;
+
+    uint32_t old_word;
+
+    if ( read_mem_words( word_addr, 1, &old_word ) != 1 )
+      return true;
+
+    uint32_t byte_mask = 0;
+
+    for ( unsigned i = 0; i < 4; ++i )
     {
-      byte_pos++;
+      if ( sel & ( 1 << i ) )
+        byte_mask |= uint32_t( 0xFF ) << ( i * BITS_PER_BYTE );
     }
 
+    const uint32_t new_word = ( old_word & ~byte_mask ) | ( word & byte_mask );
 
-    // If less than 4 bytes are left, then not all of the 4 bytes in the next
-    // 32-bit word will be overwritten. Therefore, we must load the existing 32-bit word
-    // beforehand, in order to keep those values when we write the complete word at the end.
+    // Send the address together with the data, so that the write does not depend on the CPU
+    // incrementing its write address after a previous write.
+    const spr_op rmw_ops[] = { { OR1200_DU_WRITE_MEM_ADDR, word_addr },
+                               { OR1200_DU_WRITE_MEM_DATA, new_word  } };
 
-    const unsigned byte_count_left = byte_count - i;
+    const unsigned rmw_op_count = sizeof( rmw_ops ) / sizeof( rmw_ops[0] );
 
-    if ( is_end_of_32_bit_word && byte_count_left < 4 )
-    {
-      // printf( "Unaligned at end by %d bytes.\n", byte_count_left );
-      uint32_t mem_val_3;
+    return spr_op_sequence( rmw_ops, rmw_op_count, NULL, NULL ) != rmw_op_count;
+  }
+  catch ( const std::exception & e )
+  {
+    throw std::runtime_error( format_msg( "Error writing %u bytes to memory at address 0x%08X: %s",
+                                          byte_count,
+                                          (unsigned)( word_addr + first_byte_pos ),
+                                          e.what() ) );
+  }
+}
 
-      assert( addr % 4 == 0 );
 
-      const bool error_bit_3 = dbg_cpu0_write_and_read_spr( SPR_DU_READ_MEM_ADDR, addr, &mem_val_3 );
-      if ( error_bit_3 )
-      {
-        // printf("Error bit set at mem addr: 0x%08X\n", addr );
-        return true;
-      }
-      // printf("Mem addr: 0x%08X, value read: 0x%08X\n", addr, mem_val_3 );
-      break_up_into_bytes( mem_val_3, &b1, &b2, &b3, &b4 );
-    }
+static bool dbg_cpu0_write_mem_2 ( const uint32_t start_addr,
+                                   const uint32_t byte_count,
+                                   const std::vector< uint8_t > * const data_to_write )
+{
+  if ( byte_count == 0 )
+  {
+    assert( false );
+    return false;
+  }
+
+  assert( byte_count <= data_to_write->size() );
+
+  // The code below assumes that the OR10 CPU is big endian.
+
+  const uint32_t first_word_addr = start_addr & 0xFFFFFFFC;
+  const unsigned first_byte_pos  = start_addr % 4;
+  const unsigned word_count      = ( first_byte_pos + byte_count + 3 ) / 4;
+  const unsigned last_byte_end   = ( first_byte_pos + byte_count ) % 4;
+
+  std::vector< uint32_t > words( word_count, 0 );
+
+  for ( unsigned i = 0; i < byte_count; ++i )
+  {
+    const unsigned byte_pos = first_byte_pos + i;
+    const unsigned shift    = ( 3 - byte_pos % 4 ) * BITS_PER_BYTE;
+
+    words[ byte_pos / 4 ] |= uint32_t( (*data_to_write)[ i ] ) << shift;
   }
 
+  // If the start memory address is not aligned, or the end address is not aligned,
+  // only some of the bytes in the first or last 32-bit words must be overwritten.
+  // Those words are written on their own with the right Wishbone 'sel' mask,
+  // and the whole words in between are written as a block.
+
+  if ( word_count == 1 )
+  {
+    if ( first_byte_pos == 0 && last_byte_end == 0 )
+      return write_mem_words( first_word_addr, 1, &words.front() );
+
+    return write_partial_mem_word( first_word_addr, first_byte_pos, byte_count, words.front() );
+  }
+
+  unsigned first_full_word = 0;
+  unsigned full_word_count = word_count;
+
+  if ( first_byte_pos != 0 )
+  {
+    if ( write_partial_mem_word( first_word_addr, first_byte_pos, 4 - first_byte_pos, words.front() ) )
+      return true;
+
+    ++first_full_word;
+    --full_word_count;
+  }
+
+  if ( last_byte_end != 0 )
+    --full_word_count;
+
+  if ( full_word_count != 0 &&
+       write_mem_words( first_word_addr + first_full_word * 4, full_word_count, &words[ first_full_word ] ) )
+  {
+    return true;
+  }
+
+  if ( last_byte_end != 0 )
+    return write_partial_mem_word( first_word_addr + ( word_count - 1 ) * 4, 0, last_byte_end, words.back() );
+
   return false;
 }
 
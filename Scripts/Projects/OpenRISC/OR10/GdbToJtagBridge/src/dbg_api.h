@@ -9,12 +9,44 @@
 
 void dgb_enable_jtag_trace ( bool enable_jtag_trace );
 
+// Whether memory is accessed with the DEBUG_CMD_BURST_xxx_MEM commands,
+// instead of with individual CPU SPR accesses. Enabled by default.
+void dbg_enable_burst_mem_access ( bool enable_burst_mem_access );
+
+// Returns whether the OR10 TAP implements the DEBUG_CMD_BURST_xxx_MEM commands.
+// Older TAPs do not, and they would never answer them.
+bool dbg_probe_burst_mem_access ( void );
+
+// Whether partial memory words are written with the OR1200_DU_WRITE_MEM_SEL byte mask,
+// instead of reading, modifying and writing back the whole word. Enabled by default.
+// The older CPUs without that SPR do not increment the write address after each word either,
+// so disabling it also sends the write address before each word, and turns off the burst writes.
+void dbg_enable_write_mem_sel ( bool enable_write_mem_sel );
+
+// Returns whether the CPU implements the OR1200_DU_WRITE_MEM_SEL SPR. Older CPUs do not.
+bool dbg_probe_write_mem_sel ( void );
+
+// The maximum number of bits shifted per cable call while waiting for a CPU operation to complete.
+// The actual window size adapts to how long the operations take. Throws if out of range.
+void dbg_set_max_ack_window ( unsigned max_bit_count );
+
 bool dbg_cpu0_read_spr    ( uint16_t cpu_spr_reg_number, uint32_t * cpu_spr_reg_value );
 void dbg_cpu0_read_spr_e  ( uint16_t cpu_spr_reg_number, uint32_t * cpu_spr_reg_value );
 
 bool dbg_cpu0_write_spr   ( uint16_t cpu_spr_reg_number, uint32_t   cpu_spr_reg_value );
 void dbg_cpu0_write_spr_e ( uint16_t cpu_spr_reg_number, uint32_t   cpu_spr_reg_value );
 
+// These routines access several SPRs back to back in a single JTAG scan sequence.
+// The non-_e versions execute all operations, even if some of them fail, and return
+// the error bit for each SPR in error_bits. They return true if any operation failed.
+// The _e versions stop at the first error.
+
+bool dbg_cpu0_read_sprs    ( const uint16_t * cpu_spr_reg_numbers, unsigned spr_count, uint32_t * cpu_spr_reg_values, bool * error_bits );
+void dbg_cpu0_read_sprs_e  ( const uint16_t * cpu_spr_reg_numbers, unsigned spr_count, uint32_t * cpu_spr_reg_values );
+
+bool dbg_cpu0_write_sprs   ( const uint16_t * cpu_spr_reg_numbers, const uint32_t * cpu_spr_reg_values, unsigned spr_count, bool * error_bits );
+void dbg_cpu0_write_sprs_e ( const uint16_t * cpu_spr_reg_numbers, const uint32_t * cpu_spr_reg_values, unsigned spr_count );
+
 void dbg_cpu0_read_mem  ( uint32_t start_addr, uint32_t byte_count,       std::vector< uint8_t > * data_read     );
 bool dbg_cpu0_write_mem ( uint32_t start_addr, uint32_t byte_count, const std::vector< uint8_t > * data_to_write );
 
@@ -0,0 +1,110 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jtag_tap_state.h"  // The include file for this module should come first.
+
+#include <string.h>
+#include <assert.h>
+
+
+tap_state_enum get_next_tap_state ( const tap_state_enum state, const bool tms )
+{
+  switch ( state )
+  {
+  case TAP_STATE_TEST_LOGIC_RESET: return tms ? TAP_STATE_TEST_LOGIC_RESET : TAP_STATE_RUN_TEST_IDLE;
+  case TAP_STATE_RUN_TEST_IDLE:    return tms ? TAP_STATE_SELECT_DR_SCAN   : TAP_STATE_RUN_TEST_IDLE;
+  case TAP_STATE_SELECT_DR_SCAN:   return tms ? TAP_STATE_SELECT_IR_SCAN   : TAP_STATE_CAPTURE_DR;
+  case TAP_STATE_CAPTURE_DR:       return tms ? TAP_STATE_EXIT1_DR         : TAP_STATE_SHIFT_DR;
+  case TAP_STATE_SHIFT_DR:         return tms ? TAP_STATE_EXIT1_DR         : TAP_STATE_SHIFT_DR;
+  case TAP_STATE_EXIT1_DR:         return tms ? TAP_STATE_UPDATE_DR        : TAP_STATE_PAUSE_DR;
+  case TAP_STATE_PAUSE_DR:         return tms ? TAP_STATE_EXIT2_DR         : TAP_STATE_PAUSE_DR;
+  case TAP_STATE_EXIT2_DR:         return tms ? TAP_STATE_UPDATE_DR        : TAP_STATE_SHIFT_DR;
+  case TAP_STATE_UPDATE_DR:        return tms ? TAP_STATE_SELECT_DR_SCAN   : TAP_STATE_RUN_TEST_IDLE;
+  case TAP_STATE_SELECT_IR_SCAN:   return tms ? TAP_STATE_TEST_LOGIC_RESET : TAP_STATE_CAPTURE_IR;
+  case TAP_STATE_CAPTURE_IR:       return tms ? TAP_STATE_EXIT1_IR         : TAP_STATE_SHIFT_IR;
+  case TAP_STATE_SHIFT_IR:         return tms ? TAP_STATE_EXIT1_IR         : TAP_STATE_SHIFT_IR;
+  case TAP_STATE_EXIT1_IR:         return tms ? TAP_STATE_UPDATE_IR        : TAP_STATE_PAUSE_IR;
+  case TAP_STATE_PAUSE_IR:         return tms ? TAP_STATE_EXIT2_IR         : TAP_STATE_PAUSE_IR;
+  case TAP_STATE_EXIT2_IR:         return tms ? TAP_STATE_UPDATE_IR        : TAP_STATE_SHIFT_IR;
+  case TAP_STATE_UPDATE_IR:        return tms ? TAP_STATE_SELECT_DR_SCAN   : TAP_STATE_RUN_TEST_IDLE;
+
+  default:
+    assert( false );
+    return TAP_STATE_UNKNOWN;
+  }
+}
+
+
+// Shortest TMS sequences between any two states, sent from LSB to MSB.
+
+static bool s_are_tms_paths_calculated = false;
+static uint8_t s_tms_path_bits[ TAP_STATE_COUNT ][ TAP_STATE_COUNT ];
+static uint8_t s_tms_path_len [ TAP_STATE_COUNT ][ TAP_STATE_COUNT ];
+
+static void calculate_tms_paths ( void )
+{
+  for ( int from = 0; from < TAP_STATE_COUNT; ++from )
+  {
+    bool visited[ TAP_STATE_COUNT ];
+    memset( visited, 0, sizeof( visited ) );
+
+    // Breadth-first search.
+    tap_state_enum queue[ TAP_STATE_COUNT ];
+    int queue_len = 0;
+
+    queue[ queue_len++ ] = tap_state_enum( from );
+    visited[ from ] = true;
+    s_tms_path_bits[ from ][ from ] = 0;
+    s_tms_path_len [ from ][ from ] = 0;
+
+    for ( int i = 0; i < queue_len; ++i )
+    {
+      const tap_state_enum state = queue[ i ];
+
+      for ( int tms = 0; tms <= 1; ++tms )
+      {
+        const tap_state_enum next = get_next_tap_state( state, tms != 0 );
+
+        if ( visited[ next ] )
+          continue;
+
+        visited[ next ] = true;
+        s_tms_path_len [ from ][ next ] = s_tms_path_len[ from ][ state ] + 1;
+        s_tms_path_bits[ from ][ next ] = s_tms_path_bits[ from ][ state ] | ( tms << s_tms_path_len[ from ][ state ] );
+        queue[ queue_len++ ] = next;
+      }
+    }
+
+    assert( queue_len == TAP_STATE_COUNT );
+  }
+
+  s_are_tms_paths_calculated = true;
+}
+
+
+void get_shortest_tms_path ( const tap_state_enum from,
+                             const tap_state_enum to,
+                             uint32_t * const tms_bits,
+                             int * const bit_count )
+{
+  assert( from < TAP_STATE_COUNT && to < TAP_STATE_COUNT );
+
+  if ( !s_are_tms_paths_calculated )
+    calculate_tms_paths();
+
+  *tms_bits  = s_tms_path_bits[ from ][ to ];
+  *bit_count = s_tms_path_len [ from ][ to ];
+}
@@ -0,0 +1,42 @@
+#ifndef JTAG_TAP_STATE_H_INCLUDED
+#define JTAG_TAP_STATE_H_INCLUDED
+
+#include <stdint.h>
+
+// The JTAG TAP state machine, as described in IEEE 1149.1.
+//
+// The binary JTAG trace stores these values, see JTAG_TRACE_TAP_STATE_xxx in jtag_trace_format.h .
+
+enum tap_state_enum
+{
+  TAP_STATE_TEST_LOGIC_RESET,
+  TAP_STATE_RUN_TEST_IDLE,
+  TAP_STATE_SELECT_DR_SCAN,
+  TAP_STATE_CAPTURE_DR,
+  TAP_STATE_SHIFT_DR,
+  TAP_STATE_EXIT1_DR,
+  TAP_STATE_PAUSE_DR,
+  TAP_STATE_EXIT2_DR,
+  TAP_STATE_UPDATE_DR,
+  TAP_STATE_SELECT_IR_SCAN,
+  TAP_STATE_CAPTURE_IR,
+  TAP_STATE_SHIFT_IR,
+  TAP_STATE_EXIT1_IR,
+  TAP_STATE_PAUSE_IR,
+  TAP_STATE_EXIT2_IR,
+  TAP_STATE_UPDATE_IR,
+
+  TAP_STATE_COUNT,
+  TAP_STATE_UNKNOWN = TAP_STATE_COUNT
+};
+
+tap_state_enum get_next_tap_state ( tap_state_enum state, bool tms );
+
+// Returns the shortest TMS sequence from one state to another, to be sent from LSB to MSB.
+// No path is longer than 8 bits, for example, from Capture-DR to Exit2-IR. The path from a state to itself is empty.
+void get_shortest_tms_path ( tap_state_enum from,
+                             tap_state_enum to,
+                             uint32_t * tms_bits,
+                             int * bit_count );
+
+#endif  // Include this header file only once.
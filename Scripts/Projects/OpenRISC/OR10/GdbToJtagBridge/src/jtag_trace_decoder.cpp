@@ -0,0 +1,732 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Offline decoder for the binary JTAG trace files that the bridge writes with --trace-jtag-ring.
+//
+// The default output has one line per trace record, like the bridge's --trace-jtag-bit-data option.
+//
+// With --ops, the decoder follows the TAP state machine instead, and prints the debug operation
+// messages, the IR scans, the commands shifted into the OR10 DEBUG register, and the results
+// read back for them. If there are other devices in the JTAG chain, the number of DR prefix and
+// postfix bits must be given, like the bridge itself does (one bit per device in BYPASS).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+#include "jtag_trace_format.h"
+#include "cable_drivers/cable_write_bit_constants.h"
+#include "or10_debug_module.h"
+#include "jtag_tap_state.h"
+#include "string_utils.h"
+
+
+static bool s_decode_ops = false;
+static int  s_dr_prefix_bits  = 0;
+static int  s_dr_postfix_bits = 0;
+
+
+static void print_usage ( const char * const func )
+{
+  printf( "Decoder for the binary JTAG trace files written by the GDB to JTAG bridge for the OR10 CPU.\n" );
+  printf( "Copyright (C) 2012 R. Diez\n\n" );
+  printf( "Usage: %s (options) <trace file>\n", func );
+  printf( "Options:\n" );
+  printf( "  --ops                 : Decode the debug operations instead of printing the raw bit data.\n" );
+  printf( "  --dr-prefix-bits=<n>  : Number of devices between the cable data output and the target (default: 0).\n" );
+  printf( "  --dr-postfix-bits=<n> : Number of devices between the target and the cable data input (default: 0).\n" );
+  printf( "  -h, --help            : Show this help text.\n" );
+}
+
+
+static int parse_bit_count ( const char * const str, const char * const option_name )
+{
+  char * first_err_char;
+  const long val = strtol( str, &first_err_char, 10 );
+
+  if ( *first_err_char || *str == '\0' || val < 0 || val > 1024 )
+    throw std::runtime_error( format_msg( "Invalid value \"%s\" for option %s.", str, option_name ) );
+
+  return int( val );
+}
+
+
+// ----------- Trace file loading -----------
+
+struct trace_record
+{
+  jtag_trace_record_header hdr;
+  const uint8_t * payload;
+};
+
+
+static void load_trace_file ( const char * const filename,
+                              std::vector< uint8_t > * const contents,
+                              jtag_trace_file_header * const file_hdr,
+                              std::vector< trace_record > * const records )
+{
+  FILE * const f = fopen( filename, "rb" );
+
+  if ( f == NULL )
+    throw std::runtime_error( format_errno_msg( errno, "Cannot open file \"%s\": ", filename ) );
+
+  uint8_t buffer[ 64 * 1024 ];
+
+  for ( ; ; )
+  {
+    const size_t read_count = fread( buffer, 1, sizeof( buffer ), f );
+    contents->insert( contents->end(), buffer, buffer + read_count );
+
+    if ( read_count < sizeof( buffer ) )
+      break;
+  }
+
+  const bool is_error = ( ferror( f ) != 0 );
+  fclose( f );
+
+  if ( is_error )
+    throw std::runtime_error( format_msg( "Error reading file \"%s\".", filename ) );
+
+  if ( contents->size() < sizeof( *file_hdr ) )
+    throw std::runtime_error( format_msg( "File \"%s\" is too short to be a JTAG trace file.", filename ) );
+
+  memcpy( file_hdr, &(*contents)[ 0 ], sizeof( *file_hdr ) );
+
+  if ( 0 != memcmp( file_hdr->magic, JTAG_TRACE_FILE_MAGIC, sizeof( file_hdr->magic ) ) )
+    throw std::runtime_error( format_msg( "File \"%s\" is not a JTAG trace file.", filename ) );
+
+  if ( file_hdr->version != JTAG_TRACE_FILE_VERSION ||
+       file_hdr->record_header_size != sizeof( jtag_trace_record_header ) )
+  {
+    throw std::runtime_error( format_msg( "File \"%s\" has an unsupported JTAG trace format version, "
+                                          "or it was written on a machine with a different endianness.",
+                                          filename ) );
+  }
+
+  size_t pos = sizeof( *file_hdr );
+
+  while ( pos < contents->size() )
+  {
+    trace_record rec;
+
+    if ( contents->size() - pos < sizeof( rec.hdr ) )
+      throw std::runtime_error( format_msg( "File \"%s\" is truncated.", filename ) );
+
+    memcpy( &rec.hdr, &(*contents)[ pos ], sizeof( rec.hdr ) );
+    pos += sizeof( rec.hdr );
+
+    if ( contents->size() - pos < rec.hdr.payload_len )
+      throw std::runtime_error( format_msg( "File \"%s\" is truncated.", filename ) );
+
+    rec.payload = &(*contents)[ pos ];
+    pos += rec.hdr.payload_len;
+
+    records->push_back( rec );
+  }
+}
+
+
+static uint32_t get_payload_word ( const trace_record & rec, const unsigned word_index )
+{
+  uint32_t word;
+  memcpy( &word, rec.payload + word_index * sizeof( word ), sizeof( word ) );
+  return word;
+}
+
+
+// Returns -1 if the bit was not recorded, because the stream was truncated.
+
+static int get_payload_bit ( const trace_record & rec, const unsigned bit_pos )
+{
+  if ( bit_pos / 32 >= rec.hdr.payload_len / sizeof( uint32_t ) )
+    return -1;
+
+  return int( ( get_payload_word( rec, bit_pos / 32 ) >> ( bit_pos % 32 ) ) & 1 );
+}
+
+
+static std::string format_timestamp ( const trace_record & rec )
+{
+  return format_msg( "%4" PRIu64 ".%09" PRIu64,
+                     rec.hdr.timestamp_ns / 1000000000,
+                     rec.hdr.timestamp_ns % 1000000000 );
+}
+
+
+static std::string format_bits ( const trace_record & rec )
+{
+  std::string s;
+  s.reserve( rec.hdr.bit_count );
+
+  for ( unsigned i = 0; i < rec.hdr.bit_count; ++i )
+  {
+    const int bit = get_payload_bit( rec, i );
+
+    if ( bit < 0 )
+    {
+      s += "...";
+      break;
+    }
+
+    s += bit ? '1' : '0';
+  }
+
+  return s;
+}
+
+
+// ----------- Raw text output -----------
+
+static void print_record ( const trace_record & rec )
+{
+  const std::string ts = format_timestamp( rec );
+
+  switch ( rec.hdr.type )
+  {
+  case JTAG_TRACE_TMS_SEQUENCE:
+    printf( "%s Sent TMS sequence: %s\n", ts.c_str(), format_bits( rec ).c_str() );
+    break;
+
+  case JTAG_TRACE_OUTGOING_BIT:
+    {
+      const uint32_t packet = get_payload_word( rec, 0 );
+      printf( "%s Sent bit TDI=%c%s%s\n",
+              ts.c_str(),
+              ( packet & TDO ) ? '1' : '0',
+              ( packet & TMS  ) ? ", TMS=1"  : "",
+              ( packet & TRST ) ? ", TRST=1" : "" );
+      break;
+    }
+
+  case JTAG_TRACE_INCOMING_BIT:
+    printf( "%s Received bit TDO=%c\n", ts.c_str(), get_payload_word( rec, 0 ) ? '1' : '0' );
+    break;
+
+  case JTAG_TRACE_OUTGOING_STREAM:
+    printf( "%s Sent %u bits: %s%s\n",
+            ts.c_str(),
+            unsigned( rec.hdr.bit_count ),
+            format_bits( rec ).c_str(),
+            ( rec.hdr.flags & JTAG_TRACE_FLAG_TMS_ON_LAST_BIT ) ? ", last bit TMS=1" : "" );
+    break;
+
+  case JTAG_TRACE_INCOMING_STREAM:
+    printf( "%s Received %u bits: %s\n",
+            ts.c_str(),
+            unsigned( rec.hdr.bit_count ),
+            format_bits( rec ).c_str() );
+    break;
+
+  case JTAG_TRACE_CONTEXT:
+    printf( "%s %s%.*s\n",
+            ts.c_str(),
+            ( rec.hdr.flags & JTAG_TRACE_FLAG_DEBUG_OP ) ? "Debug op: " : "",
+            int( rec.hdr.bit_count ),
+            reinterpret_cast< const char * >( rec.payload ) );
+    break;
+
+  default:
+    printf( "%s Unknown record type %u.\n", ts.c_str(), unsigned( rec.hdr.type ) );
+    break;
+  }
+}
+
+
+// ----------- Debug operation decoding -----------
+
+// The bits are stored in shift order. A value of -1 means the bit is not known,
+// for example, because the bridge did not read TDO during that part of the scan.
+typedef std::vector< int > bit_vector;
+
+static tap_state_enum s_tap_state = TAP_STATE_UNKNOWN;
+static int s_tms_high_count = 0;
+
+static bit_vector s_tdi_bits;  // Shifted in since the last Capture-xR state.
+static bit_vector s_tdo_bits;
+static bool s_is_scan_complete = false;  // Whether the current scan started after the first record in the trace.
+
+static bool     s_is_cmd_pending = false;  // Whether the last DEBUG command still waits for its result.
+static unsigned s_pending_opcode = DEBUG_CMD_NOP;
+
+static std::string s_timestamp;  // Of the record being decoded.
+
+
+static const char * get_opcode_name ( const unsigned opcode )
+{
+  switch ( opcode )
+  {
+  case DEBUG_CMD_NOP:                     return "NOP";
+  case DEBUG_CMD_IS_CPU_STALLED:          return "IS_CPU_STALLED";
+  case DEBUG_CMD_WRITE_CPU_SPR:           return "WRITE_CPU_SPR";
+  case DEBUG_CMD_READ_CPU_SPR:            return "READ_CPU_SPR";
+  case DEBUG_CMD_READ_FIXED_TEST_PATTERN: return "READ_FIXED_TEST_PATTERN";
+  case DEBUG_CMD_WRITE_TEST_PATTERN:      return "WRITE_TEST_PATTERN";
+  case DEBUG_CMD_BURST_READ_MEM:          return "BURST_READ_MEM";
+  case DEBUG_CMD_BURST_WRITE_MEM:         return "BURST_WRITE_MEM";
+  default:                                return "?";
+  }
+}
+
+
+// Returns false if any of the bits is missing or unknown.
+
+static bool get_field ( const bit_vector & bits, const int first_pos, const int bit_count, uint32_t * const value )
+{
+  *value = 0;
+
+  for ( int i = 0; i < bit_count; ++i )
+  {
+    const int pos = first_pos + i;
+
+    if ( pos < 0 || pos >= int( bits.size() ) || bits[ pos ] < 0 )
+      return false;
+
+    *value |= uint32_t( bits[ pos ] ) << i;
+  }
+
+  return true;
+}
+
+
+// Searches for the next '1' start bit, starting at *pos. Returns false if it is not there,
+// or if an unknown bit is found first.
+
+static bool find_start_bit ( const bit_vector & bits, int * const pos )
+{
+  for ( ; *pos < int( bits.size() ); ++*pos )
+  {
+    if ( bits[ *pos ] < 0 )
+      return false;
+
+    if ( bits[ *pos ] == 1 )
+      return true;
+  }
+
+  return false;
+}
+
+
+// Decodes what the target sent back for the previous DEBUG command.
+
+static void decode_result ( void )
+{
+  if ( !s_is_cmd_pending )
+    return;
+
+  s_is_cmd_pending = false;
+
+  const bit_vector & tdo = s_tdo_bits;
+  int pos = s_dr_postfix_bits;
+
+  switch ( s_pending_opcode )
+  {
+  case DEBUG_CMD_READ_CPU_SPR:
+  case DEBUG_CMD_WRITE_CPU_SPR:
+    {
+      const int first_pos = pos;
+
+      if ( !find_start_bit( tdo, &pos ) )
+      {
+        printf( "%s     No completion bit read back.\n", s_timestamp.c_str() );
+        break;
+      }
+
+      uint32_t error_bit;
+      uint32_t data;
+      const bool has_error_bit = get_field( tdo, pos + 1, 1, &error_bit );
+      const bool has_data = ( s_pending_opcode == DEBUG_CMD_READ_CPU_SPR ) && get_field( tdo, pos + 2, 32, &data );
+
+      printf( "%s     Completed after %d bits, error bit: %s",
+              s_timestamp.c_str(),
+              pos - first_pos,
+              has_error_bit ? ( error_bit ? "1" : "0" ) : "?" );
+
+      if ( has_data )
+        printf( ", value read: 0x%08X", data );
+
+      printf( "\n" );
+      break;
+    }
+
+  case DEBUG_CMD_IS_CPU_STALLED:
+    {
+      uint32_t stalled;
+
+      if ( get_field( tdo, pos, 1, &stalled ) )
+        printf( "%s     Stalled: %s\n", s_timestamp.c_str(), stalled ? "yes" : "no" );
+      else
+        printf( "%s     Stall bit not traced, it is read in queued mode.\n", s_timestamp.c_str() );
+      break;
+    }
+
+  case DEBUG_CMD_BURST_READ_MEM:
+    {
+      unsigned word_count = 0;
+      uint32_t error_bit = 0;
+
+      for ( ; ; )
+      {
+        uint32_t data;
+
+        if ( !find_start_bit( tdo, &pos ) ||
+             !get_field( tdo, pos + 1, 1, &error_bit ) ||
+             !get_field( tdo, pos + 2, 32, &data ) )
+        {
+          break;
+        }
+
+        if ( word_count < 4 )
+          printf( "%s     Word %u: 0x%08X\n", s_timestamp.c_str(), word_count, data );
+
+        ++word_count;
+        pos += 2 + 32;
+
+        if ( error_bit )
+          break;
+      }
+
+      printf( "%s     %u words read%s.\n", s_timestamp.c_str(), word_count, error_bit ? ", error bit set" : "" );
+      break;
+    }
+
+  default:
+    break;
+  }
+}
+
+
+// The DEBUG register latches the last bits shifted in, see tap_or10.v .
+// The bits after them went into the devices before the target.
+
+static void decode_command ( void )
+{
+  const int end_pos = int( s_tdi_bits.size() ) - s_dr_prefix_bits;
+
+  uint32_t opcode;
+
+  if ( !get_field( s_tdi_bits, end_pos - DEBUG_CMD_LEN, DEBUG_CMD_LEN, &opcode ) )
+  {
+    printf( "%s   DR scan of %u bits, the command could not be decoded.\n", s_timestamp.c_str(), unsigned( s_tdi_bits.size() ) );
+    return;
+  }
+
+  const int spr_pos   = end_pos - DEBUG_CMD_LEN - 16;
+  const int value_pos = spr_pos - 32;
+
+  uint32_t spr;
+  uint32_t value;
+  const bool has_spr   = get_field( s_tdi_bits, spr_pos  , 16, &spr   );
+  const bool has_value = get_field( s_tdi_bits, value_pos, 32, &value );
+
+  printf( "%s   Command %s", s_timestamp.c_str(), get_opcode_name( opcode ) );
+
+  switch ( opcode )
+  {
+  case DEBUG_CMD_READ_CPU_SPR:
+    if ( has_spr )
+      printf( ", SPR 0x%04X", spr );
+    break;
+
+  case DEBUG_CMD_WRITE_CPU_SPR:
+    if ( has_spr && has_value )
+      printf( ", SPR 0x%04X, value 0x%08X", spr, value );
+    break;
+
+  case DEBUG_CMD_BURST_READ_MEM:
+  case DEBUG_CMD_BURST_WRITE_MEM:
+    if ( has_spr && has_value )
+      printf( ", address 0x%08X, %u words", value, spr );
+    break;
+
+  default:
+    break;
+  }
+
+  printf( "\n" );
+
+  s_is_cmd_pending = true;
+  s_pending_opcode = opcode;
+}
+
+
+static void print_ir_scan ( void )
+{
+  std::string bits;
+
+  for ( size_t i = 0; i < s_tdi_bits.size(); ++i )
+    bits += s_tdi_bits[ i ] < 0 ? '?' : char( '0' + s_tdi_bits[ i ] );
+
+  printf( "%s IR scan of %u bits: %s\n", s_timestamp.c_str(), unsigned( bits.size() ), bits.c_str() );
+}
+
+
+// Clocks one TCK cycle through the TAP state machine.
+
+static void clock_tap ( const bool tms, const int tdi )
+{
+  if ( s_tap_state == TAP_STATE_SHIFT_DR || s_tap_state == TAP_STATE_SHIFT_IR )
+  {
+    s_tdi_bits.push_back( tdi );
+    s_tdo_bits.push_back( -1 );
+  }
+
+  if ( s_tap_state == TAP_STATE_UNKNOWN )
+  {
+    // 5 TCK cycles with TMS high reset the TAP from any state.
+    s_tms_high_count = tms ? s_tms_high_count + 1 : 0;
+
+    if ( s_tms_high_count >= 5 )
+      s_tap_state = TAP_STATE_TEST_LOGIC_RESET;
+
+    return;
+  }
+
+  const tap_state_enum prev_state = s_tap_state;
+  s_tap_state = get_next_tap_state( s_tap_state, tms );
+
+  switch ( s_tap_state )
+  {
+  case TAP_STATE_TEST_LOGIC_RESET:
+    if ( prev_state != TAP_STATE_TEST_LOGIC_RESET )
+      printf( "%s TAP reset.\n", s_timestamp.c_str() );
+
+    s_is_cmd_pending = false;
+    break;
+
+  case TAP_STATE_CAPTURE_DR:
+  case TAP_STATE_CAPTURE_IR:
+    s_tdi_bits.clear();
+    s_tdo_bits.clear();
+    s_is_scan_complete = true;
+    break;
+
+  case TAP_STATE_UPDATE_DR:
+    if ( s_is_scan_complete )
+    {
+      decode_result();
+      decode_command();
+    }
+    break;
+
+  case TAP_STATE_UPDATE_IR:
+    // The IR selects a different register, so whatever the DEBUG command delivers is lost.
+    if ( s_is_scan_complete )
+    {
+      decode_result();
+      print_ir_scan();
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+// Fills in the TDO bits for the TDI bits that have just been clocked.
+
+static void set_last_tdo_bits ( const trace_record & rec, const unsigned bit_count )
+{
+  // The last bit may have moved the TAP out of the Shift state, and then the bits were not stored.
+  const unsigned stored_count = std::min( unsigned( s_tdo_bits.size() ), bit_count );
+  const size_t first_index = s_tdo_bits.size() - stored_count;
+
+  for ( unsigned i = 0; i < stored_count; ++i )
+  {
+    const int bit = ( rec.hdr.type == JTAG_TRACE_INCOMING_BIT ) ? int( get_payload_word( rec, 0 ) & 1 )
+                                                                : get_payload_bit( rec, i );
+    s_tdo_bits[ first_index + i ] = bit;
+  }
+}
+
+
+static void decode_record ( const trace_record & rec, const trace_record * const prev_rec )
+{
+  s_timestamp = format_timestamp( rec );
+
+  switch ( rec.hdr.type )
+  {
+  case JTAG_TRACE_TMS_SEQUENCE:
+    {
+      const uint32_t tms_bits = get_payload_word( rec, 0 );
+
+      // If the oldest records were discarded, the bridge knows better where the TAP is.
+      if ( s_tap_state == TAP_STATE_UNKNOWN )
+      {
+        const uint32_t recorded_state = get_payload_word( rec, 1 );
+
+        if ( recorded_state <= JTAG_TRACE_TAP_STATE_UPDATE_IR )
+          s_tap_state = tap_state_enum( recorded_state );
+      }
+
+      for ( unsigned i = 0; i < rec.hdr.bit_count; ++i )
+        clock_tap( ( ( tms_bits >> i ) & 1 ) != 0, 0 );
+
+      break;
+    }
+
+  case JTAG_TRACE_OUTGOING_BIT:
+    {
+      const uint32_t packet = get_payload_word( rec, 0 );
+
+      if ( packet & TRST )
+      {
+        if ( s_tap_state != TAP_STATE_TEST_LOGIC_RESET )
+          printf( "%s TAP reset with TRST.\n", s_timestamp.c_str() );
+
+        s_tap_state = TAP_STATE_TEST_LOGIC_RESET;
+        s_is_cmd_pending = false;
+      }
+      else
+      {
+        clock_tap( ( packet & TMS ) != 0, ( packet & TDO ) ? 1 : 0 );
+      }
+
+      break;
+    }
+
+  case JTAG_TRACE_OUTGOING_STREAM:
+    {
+      const bool tms_on_last_bit = ( rec.hdr.flags & JTAG_TRACE_FLAG_TMS_ON_LAST_BIT ) != 0;
+
+      if ( rec.hdr.flags & JTAG_TRACE_FLAG_TRUNCATED )
+        printf( "%s Warning: a stream of %u bits was truncated in the trace.\n", s_timestamp.c_str(), unsigned( rec.hdr.bit_count ) );
+
+      for ( unsigned i = 0; i < rec.hdr.bit_count; ++i )
+        clock_tap( tms_on_last_bit && i == rec.hdr.bit_count - 1, get_payload_bit( rec, i ) );
+
+      break;
+    }
+
+  case JTAG_TRACE_INCOMING_BIT:
+  case JTAG_TRACE_INCOMING_STREAM:
+    // The data read back belongs to the outgoing bits just before. If the last of them left the Shift-DR state,
+    // the command has already been decoded, but the result is only decoded at the next Update-DR,
+    // so it is not too late to fill in the TDO bits.
+    if ( prev_rec != NULL &&
+         ( prev_rec->hdr.type == JTAG_TRACE_OUTGOING_BIT || prev_rec->hdr.type == JTAG_TRACE_OUTGOING_STREAM ) )
+    {
+      set_last_tdo_bits( rec, rec.hdr.bit_count );
+    }
+    break;
+
+  case JTAG_TRACE_CONTEXT:
+    if ( rec.hdr.flags & JTAG_TRACE_FLAG_DEBUG_OP )
+    {
+      printf( "%s %.*s\n",
+              s_timestamp.c_str(),
+              int( rec.hdr.bit_count ),
+              reinterpret_cast< const char * >( rec.payload ) );
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+static int main_2 ( int argc, char ** argv )
+{
+  const struct option longopts[] =
+    {
+      { "help", no_argument, NULL, 'h' },
+      { "ops", no_argument, NULL, 'o' },
+      { "dr-prefix-bits", required_argument, NULL, 'p' },
+      { "dr-postfix-bits", required_argument, NULL, 's' },
+      { NULL, 0, NULL, 0 }  // All zeros, marks the end of the long options list.
+    };
+
+  for ( ; ; )
+  {
+    const int c = getopt_long( argc, argv, "h", longopts, NULL );
+
+    if ( c == -1 )
+      break;  // Finished parsing all command-line options.
+
+    switch ( c )
+    {
+    case 'h':
+      print_usage( argv[0] );
+      return 0;
+
+    case 'o':
+      s_decode_ops = true;
+      break;
+
+    case 'p':
+      s_dr_prefix_bits = parse_bit_count( optarg, "--dr-prefix-bits" );
+      break;
+
+    case 's':
+      s_dr_postfix_bits = parse_bit_count( optarg, "--dr-postfix-bits" );
+      break;
+
+    default:
+      throw std::runtime_error( "Invalid command-line arguments, use the --help switch for help." );
+    }
+  }
+
+  if ( optind != argc - 1 )
+    throw std::runtime_error( "Invalid command-line arguments, the trace file name is missing. Use the --help switch for help." );
+
+  std::vector< uint8_t > contents;
+  jtag_trace_file_header file_hdr;
+  std::vector< trace_record > records;
+
+  load_trace_file( argv[ optind ], &contents, &file_hdr, &records );
+
+  if ( file_hdr.dropped_record_count != 0 )
+  {
+    printf( "The ring buffer overflowed, the oldest %" PRIu64 " records were discarded.\n",
+            file_hdr.dropped_record_count );
+  }
+
+  for ( size_t i = 0; i < records.size(); ++i )
+  {
+    if ( s_decode_ops )
+      decode_record( records[ i ], i == 0 ? NULL : &records[ i - 1 ] );
+    else
+      print_record( records[ i ] );
+  }
+
+  if ( s_decode_ops )
+    decode_result();
+
+  return 0;
+}
+
+
+int main ( int argc, char ** argv )
+{
+  try
+  {
+    return main_2( argc, argv );
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf( stderr, "Error running \"%s\": %s\n", argv[0], e.what() );
+    return 1;
+  }
+}
@@ -0,0 +1,72 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Layout of the binary JTAG trace files, shared between the bridge (jtag_trace_ring.cpp)
+// and the offline decoder (jtag_trace_decoder.cpp).
+//
+// A trace file starts with a jtag_trace_file_header, followed by the records from oldest to newest.
+// Each record is a jtag_trace_record_header followed by payload_len bytes of payload.
+// All values are stored in the host byte order, so the decoder must run on a machine
+// with the same endianness as the one that wrote the trace.
+
+#ifndef JTAG_TRACE_FORMAT_H_INCLUDED
+#define JTAG_TRACE_FORMAT_H_INCLUDED
+
+#include <stdint.h>
+
+#define JTAG_TRACE_FILE_MAGIC    "OR10JTRC"
+#define JTAG_TRACE_FILE_VERSION  1
+
+struct jtag_trace_file_header
+{
+  char     magic[8];              // JTAG_TRACE_FILE_MAGIC, without the null terminator.
+  uint32_t version;               // JTAG_TRACE_FILE_VERSION
+  uint32_t record_header_size;    // sizeof( jtag_trace_record_header )
+  uint64_t dropped_record_count;  // The oldest records that did not fit in the ring buffer.
+};
+
+enum jtag_trace_record_type
+{
+  JTAG_TRACE_TMS_SEQUENCE    = 1,  // Payload: 1 word with the TMS bits, TDI was held low, and 1 word with
+                                   // the TAP state beforehand, see JTAG_TRACE_TAP_STATE_xxx.
+  JTAG_TRACE_OUTGOING_BIT    = 2,  // Payload: 1 word with the packet, see cable_write_bit_constants.h .
+  JTAG_TRACE_INCOMING_BIT    = 3,  // Payload: 1 word with the bit read.
+  JTAG_TRACE_OUTGOING_STREAM = 4,  // Payload: the TDI bits, LSB first. TMS was low, except maybe for the last bit.
+  JTAG_TRACE_INCOMING_STREAM = 5,  // Payload: the TDO bits read during the preceding outgoing stream.
+  JTAG_TRACE_CONTEXT         = 6   // Payload: a text message from the upper layers, without a null terminator.
+};
+
+#define JTAG_TRACE_FLAG_TMS_ON_LAST_BIT  0x0001
+#define JTAG_TRACE_FLAG_TRUNCATED        0x0002  // Only the first bits of a long stream were recorded.
+#define JTAG_TRACE_FLAG_DEBUG_OP         0x0004  // The context message describes a debug operation, see dbg_api.cpp .
+
+// The TAP states are numbered in the same order as in chain_commands.cpp .
+// The decoder uses the TAP state in the TMS sequence records to find its way after the oldest records were discarded.
+#define JTAG_TRACE_TAP_STATE_TEST_LOGIC_RESET  0
+#define JTAG_TRACE_TAP_STATE_UPDATE_IR        15
+#define JTAG_TRACE_TAP_STATE_UNKNOWN          16
+
+struct jtag_trace_record_header
+{
+  uint64_t timestamp_ns;  // Since the trace was enabled.
+  uint32_t payload_len;   // In bytes, always a multiple of 4.
+  uint16_t type;          // See jtag_trace_record_type.
+  uint16_t flags;         // See JTAG_TRACE_FLAG_xxx.
+  uint32_t bit_count;     // For the bit vectors, the number of bits transferred. For context records, the text length.
+  uint32_t reserved;
+};
+
+#endif  // Include this header file only once.
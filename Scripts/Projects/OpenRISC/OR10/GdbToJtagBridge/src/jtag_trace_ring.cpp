@@ -0,0 +1,290 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jtag_trace_ring.h"  // The include file for this module should come first.
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+#include "jtag_trace_format.h"
+#include "string_utils.h"
+
+
+static bool s_is_enabled = false;
+static std::string s_filename;
+
+// The records are stored back to back, and a record may wrap around the end of the buffer.
+static std::vector< uint8_t > s_ring;
+static size_t   s_ring_start = 0;  // Where the oldest record begins.
+static size_t   s_ring_used  = 0;
+static uint64_t s_dropped_record_count = 0;
+static uint64_t s_start_time_ns = 0;
+
+// A single record may not take more than this fraction of the ring buffer.
+static const size_t MAX_PAYLOAD_FRACTION = 8;
+
+// Longer context messages are cut short.
+static const int MAX_CONTEXT_TEXT_LEN = 200;
+
+
+static uint64_t get_time_ns ( void )
+{
+  timespec ts;
+
+  if ( 0 != clock_gettime( CLOCK_MONOTONIC, &ts ) )
+    assert( false );
+
+  return uint64_t( ts.tv_sec ) * 1000000000 + uint64_t( ts.tv_nsec );
+}
+
+
+static void ring_write ( const size_t pos, const void * const data, const size_t len )
+{
+  const size_t first_part_len = std::min( len, s_ring.size() - pos );
+
+  memcpy( &s_ring[ pos ], data, first_part_len );
+
+  if ( first_part_len < len )
+    memcpy( &s_ring[ 0 ], static_cast< const uint8_t * >( data ) + first_part_len, len - first_part_len );
+}
+
+
+static void ring_read ( const size_t pos, void * const data, const size_t len )
+{
+  const size_t first_part_len = std::min( len, s_ring.size() - pos );
+
+  memcpy( data, &s_ring[ pos ], first_part_len );
+
+  if ( first_part_len < len )
+    memcpy( static_cast< uint8_t * >( data ) + first_part_len, &s_ring[ 0 ], len - first_part_len );
+}
+
+
+static void discard_oldest_records ( const size_t space_needed )
+{
+  while ( s_ring.size() - s_ring_used < space_needed )
+  {
+    assert( s_ring_used >= sizeof( jtag_trace_record_header ) );
+
+    jtag_trace_record_header hdr;
+    ring_read( s_ring_start, &hdr, sizeof( hdr ) );
+
+    const size_t record_len = sizeof( hdr ) + hdr.payload_len;
+
+    s_ring_start = ( s_ring_start + record_len ) % s_ring.size();
+    s_ring_used -= record_len;
+    ++s_dropped_record_count;
+  }
+}
+
+
+static void append_record ( const jtag_trace_record_type type,
+                            uint16_t flags,
+                            const uint32_t bit_count,
+                            const void * const payload,
+                            const size_t payload_len )
+{
+  const size_t max_payload_len = s_ring.size() / MAX_PAYLOAD_FRACTION;
+
+  size_t len = payload_len;
+
+  if ( len > max_payload_len )
+  {
+    len = max_payload_len;
+    flags |= JTAG_TRACE_FLAG_TRUNCATED;
+  }
+
+  const size_t padded_len = ( len + 3 ) & ~size_t( 3 );
+
+  jtag_trace_record_header hdr;
+  hdr.timestamp_ns = get_time_ns() - s_start_time_ns;
+  hdr.payload_len  = uint32_t( padded_len );
+  hdr.type         = uint16_t( type );
+  hdr.flags        = flags;
+  hdr.bit_count    = bit_count;
+  hdr.reserved     = 0;
+
+  discard_oldest_records( sizeof( hdr ) + padded_len );
+
+  size_t pos = ( s_ring_start + s_ring_used ) % s_ring.size();
+
+  ring_write( pos, &hdr, sizeof( hdr ) );
+  pos = ( pos + sizeof( hdr ) ) % s_ring.size();
+
+  ring_write( pos, payload, len );
+
+  if ( padded_len != len )
+  {
+    const uint8_t zeros[4] = { 0 };
+    ring_write( ( pos + len ) % s_ring.size(), zeros, padded_len - len );
+  }
+
+  s_ring_used += sizeof( hdr ) + padded_len;
+}
+
+
+void jtag_trace_ring_enable ( const char * const filename, const size_t ring_size_in_bytes )
+{
+  // The ring size must be a multiple of 4, like all records, and big enough for a few long streams.
+  const size_t MIN_RING_SIZE = 64 * 1024;
+
+  s_filename = filename;
+  s_ring.assign( std::max( ring_size_in_bytes & ~size_t( 3 ), MIN_RING_SIZE ), 0 );
+  s_ring_start = 0;
+  s_ring_used  = 0;
+  s_dropped_record_count = 0;
+  s_start_time_ns = get_time_ns();
+  s_is_enabled = true;
+}
+
+
+bool jtag_trace_ring_is_enabled ( void )
+{
+  return s_is_enabled;
+}
+
+
+void jtag_trace_ring_record_tms_sequence ( const uint32_t tms_bits, const int bit_count, const int tap_state )
+{
+  if ( s_is_enabled )
+  {
+    const uint32_t words[2] = { tms_bits, uint32_t( tap_state ) };
+    append_record( JTAG_TRACE_TMS_SEQUENCE, 0, bit_count, words, sizeof( words ) );
+  }
+}
+
+
+void jtag_trace_ring_record_outgoing_bit ( const uint8_t packet )
+{
+  if ( s_is_enabled )
+  {
+    const uint32_t word = packet;
+    append_record( JTAG_TRACE_OUTGOING_BIT, 0, 1, &word, sizeof( word ) );
+  }
+}
+
+
+void jtag_trace_ring_record_incoming_bit ( const uint8_t bit )
+{
+  if ( s_is_enabled )
+  {
+    const uint32_t word = bit;
+    append_record( JTAG_TRACE_INCOMING_BIT, 0, 1, &word, sizeof( word ) );
+  }
+}
+
+
+void jtag_trace_ring_record_outgoing_stream ( const uint32_t * const stream,
+                                              const int len_bits,
+                                              const bool set_TMS_during_the_last_bit_transfer )
+{
+  if ( s_is_enabled )
+  {
+    append_record( JTAG_TRACE_OUTGOING_STREAM,
+                   set_TMS_during_the_last_bit_transfer ? JTAG_TRACE_FLAG_TMS_ON_LAST_BIT : 0,
+                   len_bits,
+                   stream,
+                   ( size_t( len_bits ) + 31 ) / 32 * sizeof( uint32_t ) );
+  }
+}
+
+
+void jtag_trace_ring_record_incoming_stream ( const uint32_t * const stream, const int len_bits )
+{
+  if ( s_is_enabled )
+  {
+    append_record( JTAG_TRACE_INCOMING_STREAM,
+                   0,
+                   len_bits,
+                   stream,
+                   ( size_t( len_bits ) + 31 ) / 32 * sizeof( uint32_t ) );
+  }
+}
+
+
+// Debug operation messages come from dbg_api.cpp, the rest from the chain layer.
+
+void jtag_trace_ring_record_context ( const bool is_debug_op, const char * const format_str, va_list arg_list )
+{
+  if ( !s_is_enabled )
+    return;
+
+  char text[ MAX_CONTEXT_TEXT_LEN + 1 ];
+  int len = vsnprintf( text, sizeof( text ), format_str, arg_list );
+
+  if ( len < 0 )
+    return;
+
+  len = std::min( len, MAX_CONTEXT_TEXT_LEN );
+
+  // The messages normally end with a new-line character, the decoder adds its own.
+  if ( len > 0 && text[ len - 1 ] == '\n' )
+    --len;
+
+  append_record( JTAG_TRACE_CONTEXT,
+                 is_debug_op ? JTAG_TRACE_FLAG_DEBUG_OP : 0,
+                 uint32_t( len ),
+                 text,
+                 size_t( len ) );
+}
+
+
+void jtag_trace_ring_save ( void )
+{
+  if ( !s_is_enabled )
+    return;
+
+  FILE * const f = fopen( s_filename.c_str(), "wb" );
+
+  if ( f == NULL )
+    throw std::runtime_error( format_errno_msg( errno, "Cannot create JTAG trace file \"%s\": ", s_filename.c_str() ) );
+
+  jtag_trace_file_header file_hdr;
+  memset( &file_hdr, 0, sizeof( file_hdr ) );
+  memcpy( file_hdr.magic, JTAG_TRACE_FILE_MAGIC, sizeof( file_hdr.magic ) );
+  file_hdr.version              = JTAG_TRACE_FILE_VERSION;
+  file_hdr.record_header_size   = sizeof( jtag_trace_record_header );
+  file_hdr.dropped_record_count = s_dropped_record_count;
+
+  std::vector< uint8_t > records( s_ring_used );
+
+  if ( s_ring_used != 0 )
+    ring_read( s_ring_start, &records.front(), s_ring_used );
+
+  const bool ok = ( 1 == fwrite( &file_hdr, sizeof( file_hdr ), 1, f ) ) &&
+                  ( s_ring_used == 0 || 1 == fwrite( &records.front(), s_ring_used, 1, f ) );
+  const int write_errno = errno;
+
+  if ( 0 != fclose( f ) || !ok )
+  {
+    throw std::runtime_error( format_errno_msg( ok ? errno : write_errno,
+                                                "Error writing JTAG trace file \"%s\": ", s_filename.c_str() ) );
+  }
+
+  printf( "JTAG trace saved to file \"%s\", %u bytes of records, %" PRIu64 " older records were discarded.\n",
+          s_filename.c_str(),
+          unsigned( s_ring_used ),
+          s_dropped_record_count );
+}
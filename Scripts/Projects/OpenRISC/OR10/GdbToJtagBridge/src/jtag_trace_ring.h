@@ -0,0 +1,27 @@
+#ifndef JTAG_TRACE_RING_H_INCLUDED
+#define JTAG_TRACE_RING_H_INCLUDED
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+// Binary JTAG trace: the chain layer records every bit vector it sends or receives, together with
+// a timestamp and the trace messages from the upper layers, in a ring buffer in memory.
+// When the ring buffer is full, the oldest records are discarded. Nothing is written to disk
+// until jtag_trace_ring_save() is called, so enabling this trace has little effect on the JTAG timing.
+// Use the or10_jtag_trace_decoder tool to look at the resulting file.
+
+void jtag_trace_ring_enable ( const char * filename, size_t ring_size_in_bytes );
+bool jtag_trace_ring_is_enabled ( void );
+
+void jtag_trace_ring_record_tms_sequence ( uint32_t tms_bits, int bit_count, int tap_state );
+void jtag_trace_ring_record_outgoing_bit ( uint8_t packet );
+void jtag_trace_ring_record_incoming_bit ( uint8_t bit );
+void jtag_trace_ring_record_outgoing_stream ( const uint32_t * stream, int len_bits, bool set_TMS_during_the_last_bit_transfer );
+void jtag_trace_ring_record_incoming_stream ( const uint32_t * stream, int len_bits );
+void jtag_trace_ring_record_context ( bool is_debug_op, const char * format_str, va_list arg_list );
+
+// Writes the ring buffer contents to the file given to jtag_trace_ring_enable().
+void jtag_trace_ring_save ( void );
+
+#endif  // Include this header file only once.
@@ -39,11 +39,13 @@
 
 #include "rsp_server.h"
 #include "chain_commands.h"
+#include "dbg_api.h"
 #include "cable_api.h"
 #include "bsdl.h"
 #include "errcodes.h"
 #include "string_utils.h"
 #include "linux_utils.h"
+#include "jtag_trace_ring.h"
 
 
 #define debug(...) //fprintf(stderr, __VA_ARGS__ )
@@ -77,6 +79,12 @@ static int cmd_line_cmd_debug = -1;  // 0 is a valid debug command, so use -1
 static int listen_on_all_addrs = 0;
 static int trace_rsp = 0;
 static int trace_jtag_bit_data = 0;
+static int no_burst_mem_access = 0;
+static int no_cable_queue = 0;
+static int no_dr_session = 0;
+static const char * max_ack_window = NULL;
+static const char * trace_jtag_ring_file = NULL;
+static const char * trace_jtag_ring_size = NULL;
 
 // TCP port to set up the server for GDB on
 static const char *port = NULL;
@@ -223,11 +231,6 @@ static void configure_chain ( void )
   }
   printf("\n");
 
-  if ( discovered_id_codes.size() > 1 )
-  {
-    throw std::runtime_error( "TODO: Support for JTAG chains with more than one device must be tested again." );
-  }
-
   if ( target_dev_pos >= int( discovered_id_codes.size() ) )
   {
     printf("ERROR: Requested target device (%i) beyond highest device index (%u).\n",
@@ -369,6 +372,19 @@ void print_usage ( const char * const func )
   printf("  -b [dirname]  : Add a directory to search for BSDL files\n");
   printf("  --trace-rsp   : Trace the GDB RSP protocol data.\n");
   printf("  --trace-jtag-bit-data : Trace the JTAG communication at bit level.\n");
+  printf("  --trace-jtag-ring=<filename> : Record the JTAG bit data in a ring buffer in memory, and save it\n"
+         "                                 to the given file on exit. This has much less impact on the\n"
+         "                                 timing than --trace-jtag-bit-data. Use or10_jtag_trace_decoder\n"
+         "                                 to look at the file.\n");
+  printf("  --trace-jtag-ring-size=<MiB> : Size of the JTAG trace ring buffer (default: 16 MiB).\n");
+  printf("  --no-burst-mem-access : Access memory with individual CPU SPR commands. Otherwise, the bridge checks\n"
+         "                          on start-up whether the OR10 TAP supports the burst memory commands.\n");
+  printf("  --max-ack-window=<bits> : Maximum number of bits read per cable call while waiting for\n"
+         "                           a CPU operation to complete (default: 256, 1 polls bit by bit).\n");
+  printf("  --no-cable-queue : Send each JTAG operation to the cable straight away, instead of\n"
+         "                     queueing them until the data read back is needed.\n");
+  printf("  --no-dr-session : Return the TAP to Run-Test/Idle after every debug operation, instead of\n"
+         "                    waiting in Pause-DR for the next one until the bridge becomes idle.\n");
 
   printf("  -h, --help    : show this help text\n\n");
   cable_print_help();
@@ -421,6 +437,12 @@ static bool parse_args ( const int argc, char ** const argv )
       { "listen-on-all-addrs", no_argument, &listen_on_all_addrs, 1 },
       { "trace-rsp", no_argument, &trace_rsp, 1 },
       { "trace-jtag-bit-data", no_argument, &trace_jtag_bit_data, 1 },
+      { "no-burst-mem-access", no_argument, &no_burst_mem_access, 1 },
+      { "max-ack-window", required_argument, NULL, 'W' },
+      { "no-cable-queue", no_argument, &no_cable_queue, 1 },
+      { "no-dr-session", no_argument, &no_dr_session, 1 },
+      { "trace-jtag-ring", required_argument, NULL, 'R' },
+      { "trace-jtag-ring-size", required_argument, NULL, 'S' },
       { NULL, 0, NULL, 0 }  // All zeros, marks the end of the long options list.
     };
 
@@ -492,6 +514,18 @@ static bool parse_args ( const int argc, char ** const argv )
       bsdl_add_directory(optarg);
       break;
 
+    case 'W':
+      max_ack_window = optarg;
+      break;
+
+    case 'R':
+      trace_jtag_ring_file = optarg;
+      break;
+
+    case 'S':
+      trace_jtag_ring_size = optarg;
+      break;
+
     default:
       throw std::runtime_error( "Invalid command-line arguments, use the --help switch for help.\n" );
       // print_usage( argv[0] );
@@ -593,6 +627,35 @@ static int main_2 ( int argc,  char * argv[] )
     if ( parse_args( argc, argv ) )
     {
       config_set_trace( trace_jtag_bit_data );
+      config_set_dr_session( no_dr_session ? false : true );
+      dbg_enable_burst_mem_access( no_burst_mem_access ? false : true );
+
+      if ( max_ack_window != NULL )
+      {
+        char * max_ack_window_first_err_char;
+        const unsigned long max_ack_window_bit_count = strtoul( max_ack_window, &max_ack_window_first_err_char, 10 );
+
+        if ( *max_ack_window_first_err_char || *max_ack_window == '\0' )
+          throw std::runtime_error( format_msg( "Failed to parse the maximum ack window size from the given parameter \"%s\".", max_ack_window ) );
+
+        dbg_set_max_ack_window( unsigned( max_ack_window_bit_count ) );
+      }
+
+      if ( trace_jtag_ring_file != NULL )
+      {
+        unsigned long ring_size_mib = 16;
+
+        if ( trace_jtag_ring_size != NULL )
+        {
+          char * ring_size_first_err_char;
+          ring_size_mib = strtoul( trace_jtag_ring_size, &ring_size_first_err_char, 10 );
+
+          if ( *ring_size_first_err_char || *trace_jtag_ring_size == '\0' || ring_size_mib == 0 || ring_size_mib > 4096 )
+            throw std::runtime_error( format_msg( "Failed to parse the JTAG trace ring size from the given parameter \"%s\".", trace_jtag_ring_size ) );
+        }
+
+        jtag_trace_ring_enable( trace_jtag_ring_file, size_t( ring_size_mib ) * 1024 * 1024 );
+      }
 
       char * server_port_first_err_char;
       const long int gdb_rsp_server_port = strtol( port, &server_port_first_err_char, 10 );
@@ -609,9 +672,23 @@ static int main_2 ( int argc,  char * argv[] )
 
       cable_init();
 
+      throw_if_error( cable_enable_queue( no_cable_queue ? false : true ) );
+
       // Initialize a new connection to the or1k board, and make sure we are really connected.
       configure_chain();
 
+      if ( !no_burst_mem_access && !dbg_probe_burst_mem_access() )
+      {
+        printf( "The OR10 TAP does not support the burst memory commands, memory will be accessed with individual CPU SPR commands.\n" );
+        dbg_enable_burst_mem_access( false );
+      }
+
+      if ( !dbg_probe_write_mem_sel() )
+      {
+        printf( "The CPU does not support the OR1200_DU_WRITE_MEM_SEL SPR, partial memory words will be read, modified and written back.\n" );
+        dbg_enable_write_mem_sel( false );
+      }
+
 #ifdef ENABLE_JSP
       long int jspserverport;
       jspserverport = strtol(jspport,&s,10);
@@ -646,7 +723,11 @@ static int main_2 ( int argc,  char * argv[] )
         printf( "Quitting after receiving signal number %d.\n", s_received_signal_number );
       }
 
+      tap_end_dr_session();
+
       cable_close();
+
+      jtag_trace_ring_save();
     }
 
     bsdl_terminate();
@@ -655,6 +736,27 @@ static int main_2 ( int argc,  char * argv[] )
   }
   catch ( ... )
   {
+    // Leave the CPU Debug Module in a known state, as on the normal path.
+    // The cable may be the reason for the error, so this may fail too.
+    try
+    {
+      tap_end_dr_session();
+    }
+    catch ( const std::exception & e )
+    {
+      fprintf( stderr, "Error ending the debug session: %s\n", e.what() );
+    }
+
+    // The JTAG trace is most useful when something has gone wrong.
+    try
+    {
+      jtag_trace_ring_save();
+    }
+    catch ( const std::exception & e )
+    {
+      fprintf( stderr, "%s\n", e.what() );
+    }
+
     bsdl_terminate();
     throw;
   }
@@ -11,6 +11,8 @@
 #define DEBUG_CMD_READ_CPU_SPR   3
 #define DEBUG_CMD_READ_FIXED_TEST_PATTERN 4
 #define DEBUG_CMD_WRITE_TEST_PATTERN 5
+#define DEBUG_CMD_BURST_READ_MEM  6
+#define DEBUG_CMD_BURST_WRITE_MEM 7
 
 
 #endif	// Include this header file only once.
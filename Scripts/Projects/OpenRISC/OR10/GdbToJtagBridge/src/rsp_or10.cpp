@@ -26,10 +26,13 @@
 #include <assert.h>
 
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
 
 #include "rsp_or10.h"
 #include "spr-defs.h"
 #include "dbg_api.h"
+#include "target_mem_cache.h"
 #include "string_utils.h"
 #include "linux_utils.h"
 #include "rsp_string_helpers.h"
@@ -69,9 +72,30 @@ std::string s_scratch;
 #define STD_ERROR_CODE "E01"  // The one and only error code we return to GDB.
 
 
+// Snapshot of the registers GDB reads with the 'g' packet. GDB sends 'g' after every stop and step,
+// and the registers cannot change while the CPU remains stalled, unless GDB or the user modifies them.
+// Register order: GPR0 through GPR31, NPC, SR.
+
+static const unsigned REG_CACHE_SIZE = MAX_GPRS + 2;
+static uint32_t s_reg_cache[ REG_CACHE_SIZE ];
+static bool s_is_reg_cache_valid = false;
+
+static void invalidate_reg_cache ( void )
+{
+  s_is_reg_cache_valid = false;
+}
+
+static void invalidate_caches ( void )
+{
+  invalidate_reg_cache();
+  mem_cache_invalidate_all();
+}
+
+
 static void unstall_cpu ( void )
 {
   assert( !rsp.is_target_running );
+  invalidate_caches();
   dbg_cpu0_write_spr_e( SPR_DU_EDIS, 0 );
   rsp.is_target_running = true;
 }
@@ -80,6 +104,9 @@ static void stall_cpu ( void )
 {
   dbg_cpu0_write_spr_e( SPR_DU_EDIS, 1 );
   rsp.is_target_running = false;
+
+  // The CPU may have been running beforehand without us knowing, for example, before attaching to it.
+  invalidate_caches();
 }
 
 
@@ -87,8 +114,21 @@ static void collect_cpu_stop_reason ( const bool stopped_via_edis )
 {
   assert( rsp.is_target_running == false );
 
-  uint32_t drrval;
-  dbg_cpu0_read_spr_e( SPR_DRR, &drrval );  // Read the DRR, find out why the CPU stopped.
+  // Read the DRR, find out why the CPU stopped, and the watchpoint addresses, all in one go.
+
+  uint16_t spr_numbers[ 1 + MAX_WATCHPOINT_COUNT ];
+  uint32_t spr_values [ 1 + MAX_WATCHPOINT_COUNT ];
+
+  assert( rsp.watchpoint_count <= MAX_WATCHPOINT_COUNT );
+
+  spr_numbers[ 0 ] = SPR_DRR;
+
+  for ( unsigned i = 0; i < rsp.watchpoint_count; ++i )
+    spr_numbers[ 1 + i ] = SPR_DVR(i);
+
+  dbg_cpu0_read_sprs_e( spr_numbers, 1 + rsp.watchpoint_count, spr_values );
+
+  const uint32_t drrval = spr_values[ 0 ];
 
   // Note that the current OR10 implementation only supports the "trap" reason.
   assert( drrval == 0 || drrval == SPR_DRR_TE );
@@ -130,7 +170,7 @@ static void collect_cpu_stop_reason ( const bool stopped_via_edis )
 
   for ( unsigned i = 0; i < rsp.watchpoint_count; ++i )
   {
-    dbg_cpu0_read_spr_e( SPR_DVR(i), &rsp.watchpoint_addr[ i ] );
+    rsp.watchpoint_addr[ i ] = spr_values[ 1 + i ];
     // printf( "Watchpoint addr: 0x%08X\n", rsp.watchpoint_addr[ i ] );
   }
 }
@@ -158,12 +198,21 @@ void attach_to_cpu ( void )
   // for the software to modify the same SPR registers being accessed here.
   stall_cpu();
 
-  uint32_t val;
-  dbg_cpu0_read_spr_e( OR1200_DU_WATCHPOINT_COUNT, &val );
-  rsp.watchpoint_count = val;
+  const uint16_t spr_numbers[] = { OR1200_DU_WATCHPOINT_COUNT, SPR_VR, SPR_UPR };
+  uint32_t spr_values[ sizeof( spr_numbers ) / sizeof( spr_numbers[0] ) ];
 
-  dbg_cpu0_read_spr_e( SPR_VR , &rsp.spr_vr  );
-  dbg_cpu0_read_spr_e( SPR_UPR, &rsp.spr_upr );
+  dbg_cpu0_read_sprs_e( spr_numbers, sizeof( spr_numbers ) / sizeof( spr_numbers[0] ), spr_values );
+
+  if ( spr_values[ 0 ] > MAX_WATCHPOINT_COUNT )
+  {
+    throw std::runtime_error( format_msg( "The CPU reports %u watchpoints, but the maximum supported is %u.",
+                                          (unsigned)spr_values[ 0 ],
+                                          MAX_WATCHPOINT_COUNT ) );
+  }
+
+  rsp.watchpoint_count = spr_values[ 0 ];
+  rsp.spr_vr           = spr_values[ 1 ];
+  rsp.spr_upr          = spr_values[ 2 ];
 
   for ( unsigned i = 0; i < MAX_WATCHPOINT_COUNT; ++i )
     rsp.watchpoint_addr[ i ] = 0;
@@ -291,21 +340,39 @@ static void rsp_continue ( const rsp_buf * const buf )
    Each byte is packed as a pair of hex digits.
 */
 
+static void fill_reg_cache ( void )
+{
+  uint16_t spr_numbers[ REG_CACHE_SIZE ];
+
+  for ( int i = 0; i < MAX_GPRS; ++i )
+    spr_numbers[ i ] = SPR_GPR_BASE + i;
+
+  spr_numbers[ MAX_GPRS     ] = SPR_NPC;
+  spr_numbers[ MAX_GPRS + 1 ] = SPR_SR;
+  // The PPC register is not supported by the OR10 CPU.
+
+  dbg_cpu0_read_sprs_e( spr_numbers, REG_CACHE_SIZE, s_reg_cache );
+
+  s_is_reg_cache_valid = true;
+}
+
+
 static void rsp_read_all_regs ( void )
 {
   rsp_buf      buf;
-  uint32_t     regbuf[MAX_GPRS];
+  uint32_t     regbuf[3];
+
+  if ( !s_is_reg_cache_valid )
+    fill_reg_cache();
 
   for ( int i = 0; i < MAX_GPRS; ++i )
   {
-    dbg_cpu0_read_spr_e( SPR_GPR_BASE + i, &regbuf[i] );
-    reg2hex( regbuf[i], &(buf.data[i * 8]) );
+    reg2hex( s_reg_cache[i], &(buf.data[i * 8]) );
   }
 
-  dbg_cpu0_read_spr_e( SPR_NPC, &regbuf[0] );
-  dbg_cpu0_read_spr_e( SPR_SR , &regbuf[1] );
-  // dbg_cpu0_read_spr_e( SPR_PPC, &regbuf[2] );  // The PPC register is not supported by the OR10 CPU.
-  regbuf[2] = 0;
+  regbuf[0] = s_reg_cache[ MAX_GPRS     ];  // NPC
+  regbuf[1] = s_reg_cache[ MAX_GPRS + 1 ];  // SR
+  regbuf[2] = 0;                             // PPC, not supported by the OR10 CPU.
 
   // Note that reg2hex adds a NULL terminator; as such, they must be
   // put in buf.data in numerical order:  PPC, NPC, SR
@@ -352,7 +419,7 @@ static void rsp_read_mem ( const rsp_buf * const buf )
   }
 
   std::vector< uint8_t > data;
-  dbg_cpu0_read_mem( uint32_t( addr ), uint32_t( len ), &data );
+  mem_cache_read( uint32_t( addr ), uint32_t( len ), &data );
 
   const unsigned actually_read_len = data.size();
   rsp_buf reply;
@@ -371,6 +438,19 @@ static void rsp_read_mem ( const rsp_buf * const buf )
 }
 
 
+static void write_mem_and_reply ( const uint32_t addr, const std::vector< uint8_t > * const data )
+{
+  mem_cache_invalidate_range( addr, uint32_t( data->size() ) );
+
+  const bool error_bit = dbg_cpu0_write_mem( addr, uint32_t( data->size() ), data );
+
+  if ( error_bit )
+    put_str_packet( rsp.client_fd, STD_ERROR_CODE );
+  else
+    send_ok_packet( rsp.client_fd );
+}
+
+
 /* Handle a RSP write memory (symbolic) request
 
    Syntax is:
@@ -409,9 +489,9 @@ static void rsp_write_mem ( const rsp_buf * const buf )
 
   // Put all the data into a single buffer, so it can be burst-written via JTAG.
   // One burst is much faster than many single-byte transactions.
-  // NOTE: We don't support burst data accesses any more, but that may change in the future.
 
   std::vector< uint8_t > data;
+  data.reserve( len );
 
   for ( int off = 0; off < len; off++ )
   {
@@ -420,12 +500,81 @@ static void rsp_write_mem ( const rsp_buf * const buf )
     data.push_back( (nyb1 << 4) | nyb2 );
   }
 
-  const bool error_bit = dbg_cpu0_write_mem( addr, len, &data );
+  write_mem_and_reply( addr, &data );
+}
 
-  if ( error_bit )
-    put_str_packet( rsp.client_fd, STD_ERROR_CODE );
-  else
+
+/* Handle a RSP write memory (binary) request
+
+   Syntax is:
+
+     X<addr>,<length>:<data>
+
+   The data is the raw bytes, lowest address first. Characters '$', '#' and '}' (and '*' for some GDB versions)
+   are escaped as '}' followed by the original character XOR 0x20.
+
+   The length given is the number of bytes to be written, after removing the escape characters.
+
+   GDB sends a zero-length 'X' packet at the beginning in order to find out whether the stub supports
+   binary downloads. If it gets an "OK", it will use 'X' instead of 'M' for the "load" command and the like.
+*/
+
+static void rsp_write_mem_bin ( const rsp_buf * const buf )
+{
+  unsigned int addr;
+  unsigned int len;
+
+  assert( buf->data[0] == 'X' );
+
+  if ( 2 != sscanf( buf->data, "X%x,%x:", &addr, &len ) )
+  {
+    throw std::runtime_error( "Illegal binary write memory packet." );
+  }
+
+  const char * const colon = (const char *)memchr( buf->data, ':', buf->len );
+
+  if ( colon == NULL )
+  {
+    throw std::runtime_error( "Illegal binary write memory packet: The data separator ':' is missing." );
+  }
+
+  const uint8_t * const bindat     = (const uint8_t *)( colon + 1 );
+  const uint8_t * const bindat_end = (const uint8_t *)( buf->data + buf->len );
+
+  std::vector< uint8_t > data;
+  data.reserve( len );
+
+  for ( const uint8_t * p = bindat; p < bindat_end; ++p )
+  {
+    if ( *p == '}' )
+    {
+      ++p;
+
+      if ( p == bindat_end )
+        throw std::runtime_error( "Illegal binary write memory packet: The data ends with an escape character." );
+
+      data.push_back( *p ^ 0x20 );
+    }
+    else
+    {
+      data.push_back( *p );
+    }
+  }
+
+  if ( data.size() != len )
+  {
+    throw std::runtime_error( format_msg( "Illegal binary write memory packet: Write of %u bytes requested, but %u bytes were supplied.",
+                                          len, unsigned( data.size() ) ) );
+  }
+
+  if ( len == 0 )
+  {
+    // This is GDB probing for 'X' support.
     send_ok_packet( rsp.client_fd );
+    return;
+  }
+
+  write_mem_and_reply( addr, &data );
 }
 
 
@@ -486,6 +635,7 @@ static void rsp_write_reg ( const rsp_buf * const buf )
   if ( !ignore )
   {
     const uint32_t new_val = parse_reg_32_from_hex( valstr );
+    invalidate_reg_cache();
     dbg_cpu0_write_spr_e( spr_number, new_val );
   }
 
@@ -606,12 +756,69 @@ static void send_pass_through_command_text_reply ( const int fd, const char * co
 }
 
 
+static void add_spr_write ( const uint16_t spr_number,
+                            const uint32_t value,
+                            std::vector< uint16_t > * const spr_numbers,
+                            std::vector< uint32_t > * const spr_values )
+{
+  spr_numbers->push_back( spr_number );
+  spr_values->push_back( value );
+}
+
+
+static void rsp_memcache_command ( std::string * const args )
+{
+  static const std::string ON_PREFIX( "on" );
+  static const std::string OFF_PREFIX( "off" );
+  static const std::string NOCACHE_PREFIX( "nocache" );
+  static const std::string CLEAR_PREFIX( "clear" );
+
+  if ( args->empty() )
+  {
+    // Nothing to do here, the status is printed below.
+  }
+  else if ( *args == ON_PREFIX )
+  {
+    mem_cache_enable( true );
+  }
+  else if ( *args == OFF_PREFIX )
+  {
+    mem_cache_enable( false );
+  }
+  else if ( str_remove_prefix( args, &NOCACHE_PREFIX ) )
+  {
+    remove_cmd_separator( args );
+
+    unsigned int start_addr;
+    unsigned int len;
+
+    if ( *args == CLEAR_PREFIX )
+    {
+      mem_cache_clear_no_cache_regions();
+    }
+    else if ( 2 == sscanf( args->c_str(), "%x %x", &start_addr, &len ) && len != 0 )
+    {
+      mem_cache_add_no_cache_region( start_addr, len );
+    }
+    else
+    {
+      throw std::runtime_error( "Error parsing the target-specific 'memcache nocache' command." );
+    }
+  }
+  else
+    throw std::runtime_error( "Error parsing the target-specific 'memcache' command." );
+
+  send_pass_through_command_text_reply( rsp.client_fd, mem_cache_get_status_text().c_str() );
+}
+
+
 static void rsp_pass_through_command ( const rsp_buf * const buf, const int cmd_str_pos )
 {
   static const std::string HELP_PREFIX( "help" );
   static const std::string READSPR_PREFIX ( "readspr" );
   static const std::string WRITESPR_PREFIX( "writespr" );
   static const std::string RESET_PREFIX( "reset" );
+  static const std::string MEMCACHE_PREFIX( "memcache" );
 
   try
   {
@@ -650,6 +857,11 @@ static void rsp_pass_through_command ( const rsp_buf * const buf, const int cmd_
       help_text += "- monitor reset\n";
       help_text += "  Resets the CPU.\n";
       help_text += "\n";
+      help_text += "- monitor memcache [ on | off | nocache <start address in hex> <length in hex> | nocache clear ]\n";
+      help_text += "  Without arguments, prints the memory cache status and hit/miss counters.\n";
+      help_text += "  Memory is only cached while the CPU is stalled. Use 'nocache' to exclude\n";
+      help_text += "  memory-mapped I/O regions from the cache.\n";
+      help_text += "\n";
 
       send_pass_through_command_text_reply( rsp.client_fd, help_text.c_str() );
     }
@@ -692,6 +904,8 @@ static void rsp_pass_through_command ( const rsp_buf * const buf, const int cmd_
         throw std::runtime_error( format_msg( "Error parsing the target-specific 'writespr' command: SPR number %u is out of range.", regno ) );
       }
 
+      // The SPR could be anything, including a Debug Unit memory write.
+      invalidate_caches();
       dbg_cpu0_write_spr_e( uint16_t( regno ), val );
 
       send_ok_packet( rsp.client_fd );
@@ -708,15 +922,21 @@ static void rsp_pass_through_command ( const rsp_buf * const buf, const int cmd_
       // In order to save FPGA resources, there is no reset signal or command in the Debug Unit.
       // We reset the CPU here by manually writing all necessary SPRs.
 
+      invalidate_reg_cache();
+
       const uint32_t RESET_SPR_SR = 0x8001;  // See the RESET_SPR_SR constant in the CPU Verilog source code.
       const uint32_t RESET_VECTOR = 0x0100;  // See the RESET_VECTOR constant in the CPU Verilog source code.
 
-      dbg_cpu0_write_spr_e( SPR_SR , RESET_SPR_SR );
-      dbg_cpu0_write_spr_e( SPR_NPC, RESET_VECTOR );
+      // All registers are written in a single JTAG scan sequence.
+      std::vector< uint16_t > spr_numbers;
+      std::vector< uint32_t > spr_values;
 
-      dbg_cpu0_write_spr_e( SPR_EPCR_BASE, 0 );
-      dbg_cpu0_write_spr_e( SPR_EEAR_BASE, 0 );
-      dbg_cpu0_write_spr_e( SPR_ESR_BASE, 0 );
+      add_spr_write( SPR_SR , RESET_SPR_SR, &spr_numbers, &spr_values );
+      add_spr_write( SPR_NPC, RESET_VECTOR, &spr_numbers, &spr_values );
+
+      add_spr_write( SPR_EPCR_BASE, 0, &spr_numbers, &spr_values );
+      add_spr_write( SPR_EEAR_BASE, 0, &spr_numbers, &spr_values );
+      add_spr_write( SPR_ESR_BASE, 0, &spr_numbers, &spr_values );
 
       // The CPU uses another initial value for the GPRs, namely 0x12345678, which is fine.
       // According to the OpenRISC specification, it is not necessary to initialise these registers.
@@ -724,26 +944,33 @@ static void rsp_pass_through_command ( const rsp_buf * const buf, const int cmd_
 
       for ( int i = 0; i < MAX_GPRS; ++i )
       {
-        dbg_cpu0_write_spr_e( SPR_GPR_BASE + i, INITIAL_GPR_VALUE );
+        add_spr_write( SPR_GPR_BASE + i, INITIAL_GPR_VALUE, &spr_numbers, &spr_values );
       }
 
       std::string msg( "The basic CPU core was reset.\n" );
 
       if ( rsp.spr_upr & SPR_UPR_PICP )
       {
-        dbg_cpu0_write_spr_e( SPR_PICMR, 0 );
+        add_spr_write( SPR_PICMR, 0, &spr_numbers, &spr_values );
         msg += "The CPU PIC unit (Programmable Interrupt Controller) was reset.\n";
       }
 
       if ( rsp.spr_upr & SPR_UPR_TTP )
       {
-        dbg_cpu0_write_spr_e( SPR_TTMR, 0 );
-        dbg_cpu0_write_spr_e( SPR_TTCR, 0 );
+        add_spr_write( SPR_TTMR, 0, &spr_numbers, &spr_values );
+        add_spr_write( SPR_TTCR, 0, &spr_numbers, &spr_values );
         msg += "The CPU Tick Timer unit was reset.\n";
       }
 
+      dbg_cpu0_write_sprs_e( &spr_numbers.front(), &spr_values.front(), unsigned( spr_numbers.size() ) );
+
       send_pass_through_command_text_reply( rsp.client_fd, msg.c_str() );
     }
+    else if ( str_remove_prefix( &cmd, &MEMCACHE_PREFIX ) )
+    {
+      remove_cmd_separator( &cmd );
+      rsp_memcache_command( &cmd );
+    }
     else
       throw std::runtime_error( "Unknown target-specific command." );
   }
@@ -757,6 +984,87 @@ static void rsp_pass_through_command ( const rsp_buf * const buf, const int cmd_
 }
 
 
+// CRC-32 as calculated by GDB for the qCRC packet (see xcrc32() in libiberty): polynomial 0x04C11DB7,
+// most significant bit first, no final XOR. The initial value is 0xFFFFFFFF.
+
+static uint32_t s_crc32_table[ 256 ];
+static bool s_is_crc32_table_ready = false;
+
+static uint32_t calculate_crc32 ( uint32_t crc, const uint8_t * const data, const size_t len )
+{
+  if ( !s_is_crc32_table_ready )
+  {
+    for ( uint32_t i = 0; i < 256; ++i )
+    {
+      uint32_t c = i << 24;
+
+      for ( int j = 0; j < 8; ++j )
+        c = ( c & 0x80000000 ) ? ( c << 1 ) ^ 0x04C11DB7 : ( c << 1 );
+
+      s_crc32_table[ i ] = c;
+    }
+
+    s_is_crc32_table_ready = true;
+  }
+
+  for ( size_t i = 0; i < len; ++i )
+    crc = ( crc << 8 ) ^ s_crc32_table[ ( ( crc >> 24 ) ^ data[ i ] ) & 0xFF ];
+
+  return crc;
+}
+
+
+/* Handle a RSP CRC request
+
+   Syntax is:
+
+     qCRC:<addr>,<length>
+
+   The reply is "C<crc32 in hex>", or an error code if the memory could not be read.
+
+   GDB uses this packet for "compare-sections", so that it does not need to read back whole sections
+   over RSP. The memory is read in big blocks, which turn into burst reads over JTAG.
+*/
+
+static void rsp_crc ( const rsp_buf * const buf )
+{
+  unsigned int addr;
+  unsigned int len;
+
+  if ( 2 != sscanf( buf->data, "qCRC:%x,%x", &addr, &len ) )
+  {
+    throw std::runtime_error( "Illegal CRC packet." );
+  }
+
+  const uint32_t CHUNK_SIZE = 64 * 1024;
+
+  uint32_t crc = 0xFFFFFFFF;
+  uint32_t done_len = 0;
+  std::vector< uint8_t > data;
+  data.reserve( CHUNK_SIZE );
+
+  while ( done_len < len )
+  {
+    const uint32_t chunk_len = std::min( len - done_len, CHUNK_SIZE );
+
+    data.clear();
+    dbg_cpu0_read_mem( addr + done_len, chunk_len, &data );
+
+    if ( data.size() != chunk_len )
+    {
+      put_str_packet( rsp.client_fd, STD_ERROR_CODE );
+      return;
+    }
+
+    crc = calculate_crc32( crc, &data.front(), data.size() );
+    done_len += chunk_len;
+  }
+
+  const std::string reply = format_msg( "C%08x", (unsigned)crc );
+  put_str_packet( rsp.client_fd, &reply );
+}
+
+
 static void rsp_query ( const rsp_buf * const buf )
 {
   s_scratch.clear();
@@ -783,6 +1091,10 @@ static void rsp_query ( const rsp_buf * const buf )
     // support a thread concept, this is the appropriate response.
     put_str_packet( rsp.client_fd, "" );
   }
+  else if ( s_scratch == "CRC" )
+  {
+    rsp_crc( buf );
+  }
   else if ( s_scratch == "Offsets" )
   {
     // We don't support any relocations, so report zero for all sections.
@@ -1000,6 +1312,10 @@ void process_client_command ( const rsp_buf * const buf )
     rsp_write_mem( buf );
     break;
 
+  case 'X':
+    rsp_write_mem_bin( buf );
+    break;
+
   case 'P':
     rsp_write_reg( buf );
     break;
@@ -1030,10 +1346,6 @@ void process_client_command ( const rsp_buf * const buf )
   case 'D':  // Detach GDB. I'm not sure what to do in this case. If you type "detach" in the current
              // GDB version it does not close the connection and it triggers error message
              // "A problem internal to GDB has been detected".
-
-  case 'X':  // We don't support binary memory writes. The old code did, so it should not be hard
-             // to port it to this new implementation. This is only an optimisation, as GDB
-             // will fall back to using text-based memory writes (see the 'M' command).
     send_unknown_command_reply( rsp.client_fd );
     break;
 
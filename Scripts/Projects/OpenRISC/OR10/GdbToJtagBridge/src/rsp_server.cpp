@@ -41,6 +41,7 @@
 #include <stdexcept>
 
 #include "rsp_or10.h"
+#include "chain_commands.h"
 #include "string_utils.h"
 #include "linux_utils.h"
 #include "rsp_packet_helpers.h"
@@ -216,6 +217,9 @@ static void wait_for_client_connection ( const int port_number,
   if ( -1 == rsp.server_fd )
     setup_listening_socket( port_number, listen_on_local_addr_only );
 
+  // The last client may have left a debug session open.
+  tap_end_dr_session();
+
   for ( ; ; )
   {
     pollfd fds[1];
@@ -348,6 +352,9 @@ static void wait_for_next_client_request ( const bool * const exit_request )
     break;
   }
 
+  // The bridge may have nothing to do for a while, so leave the TAP in a stable state.
+  tap_end_dr_session();
+
   const int poll_res = poll( fds, 1, poll_timeout );
 
   switch ( poll_res )
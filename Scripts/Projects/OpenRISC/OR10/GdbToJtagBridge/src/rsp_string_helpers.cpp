@@ -25,7 +25,7 @@
 
 uint32_t parse_reg_32_from_hex ( const char * const buf )
 {
-  uint32_t val;
+  uint32_t val = 0;
 
   for ( int n = 0; n < 8; n++ )
   {
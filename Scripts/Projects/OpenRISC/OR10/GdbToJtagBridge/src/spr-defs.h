@@ -118,6 +118,7 @@
 #define OR1200_DU_WRITE_MEM_ADDR   (SPRGROUP_D + 202)
 #define OR1200_DU_WRITE_MEM_DATA   (SPRGROUP_D + 203)
 #define OR1200_DU_WATCHPOINT_COUNT (SPRGROUP_D + 204)
+#define OR1200_DU_WRITE_MEM_SEL    (SPRGROUP_D + 205)
 
 
 /* Performance counters group */
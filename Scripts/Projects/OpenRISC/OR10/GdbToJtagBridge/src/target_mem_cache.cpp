@@ -0,0 +1,217 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "target_mem_cache.h"  // The include file for this module should come first.
+
+#include <assert.h>
+
+#include <map>
+#include <algorithm>
+
+#include "dbg_api.h"
+#include "string_utils.h"
+
+
+// A page is filled with a single burst read. Should be a power of 2.
+static const uint32_t MEM_CACHE_PAGE_SIZE = 256;
+
+// When the cache is full, it is emptied, which is good enough for the typical access pattern
+// while debugging: a few stack and data areas between each time the CPU runs.
+static const unsigned MEM_CACHE_MAX_PAGE_COUNT = 1024;
+
+typedef std::map< uint32_t, std::vector< uint8_t > > page_map_type;
+
+static page_map_type s_pages;  // Key: page start address.
+
+static bool s_is_enabled = true;
+
+struct no_cache_region
+{
+  uint64_t start_addr;
+  uint64_t end_addr;  // One past the last byte, so it does not overflow at the end of the address space.
+};
+
+static std::vector< no_cache_region > s_no_cache_regions;
+
+static uint64_t s_page_hit_count;
+static uint64_t s_page_miss_count;
+static uint64_t s_uncached_read_count;
+static uint64_t s_invalidate_all_count;
+
+
+static bool overlaps_no_cache_region ( const uint64_t start_addr, const uint64_t end_addr )
+{
+  for ( std::vector< no_cache_region >::const_iterator it = s_no_cache_regions.begin(); it != s_no_cache_regions.end(); ++it )
+  {
+    if ( start_addr < it->end_addr && it->start_addr < end_addr )
+      return true;
+  }
+
+  return false;
+}
+
+
+void mem_cache_read ( const uint32_t start_addr,
+                      const uint32_t byte_count,
+                      std::vector< uint8_t > * const data_read )
+{
+  if ( byte_count == 0 )
+  {
+    assert( false );
+    return;
+  }
+
+  const uint64_t end_addr        = uint64_t( start_addr ) + byte_count;
+  const uint64_t first_page_addr = start_addr & ~( MEM_CACHE_PAGE_SIZE - 1 );
+  const uint64_t pages_end_addr  = ( end_addr + MEM_CACHE_PAGE_SIZE - 1 ) & ~uint64_t( MEM_CACHE_PAGE_SIZE - 1 );
+
+  // Filling a page may read memory outside the requested range,
+  // which must not happen for memory-mapped I/O registers.
+  if ( !s_is_enabled || overlaps_no_cache_region( first_page_addr, pages_end_addr ) )
+  {
+    ++s_uncached_read_count;
+    dbg_cpu0_read_mem( start_addr, byte_count, data_read );
+    return;
+  }
+
+  for ( uint64_t page_addr = first_page_addr; page_addr < end_addr; page_addr += MEM_CACHE_PAGE_SIZE )
+  {
+    const uint64_t copy_start = std::max( page_addr, uint64_t( start_addr ) );
+    const uint64_t copy_end   = std::min( page_addr + MEM_CACHE_PAGE_SIZE, end_addr );
+
+    page_map_type::const_iterator it = s_pages.find( uint32_t( page_addr ) );
+
+    if ( it != s_pages.end() )
+    {
+      ++s_page_hit_count;
+    }
+    else
+    {
+      ++s_page_miss_count;
+
+      std::vector< uint8_t > contents;
+      contents.reserve( MEM_CACHE_PAGE_SIZE );
+      dbg_cpu0_read_mem( uint32_t( page_addr ), MEM_CACHE_PAGE_SIZE, &contents );
+
+      if ( contents.size() != MEM_CACHE_PAGE_SIZE )
+      {
+        // Part of the page is not readable. Read the rest of the requested range directly,
+        // so that the caller gets exactly the same number of bytes as without the cache.
+        dbg_cpu0_read_mem( uint32_t( copy_start ), uint32_t( end_addr - copy_start ), data_read );
+        return;
+      }
+
+      if ( s_pages.size() >= MEM_CACHE_MAX_PAGE_COUNT )
+        s_pages.clear();
+
+      it = s_pages.insert( page_map_type::value_type( uint32_t( page_addr ), contents ) ).first;
+    }
+
+    const std::vector< uint8_t > & page = it->second;
+
+    data_read->insert( data_read->end(),
+                       page.begin() + ( copy_start - page_addr ),
+                       page.begin() + ( copy_end   - page_addr ) );
+  }
+}
+
+
+void mem_cache_invalidate_all ( void )
+{
+  if ( !s_pages.empty() )
+  {
+    ++s_invalidate_all_count;
+    s_pages.clear();
+  }
+}
+
+
+void mem_cache_invalidate_range ( const uint32_t start_addr, const uint32_t byte_count )
+{
+  if ( byte_count == 0 )
+    return;
+
+  const uint64_t end_addr = uint64_t( start_addr ) + byte_count;
+
+  page_map_type::iterator it = s_pages.lower_bound( start_addr & ~( MEM_CACHE_PAGE_SIZE - 1 ) );
+
+  while ( it != s_pages.end() && it->first < end_addr )
+    s_pages.erase( it++ );
+}
+
+
+void mem_cache_enable ( const bool enable )
+{
+  s_is_enabled = enable;
+  s_pages.clear();
+}
+
+
+void mem_cache_add_no_cache_region ( const uint32_t start_addr, const uint32_t byte_count )
+{
+  if ( byte_count == 0 )
+    return;
+
+  no_cache_region region;
+  region.start_addr = start_addr;
+  region.end_addr   = uint64_t( start_addr ) + byte_count;
+
+  s_no_cache_regions.push_back( region );
+
+  mem_cache_invalidate_range( start_addr, byte_count );
+}
+
+
+void mem_cache_clear_no_cache_regions ( void )
+{
+  s_no_cache_regions.clear();
+}
+
+
+std::string mem_cache_get_status_text ( void )
+{
+  std::string text;
+
+  text += format_msg( "Memory cache: %s, page size %u bytes, %u pages cached (maximum %u).\n",
+                      s_is_enabled ? "enabled" : "disabled",
+                      unsigned( MEM_CACHE_PAGE_SIZE ),
+                      unsigned( s_pages.size() ),
+                      MEM_CACHE_MAX_PAGE_COUNT );
+
+  text += format_msg( "Page hits: %llu, page misses: %llu, uncached reads: %llu, full invalidations: %llu.\n",
+                      (unsigned long long)s_page_hit_count,
+                      (unsigned long long)s_page_miss_count,
+                      (unsigned long long)s_uncached_read_count,
+                      (unsigned long long)s_invalidate_all_count );
+
+  if ( s_no_cache_regions.empty() )
+  {
+    text += "No-cache regions: none.\n";
+  }
+  else
+  {
+    text += "No-cache regions:\n";
+
+    for ( std::vector< no_cache_region >::const_iterator it = s_no_cache_regions.begin(); it != s_no_cache_regions.end(); ++it )
+    {
+      text += format_msg( "  0x%08X - 0x%08X\n",
+                          unsigned( it->start_addr ),
+                          unsigned( it->end_addr - 1 ) );
+    }
+  }
+
+  return text;
+}
@@ -0,0 +1,47 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TARGET_MEM_CACHE_H_INCLUDED
+#define TARGET_MEM_CACHE_H_INCLUDED
+
+#include <stdint.h>
+
+#include <vector>
+#include <string>
+
+// Page-granular cache of the target memory contents.
+//
+// GDB re-reads the same stack and data words many times while unwinding frames and printing variables.
+// The cache contents are only valid while the CPU remains stalled, so the caller must invalidate
+// the whole cache whenever the CPU runs, and the affected range whenever memory is written to.
+
+// Same semantics as dbg_cpu0_read_mem(): if there is an error reading from memory,
+// the data returned may contain fewer bytes than requested.
+void mem_cache_read ( uint32_t start_addr, uint32_t byte_count, std::vector< uint8_t > * data_read );
+
+void mem_cache_invalidate_all   ( void );
+void mem_cache_invalidate_range ( uint32_t start_addr, uint32_t byte_count );
+
+void mem_cache_enable ( bool enable );
+
+// Memory regions that are never cached, like memory-mapped I/O registers.
+// Any read that touches a cache page overlapping such a region goes straight to the target.
+void mem_cache_add_no_cache_region    ( uint32_t start_addr, uint32_t byte_count );
+void mem_cache_clear_no_cache_regions ( void );
+
+std::string mem_cache_get_status_text ( void );
+
+#endif  // Include this header file only once.
@@ -0,0 +1,504 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs the bridge against the "model" cable with other devices before and after the OR10 TAP,
+// and checks register and memory round-trips over the GDB RSP protocol.
+//
+// For each chain layout, the test starts the bridge as a separate process, connects to it like GDB would,
+// writes registers and memory and reads them back. Then it stops the bridge with SIGINT
+// and checks that it exits cleanly.
+//
+// The bridge binary is expected in the current directory, which is where "make check" runs the tests,
+// unless given as the first argument. The BSDL files for the model devices are taken from tests/bsdl
+// under $srcdir.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "test_helpers.h"
+
+
+static const unsigned RECEIVE_TIMEOUT_S = 30;
+
+// GDB register numbers for the OR10, see rsp_or10.cpp .
+static const unsigned GPR_COUNT  = 32;
+static const unsigned NPC_REGNUM = GPR_COUNT + 1;
+static const unsigned REG_COUNT  = GPR_COUNT + 3;
+
+
+static std::string format_error ( const char * const prefix )
+{
+  return std::string( prefix ) + strerror( errno );
+}
+
+
+static std::string to_hex ( const uint8_t * const data, const size_t len )
+{
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  std::string str;
+
+  for ( size_t i = 0; i < len; ++i )
+  {
+    str += HEX_DIGITS[ data[ i ] >> 4 ];
+    str += HEX_DIGITS[ data[ i ] & 0xF ];
+  }
+
+  return str;
+}
+
+
+// ----------- RSP client -----------
+
+static void send_all ( const int fd, const std::string & data )
+{
+  size_t pos = 0;
+
+  while ( pos < data.size() )
+  {
+    const ssize_t written = send( fd, data.data() + pos, data.size() - pos, 0 );
+
+    if ( written < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+
+      throw std::runtime_error( format_error( "Error sending data to the bridge: " ) );
+    }
+
+    pos += size_t( written );
+  }
+}
+
+
+static char receive_char ( const int fd )
+{
+  for ( ; ; )
+  {
+    char c;
+    const ssize_t len = recv( fd, &c, 1, 0 );
+
+    if ( len == 1 )
+      return c;
+
+    if ( len == 0 )
+      throw std::runtime_error( "The bridge has closed the connection." );
+
+    if ( errno == EINTR )
+      continue;
+
+    if ( errno == EAGAIN || errno == EWOULDBLOCK )
+      throw std::runtime_error( "Timeout waiting for data from the bridge." );
+
+    throw std::runtime_error( format_error( "Error receiving data from the bridge: " ) );
+  }
+}
+
+
+static void send_packet ( const int fd, const std::string & data )
+{
+  uint8_t checksum = 0;
+
+  for ( size_t i = 0; i < data.size(); ++i )
+    checksum += uint8_t( data[ i ] );
+
+  send_all( fd, "$" + data + "#" + to_hex( &checksum, 1 ) );
+
+  const char ack = receive_char( fd );
+
+  if ( ack != '+' )
+    throw std::runtime_error( "The bridge did not acknowledge a packet." );
+}
+
+
+static std::string receive_packet ( const int fd )
+{
+  while ( receive_char( fd ) != '$' )
+  {
+  }
+
+  std::string data;
+  uint8_t checksum = 0;
+
+  for ( ; ; )
+  {
+    const char c = receive_char( fd );
+
+    if ( c == '#' )
+      break;
+
+    data += c;
+    checksum += uint8_t( c );
+  }
+
+  char checksum_str[ 3 ] = { receive_char( fd ), receive_char( fd ), '\0' };
+
+  if ( strtoul( checksum_str, NULL, 16 ) != checksum )
+    throw std::runtime_error( "Wrong checksum in a packet from the bridge." );
+
+  send_all( fd, "+" );
+
+  return data;
+}
+
+
+static std::string transact ( const int fd, const std::string & request )
+{
+  send_packet( fd, request );
+  return receive_packet( fd );
+}
+
+
+// The binary data in an 'X' packet must escape these characters.
+
+static std::string escape_binary ( const std::vector< uint8_t > & data )
+{
+  std::string str;
+
+  for ( size_t i = 0; i < data.size(); ++i )
+  {
+    const char c = char( data[ i ] );
+
+    if ( c == '#' || c == '$' || c == '}' || c == '*' )
+    {
+      str += '}';
+      str += char( c ^ 0x20 );
+    }
+    else
+    {
+      str += c;
+    }
+  }
+
+  return str;
+}
+
+
+// ----------- Bridge process -----------
+
+static pid_t start_bridge ( const char * const bridge_path, const std::vector< std::string > & args )
+{
+  std::vector< char * > argv;
+  argv.push_back( const_cast< char * >( bridge_path ) );
+
+  for ( size_t i = 0; i < args.size(); ++i )
+    argv.push_back( const_cast< char * >( args[ i ].c_str() ) );
+
+  argv.push_back( NULL );
+
+  const pid_t pid = fork();
+
+  if ( pid == -1 )
+    throw std::runtime_error( format_error( "Cannot start the bridge process: " ) );
+
+  if ( pid == 0 )
+  {
+    execv( bridge_path, &argv.front() );
+    fprintf( stderr, "Cannot run \"%s\": %s\n", bridge_path, strerror( errno ) );
+    _exit( 127 );
+  }
+
+  return pid;
+}
+
+
+// The bridge needs some time to come up, so keep trying until it accepts the connection.
+
+static int connect_to_bridge ( const pid_t bridge_pid, const uint16_t port )
+{
+  for ( unsigned attempt = 0; attempt < 300; ++attempt )
+  {
+    int status;
+
+    if ( waitpid( bridge_pid, &status, WNOHANG ) == bridge_pid )
+      throw std::runtime_error( "The bridge has terminated before accepting a connection." );
+
+    const int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+    if ( fd == -1 )
+      throw std::runtime_error( format_error( "Cannot create a socket: " ) );
+
+    sockaddr_in addr;
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    if ( 0 == connect( fd, (const sockaddr *) &addr, sizeof( addr ) ) )
+    {
+      timeval timeout;
+      timeout.tv_sec  = RECEIVE_TIMEOUT_S;
+      timeout.tv_usec = 0;
+
+      if ( 0 != setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) ) )
+        throw std::runtime_error( format_error( "Cannot set the socket receive timeout: " ) );
+
+      return fd;
+    }
+
+    close( fd );
+    usleep( 100 * 1000 );
+  }
+
+  throw std::runtime_error( "Timeout connecting to the bridge." );
+}
+
+
+static void stop_bridge ( const pid_t bridge_pid, const char * const test_name )
+{
+  if ( 0 != kill( bridge_pid, SIGINT ) )
+    throw std::runtime_error( format_error( "Cannot send SIGINT to the bridge: " ) );
+
+  int status;
+
+  while ( waitpid( bridge_pid, &status, 0 ) == -1 )
+  {
+    if ( errno != EINTR )
+      throw std::runtime_error( format_error( "Error waiting for the bridge to terminate: " ) );
+  }
+
+  check( WIFEXITED( status ) && WEXITSTATUS( status ) == 0, test_name, "the bridge did not exit cleanly" );
+}
+
+
+// ----------- Round-trip checks -----------
+
+static std::string format_reg ( const uint32_t value )
+{
+  char str[ 9 ];
+  snprintf( str, sizeof( str ), "%08x", value );
+  return str;
+}
+
+
+static void check_registers ( const int fd, const char * const test_name )
+{
+  // r0 is not written, as it is always zero on real hardware.
+  for ( unsigned i = 1; i < GPR_COUNT; ++i )
+  {
+    char request[ 32 ];
+    snprintf( request, sizeof( request ), "P%x=%s", i, format_reg( 0x11111111 * ( i % 16 ) + i ).c_str() );
+    check( transact( fd, request ) == "OK", test_name, "a GPR write failed" );
+  }
+
+  char request[ 32 ];
+  snprintf( request, sizeof( request ), "P%x=%s", NPC_REGNUM, format_reg( 0x00002468 ).c_str() );
+  check( transact( fd, request ) == "OK", test_name, "the NPC write failed" );
+
+  const std::string regs = transact( fd, "g" );
+
+  if ( regs.size() != REG_COUNT * 8 )
+  {
+    check( false, test_name, "wrong length of the register read reply" );
+    return;
+  }
+
+  for ( unsigned i = 1; i < GPR_COUNT; ++i )
+  {
+    check( regs.substr( i * 8, 8 ) == format_reg( 0x11111111 * ( i % 16 ) + i ),
+           test_name,
+           "a GPR did not read back the value written" );
+  }
+
+  check( regs.substr( NPC_REGNUM * 8, 8 ) == format_reg( 0x00002468 ), test_name, "the NPC did not read back the value written" );
+}
+
+
+static std::vector< uint8_t > read_memory ( const int fd, const uint32_t addr, const uint32_t len )
+{
+  char request[ 32 ];
+  snprintf( request, sizeof( request ), "m%x,%x", addr, len );
+
+  const std::string reply = transact( fd, request );
+
+  if ( reply.size() != len * 2 )
+    throw std::runtime_error( "Wrong length of the memory read reply: " + reply.substr( 0, 16 ) );
+
+  std::vector< uint8_t > data( len );
+
+  for ( uint32_t i = 0; i < len; ++i )
+    data[ i ] = uint8_t( strtoul( reply.substr( i * 2, 2 ).c_str(), NULL, 16 ) );
+
+  return data;
+}
+
+
+static void check_memory ( const int fd, const char * const test_name )
+{
+  const uint32_t BASE_ADDR = 0x2000;
+  const uint32_t LEN       = 4000;  // Long enough for the burst commands.
+
+  std::vector< uint8_t > expected( LEN );
+  uint32_t generator_state = 3;
+
+  for ( uint32_t i = 0; i < LEN; ++i )
+    expected[ i ] = next_test_byte( &generator_state );
+
+  char request[ 32 ];
+  snprintf( request, sizeof( request ), "M%x,%x:", BASE_ADDR, LEN );
+  check( transact( fd, request + to_hex( &expected.front(), LEN ) ) == "OK", test_name, "the memory write failed" );
+
+  // Small writes at odd addresses need partial word writes.
+  const uint32_t small_writes[][ 2 ] = { { 1, 1 }, { 6, 3 }, { 17, 10 }, { 3001, 7 } };
+
+  for ( unsigned i = 0; i < sizeof( small_writes ) / sizeof( small_writes[0] ); ++i )
+  {
+    const uint32_t offset = small_writes[ i ][ 0 ];
+    const uint32_t len    = small_writes[ i ][ 1 ];
+
+    for ( uint32_t j = 0; j < len; ++j )
+      expected[ offset + j ] = next_test_byte( &generator_state );
+
+    snprintf( request, sizeof( request ), "M%x,%x:", BASE_ADDR + offset, len );
+    check( transact( fd, request + to_hex( &expected[ offset ], len ) ) == "OK", test_name, "a small memory write failed" );
+  }
+
+  // A binary write with all byte values, including the ones that must be escaped.
+  {
+    const uint32_t offset = 1000;
+    std::vector< uint8_t > data( 256 );
+
+    for ( uint32_t j = 0; j < data.size(); ++j )
+    {
+      data[ j ] = uint8_t( j );
+      expected[ offset + j ] = data[ j ];
+    }
+
+    snprintf( request, sizeof( request ), "X%x,%x:", BASE_ADDR + offset, unsigned( data.size() ) );
+    check( transact( fd, request + escape_binary( data ) ) == "OK", test_name, "the binary memory write failed" );
+  }
+
+  check( read_memory( fd, BASE_ADDR, LEN ) == expected, test_name, "the memory did not read back the data written" );
+  check( read_memory( fd, BASE_ADDR + 5, 3 ) == std::vector< uint8_t >( &expected[ 5 ], &expected[ 8 ] ),
+         test_name,
+         "a small memory read at an odd address returned the wrong data" );
+}
+
+
+static void test_chain_layout ( const char * const bridge_path,
+                                const char * const test_name,
+                                const std::vector< std::string > & layout_args )
+{
+  printf( "Testing chain layout: %s\n", test_name );
+  fflush( stdout );  // Otherwise the output would come after the bridge's one.
+
+  const char * const srcdir = getenv( "srcdir" );
+  const uint16_t port = uint16_t( 20000 + getpid() % 20000 );
+
+  char port_str[ 16 ];
+  snprintf( port_str, sizeof( port_str ), "%u", unsigned( port ) );
+
+  std::vector< std::string > args;
+  args.push_back( "-b" );
+  args.push_back( std::string( srcdir == NULL ? "." : srcdir ) + "/tests/bsdl" );
+  args.push_back( "-g" );
+  args.push_back( port_str );
+  args.insert( args.end(), layout_args.begin(), layout_args.end() );
+
+  const pid_t bridge_pid = start_bridge( bridge_path, args );
+
+  try
+  {
+    const int fd = connect_to_bridge( bridge_pid, port );
+
+    try
+    {
+      const std::string stop_reply = transact( fd, "?" );
+      check( !stop_reply.empty() && ( stop_reply[ 0 ] == 'S' || stop_reply[ 0 ] == 'T' ), test_name, "wrong stop reply" );
+
+      check_registers( fd, test_name );
+      check_memory( fd, test_name );
+    }
+    catch ( ... )
+    {
+      close( fd );
+      throw;
+    }
+
+    close( fd );
+  }
+  catch ( const std::exception & e )
+  {
+    check( false, test_name, e.what() );
+    kill( bridge_pid, SIGKILL );
+    waitpid( bridge_pid, NULL, 0 );
+    return;
+  }
+
+  stop_bridge( bridge_pid, test_name );
+}
+
+
+static std::vector< std::string > make_args ( const char * const * const args )
+{
+  std::vector< std::string > v;
+
+  for ( unsigned i = 0; args[ i ] != NULL; ++i )
+    v.push_back( args[ i ] );
+
+  return v;
+}
+
+
+int main ( const int argc, char ** const argv )
+{
+  const char * const bridge_path = argc >= 2 ? argv[ 1 ] : "./or10_gdb_to_jtag_bridge";
+
+  // The chain positions are counted from the cable data input, so the devices added with -a come first.
+  const char * const single_device [] = { "-x", "0", "model", NULL };
+  const char * const before_and_after[] = { "-x", "3", "model", "-b", "2", "-a", "3", NULL };
+  const char * const only_before     [] = { "-x", "0", "model", "-b", "3", "-a", "0", NULL };
+  const char * const only_after      [] = { "-x", "2", "--no-cable-queue", "--no-dr-session", "model", "-a", "2", NULL };
+
+  // Older bitstreams, and the memory access fallbacks in the bridge.
+  const char * const no_burst_access [] = { "-x", "0", "--no-burst-mem-access", "model", NULL };
+  const char * const old_tap         [] = { "-x", "0", "model", "-n", NULL };
+  const char * const old_cpu         [] = { "-x", "0", "model", "-s", NULL };
+  const char * const old_tap_and_cpu [] = { "-x", "1", "model", "-n", "-s", "-b", "1", "-a", "1", NULL };
+
+  try
+  {
+    test_chain_layout( bridge_path, "Single device"                , make_args( single_device    ) );
+    test_chain_layout( bridge_path, "2 devices before, 3 after"    , make_args( before_and_after ) );
+    test_chain_layout( bridge_path, "3 devices before"             , make_args( only_before      ) );
+    test_chain_layout( bridge_path, "2 devices after, no cable queue and no DR session", make_args( only_after ) );
+    test_chain_layout( bridge_path, "No burst memory access"       , make_args( no_burst_access  ) );
+    test_chain_layout( bridge_path, "TAP without burst commands"   , make_args( old_tap          ) );
+    test_chain_layout( bridge_path, "CPU without WRITE_MEM_SEL"    , make_args( old_cpu          ) );
+    test_chain_layout( bridge_path, "Old TAP and CPU, 1 device before and after", make_args( old_tap_and_cpu ) );
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf( stderr, "Unexpected error: %s\n", e.what() );
+    return 1;
+  }
+
+  return report_test_results( "All bridge tests against the model cable passed." );
+}
@@ -0,0 +1,238 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the MPSSE commands the ft2232 cable driver assembles for known TMS and TDI sequences.
+//
+// The driver runs in -L mode, so its commands go to the software MPSSE interpreter instead of to the hardware.
+// The test compares the bytes written with the expected MPSSE opcodes, and the TMS and TDI values
+// the interpreter clocks out with the bits the driver was asked to send.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "cable_drivers/cable_ft2232.h"
+#include "cable_drivers/mpsse_interpreter.h"
+#include "cable_drivers/cable_write_bit_constants.h"
+#include "errcodes.h"
+#include "test_helpers.h"
+
+
+static const uint8_t WRITE_BYTES     = 0x19;  // MPSSE_DO_WRITE | MPSSE_LSB | MPSSE_WRITE_NEG
+static const uint8_t WRITE_BITS      = 0x1B;  // The same plus MPSSE_BITMODE.
+static const uint8_t WRITE_TMS       = 0x4B;  // MPSSE_WRITE_TMS | MPSSE_LSB | MPSSE_BITMODE | MPSSE_WRITE_NEG
+static const uint8_t READ_WRITE_FLAG = 0x20;  // MPSSE_DO_READ
+
+static const uint8_t NO_CHECK = 0xFF;  // For the TMS value of data bits, which the MPSSE engine leaves unchanged.
+
+struct clocked_bit
+{
+  uint8_t tms;
+  uint8_t tdi;
+};
+
+static std::vector< clocked_bit > s_clocked_bits;
+static std::vector< uint8_t > s_written_bytes;
+
+
+// TDO is looped back from TDI, like the interpreter does without a callback.
+
+static int record_tck ( void *, const int tms, const int tdi )
+{
+  const clocked_bit bit = { uint8_t( tms ), uint8_t( tdi ) };
+  s_clocked_bits.push_back( bit );
+  return tdi;
+}
+
+
+// Flushes the driver and compares what was sent with the expected MPSSE command bytes
+// and the expected TMS and TDI values for each TCK cycle.
+
+static void check_output ( jtag_cable_t * const driver,
+                           const char * const test_name,
+                           const uint8_t * const expected_bytes,
+                           const unsigned expected_byte_count,
+                           const clocked_bit * const expected_bits,
+                           const unsigned expected_bit_count )
+{
+  check( driver->flush_func() == APP_ERR_NONE, test_name, "flush failed" );
+
+  check( s_written_bytes.size() == expected_byte_count &&
+         0 == memcmp( &s_written_bytes.front(), expected_bytes, expected_byte_count ),
+         test_name,
+         "wrong MPSSE command bytes" );
+
+  bool are_bits_ok = s_clocked_bits.size() == expected_bit_count;
+
+  for ( unsigned i = 0; are_bits_ok && i < expected_bit_count; ++i )
+  {
+    if ( s_clocked_bits[ i ].tdi != expected_bits[ i ].tdi ||
+         ( expected_bits[ i ].tms != NO_CHECK && s_clocked_bits[ i ].tms != expected_bits[ i ].tms ) )
+    {
+      are_bits_ok = false;
+    }
+  }
+
+  check( are_bits_ok, test_name, "wrong TMS or TDI sequence" );
+
+  s_written_bytes.clear();
+  s_clocked_bits.clear();
+}
+
+
+static void append_bits ( std::vector< clocked_bit > * const bits,
+                          const uint8_t tms,
+                          const uint32_t tdi_bits,
+                          const unsigned bit_count )
+{
+  for ( unsigned i = 0; i < bit_count; ++i )
+  {
+    const clocked_bit bit = { tms, uint8_t( ( tdi_bits >> i ) & 1 ) };
+    bits->push_back( bit );
+  }
+}
+
+
+static void append_tms_bits ( std::vector< clocked_bit > * const bits,
+                              const uint32_t tms_bits,
+                              const unsigned bit_count )
+{
+  for ( unsigned i = 0; i < bit_count; ++i )
+  {
+    const clocked_bit bit = { uint8_t( ( tms_bits >> i ) & 1 ), 0 };
+    bits->push_back( bit );
+  }
+}
+
+
+static void test_tms_sequences ( jtag_cable_t * const driver )
+{
+  // Test-Logic-Reset: 5 bits fit in a single command.
+  {
+    check( driver->tms_sequence_func( 0x1F, 5 ) == APP_ERR_NONE, "TMS reset", "call failed" );
+
+    const uint8_t expected_bytes[] = { WRITE_TMS, 4, 0x1F };
+
+    std::vector< clocked_bit > expected_bits;
+    append_tms_bits( &expected_bits, 0x1F, 5 );
+
+    check_output( driver, "TMS reset", expected_bytes, sizeof( expected_bytes ), &expected_bits.front(), unsigned( expected_bits.size() ) );
+  }
+
+  // A command holds at most 7 TMS bits, so 10 bits need 2 commands.
+  {
+    const uint32_t tms_bits = 0x106;
+
+    check( driver->tms_sequence_func( tms_bits, 10 ) == APP_ERR_NONE, "TMS 10 bits", "call failed" );
+
+    const uint8_t expected_bytes[] = { WRITE_TMS, 6, 0x06,
+                                       WRITE_TMS, 2, 0x02 };
+
+    std::vector< clocked_bit > expected_bits;
+    append_tms_bits( &expected_bits, tms_bits, 10 );
+
+    check_output( driver, "TMS 10 bits", expected_bytes, sizeof( expected_bytes ), &expected_bits.front(), unsigned( expected_bits.size() ) );
+  }
+}
+
+
+static void test_streams ( jtag_cable_t * const driver )
+{
+  // 20 bits with TMS set on the last one: 2 whole bytes, 3 single bits and a 1-bit TMS command
+  // that carries the last TDI bit in bit 7.
+  {
+    const uint32_t stream = 0x000A5F3C;
+
+    check( driver->stream_out_func( &stream, 20, 1 ) == APP_ERR_NONE, "Write stream", "call failed" );
+
+    const uint8_t expected_bytes[] = { WRITE_BYTES, 1, 0, 0x3C, 0x5F,
+                                       WRITE_BITS , 2, 0x0A,
+                                       WRITE_TMS  , 0, 0x81 };
+
+    std::vector< clocked_bit > expected_bits;
+    append_bits( &expected_bits, NO_CHECK, stream, 19 );
+    append_bits( &expected_bits, 1, stream >> 19, 1 );
+
+    check_output( driver, "Write stream", expected_bytes, sizeof( expected_bytes ), &expected_bits.front(), unsigned( expected_bits.size() ) );
+  }
+
+  // The read variants of the same commands. TDO is looped back, so the bits read must be the bits written.
+  {
+    const uint32_t stream = 0x00000ABC;
+    uint32_t stream_in = 0;
+
+    check( driver->stream_inout_func( &stream, &stream_in, 12, 0 ) == APP_ERR_NONE, "Read stream", "call failed" );
+
+    check( ( stream_in & 0xFFF ) == stream, "Read stream", "wrong data read back" );
+
+    const uint8_t expected_bytes[] = { WRITE_BYTES | READ_WRITE_FLAG, 0, 0, 0xBC,
+                                       WRITE_BITS  | READ_WRITE_FLAG, 3, 0x0A };
+
+    std::vector< clocked_bit > expected_bits;
+    append_bits( &expected_bits, NO_CHECK, stream, 12 );
+
+    // The read has already flushed the commands.
+    check_output( driver, "Read stream", expected_bytes, sizeof( expected_bytes ), &expected_bits.front(), unsigned( expected_bits.size() ) );
+  }
+}
+
+
+static void test_single_bits ( jtag_cable_t * const driver )
+{
+  // Single bits always set TMS explicitly.
+  check( driver->bit_out_func( TMS ) == APP_ERR_NONE, "Single bits", "call failed" );
+  check( driver->bit_out_func( 0 ) == APP_ERR_NONE, "Single bits", "call failed" );
+
+  uint8_t bit_in = 0;
+  check( driver->bit_inout_func( TDO, &bit_in ) == APP_ERR_NONE, "Single bits", "call failed" );
+  check( bit_in == 1, "Single bits", "wrong bit read back" );
+
+  const uint8_t expected_bytes[] = { WRITE_TMS, 0, 0x01,
+                                     WRITE_TMS, 0, 0x00,
+                                     WRITE_TMS | READ_WRITE_FLAG, 0, 0x80 };
+
+  const clocked_bit expected_bits[] = { { 1, 0 }, { 0, 0 }, { 0, 1 } };
+
+  check_output( driver, "Single bits", expected_bytes, sizeof( expected_bytes ), expected_bits, 3 );
+}
+
+
+int main ( void )
+{
+  jtag_cable_t * const driver = cable_ftdi_get_driver();
+
+  if ( driver->opt_func( 'L', NULL ) != APP_ERR_NONE ||
+       driver->init_func() != APP_ERR_NONE )
+  {
+    fprintf( stderr, "Cannot initialise the ft2232 cable in -L mode.\n" );
+    return 1;
+  }
+
+  mpsse_interpreter * const mi = cable_ftdi_get_mpsse_interpreter();
+
+  mi->write_log = &s_written_bytes;
+  mi->tck_func  = record_tck;
+
+  test_tms_sequences( driver );
+  test_streams( driver );
+  test_single_bits( driver );
+
+  mi->write_log = NULL;
+
+  return report_test_results( "All MPSSE command tests passed." );
+}
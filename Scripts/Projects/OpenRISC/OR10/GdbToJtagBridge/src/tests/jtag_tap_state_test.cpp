@@ -0,0 +1,168 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the TAP state machine and the TMS paths between all pairs of states.
+//
+// The transitions are compared with the table in IEEE 1149.1. Then every path from get_shortest_tms_path()
+// is walked with get_next_tap_state(), and must end in the target state with as few bits
+// as a breadth-first search over the reference table needs.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "jtag_tap_state.h"
+#include "test_helpers.h"
+
+
+// The next state for TMS = 0 and for TMS = 1, in the tap_state_enum order.
+static const tap_state_enum REFERENCE_TRANSITIONS[ TAP_STATE_COUNT ][ 2 ] =
+{
+  { TAP_STATE_RUN_TEST_IDLE , TAP_STATE_TEST_LOGIC_RESET },  // Test-Logic-Reset
+  { TAP_STATE_RUN_TEST_IDLE , TAP_STATE_SELECT_DR_SCAN   },  // Run-Test/Idle
+  { TAP_STATE_CAPTURE_DR    , TAP_STATE_SELECT_IR_SCAN   },  // Select-DR-Scan
+  { TAP_STATE_SHIFT_DR      , TAP_STATE_EXIT1_DR         },  // Capture-DR
+  { TAP_STATE_SHIFT_DR      , TAP_STATE_EXIT1_DR         },  // Shift-DR
+  { TAP_STATE_PAUSE_DR      , TAP_STATE_UPDATE_DR        },  // Exit1-DR
+  { TAP_STATE_PAUSE_DR      , TAP_STATE_EXIT2_DR         },  // Pause-DR
+  { TAP_STATE_SHIFT_DR      , TAP_STATE_UPDATE_DR        },  // Exit2-DR
+  { TAP_STATE_RUN_TEST_IDLE , TAP_STATE_SELECT_DR_SCAN   },  // Update-DR
+  { TAP_STATE_CAPTURE_IR    , TAP_STATE_TEST_LOGIC_RESET },  // Select-IR-Scan
+  { TAP_STATE_SHIFT_IR      , TAP_STATE_EXIT1_IR         },  // Capture-IR
+  { TAP_STATE_SHIFT_IR      , TAP_STATE_EXIT1_IR         },  // Shift-IR
+  { TAP_STATE_PAUSE_IR      , TAP_STATE_UPDATE_IR        },  // Exit1-IR
+  { TAP_STATE_PAUSE_IR      , TAP_STATE_EXIT2_IR         },  // Pause-IR
+  { TAP_STATE_SHIFT_IR      , TAP_STATE_UPDATE_IR        },  // Exit2-IR
+  { TAP_STATE_RUN_TEST_IDLE , TAP_STATE_SELECT_DR_SCAN   },  // Update-IR
+};
+
+
+static void test_transitions ( void )
+{
+  for ( int state = 0; state < TAP_STATE_COUNT; ++state )
+  {
+    for ( int tms = 0; tms <= 1; ++tms )
+    {
+      check( get_next_tap_state( tap_state_enum( state ), tms != 0 ) == REFERENCE_TRANSITIONS[ state ][ tms ],
+             "Transitions",
+             "get_next_tap_state() does not match IEEE 1149.1" );
+    }
+  }
+}
+
+
+// Calculates the minimum number of TCK cycles from 'from' to every other state.
+
+static void calculate_distances ( const int from, int * const distances )
+{
+  for ( int i = 0; i < TAP_STATE_COUNT; ++i )
+    distances[ i ] = -1;
+
+  int queue[ TAP_STATE_COUNT ];
+  int queue_len = 0;
+
+  queue[ queue_len++ ] = from;
+  distances[ from ] = 0;
+
+  for ( int i = 0; i < queue_len; ++i )
+  {
+    for ( int tms = 0; tms <= 1; ++tms )
+    {
+      const int next = REFERENCE_TRANSITIONS[ queue[ i ] ][ tms ];
+
+      if ( distances[ next ] == -1 )
+      {
+        distances[ next ] = distances[ queue[ i ] ] + 1;
+        queue[ queue_len++ ] = next;
+      }
+    }
+  }
+}
+
+
+static void test_all_paths ( void )
+{
+  for ( int from = 0; from < TAP_STATE_COUNT; ++from )
+  {
+    int distances[ TAP_STATE_COUNT ];
+    calculate_distances( from, distances );
+
+    for ( int to = 0; to < TAP_STATE_COUNT; ++to )
+    {
+      char test_name[ 80 ];
+      snprintf( test_name, sizeof( test_name ), "Path from state %d to state %d", from, to );
+
+      uint32_t tms_bits;
+      int bit_count;
+      get_shortest_tms_path( tap_state_enum( from ), tap_state_enum( to ), &tms_bits, &bit_count );
+
+      check( bit_count == distances[ to ], test_name, "the path is not the shortest one" );
+      check( bit_count <= 8, test_name, "the path is longer than 8 bits" );
+      check( ( tms_bits >> bit_count ) == 0, test_name, "there are TMS bits beyond the path length" );
+
+      tap_state_enum state = tap_state_enum( from );
+
+      for ( int i = 0; i < bit_count; ++i )
+        state = get_next_tap_state( state, ( ( tms_bits >> i ) & 1 ) != 0 );
+
+      check( state == to, test_name, "the path does not end in the target state" );
+    }
+  }
+}
+
+
+// A few well-known sequences, sent from LSB to MSB.
+
+static void test_known_paths ( void )
+{
+  struct known_path
+  {
+    tap_state_enum from;
+    tap_state_enum to;
+    uint32_t tms_bits;
+    int bit_count;
+  };
+
+  const known_path known_paths[] =
+  {
+    { TAP_STATE_TEST_LOGIC_RESET, TAP_STATE_SHIFT_DR     , 0x02, 4 },  // 0, 1, 0, 0
+    { TAP_STATE_RUN_TEST_IDLE   , TAP_STATE_SHIFT_IR     , 0x03, 4 },  // 1, 1, 0, 0
+    { TAP_STATE_SHIFT_DR        , TAP_STATE_PAUSE_DR     , 0x01, 2 },  // 1, 0
+    { TAP_STATE_PAUSE_DR        , TAP_STATE_SHIFT_DR     , 0x01, 2 },  // 1, 0
+    { TAP_STATE_SHIFT_IR        , TAP_STATE_RUN_TEST_IDLE, 0x03, 3 },  // 1, 1, 0
+    { TAP_STATE_RUN_TEST_IDLE   , TAP_STATE_RUN_TEST_IDLE, 0x00, 0 },
+  };
+
+  for ( unsigned i = 0; i < sizeof( known_paths ) / sizeof( known_paths[0] ); ++i )
+  {
+    uint32_t tms_bits;
+    int bit_count;
+    get_shortest_tms_path( known_paths[ i ].from, known_paths[ i ].to, &tms_bits, &bit_count );
+
+    check( tms_bits == known_paths[ i ].tms_bits && bit_count == known_paths[ i ].bit_count,
+           "Known paths",
+           "wrong TMS sequence" );
+  }
+}
+
+
+int main ( void )
+{
+  test_transitions();
+  test_all_paths();
+  test_known_paths();
+
+  return report_test_results( "All TAP state tests passed." );
+}
@@ -0,0 +1,46 @@
+#ifndef TEST_HELPERS_H_INCLUDED
+#define TEST_HELPERS_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Helpers shared by the "make check" tests. Each test is a single source file,
+// so the failure counter does not need to live in a separate translation unit.
+
+static unsigned s_failure_count = 0;
+
+
+static inline void check ( const bool condition, const char * const test_name, const char * const what )
+{
+  if ( !condition )
+  {
+    fprintf( stderr, "Test \"%s\" failed: %s\n", test_name, what );
+    ++s_failure_count;
+  }
+}
+
+
+// A simple linear congruential generator, so that the test data is always the same.
+
+static inline uint8_t next_test_byte ( uint32_t * const state )
+{
+  *state = *state * 1103515245 + 12345;
+  return uint8_t( *state >> 16 );
+}
+
+
+// Prints the test summary and returns the exit code for main().
+
+static inline int report_test_results ( const char * const success_msg )
+{
+  if ( s_failure_count != 0 )
+  {
+    fprintf( stderr, "%u checks failed.\n", s_failure_count );
+    return 1;
+  }
+
+  printf( "%s\n", success_msg );
+  return 0;
+}
+
+#endif  // Include this header file only once.
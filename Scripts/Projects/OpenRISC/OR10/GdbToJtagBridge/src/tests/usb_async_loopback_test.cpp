@@ -0,0 +1,179 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the chunking and reordering logic in usb_async_transport with the loopback backend.
+//
+// The test writes a pseudo-random byte stream in pieces of varying sizes, much larger than one transfer,
+// and reads it back in pieces of other sizes, interleaved with the writes. The loopback backend
+// completes the transfers in reverse order and inserts a status header in every IN packet,
+// so the data only comes back intact and in order if the transport reassembles it correctly.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include "cable_drivers/usb_async_transport.h"
+#include "test_helpers.h"
+
+
+static const unsigned PACKET_SIZE = 16;
+static const unsigned HEADER_LEN  = 2;
+
+
+static usb_async_transport_config get_config ( void )
+{
+  usb_async_transport_config config;
+
+  config.out_transfer_size  = 64;
+  config.out_transfer_count = 3;
+  config.in_transfer_size   = 4 * PACKET_SIZE;
+  config.in_transfer_count  = 3;
+  config.in_header_len      = HEADER_LEN;
+  config.in_packet_size     = PACKET_SIZE;
+  config.timeout_ms         = 100;
+
+  return config;
+}
+
+
+static void test_interleaved_streams ( void )
+{
+  const char * const TEST_NAME = "Interleaved streams";
+
+  usb_async_transport transport( usb_async_create_loopback_backend( PACKET_SIZE, HEADER_LEN ), get_config() );
+
+  // The write and read sizes are chosen so that they do not line up with the transfer or packet sizes.
+  const unsigned write_sizes[] = { 1, 7, 63, 64, 65, 130, 3, 250, 17, 500 };
+  const unsigned read_sizes [] = { 5, 1, 100, 33, 64, 200, 13, 311 };
+
+  const unsigned write_size_count = sizeof( write_sizes ) / sizeof( write_sizes[0] );
+  const unsigned read_size_count  = sizeof( read_sizes  ) / sizeof( read_sizes [0] );
+
+  std::vector< uint8_t > written;
+  std::vector< uint8_t > read_back;
+
+  uint32_t generator_state = 1;
+
+  for ( unsigned round = 0; round < 20; ++round )
+  {
+    const unsigned write_size = write_sizes[ round % write_size_count ];
+
+    std::vector< uint8_t > data( write_size );
+
+    for ( unsigned i = 0; i < write_size; ++i )
+      data[ i ] = next_test_byte( &generator_state );
+
+    transport.write( &data.front(), write_size );
+    written.insert( written.end(), data.begin(), data.end() );
+
+    // Read back some of the data written so far, but never more than that,
+    // as the loopback backend has nothing else to return.
+    const unsigned read_size = std::min( read_sizes[ round % read_size_count ],
+                                         unsigned( written.size() - read_back.size() ) );
+
+    if ( read_size != 0 )
+    {
+      std::vector< uint8_t > buf( read_size );
+      transport.read( &buf.front(), read_size );
+      read_back.insert( read_back.end(), buf.begin(), buf.end() );
+    }
+  }
+
+  // Collect the rest.
+  const unsigned rest = unsigned( written.size() - read_back.size() );
+
+  if ( rest != 0 )
+  {
+    std::vector< uint8_t > buf( rest );
+    transport.read( &buf.front(), rest );
+    read_back.insert( read_back.end(), buf.begin(), buf.end() );
+  }
+
+  check( read_back == written, TEST_NAME, "the data read back does not match the data written" );
+  check( transport.get_out_transfer_count() > written.size() / get_config().out_transfer_size,
+         TEST_NAME,
+         "the data was not split into several OUT transfers" );
+  check( transport.get_max_in_flight() > 1, TEST_NAME, "there was never more than one transfer in flight" );
+}
+
+
+static void test_flush_then_read ( void )
+{
+  const char * const TEST_NAME = "Flush then read";
+
+  usb_async_transport transport( usb_async_create_loopback_backend( PACKET_SIZE, HEADER_LEN ), get_config() );
+
+  std::vector< uint8_t > written( 1000 );
+  uint32_t generator_state = 2;
+
+  for ( size_t i = 0; i < written.size(); ++i )
+    written[ i ] = next_test_byte( &generator_state );
+
+  transport.write( &written.front(), unsigned( written.size() ) );
+  transport.flush();
+
+  std::vector< uint8_t > read_back( written.size() );
+  transport.read( &read_back.front(), unsigned( read_back.size() ) );
+
+  check( read_back == written, TEST_NAME, "the data read back does not match the data written" );
+}
+
+
+static void test_read_timeout ( void )
+{
+  const char * const TEST_NAME = "Read timeout";
+
+  usb_async_transport transport( usb_async_create_loopback_backend( PACKET_SIZE, HEADER_LEN ), get_config() );
+
+  const uint8_t data[] = { 1, 2, 3 };
+  transport.write( data, sizeof( data ) );
+
+  // Only 3 bytes come back, so reading 4 must time out.
+  bool has_timed_out = false;
+
+  try
+  {
+    uint8_t buf[ 4 ];
+    transport.read( buf, sizeof( buf ) );
+  }
+  catch ( const std::exception & )
+  {
+    has_timed_out = true;
+  }
+
+  check( has_timed_out, TEST_NAME, "reading more data than available did not fail" );
+}
+
+
+int main ( void )
+{
+  try
+  {
+    test_interleaved_streams();
+    test_flush_then_read();
+    test_read_timeout();
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf( stderr, "Unexpected error: %s\n", e.what() );
+    return 1;
+  }
+
+  return report_test_results( "All USB loopback transport tests passed." );
+}
@@ -0,0 +1,152 @@
+/* Copyright (C) 2012 R. Diez
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+   more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks usbblaster_scan_encoder against recorded USB-Blaster command streams.
+//
+// The expected streams were recorded from the USB-Blaster driver as it was before the encoder existed,
+// which sent the byte-shift blocks and then every leftover bit with a separate USB write.
+// The concatenation of all those writes must be exactly what the encoder now builds in one go.
+//
+// The old driver split reading scans into blocks of 62 bytes instead of 63,
+// so the reading scans here are short enough to fit in a single block.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cable_drivers/usbblaster_scan_encoder.h"
+#include "test_helpers.h"
+
+
+// The stream the recordings were made with, from a simple linear congruential generator with seed 7.
+
+static const uint32_t TEST_STREAM[] =
+{
+  0xCC6C5534, 0x264E4F5D, 0x2A7450D2, 0x589295A3, 0x7F1390A0, 0x8D258459, 0x7D22A81E, 0x7C2EE8FF,
+  0x1F3116CC, 0xAAA10D15, 0x2BCD282A, 0xE313161B, 0x73BED3B8, 0xE5126591, 0x82ED9CF6, 0x0142F8F7,
+  0x37697364, 0x5C66C9CD, 0xCACE9282
+};
+
+
+static void check_encoding ( const char * const test_name,
+                             const int len_bits,
+                             const bool set_last_bit,
+                             const bool read_tdo,
+                             const bool is_clock_high,
+                             const uint8_t * const expected_commands,
+                             const unsigned expected_command_count,
+                             const bool expected_clock_high_at_the_end,
+                             usbblaster_encoded_scan * const scan )
+{
+  usbblaster_encode_scan( TEST_STREAM, len_bits, set_last_bit, read_tdo, is_clock_high, scan );
+
+  check( scan->commands.size() == expected_command_count &&
+         0 == memcmp( &scan->commands.front(), expected_commands, expected_command_count ),
+         test_name,
+         "the command bytes do not match the recorded stream" );
+
+  check( scan->is_clock_high_at_the_end == expected_clock_high_at_the_end,
+         test_name,
+         "wrong TCK state at the end" );
+
+  check( scan->byte_shift_count * 8 + scan->bit_bang_count == unsigned( len_bits ),
+         test_name,
+         "the answer layout does not cover all bits" );
+}
+
+
+static void test_write_scans ( void )
+{
+  usbblaster_encoded_scan scan;
+
+  // Too short for byte-shift mode, so every bit is bit-banged.
+  {
+    const uint8_t recorded[] = { 0x28, 0x29, 0x28, 0x29, 0x38, 0x39, 0x28, 0x29, 0x3A, 0x3B };
+
+    check_encoding( "Write 5 bits with TMS", 5, true, false, false, recorded, sizeof( recorded ), true, &scan );
+  }
+
+  // The clock must be lowered before byte-shift mode, and the last whole byte is bit-banged because of TMS.
+  {
+    const uint8_t recorded[] = { 0x28,
+                                 0x83, 0x34, 0x55, 0x6C,
+                                 0x28, 0x29, 0x28, 0x29, 0x38, 0x39, 0x38, 0x39,
+                                 0x28, 0x29, 0x28, 0x29, 0x38, 0x39, 0x3A, 0x3B };
+
+    check_encoding( "Write 32 bits with TMS", 32, true, false, true, recorded, sizeof( recorded ), true, &scan );
+  }
+
+  // 75 bytes need 2 byte-shift blocks.
+  {
+    const uint8_t recorded[] =
+    {
+      0xBF, 0x34, 0x55, 0x6C, 0xCC, 0x5D, 0x4F, 0x4E, 0x26, 0xD2, 0x50, 0x74, 0x2A, 0xA3, 0x95, 0x92,
+      0x58, 0xA0, 0x90, 0x13, 0x7F, 0x59, 0x84, 0x25, 0x8D, 0x1E, 0xA8, 0x22, 0x7D, 0xFF, 0xE8, 0x2E,
+      0x7C, 0xCC, 0x16, 0x31, 0x1F, 0x15, 0x0D, 0xA1, 0xAA, 0x2A, 0x28, 0xCD, 0x2B, 0x1B, 0x16, 0x13,
+      0xE3, 0xB8, 0xD3, 0xBE, 0x73, 0x91, 0x65, 0x12, 0xE5, 0xF6, 0x9C, 0xED, 0x82, 0xF7, 0xF8, 0x42,
+      0x8C, 0x01, 0x64, 0x73, 0x69, 0x37, 0xCD, 0xC9, 0x66, 0x5C, 0x82, 0x92, 0xCE
+    };
+
+    check_encoding( "Write 600 bits", 600, false, false, false, recorded, sizeof( recorded ), false, &scan );
+  }
+
+  // Whole bytes without TMS leave the clock low.
+  {
+    const uint8_t recorded[] = { 0x28, 0x82, 0x34, 0x55 };
+
+    check_encoding( "Write 16 bits", 16, false, false, true, recorded, sizeof( recorded ), false, &scan );
+  }
+}
+
+
+static void test_read_scan ( void )
+{
+  const char * const TEST_NAME = "Read 20 bits with TMS";
+
+  usbblaster_encoded_scan scan;
+
+  const uint8_t recorded[] = { 0x28,
+                               0xC2, 0x34, 0x55,
+                               0x28, 0x69, 0x28, 0x69, 0x38, 0x79, 0x3A, 0x7B };
+
+  check_encoding( TEST_NAME, 20, true, true, true, recorded, sizeof( recorded ), true, &scan );
+
+  check( scan.byte_shift_count == 2 && scan.bit_bang_count == 4, TEST_NAME, "wrong answer length" );
+
+  // The answer the old driver was fed during the recording, and what it made of it.
+  // Bit-bang answers may have bit 1 set too, which must be ignored.
+  const uint8_t answer[] = { 0xA5, 0x3C, 0x01, 0x00, 0x03, 0x02 };
+  uint32_t in_stream = 0xFFFFFFFF;
+
+  usbblaster_decode_scan( &scan, answer, &in_stream );
+
+  check( in_stream == 0x00053CA5, TEST_NAME, "wrong TDO bits decoded" );
+
+  // With at most 3 answer bytes, the segment must end just before the second bit-bang read.
+  unsigned answer_len;
+  const unsigned end = usbblaster_find_segment_end( &scan.commands, 0, 3, &answer_len );
+
+  check( end == 7 && answer_len == 3, TEST_NAME, "wrong segment end" );
+}
+
+
+int main ( void )
+{
+  test_write_scans();
+  test_read_scan();
+
+  return report_test_results( "All USB-Blaster scan encoder tests passed." );
+}
@@ -29,6 +29,11 @@
    as the NOP command has an opcode consisting of just zeroes. The JTAG client only has to
    keep shifting zeroes in while waiting for a lengthy DEBUG command to complete.
 
+   The burst memory commands transfer a whole block of 32-bit words without going through Update-DR
+   for each word. The data is framed on the DEBUG register with start bits, so that the JTAG client
+   can stream the frames continuously and only needs to look for the start bits afterwards.
+   See the description of DEBUG_CMD_BURST_READ_MEM and DEBUG_CMD_BURST_WRITE_MEM below.
+
    It is possible to interrupt the TAP side of those lengthy operations by leaving the
    Shift-DR state early and going through Update-DR before the operation is complete.
    However, the CPU side may take some time to realise that the client is no longer
@@ -65,6 +70,7 @@
 */
 
 `include "or10_defines.v"
+`include "or1200_defines.v"
 `include "simulator_features.v"
 
 module tap_or10
@@ -134,6 +140,24 @@ module tap_or10
 
    localparam DEBUG_CMD_READ_CPU_SPR   = 3'd3;  // Followed by 16-bits with the CPU SPR number. The result is the same as for DEBUG_CMD_WRITE_CPU_SPR.
 
+   // Opcodes 4 and 5 are reserved for test pattern commands.
+
+   localparam DEBUG_CMD_BURST_READ_MEM = 3'd6;  // Followed by 16 bits with the word count and 32 bits with the aligned start memory address.
+                                                // For each word, the result is a '1' start bit, an error bit and 32 bits of data.
+                                                // There may be any number of '0' bits between those result frames.
+                                                // The memory address is incremented by 4 after each word.
+                                                // After an error, no more result frames are delivered.
+
+   localparam DEBUG_CMD_BURST_WRITE_MEM = 3'd7; // Followed by 16 bits with the word count and 32 bits with the aligned start memory address.
+                                                // For each word, the JTAG client shifts in a '1' start bit followed by 32 bits of data.
+                                                // There may be any number of '0' bits between those data frames.
+                                                // After the last word has been written, the result is a '1' bit followed by an error bit
+                                                // and an overflow bit. The error bit is set if the write failed.
+                                                // The overflow bit is set if a data frame arrived before the previous word
+                                                // could be handed over to the CPU, which means the client needs to leave more '0' bits between frames.
+                                                // A word count of 0 only writes the start address, which is a cheap way to check
+                                                // whether the TAP supports the burst commands.
+
 
    localparam OPERATION_COMPLETE_FLAG    = 1'b1;
    localparam OPERATION_IN_PROGRESS_FLAG = 1'b0;
@@ -151,6 +175,10 @@ module tap_or10
    `define TAP_OR10_CMD_SPR_NUM 47:32
    `define TAP_OR10_CMD_SPR_VAL 31:0
 
+   // The burst commands use the same register layout: <command opcode> + <word count (16 bits)> + <start memory address (32 bits)>
+   `define TAP_OR10_CMD_BURST_WORD_COUNT 47:32
+   `define TAP_OR10_CMD_BURST_ADDR       31:0
+
    reg [SHIFT_REG_LEN-1:0] input_shift_reg;
    reg [SHIFT_REG_LEN-1:0] current_cmd;  // Latched input_shift_reg.
 
@@ -159,20 +187,76 @@ module tap_or10
    reg [OUTPUT_REG_LEN-1:0] output_shift_reg;
 
 
-   function [14*8-1:0] get_cmd_name;
+   // State for the burst memory commands.
+
+   localparam BURST_FRAME_LEN = `OR10_OPERAND_WIDTH;  // Data bits in a burst frame, without the start bit.
+
+   localparam OUTPUT_BITS_LEFT_WIDTH = 6;
+   reg [OUTPUT_BITS_LEFT_WIDTH-1:0] output_bits_left;  // How many bits of the current burst result frame in output_shift_reg
+                                                       // have not been shifted out yet.
+
+   reg [SPR_NUMBER_WIDTH-1:0]    burst_cpu_ops_left;     // Burst reads: how many memory reads have not been started yet.
+   reg [SPR_NUMBER_WIDTH-1:0]    burst_frames_left;      // Burst writes: how many data frames the JTAG client has not shifted in yet.
+   reg [`OR10_OPERAND_WIDTH-1:0] burst_addr;             // Burst reads: next memory address. Burst writes: start memory address.
+   reg                           burst_write_addr_sent;  // Burst writes: whether the start address has been written to the CPU.
+   reg                           burst_failed;
+   reg                           burst_overflow;         // Burst writes: whether the failure was a data overflow.
+   reg                           burst_status_sent;      // Burst writes: whether the final result has been shifted out.
+
+   reg                           burst_held_valid;       // Burst reads: a result frame waiting for output_shift_reg to become free.
+   reg [OUTPUT_REG_LEN-1:0]      burst_held_frame;
+
+   reg                           burst_pending_valid;    // Burst writes: a data word waiting to be handed over to the CPU.
+   reg [`OR10_OPERAND_WIDTH-1:0] burst_pending_data;
+
+   reg [OUTPUT_BITS_LEFT_WIDTH-1:0] input_bits_left;     // Burst writes: data bits of the current frame still to come, 0 if waiting for a start bit.
+   reg [`OR10_OPERAND_WIDTH-1:0]    input_word;
+
+
+   function [15*8-1:0] get_cmd_name;
       input [DEBUG_CMD_LEN-1:0] cmd_code;
       begin
          case ( cmd_code )
-           DEBUG_CMD_NOP:            get_cmd_name = "NOP";
-           DEBUG_CMD_READ_CPU_SPR:   get_cmd_name = "READ_CPU_SPR";
-           DEBUG_CMD_WRITE_CPU_SPR:  get_cmd_name = "WRITE_CPU_SPR";
-           DEBUG_CMD_IS_CPU_STALLED: get_cmd_name = "IS_CPU_STALLED";
-           default:                  get_cmd_name = "<unknown>";
+           DEBUG_CMD_NOP:             get_cmd_name = "NOP";
+           DEBUG_CMD_READ_CPU_SPR:    get_cmd_name = "READ_CPU_SPR";
+           DEBUG_CMD_WRITE_CPU_SPR:   get_cmd_name = "WRITE_CPU_SPR";
+           DEBUG_CMD_IS_CPU_STALLED:  get_cmd_name = "IS_CPU_STALLED";
+           DEBUG_CMD_BURST_READ_MEM:  get_cmd_name = "BURST_READ_MEM";
+           DEBUG_CMD_BURST_WRITE_MEM: get_cmd_name = "BURST_WRITE_MEM";
+           default:                   get_cmd_name = "<unknown>";
          endcase
       end
    endfunction
 
 
+   function is_burst_cmd;
+      input [DEBUG_CMD_LEN-1:0] cmd_code;
+      begin
+         is_burst_cmd = ( cmd_code == DEBUG_CMD_BURST_READ_MEM || cmd_code == DEBUG_CMD_BURST_WRITE_MEM );
+      end
+   endfunction
+
+
+   task automatic reset_burst_state;
+      begin
+         output_bits_left      <= 0;
+         burst_cpu_ops_left    <= 0;
+         burst_frames_left     <= 0;
+         burst_addr            <= {`OR10_OPERAND_WIDTH{1'bx}};
+         burst_write_addr_sent <= 0;
+         burst_failed          <= 0;
+         burst_overflow        <= 0;
+         burst_status_sent     <= 0;
+         burst_held_valid      <= 0;
+         burst_held_frame      <= {OUTPUT_REG_LEN{1'bx}};
+         burst_pending_valid   <= 0;
+         burst_pending_data    <= {`OR10_OPERAND_WIDTH{1'bx}};
+         input_bits_left       <= 0;
+         input_word            <= {`OR10_OPERAND_WIDTH{1'bx}};
+      end
+   endtask
+
+
    task automatic stop_cpu_transaction;
       begin
          cpu_stb_o         <= 0;
@@ -188,7 +272,7 @@ module tap_or10
       output [SHIFT_REG_LEN-1:0]   next_cmd;
       inout  [CPU_STATE_WIDTH-1:0] next_cpu_state;
 
-      reg [14*8-1:0] next_cmd_name;
+      reg [15*8-1:0] next_cmd_name;
 
       begin
          // In case there was some other operation going on, stop it now.
@@ -207,6 +291,8 @@ module tap_or10
 
          next_cmd = input_shift_reg;
 
+         reset_burst_state;
+
          case ( input_shift_reg[`TAP_OR10_CMD_OPCODE] )
            DEBUG_CMD_NOP:
              begin
@@ -227,6 +313,22 @@ module tap_or10
                 next_cpu_state = CPU_STATE_WAITING_FOR_CPU_IDLE;
              end
 
+           DEBUG_CMD_BURST_READ_MEM, DEBUG_CMD_BURST_WRITE_MEM:
+             begin
+                if ( ENABLE_TRACE )
+                  $display( "%sBurst of %0d words at memory address 0x%08h.", TRACE_PREFIX,
+                            input_shift_reg[`TAP_OR10_CMD_BURST_WORD_COUNT],
+                            input_shift_reg[`TAP_OR10_CMD_BURST_ADDR] );
+
+                output_shift_reg   <= {OUTPUT_REG_LEN{DOES_NOT_MATTER_BIT}};
+                burst_addr         <= input_shift_reg[`TAP_OR10_CMD_BURST_ADDR];
+                burst_cpu_ops_left <= ( input_shift_reg[`TAP_OR10_CMD_OPCODE] == DEBUG_CMD_BURST_READ_MEM  ) ? input_shift_reg[`TAP_OR10_CMD_BURST_WORD_COUNT] : 0;
+                burst_frames_left  <= ( input_shift_reg[`TAP_OR10_CMD_OPCODE] == DEBUG_CMD_BURST_WRITE_MEM ) ? input_shift_reg[`TAP_OR10_CMD_BURST_WORD_COUNT] : 0;
+
+                // The CPU operations are started by step_state_machine_tick.
+                next_cpu_state = CPU_STATE_IDLE;
+             end
+
            default:
              begin
                 `ASSERT_FALSE;
@@ -242,9 +344,16 @@ module tap_or10
 
    task automatic step_state_machine_shift;
 
+      input  [SHIFT_REG_LEN-1:0]       next_cmd;
+      output                           input_word_complete;
+      output [`OR10_OPERAND_WIDTH-1:0] input_word_value;
+
       reg [SHIFT_REG_LEN-1:0] new_shift_reg_val;
 
       begin
+         input_word_complete = 0;
+         input_word_value    = { jtag_tdi_i, input_word[`OR10_OPERAND_WIDTH-1:1] };
+
          // ------ Shift one bit in ------
 
          // The input side of the Debug Register is not connected to the output,
@@ -261,31 +370,95 @@ module tap_or10
          input_shift_reg <= new_shift_reg_val;
 
 
+         // ------ Collect the burst write data frames ------
+
+         if ( next_cmd[`TAP_OR10_CMD_OPCODE] == DEBUG_CMD_BURST_WRITE_MEM )
+           begin
+              if ( input_bits_left == 0 )
+                begin
+                   if ( jtag_tdi_i && burst_frames_left != 0 )
+                     input_bits_left <= BURST_FRAME_LEN;
+                end
+              else
+                begin
+                   input_word      <= input_word_value;
+                   input_bits_left <= input_bits_left - 1'b1;
+
+                   if ( input_bits_left == 1 )
+                     input_word_complete = 1;
+                end
+           end
+
+
          // ------ Shift one bit out ------
          // Always shift, although for most commandos there is no need to shift anything.
          output_shift_reg <= { DOES_NOT_MATTER_BIT, output_shift_reg[OUTPUT_REG_LEN-1:1] };
+
+         if ( output_bits_left != 0 )
+           output_bits_left <= output_bits_left - 1'b1;
       end
    endtask
 
 
    task automatic step_state_machine_tick;
 
-      input [SHIFT_REG_LEN-1:0]   next_cmd;
-      inout [CPU_STATE_WIDTH-1:0] next_cpu_state;
+      input [SHIFT_REG_LEN-1:0]       next_cmd;
+      inout [CPU_STATE_WIDTH-1:0]     next_cpu_state;
+      input                           input_word_complete;
+      input [`OR10_OPERAND_WIDTH-1:0] input_word_value;
 
       reg [SPR_NUMBER_WIDTH-1:0]  combined_spr_number;
 
+      reg                         is_burst;
+      reg                         is_output_free;
+      reg                         next_pending_valid;
+      reg                         next_failed;
+      reg [OUTPUT_REG_LEN-1:0]    result_frame;
+
       begin
+         is_burst = is_burst_cmd( next_cmd[`TAP_OR10_CMD_OPCODE] );
+
+         // Whether output_shift_reg can take a new burst result frame at the end of this clock cycle.
+         is_output_free = ( output_bits_left == 0 ) || ( output_bits_left == 1 && is_tap_state_shift_dr_i );
+
+         next_pending_valid = burst_pending_valid;
+         next_failed        = burst_failed;
+
+         // A burst read result frame that had to wait goes out first.
+         // During Update-DR, the burst state is being reset, so it must be left alone here.
+         if ( burst_held_valid && is_output_free && !is_tap_state_update_dr_i )
+           begin
+              output_shift_reg <= burst_held_frame;
+              output_bits_left <= OUTPUT_REG_LEN;
+              burst_held_valid <= 0;
+              is_output_free = 0;
+           end
 
          case ( next_cpu_state )
            CPU_STATE_IDLE:
              begin
-                // Nothing to do here.
+                // Start the next burst operation, if any.
+                if ( is_burst && !is_tap_state_update_dr_i && !next_failed )
+                  begin
+                     if ( next_cmd[`TAP_OR10_CMD_OPCODE] == DEBUG_CMD_BURST_READ_MEM )
+                       begin
+                          if ( burst_cpu_ops_left != 0 && !burst_held_valid )
+                            begin
+                               burst_cpu_ops_left <= burst_cpu_ops_left - 1'b1;
+                               next_cpu_state = CPU_STATE_WAITING_FOR_CPU_IDLE;
+                            end
+                       end
+                     else if ( !burst_write_addr_sent || burst_pending_valid )
+                       begin
+                          next_cpu_state = CPU_STATE_WAITING_FOR_CPU_IDLE;
+                       end
+                  end
              end
 
            CPU_STATE_WAITING_FOR_CPU_IDLE:
              begin
-                output_shift_reg <= { {OUTPUT_REG_LEN-1{DOES_NOT_MATTER_BIT}}, OPERATION_IN_PROGRESS_FLAG };
+                if ( !is_burst )
+                  output_shift_reg <= { {OUTPUT_REG_LEN-1{DOES_NOT_MATTER_BIT}}, OPERATION_IN_PROGRESS_FLAG };
 
                 // Do not start the next operation until the CPU has gone back to the idle state.
                 // Otherwise, we may issue the next debug interface transaction
@@ -294,36 +467,65 @@ module tap_or10
                   begin
                      combined_spr_number = next_cmd[`TAP_OR10_CMD_SPR_NUM];
 
-                     if ( next_cmd[`TAP_OR10_CMD_OPCODE] == DEBUG_CMD_READ_CPU_SPR )
-                       begin
-                          if ( ENABLE_TRACE )
-                            $display( "%sReading from SPR group %0d, register %0d...",
-                                      TRACE_PREFIX,
-                                      combined_spr_number[`OR10_SPR_GRP_NUMBER],
-                                      combined_spr_number[`OR10_SPR_REG_NUMBER] );
-
-                          cpu_spr_number_o  <= next_cmd[`TAP_OR10_CMD_SPR_NUM];
-                          cpu_data_o        <= {`OR10_OPERAND_WIDTH{1'bx}};
-                          cpu_we_o          <= 0;
-                       end
-                     else
-                       begin
-                          if ( next_cmd[`TAP_OR10_CMD_OPCODE] != DEBUG_CMD_WRITE_CPU_SPR )
-                            begin
-                               `ASSERT_FALSE;
-                            end
-
-                          if ( ENABLE_TRACE )
-                            $display( "%sWriting to SPR group %0d, register %0d, data 0x%08h.",
-                                      TRACE_PREFIX,
-                                      combined_spr_number[`OR10_SPR_GRP_NUMBER],
-                                      combined_spr_number[`OR10_SPR_REG_NUMBER],
-                                      next_cmd[`TAP_OR10_CMD_SPR_VAL] );
-
-                          cpu_spr_number_o  <= next_cmd[`TAP_OR10_CMD_SPR_NUM];
-                          cpu_data_o        <= next_cmd[`TAP_OR10_CMD_SPR_VAL];
-                          cpu_we_o          <= 1;
-                       end
+                     case ( next_cmd[`TAP_OR10_CMD_OPCODE] )
+                       DEBUG_CMD_READ_CPU_SPR:
+                         begin
+                            if ( ENABLE_TRACE )
+                              $display( "%sReading from SPR group %0d, register %0d...",
+                                        TRACE_PREFIX,
+                                        combined_spr_number[`OR10_SPR_GRP_NUMBER],
+                                        combined_spr_number[`OR10_SPR_REG_NUMBER] );
+
+                            cpu_spr_number_o  <= next_cmd[`TAP_OR10_CMD_SPR_NUM];
+                            cpu_data_o        <= {`OR10_OPERAND_WIDTH{1'bx}};
+                            cpu_we_o          <= 0;
+                         end
+
+                       DEBUG_CMD_WRITE_CPU_SPR:
+                         begin
+                            if ( ENABLE_TRACE )
+                              $display( "%sWriting to SPR group %0d, register %0d, data 0x%08h.",
+                                        TRACE_PREFIX,
+                                        combined_spr_number[`OR10_SPR_GRP_NUMBER],
+                                        combined_spr_number[`OR10_SPR_REG_NUMBER],
+                                        next_cmd[`TAP_OR10_CMD_SPR_VAL] );
+
+                            cpu_spr_number_o  <= next_cmd[`TAP_OR10_CMD_SPR_NUM];
+                            cpu_data_o        <= next_cmd[`TAP_OR10_CMD_SPR_VAL];
+                            cpu_we_o          <= 1;
+                         end
+
+                       DEBUG_CMD_BURST_READ_MEM:
+                         begin
+                            // Writing the address to this SPR reads the memory contents back.
+                            cpu_spr_number_o  <= { `OR1200_SPR_GROUP_DU, `OR1200_DU_READ_MEM_ADDR };
+                            cpu_data_o        <= burst_addr;
+                            cpu_we_o          <= 1;
+                         end
+
+                       DEBUG_CMD_BURST_WRITE_MEM:
+                         begin
+                            if ( !burst_write_addr_sent )
+                              begin
+                                 cpu_spr_number_o  <= { `OR1200_SPR_GROUP_DU, `OR1200_DU_WRITE_MEM_ADDR };
+                                 cpu_data_o        <= burst_addr;
+                              end
+                            else
+                              begin
+                                 // The CPU increments the write address after each data word.
+                                 cpu_spr_number_o  <= { `OR1200_SPR_GROUP_DU, `OR1200_DU_WRITE_MEM_DATA };
+                                 cpu_data_o        <= burst_pending_data;
+                                 next_pending_valid = 0;
+                              end
+
+                            cpu_we_o          <= 1;
+                         end
+
+                       default:
+                         begin
+                            `ASSERT_FALSE;
+                         end
+                     endcase
 
                      next_cpu_state = CPU_STATE_DATA_WRITTEN;
                   end
@@ -331,18 +533,59 @@ module tap_or10
 
            CPU_STATE_DATA_WRITTEN:
              begin
-                output_shift_reg <= { {OUTPUT_REG_LEN-1{DOES_NOT_MATTER_BIT}}, OPERATION_IN_PROGRESS_FLAG };
+                if ( !is_burst )
+                  output_shift_reg <= { {OUTPUT_REG_LEN-1{DOES_NOT_MATTER_BIT}}, OPERATION_IN_PROGRESS_FLAG };
+
                 cpu_stb_o <= 1;
                 next_cpu_state = CPU_STATE_WAITING_FOR_ACK;
              end
 
            CPU_STATE_WAITING_FOR_ACK:
              begin
-                output_shift_reg <= { {OUTPUT_REG_LEN-1{DOES_NOT_MATTER_BIT}}, OPERATION_IN_PROGRESS_FLAG };
+                if ( !is_burst )
+                  output_shift_reg <= { {OUTPUT_REG_LEN-1{DOES_NOT_MATTER_BIT}}, OPERATION_IN_PROGRESS_FLAG };
 
                 if ( synchronised_cpu_ack_i )
                   begin
-                     if ( cpu_err_i )
+                     if ( is_burst )
+                       begin
+                          if ( cpu_err_i )
+                            begin
+                               if ( ENABLE_TRACE )
+                                 $display( "%sThe CPU dbg interface answered with error during a burst.", TRACE_PREFIX );
+
+                               next_failed = 1;
+                            end
+
+                          if ( next_cmd[`TAP_OR10_CMD_OPCODE] == DEBUG_CMD_BURST_READ_MEM )
+                            begin
+                               if ( cpu_err_i )
+                                 result_frame = { {`OR10_OPERAND_WIDTH{DOES_NOT_MATTER_BIT}}, OPERATION_FAILED_FLAG, OPERATION_COMPLETE_FLAG };
+                               else
+                                 result_frame = { cpu_data_i, OPERATION_SUCCEEDED_FLAG, OPERATION_COMPLETE_FLAG };
+
+                               // The next read does not start until any held frame has gone out,
+                               // so there is always room here.
+                               if ( is_output_free )
+                                 begin
+                                    output_shift_reg <= result_frame;
+                                    output_bits_left <= OUTPUT_REG_LEN;
+                                    is_output_free = 0;
+                                 end
+                               else
+                                 begin
+                                    burst_held_frame <= result_frame;
+                                    burst_held_valid <= 1;
+                                 end
+
+                               burst_addr <= burst_addr + 3'd4;
+                            end
+                          else
+                            begin
+                               burst_write_addr_sent <= 1;
+                            end
+                       end
+                     else if ( cpu_err_i )
                        begin
                           if ( ENABLE_TRACE )
                             $display( "%sThe CPU dbg interface answered with error.", TRACE_PREFIX );
@@ -391,6 +634,58 @@ module tap_or10
                 `ASSERT_FALSE;
              end
          endcase
+
+
+         if ( next_cmd[`TAP_OR10_CMD_OPCODE] == DEBUG_CMD_BURST_WRITE_MEM && !is_tap_state_update_dr_i )
+           begin
+              // A data word is complete. If the previous one has not been handed over
+              // to the CPU yet, the JTAG client is shifting the data in too fast.
+              if ( input_word_complete )
+                begin
+                   burst_frames_left <= burst_frames_left - 1'b1;
+
+                   if ( next_pending_valid )
+                     begin
+                        if ( ENABLE_TRACE )
+                          $display( "%sBurst write data overflow.", TRACE_PREFIX );
+
+                        next_failed = 1;
+                        burst_overflow <= 1;
+                     end
+                   else if ( !next_failed )
+                     begin
+                        next_pending_valid = 1;
+                        burst_pending_data <= input_word_value;
+                     end
+                end
+
+              // After a failure, any further data words are discarded.
+              if ( next_failed )
+                next_pending_valid = 0;
+
+              // Once all data words have been received and written, deliver the final result.
+              if ( burst_frames_left == 0 &&
+                   !input_word_complete &&
+                   !next_pending_valid &&
+                   next_cpu_state == CPU_STATE_IDLE &&
+                   ( burst_write_addr_sent || next_failed ) &&
+                   !burst_status_sent &&
+                   is_output_free )
+                begin
+                   output_shift_reg  <= { {`OR10_OPERAND_WIDTH-1{DOES_NOT_MATTER_BIT}},
+                                          burst_overflow,
+                                          next_failed ? OPERATION_FAILED_FLAG : OPERATION_SUCCEEDED_FLAG,
+                                          OPERATION_COMPLETE_FLAG };
+                   output_bits_left  <= 3;
+                   burst_status_sent <= 1;
+                end
+           end
+
+         if ( !is_tap_state_update_dr_i )
+           begin
+              burst_pending_valid <= next_pending_valid;
+              burst_failed        <= next_failed;
+           end
       end
    endtask
 
@@ -428,19 +723,25 @@ module tap_or10
       reg [SHIFT_REG_LEN-1:0]   next_cmd;
       reg [CPU_STATE_WIDTH-1:0] next_cpu_state;
 
+      reg                           input_word_complete;
+      reg [`OR10_OPERAND_WIDTH-1:0] input_word_value;
+
       begin
          next_cmd       = current_cmd;
          next_cpu_state = current_cpu_state;
 
+         input_word_complete = 0;
+         input_word_value    = {`OR10_OPERAND_WIDTH{1'bx}};
+
          // This can start and complete a short debug operation, or start a lengthy one.
          if ( is_tap_state_update_dr_i )
            step_state_machine_update( next_cmd, next_cpu_state );
 
          if ( is_tap_state_shift_dr_i )
-           step_state_machine_shift;
+           step_state_machine_shift( next_cmd, input_word_complete, input_word_value );
 
          // When a lengthy debug operation finishes, this will write to the output register the results.
-         step_state_machine_tick( next_cmd, next_cpu_state );
+         step_state_machine_tick( next_cmd, next_cpu_state, input_word_complete, input_word_value );
 
          current_cmd       <= next_cmd;
          current_cpu_state <= next_cpu_state;
@@ -454,6 +755,22 @@ module tap_or10
         input_shift_reg    = {SHIFT_REG_LEN{1'bx}};
         current_cmd        = {SHIFT_REG_LEN{1'bx}};
 
+        // The following code corresponds to reset_burst_state:
+        output_bits_left      = 0;
+        burst_cpu_ops_left    = 0;
+        burst_frames_left     = 0;
+        burst_addr            = {`OR10_OPERAND_WIDTH{1'bx}};
+        burst_write_addr_sent = 0;
+        burst_failed          = 0;
+        burst_overflow        = 0;
+        burst_status_sent     = 0;
+        burst_held_valid      = 0;
+        burst_held_frame      = {OUTPUT_REG_LEN{1'bx}};
+        burst_pending_valid   = 0;
+        burst_pending_data    = {`OR10_OPERAND_WIDTH{1'bx}};
+        input_bits_left       = 0;
+        input_word            = {`OR10_OPERAND_WIDTH{1'bx}};
+
         // The following code corresponds to stop_cpu_transaction:
         cpu_stb_o         = 0;
         cpu_spr_number_o  = {SPR_NUMBER_WIDTH{1'bx}};
@@ -475,6 +792,7 @@ module tap_or10
              current_cmd       <= {SHIFT_REG_LEN{1'bx}};
 
              stop_cpu_transaction;
+             reset_burst_state;
           end
         else
           step_state_machine;
@@ -0,0 +1,86 @@
+/* JTAG server for the simulation, it lets the GDB-to-JTAG bridge drive the JTAG pins
+   over a shared memory file, see cable 'rtl_sim' option -m in the bridge.
+
+   Under Verilator, this module uses the DPI functions in jtag_shm_server.cpp .
+   Under Icarus Verilog, it uses the system tasks that the same file registers
+   when compiled as a VPI module.
+
+   Copyright (C) 2012, R. Diez
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License version 3
+   as published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License version 3 for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+`include "simulator_features.v"
+
+
+module jtag_shm_dpi
+  #( parameter FILE_NAME = "jtag_shm.bin",
+     parameter TICKS_PER_HALF_TCK = 2 )  // Number of system_clk cycles TCK stays low and high.
+   ( input wire  system_clk,
+     output wire jtag_tms_o,
+     output wire jtag_tck_o,
+     output wire jtag_trst_o,
+     output wire jtag_tdi_o,
+     input  wire jtag_tdo_i );
+
+   `ifndef __ICARUS__
+
+   import "DPI-C" function void jtag_shm_dpi_init ( input string file_name,
+                                                    input int    ticks_per_half_tck );
+
+   import "DPI-C" function void jtag_shm_dpi_tick ( output bit jtag_tms,
+                                                    output bit jtag_tck,
+                                                    output bit jtag_trst,
+                                                    output bit jtag_tdi,
+                                                    input  bit jtag_tdo );
+
+   import "DPI-C" function void jtag_shm_dpi_terminate ();
+
+   `endif
+
+   reg tms  = 0;
+   reg tck  = 0;
+   reg trst = 1;  // TRST is active low.
+   reg tdi  = 0;
+
+   assign jtag_tms_o  = tms;
+   assign jtag_tck_o  = tck;
+   assign jtag_trst_o = trst;
+   assign jtag_tdi_o  = tdi;
+
+   initial
+     begin
+        `ifdef __ICARUS__
+          $jtag_shm_init( FILE_NAME, TICKS_PER_HALF_TCK );
+        `else
+          jtag_shm_dpi_init( FILE_NAME, TICKS_PER_HALF_TCK );
+        `endif
+     end
+
+   always @( posedge system_clk )
+     begin
+        `ifdef __ICARUS__
+          $jtag_shm_tick( tms, tck, trst, tdi, jtag_tdo_i );
+        `else
+          jtag_shm_dpi_tick( tms, tck, trst, tdi, jtag_tdo_i );
+        `endif
+     end
+
+   `ifdef SUPPORTS_FINAL
+     final
+       begin
+          jtag_shm_dpi_terminate();
+       end
+   `endif
+
+endmodule
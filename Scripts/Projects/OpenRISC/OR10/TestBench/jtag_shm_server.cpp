@@ -0,0 +1,358 @@
+// Copyright (c) 2012, R. Diez
+
+// Simulation-side counterpart of the GDB-to-JTAG bridge's 'rtl_sim' cable in shared-memory mode
+// (cable option -m), see jtag_shm_dpi.v and the bridge's jtag_shm_ring.h .
+//
+// The bridge creates the shared memory file, so this server keeps trying to open it until it appears.
+// Afterwards, it executes one command from the ring on every TCK half period.
+//
+// Verilator calls the DPI functions directly. For Icarus Verilog, compile this file as a VPI module
+// with symbol JTAG_SHM_VPI defined, which registers system tasks $jtag_shm_init and $jtag_shm_tick instead:
+//   iverilog-vpi -DJTAG_SHM_VPI -I<bridge>/src/cable_drivers jtag_shm_server.cpp
+//   vvp -M. -mjtag_shm_server <simulation>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "jtag_shm_ring.h"
+
+
+// Trying to open the file on every clock tick would slow the simulation down considerably.
+static const unsigned OPEN_RETRY_INTERVAL = 100000;
+
+
+static std::string format_errno ( const int errno_code, const char * const prefix )
+{
+  std::string msg( prefix );
+  msg += strerror( errno_code );
+  return msg;
+}
+
+
+class jtag_shm_server
+{
+public:
+  jtag_shm_server ( const char * file_name, unsigned ticks_per_half_tck );
+  ~jtag_shm_server ( void );
+
+  // Returns the new pin states, see the JTAG_SHM_PIN_xxx constants.
+  uint8_t tick ( bool tdo );
+
+private:
+  const std::string m_file_name;
+  const unsigned m_ticks_per_half_tck;
+
+  jtag_shm_layout * m_shm;
+  uint32_t m_session;
+  uint32_t m_cmd_tail;
+  uint32_t m_rsp_head;
+
+  uint8_t m_pins;
+  unsigned m_delay;  // Clock ticks before the next command.
+  unsigned m_open_countdown;
+
+  void try_to_open ( void );
+};
+
+
+jtag_shm_server::jtag_shm_server ( const char * const file_name, const unsigned ticks_per_half_tck )
+  : m_file_name( file_name )
+  , m_ticks_per_half_tck( ticks_per_half_tck )
+  , m_shm( NULL )
+  , m_session( 0 )
+  , m_cmd_tail( 0 )
+  , m_rsp_head( 0 )
+  , m_pins( JTAG_SHM_PIN_TRST )
+  , m_delay( 0 )
+  , m_open_countdown( 0 )
+{
+  if ( ticks_per_half_tck == 0 )
+    throw std::runtime_error( "The number of clock ticks per half TCK period must be at least 1." );
+
+  printf( "JTAG shared memory server waiting for file \"%s\".\n", file_name );
+}
+
+
+jtag_shm_server::~jtag_shm_server ( void )
+{
+  if ( m_shm != NULL )
+    munmap( m_shm, sizeof( jtag_shm_layout ) );
+}
+
+
+void jtag_shm_server::try_to_open ( void )
+{
+  const int fd = open( m_file_name.c_str(), O_RDWR );
+
+  if ( fd == -1 )
+  {
+    if ( errno == ENOENT )
+      return;
+
+    throw std::runtime_error( format_errno( errno, "Cannot open the JTAG shared memory file: " ) );
+  }
+
+  struct stat file_info;
+
+  if ( 0 != fstat( fd, &file_info ) )
+  {
+    const int saved_errno = errno;
+    close( fd );
+    throw std::runtime_error( format_errno( saved_errno, "Cannot get the size of the JTAG shared memory file: " ) );
+  }
+
+  // The bridge may not have finished setting the file up yet.
+  if ( size_t( file_info.st_size ) < sizeof( jtag_shm_layout ) )
+  {
+    close( fd );
+    return;
+  }
+
+  void * const addr = mmap( NULL, sizeof( jtag_shm_layout ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  const int mmap_errno = errno;
+
+  close( fd );
+
+  if ( addr == MAP_FAILED )
+    throw std::runtime_error( format_errno( mmap_errno, "Cannot map the JTAG shared memory file: " ) );
+
+  m_shm = static_cast< jtag_shm_layout * >( addr );
+  m_session = 0;  // The session numbers start at 1, so the first tick resynchronises.
+
+  printf( "JTAG shared memory file mapped.\n" );
+}
+
+
+uint8_t jtag_shm_server::tick ( const bool tdo )
+{
+  if ( m_delay > 0 )
+  {
+    --m_delay;
+    return m_pins;
+  }
+
+  if ( m_shm == NULL )
+  {
+    if ( m_open_countdown == 0 )
+    {
+      m_open_countdown = OPEN_RETRY_INTERVAL;
+      try_to_open();
+    }
+    else
+    {
+      --m_open_countdown;
+    }
+
+    return m_pins;
+  }
+
+  if ( jtag_shm_load( &m_shm->magic ) != JTAG_SHM_MAGIC )
+    return m_pins;
+
+  const uint32_t session = jtag_shm_load( &m_shm->session );
+
+  if ( session != m_session )
+  {
+    if ( m_shm->version != JTAG_SHM_VERSION )
+      throw std::runtime_error( "The JTAG shared memory file has an unsupported version." );
+
+    m_session  = session;
+    m_cmd_tail = jtag_shm_load( &m_shm->cmd_tail.value );
+    m_rsp_head = jtag_shm_load( &m_shm->rsp_head.value );
+    m_pins     = JTAG_SHM_PIN_TRST;
+
+    printf( "JTAG client connected over shared memory.\n" );
+  }
+
+  // This is just a load from memory, which is cheap enough to do on every clock tick.
+  if ( jtag_shm_load( &m_shm->cmd_head.value ) == m_cmd_tail )
+    return m_pins;
+
+  const uint8_t cmd = m_shm->cmd_ring[ m_cmd_tail % JTAG_SHM_CMD_RING_SIZE ];
+
+  if ( cmd & JTAG_SHM_CMD_READ_TDO )
+  {
+    m_shm->rsp_ring[ m_rsp_head % JTAG_SHM_RSP_RING_SIZE ] = tdo ? 1 : 0;
+    ++m_rsp_head;
+    jtag_shm_publish( &m_shm->rsp_head, m_rsp_head );
+  }
+
+  m_pins = cmd & JTAG_SHM_PIN_MASK;
+
+  ++m_cmd_tail;
+  jtag_shm_publish( &m_shm->cmd_tail, m_cmd_tail );
+
+  m_delay = m_ticks_per_half_tck - 1;
+
+  return m_pins;
+}
+
+
+static jtag_shm_server * s_server = NULL;
+
+
+static void init_server ( const char * const file_name, const int ticks_per_half_tck )
+{
+  if ( s_server != NULL )
+    throw std::runtime_error( "Only one instance of the JTAG shared memory server is supported." );
+
+  s_server = new jtag_shm_server( file_name, unsigned( ticks_per_half_tck ) );
+}
+
+
+#ifndef JTAG_SHM_VPI
+
+#include "svdpi.h"
+
+extern "C" void jtag_shm_dpi_init ( const char * const file_name, const int ticks_per_half_tck )
+{
+  init_server( file_name, ticks_per_half_tck );
+}
+
+
+extern "C" void jtag_shm_dpi_tick ( svBit * const jtag_tms,
+                                    svBit * const jtag_tck,
+                                    svBit * const jtag_trst,
+                                    svBit * const jtag_tdi,
+                                    const svBit jtag_tdo )
+{
+  const uint8_t pins = s_server->tick( jtag_tdo != 0 );
+
+  *jtag_tms  = ( pins & JTAG_SHM_PIN_TMS  ) ? 1 : 0;
+  *jtag_tck  = ( pins & JTAG_SHM_PIN_TCK  ) ? 1 : 0;
+  *jtag_trst = ( pins & JTAG_SHM_PIN_TRST ) ? 1 : 0;
+  *jtag_tdi  = ( pins & JTAG_SHM_PIN_TDI  ) ? 1 : 0;
+}
+
+
+extern "C" void jtag_shm_dpi_terminate ( void )
+{
+  delete s_server;
+  s_server = NULL;
+}
+
+#else  // #ifndef JTAG_SHM_VPI
+
+#include "vpi_user.h"
+
+
+static void put_scalar ( const vpiHandle arg, const bool value )
+{
+  s_vpi_value v;
+  v.format = vpiScalarVal;
+  v.value.scalar = value ? vpi1 : vpi0;
+  vpi_put_value( arg, &v, NULL, vpiNoDelay );
+}
+
+
+// $jtag_shm_init( file_name, ticks_per_half_tck );
+
+static PLI_INT32 jtag_shm_vpi_init_calltf ( PLI_BYTE8 * )
+{
+  const vpiHandle call = vpi_handle( vpiSysTfCall, NULL );
+  const vpiHandle args = vpi_iterate( vpiArgument, call );
+
+  const vpiHandle file_name_arg = vpi_scan( args );
+  const vpiHandle ticks_arg     = vpi_scan( args );
+  vpi_free_object( args );
+
+  s_vpi_value v;
+
+  v.format = vpiStringVal;
+  vpi_get_value( file_name_arg, &v );
+  const std::string file_name( v.value.str );
+
+  v.format = vpiIntVal;
+  vpi_get_value( ticks_arg, &v );
+
+  try
+  {
+    init_server( file_name.c_str(), v.value.integer );
+  }
+  catch ( const std::exception & e )
+  {
+    vpi_printf( "ERROR: %s\n", e.what() );
+    vpi_control( vpiFinish, 1 );
+  }
+
+  return 0;
+}
+
+
+// $jtag_shm_tick( tms, tck, trst, tdi, tdo );
+
+static PLI_INT32 jtag_shm_vpi_tick_calltf ( PLI_BYTE8 * )
+{
+  const vpiHandle call = vpi_handle( vpiSysTfCall, NULL );
+  const vpiHandle args = vpi_iterate( vpiArgument, call );
+
+  const vpiHandle tms_arg  = vpi_scan( args );
+  const vpiHandle tck_arg  = vpi_scan( args );
+  const vpiHandle trst_arg = vpi_scan( args );
+  const vpiHandle tdi_arg  = vpi_scan( args );
+  const vpiHandle tdo_arg  = vpi_scan( args );
+  vpi_free_object( args );
+
+  s_vpi_value v;
+  v.format = vpiScalarVal;
+  vpi_get_value( tdo_arg, &v );
+
+  try
+  {
+    const uint8_t pins = s_server->tick( v.value.scalar == vpi1 );
+
+    put_scalar( tms_arg,  ( pins & JTAG_SHM_PIN_TMS  ) != 0 );
+    put_scalar( tck_arg,  ( pins & JTAG_SHM_PIN_TCK  ) != 0 );
+    put_scalar( trst_arg, ( pins & JTAG_SHM_PIN_TRST ) != 0 );
+    put_scalar( tdi_arg,  ( pins & JTAG_SHM_PIN_TDI  ) != 0 );
+  }
+  catch ( const std::exception & e )
+  {
+    vpi_printf( "ERROR: %s\n", e.what() );
+    vpi_control( vpiFinish, 1 );
+  }
+
+  return 0;
+}
+
+
+static void register_system_task ( const char * const name, PLI_INT32 (* const calltf)( PLI_BYTE8 * ) )
+{
+  s_vpi_systf_data tf;
+  memset( &tf, 0, sizeof( tf ) );
+
+  tf.type   = vpiSysTask;
+  tf.tfname = const_cast< PLI_BYTE8 * >( name );
+  tf.calltf = calltf;
+
+  vpi_register_systf( &tf );
+}
+
+
+static void jtag_shm_vpi_register ( void )
+{
+  register_system_task( "$jtag_shm_init", jtag_shm_vpi_init_calltf );
+  register_system_task( "$jtag_shm_tick", jtag_shm_vpi_tick_calltf );
+}
+
+
+extern "C"
+{
+  void (* vlog_startup_routines[] )( void ) =
+  {
+    jtag_shm_vpi_register,
+    NULL
+  };
+}
+
+#endif  // #ifndef JTAG_SHM_VPI
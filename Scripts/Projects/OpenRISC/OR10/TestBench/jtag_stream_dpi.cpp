@@ -0,0 +1,494 @@
+// Copyright (c) 2012, R. Diez
+
+// Simulation-side JTAG server for the GDB-to-JTAG bridge, see jtag_stream_dpi.v .
+//
+// Two protocols are supported on the same connection:
+//
+// 1) The per-bit protocol, like the jtag_dpi module:
+//    - A byte below 0x80 sets the JTAG pins (see the PIN_xxx constants)
+//      and gets acknowledged with the same byte ORed with 0x10.
+//    - 0x80 asks for the current TDO value, the answer is 0 or 1.
+//    - 0x81 waits for half a TCK period, the answer is 0xFF.
+//    That means several socket round trips for every single TCK cycle.
+//
+// 2) The stream protocol, where a single frame carries many bits:
+//    - 0x82, flags, 16-bit bit count (little endian), TDI bits, TMS bits.
+//      The TDI and TMS bits are packed LSB first, each padded to a whole byte.
+//    - For each bit, TCK goes low with the given TDI and TMS values, and then high again.
+//      TDO is sampled just before the rising edge.
+//    - If flag 0x01 is set, the answer is the TDO bits, packed like the TDI bits.
+//      Otherwise, there is no answer at all, so that the client can send many frames
+//      without waiting for each one of them.
+//    TRST is not affected by the stream frames.
+//
+// Old clients only know about the per-bit protocol. In order to tell new clients that the stream protocol
+// is available, this server sends a short banner as soon as it accepts a connection.
+// Old clients start by setting the pins, and they skip the banner while waiting for the first acknowledge,
+// because no banner byte looks like one.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "svdpi.h"
+
+
+static const uint8_t PIN_TCK  = 0x01;
+static const uint8_t PIN_TRST = 0x02;
+static const uint8_t PIN_TDI  = 0x04;
+static const uint8_t PIN_TMS  = 0x08;
+static const uint8_t PIN_ACK  = 0x10;
+
+static const uint8_t CMD_READ_TDO = 0x80;
+static const uint8_t CMD_WAIT     = 0x81;
+static const uint8_t CMD_STREAM   = 0x82;
+
+static const uint8_t WAIT_ANSWER = 0xFF;
+
+static const uint8_t STREAM_FLAG_READ_TDO = 0x01;
+static const unsigned STREAM_HEADER_LEN = 4;
+
+// These values must match the ones in the bridge's cable_simulation_over_tcp_socket.cpp .
+static const uint8_t STREAM_BANNER[] = { 0xA5, 'J', 'S', 0x01 };
+
+// Reading the socket on every clock tick slows the simulation down considerably.
+// Therefore, after a while without any data, the socket is only read every so many ticks.
+static const unsigned ACTIVE_POLL_TICKS  = 10000;
+static const unsigned IDLE_POLL_INTERVAL = 64;
+
+
+static std::string format_errno ( const int errno_code, const char * const prefix )
+{
+  std::string msg( prefix );
+  msg += strerror( errno_code );
+  return msg;
+}
+
+
+class jtag_stream_server
+{
+public:
+  jtag_stream_server ( int tcp_port, unsigned ticks_per_half_tck );
+  ~jtag_stream_server ( void );
+
+  void tick ( svBit * tms, svBit * tck, svBit * trst, svBit * tdi, svBit tdo );
+
+private:
+  int m_listen_socket;
+  int m_client_socket;
+  const unsigned m_ticks_per_half_tck;
+
+  uint8_t m_pins;
+
+  std::vector< uint8_t > m_rx_buffer;
+  size_t m_rx_pos;
+  bool m_is_command_incomplete;
+  unsigned m_idle_ticks;     // Saturates at ACTIVE_POLL_TICKS.
+  unsigned m_poll_countdown;
+
+  // Delay before the next step, in clock ticks.
+  unsigned m_delay;
+  bool m_answer_wait_after_delay;
+
+  // The stream frame being executed.
+  bool m_is_streaming;
+  bool m_stream_read_tdo;
+  unsigned m_stream_bit_count;
+  unsigned m_stream_bit_index;
+  bool m_stream_tck_is_low;
+  std::vector< uint8_t > m_stream_tdi;
+  std::vector< uint8_t > m_stream_tms;
+  std::vector< uint8_t > m_stream_tdo;
+
+  void accept_connection ( void );
+  void close_connection ( const char * reason );
+  void receive_data ( void );
+  void send_data ( const uint8_t * data, size_t len );
+  void process_next_command ( svBit tdo );
+  void step_stream ( svBit tdo );
+};
+
+
+jtag_stream_server::jtag_stream_server ( const int tcp_port, const unsigned ticks_per_half_tck )
+  : m_listen_socket( -1 )
+  , m_client_socket( -1 )
+  , m_ticks_per_half_tck( ticks_per_half_tck )
+  , m_pins( PIN_TRST )
+  , m_rx_pos( 0 )
+  , m_is_command_incomplete( false )
+  , m_idle_ticks( 0 )
+  , m_poll_countdown( 0 )
+  , m_delay( 0 )
+  , m_answer_wait_after_delay( false )
+  , m_is_streaming( false )
+  , m_stream_read_tdo( false )
+  , m_stream_bit_count( 0 )
+  , m_stream_bit_index( 0 )
+  , m_stream_tck_is_low( false )
+{
+  if ( ticks_per_half_tck == 0 )
+    throw std::runtime_error( "The number of clock ticks per half TCK period must be at least 1." );
+
+  m_listen_socket = socket( PF_INET, SOCK_STREAM, 0 );
+
+  if ( m_listen_socket == -1 )
+    throw std::runtime_error( format_errno( errno, "Cannot create the JTAG server socket: " ) );
+
+  const int reuse_addr = 1;
+
+  if ( 0 != setsockopt( m_listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof( reuse_addr ) ) )
+    throw std::runtime_error( format_errno( errno, "Cannot set the JTAG server socket options: " ) );
+
+  sockaddr_in addr;
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons( tcp_port );
+  addr.sin_addr.s_addr = htonl( INADDR_ANY );
+
+  if ( 0 != bind( m_listen_socket, (const sockaddr *) &addr, sizeof( addr ) ) )
+    throw std::runtime_error( format_errno( errno, "Cannot bind the JTAG server socket: " ) );
+
+  if ( 0 != listen( m_listen_socket, 1 ) )
+    throw std::runtime_error( format_errno( errno, "Cannot listen on the JTAG server socket: " ) );
+
+  if ( 0 != fcntl( m_listen_socket, F_SETFL, O_NONBLOCK ) )
+    throw std::runtime_error( format_errno( errno, "Cannot set the JTAG server socket to non-blocking mode: " ) );
+
+  printf( "JTAG stream server listening on TCP port %d.\n", tcp_port );
+}
+
+
+jtag_stream_server::~jtag_stream_server ( void )
+{
+  if ( m_client_socket != -1 )
+    close( m_client_socket );
+
+  if ( m_listen_socket != -1 )
+    close( m_listen_socket );
+}
+
+
+void jtag_stream_server::accept_connection ( void )
+{
+  const int s = accept( m_listen_socket, NULL, NULL );
+
+  if ( s == -1 )
+  {
+    if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+      return;
+
+    throw std::runtime_error( format_errno( errno, "Error accepting a JTAG connection: " ) );
+  }
+
+  m_client_socket = s;
+
+  // The protocol is latency-bound, so do not let the TCP stack hold back the small answers.
+  const int no_delay = 1;
+
+  if ( 0 != setsockopt( m_client_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof( no_delay ) ) )
+    throw std::runtime_error( format_errno( errno, "Cannot set the JTAG client socket options: " ) );
+
+  m_rx_buffer.clear();
+  m_rx_pos = 0;
+  m_is_command_incomplete = false;
+  m_idle_ticks = 0;
+
+  printf( "JTAG client connected.\n" );
+
+  send_data( STREAM_BANNER, sizeof( STREAM_BANNER ) );
+}
+
+
+void jtag_stream_server::close_connection ( const char * const reason )
+{
+  printf( "JTAG client disconnected: %s\n", reason );
+
+  close( m_client_socket );
+  m_client_socket = -1;
+
+  m_is_streaming = false;
+  m_answer_wait_after_delay = false;
+  m_delay = 0;
+}
+
+
+void jtag_stream_server::receive_data ( void )
+{
+  // Discard the data already processed.
+  if ( m_rx_pos == m_rx_buffer.size() )
+  {
+    m_rx_buffer.clear();
+    m_rx_pos = 0;
+  }
+
+  uint8_t buffer[ 4096 ];
+
+  const ssize_t res = recv( m_client_socket, buffer, sizeof( buffer ), MSG_DONTWAIT );
+
+  if ( res == 0 )
+  {
+    close_connection( "the remote side closed the connection." );
+    return;
+  }
+
+  if ( res == -1 )
+  {
+    if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+      close_connection( strerror( errno ) );
+
+    return;
+  }
+
+  m_rx_buffer.insert( m_rx_buffer.end(), buffer, buffer + res );
+  m_is_command_incomplete = false;
+}
+
+
+void jtag_stream_server::send_data ( const uint8_t * data, size_t len )
+{
+  while ( len > 0 && m_client_socket != -1 )
+  {
+    const ssize_t res = send( m_client_socket, data, len, MSG_NOSIGNAL );
+
+    if ( res == -1 )
+    {
+      if ( errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK )
+        continue;
+
+      close_connection( strerror( errno ) );
+      return;
+    }
+
+    data += res;
+    len  -= size_t( res );
+  }
+}
+
+
+void jtag_stream_server::process_next_command ( const svBit tdo )
+{
+  const size_t available = m_rx_buffer.size() - m_rx_pos;
+
+  if ( available == 0 )
+    return;
+
+  const uint8_t * const cmd = &m_rx_buffer[ m_rx_pos ];
+
+  if ( cmd[0] < CMD_READ_TDO )
+  {
+    m_pins = cmd[0];
+    ++m_rx_pos;
+
+    const uint8_t ack = cmd[0] | PIN_ACK;
+    send_data( &ack, 1 );
+    return;
+  }
+
+  switch ( cmd[0] )
+  {
+  case CMD_READ_TDO:
+    {
+      ++m_rx_pos;
+      const uint8_t answer = tdo ? 1 : 0;
+      send_data( &answer, 1 );
+      break;
+    }
+
+  case CMD_WAIT:
+    ++m_rx_pos;
+    m_delay = m_ticks_per_half_tck;
+    m_answer_wait_after_delay = true;
+    break;
+
+  case CMD_STREAM:
+    {
+      if ( available < STREAM_HEADER_LEN )
+      {
+        m_is_command_incomplete = true;
+        return;
+      }
+
+      const unsigned bit_count  = unsigned( cmd[2] ) | ( unsigned( cmd[3] ) << 8 );
+      const unsigned byte_count = ( bit_count + 7 ) / 8;
+
+      if ( bit_count == 0 )
+      {
+        close_connection( "invalid stream frame with 0 bits." );
+        return;
+      }
+
+      if ( available < STREAM_HEADER_LEN + byte_count * 2 )
+      {
+        m_is_command_incomplete = true;
+        return;
+      }
+
+      const uint8_t * const tdi_bits = cmd + STREAM_HEADER_LEN;
+      const uint8_t * const tms_bits = tdi_bits + byte_count;
+
+      m_stream_read_tdo  = ( cmd[1] & STREAM_FLAG_READ_TDO ) != 0;
+      m_stream_bit_count = bit_count;
+      m_stream_bit_index = 0;
+      m_stream_tck_is_low = false;
+      m_stream_tdi.assign( tdi_bits, tdi_bits + byte_count );
+      m_stream_tms.assign( tms_bits, tms_bits + byte_count );
+      m_stream_tdo.assign( byte_count, 0 );
+      m_is_streaming = true;
+
+      m_rx_pos += STREAM_HEADER_LEN + byte_count * 2;
+      break;
+    }
+
+  default:
+    {
+      char msg[ 80 ];
+      snprintf( msg, sizeof( msg ), "unknown command 0x%02X.", cmd[0] );
+      close_connection( msg );
+      break;
+    }
+  }
+}
+
+
+void jtag_stream_server::step_stream ( const svBit tdo )
+{
+  const unsigned byte_index = m_stream_bit_index / 8;
+  const uint8_t  bit_mask   = uint8_t( 1 << ( m_stream_bit_index % 8 ) );
+
+  if ( !m_stream_tck_is_low )
+  {
+    uint8_t pins = m_pins & PIN_TRST;
+
+    if ( m_stream_tdi[ byte_index ] & bit_mask )
+      pins |= PIN_TDI;
+
+    if ( m_stream_tms[ byte_index ] & bit_mask )
+      pins |= PIN_TMS;
+
+    m_pins = pins;
+    m_stream_tck_is_low = true;
+  }
+  else
+  {
+    if ( tdo )
+      m_stream_tdo[ byte_index ] |= bit_mask;
+
+    m_pins |= PIN_TCK;
+    m_stream_tck_is_low = false;
+
+    if ( ++m_stream_bit_index == m_stream_bit_count )
+    {
+      m_is_streaming = false;
+
+      if ( m_stream_read_tdo )
+        send_data( &m_stream_tdo[0], m_stream_tdo.size() );
+    }
+  }
+
+  m_delay = m_ticks_per_half_tck - 1;
+}
+
+
+void jtag_stream_server::tick ( svBit * const tms,
+                                svBit * const tck,
+                                svBit * const trst,
+                                svBit * const tdi,
+                                const svBit tdo )
+{
+  if ( m_delay > 0 )
+  {
+    --m_delay;
+  }
+  else if ( m_answer_wait_after_delay )
+  {
+    m_answer_wait_after_delay = false;
+    send_data( &WAIT_ANSWER, 1 );
+  }
+  else if ( m_client_socket == -1 )
+  {
+    if ( m_poll_countdown == 0 )
+    {
+      m_poll_countdown = IDLE_POLL_INTERVAL;
+      accept_connection();
+    }
+    else
+    {
+      --m_poll_countdown;
+    }
+  }
+  else if ( m_is_streaming )
+  {
+    step_stream( tdo );
+  }
+  else
+  {
+    // Only read the socket when all complete commands have been processed.
+    if ( m_rx_pos == m_rx_buffer.size() || m_is_command_incomplete )
+    {
+      if ( m_idle_ticks < ACTIVE_POLL_TICKS || m_poll_countdown == 0 )
+      {
+        m_poll_countdown = IDLE_POLL_INTERVAL;
+        receive_data();
+      }
+      else
+      {
+        --m_poll_countdown;
+      }
+    }
+
+    if ( m_client_socket != -1 && m_rx_pos != m_rx_buffer.size() && !m_is_command_incomplete )
+    {
+      m_idle_ticks = 0;
+      process_next_command( tdo );
+    }
+    else if ( m_idle_ticks < ACTIVE_POLL_TICKS )
+    {
+      ++m_idle_ticks;
+    }
+  }
+
+  *tms  = ( m_pins & PIN_TMS  ) ? 1 : 0;
+  *tck  = ( m_pins & PIN_TCK  ) ? 1 : 0;
+  *trst = ( m_pins & PIN_TRST ) ? 1 : 0;
+  *tdi  = ( m_pins & PIN_TDI  ) ? 1 : 0;
+}
+
+
+static jtag_stream_server * s_server = NULL;
+
+
+extern "C" void jtag_stream_dpi_init ( const int tcp_port, const int ticks_per_half_tck )
+{
+  if ( s_server != NULL )
+    throw std::runtime_error( "Only one instance of the JTAG stream server is supported." );
+
+  s_server = new jtag_stream_server( tcp_port, unsigned( ticks_per_half_tck ) );
+}
+
+
+extern "C" void jtag_stream_dpi_tick ( svBit * const jtag_tms,
+                                       svBit * const jtag_tck,
+                                       svBit * const jtag_trst,
+                                       svBit * const jtag_tdi,
+                                       const svBit jtag_tdo )
+{
+  s_server->tick( jtag_tms, jtag_tck, jtag_trst, jtag_tdi, jtag_tdo );
+}
+
+
+extern "C" void jtag_stream_dpi_terminate ( void )
+{
+  delete s_server;
+  s_server = NULL;
+}
@@ -0,0 +1,73 @@
+/* JTAG server for the simulation, it lets the GDB-to-JTAG bridge drive the JTAG pins over a TCP socket.
+
+   It understands the same per-bit protocol as the jtag_dpi module, and additionally
+   the stream protocol, where a single frame carries many TDI/TMS bits.
+   See jtag_stream_dpi.cpp for details.
+
+   Copyright (C) 2012, R. Diez
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License version 3
+   as published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License version 3 for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+`include "simulator_features.v"
+
+
+module jtag_stream_dpi
+  #( parameter TCP_PORT = 4567,
+     parameter TICKS_PER_HALF_TCK = 2 )  // Number of system_clk cycles TCK stays low and high.
+   ( input wire  system_clk,
+     output wire jtag_tms_o,
+     output wire jtag_tck_o,
+     output wire jtag_trst_o,
+     output wire jtag_tdi_o,
+     input  wire jtag_tdo_i );
+
+   import "DPI-C" function void jtag_stream_dpi_init ( input int tcp_port,
+                                                       input int ticks_per_half_tck );
+
+   import "DPI-C" function void jtag_stream_dpi_tick ( output bit jtag_tms,
+                                                       output bit jtag_tck,
+                                                       output bit jtag_trst,
+                                                       output bit jtag_tdi,
+                                                       input  bit jtag_tdo );
+
+   import "DPI-C" function void jtag_stream_dpi_terminate ();
+
+   bit tms;
+   bit tck;
+   bit trst = 1;  // TRST is active low.
+   bit tdi;
+
+   assign jtag_tms_o  = tms;
+   assign jtag_tck_o  = tck;
+   assign jtag_trst_o = trst;
+   assign jtag_tdi_o  = tdi;
+
+   initial
+     begin
+        jtag_stream_dpi_init( TCP_PORT, TICKS_PER_HALF_TCK );
+     end
+
+   always @( posedge system_clk )
+     begin
+        jtag_stream_dpi_tick( tms, tck, trst, tdi, jtag_tdo_i );
+     end
+
+   `ifdef SUPPORTS_FINAL
+     final
+       begin
+          jtag_stream_dpi_terminate();
+       end
+   `endif
+
+endmodule
@@ -20,7 +20,19 @@
 
 
 module test_bench ( input wire clock,
-                    input wire reset );
+                    input wire reset
+
+                  `ifdef EXTERNAL_JTAG_PINS
+                    // For the 'verilator' cable in the GDB-to-JTAG bridge, which links this model in
+                    // and drives the JTAG pins with direct function calls.
+                    ,
+                    input  wire jtag_tms_i,
+                    input  wire jtag_tck_i,
+                    input  wire jtag_trst_i,
+                    input  wire jtag_tdi_i,
+                    output wire jtag_tdo_o
+                  `endif
+                  );
 
    // Keep the memory size low, as Icarus Verilog needs lots of RAM to simulate 8-bit memory arrays.
    // 2^21 = 2 MBytes x 4 bytes (32 bits width) = 8 MBytes, which is enough for the Test Suite.
@@ -210,11 +222,19 @@ module test_bench ( input wire clock,
    wire jtag_tdi;
    wire jtag_tdo;
 
-   `ifdef ENABLE_DPI_MODULES
+   `ifdef EXTERNAL_JTAG_PINS
+
+     assign jtag_tms   = jtag_tms_i;
+     assign jtag_tck   = jtag_tck_i;
+     assign jtag_trst  = jtag_trst_i;
+     assign jtag_tdi   = jtag_tdi_i;
+     assign jtag_tdo_o = jtag_tdo;
+
+   `elsif USE_JTAG_SHM_SERVER
 
-     jtag_dpi
-         #( .PRINT_RECEIVED_JTAG_DATA( 0 ) )
-       jtag_dpi_instance
+     // For the bridge's 'rtl_sim' cable in shared-memory mode, works with Icarus Verilog too.
+     jtag_shm_dpi
+       jtag_shm_instance
          (
           .system_clk ( clock  ),
           .jtag_tms_o ( jtag_tms  ),
@@ -224,7 +244,39 @@ module test_bench ( input wire clock,
           .jtag_tdo_i ( jtag_tdo  )
          );
 
-   `else  // `ifdef ENABLE_DPI_MODULES
+   `elsif ENABLE_DPI_MODULES
+
+     `ifdef USE_JTAG_STREAM_SERVER
+
+       // Understands the same protocol as jtag_dpi, and also the much faster stream protocol.
+       jtag_stream_dpi
+         jtag_dpi_instance
+           (
+            .system_clk ( clock  ),
+            .jtag_tms_o ( jtag_tms  ),
+            .jtag_tck_o ( jtag_tck  ),
+            .jtag_trst_o( jtag_trst ),
+            .jtag_tdi_o ( jtag_tdi  ),
+            .jtag_tdo_i ( jtag_tdo  )
+           );
+
+     `else  // `ifdef USE_JTAG_STREAM_SERVER
+
+       jtag_dpi
+           #( .PRINT_RECEIVED_JTAG_DATA( 0 ) )
+         jtag_dpi_instance
+           (
+            .system_clk ( clock  ),
+            .jtag_tms_o ( jtag_tms  ),
+            .jtag_tck_o ( jtag_tck  ),
+            .jtag_trst_o( jtag_trst ),
+            .jtag_tdi_o ( jtag_tdi  ),
+            .jtag_tdo_i ( jtag_tdo  )
+           );
+
+     `endif  // `ifdef USE_JTAG_STREAM_SERVER
+
+   `else  // `ifdef EXTERNAL_JTAG_PINS
 
      assign jtag_tms  = 0;
      assign jtag_tck  = 0;
@@ -235,7 +287,7 @@ module test_bench ( input wire clock,
                                                           jtag_tdo,
                                                           1'b0 };
 
-   `endif  // `ifdef ENABLE_DPI_MODULES
+   `endif  // `ifdef EXTERNAL_JTAG_PINS
 
    wire is_tap_state_test_logic_reset;
    wire is_tap_state_shift_dr;
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Copyright (C) 2011-2012 R. Diez - see the orbuild project for licensing information.
+
+# Builds the OR10 test bench with Verilator as a static library, with the JTAG pins as top-level ports,
+# so that it can be linked into the GDB-to-JTAG bridge. See the bridge's --with-verilator-model configure option.
+
+set -o errexit
+
+source "$ORBUILD_SANDBOX/Scripts/ShellModules/StandardShellHeader.sh"
+source "$ORBUILD_SANDBOX/Scripts/ShellModules/MakeJVal.sh"
+
+if [ $# -ne 1 ]; then
+  abort "Invalid number of command-line arguments, see the source code for details."
+fi
+
+VERILATOR_LIB_DIR="$1"
+shift
+
+OR10_BASE_DIR="$ORBUILD_PROJECT_DIR/OR10"
+
+TOP_LEVEL_MODULE="test_bench"
+
+mkdir -p "$VERILATOR_LIB_DIR"
+
+pushd "$VERILATOR_LIB_DIR" >/dev/null
+
+declare -a INCLUDE_PATHS=(
+    -I$OR10_BASE_DIR/TestBench
+    -I$OR10_BASE_DIR/WishboneSwitch
+    -I$OR10_BASE_DIR/Memory
+    -I$OR10_BASE_DIR/CPU
+    -I$OR10_BASE_DIR/CPU/FakeExternalComponents
+    -I$OR10_BASE_DIR/Misc
+    -I$OR10_BASE_DIR/JTAG
+  )
+
+CMD="verilator"
+CMD+=" ${INCLUDE_PATHS[@]}"
+CMD+=" --Mdir \"$VERILATOR_LIB_DIR\""
+CMD+=" -sv --cc"
+CMD+=" -Wall -Wno-fatal --error-limit 10000"
+CMD+=" -O3 --assert"
+
+WARN_FLAGS="-Wall -Wwrite-strings"
+WARN_FLAGS+=" -Wno-unused-but-set-variable"
+
+# The model runs inside the bridge, so it is always optimised.
+CMD+=" -CFLAGS \"-O2 -g -DNDEBUG $WARN_FLAGS\""
+
+CMD+=" +define+EXTERNAL_JTAG_PINS+1"
+CMD+=" \"$TOP_LEVEL_MODULE.v\""
+
+printf "$CMD\n\n"
+eval "$CMD"
+
+get_make_j_val MAKE_J_VAL
+
+CMD="make -f \"V$TOP_LEVEL_MODULE.mk\" -j \"$MAKE_J_VAL\" \"V${TOP_LEVEL_MODULE}__ALL.a\" verilated.o"
+printf "$CMD\n\n"
+eval "$CMD"
+
+popd >/dev/null
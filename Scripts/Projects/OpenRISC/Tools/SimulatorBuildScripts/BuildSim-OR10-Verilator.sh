@@ -32,6 +32,13 @@ verify_var_is_set ()
 
 ENABLE_DPI_MODULES=0
 
+# The JTAG stream server in the TestBench directory also understands the jtag_dpi protocol,
+# but it is much faster with a GDB-to-JTAG bridge that supports the stream protocol.
+USE_JTAG_STREAM_SERVER=1
+
+# Use the shared memory server for the bridge's 'rtl_sim' cable (option -m) instead of the TCP socket servers.
+USE_JTAG_SHM_SERVER=0
+
 verify_var_is_set "JTAG_DPI_CHECKOUT_DIR"
 verify_var_is_set "UART_DPI_CHECKOUT_DIR"
 verify_var_is_set "ETHERNET_DPI_CHECKOUT_DIR"
@@ -104,14 +111,22 @@ fi
 
 # Remember that the optimisation flags (-flto -O3) must be passed to the linker too.
 
-CMD+=" -CFLAGS \"$OPT_FLAGS $WARN_FLAGS\""
+CMD+=" -CFLAGS \"$OPT_FLAGS $WARN_FLAGS -I$OR10_BASE_DIR/GdbToJtagBridge/src/cable_drivers\""
 CMD+=" -LDFLAGS \"$OPT_FLAGS\""
 
 if [ $ENABLE_DPI_MODULES -ne 0 ]; then
   CMD+=" +define+ENABLE_DPI_MODULES+$ENABLE_DPI_MODULES"
 fi
+if [ $USE_JTAG_STREAM_SERVER -ne 0 ]; then
+  CMD+=" +define+USE_JTAG_STREAM_SERVER+$USE_JTAG_STREAM_SERVER"
+fi
+if [ $USE_JTAG_SHM_SERVER -ne 0 ]; then
+  CMD+=" +define+USE_JTAG_SHM_SERVER+$USE_JTAG_SHM_SERVER"
+fi
 CMD+=" \"$TOP_LEVEL_MODULE.v\""
 CMD+=" \"$TEST_BENCH_DIR/test_bench_verilator_driver.cpp\""
+CMD+=" \"$TEST_BENCH_DIR/jtag_stream_dpi.cpp\""
+CMD+=" \"$TEST_BENCH_DIR/jtag_shm_server.cpp\""
 CMD+=" \"$JTAG_DPI_WRAPPER_FILENAME\""
 CMD+=" \"$UART_DPI_WRAPPER_FILENAME\""
 CMD+=" \"$ETHERNET_DPI_WRAPPER_FILENAME\""